@@ -22,7 +22,7 @@ CheckCloudConnection::CheckCloudConnection(QObject *parent) :
 #define TEAPOT "/make-latte?number-of-shots=3"
 #define HTTP_I_AM_A_TEAPOT 418
 #define MILK "Linus does not like non-fat milk"
-bool CheckCloudConnection::checkServer()
+bool CheckCloudConnection::checkServer(bool setOffline)
 {
 	if (verbose)
 		fprintf(stderr, "Checking cloud connection...\n");
@@ -63,7 +63,8 @@ bool CheckCloudConnection::checkServer()
 		}
 	}
 	git_storage_update_progress(qPrintable(tr("Cloud connection failed")));
-	git_local_only = true;
+	if (setOffline)
+		git_local_only = true;
 	if (verbose)
 		qDebug() << "connection test to cloud server failed" <<
 			    reply->error() << reply->errorString() <<
@@ -98,10 +99,11 @@ void CheckCloudConnection::sslErrors(QList<QSslError> errorList)
 	}
 }
 
-// helper to be used from C code
-extern "C" bool canReachCloudServer()
+// helper to be used from C code. The background sync passes false for setOffline,
+// since git_local_only belongs to the UI thread.
+extern "C" bool canReachCloudServer(bool setOffline)
 {
 	if (verbose)
 		qWarning() << "Cloud storage: checking connection to cloud server";
-	return CheckCloudConnection().checkServer();
+	return CheckCloudConnection().checkServer(setOffline);
 }
@@ -10,7 +10,8 @@ class CheckCloudConnection : public QObject {
 	Q_OBJECT
 public:
 	CheckCloudConnection(QObject *parent = 0);
-	bool checkServer();
+	// If setOffline is true and the server can't be reached, switch to offline mode
+	bool checkServer(bool setOffline = true);
 private:
 	QNetworkReply *reply;
 private
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "cloudsync.h"
+#include "git-access.h"
+
+bool cloud_sync_in_background = false;
+
+// Only created on the UI thread, when the first sync is requested
+static CloudSync *syncInstance = nullptr;
+static QMutex cacheLock;
+
+CloudSync *CloudSync::instance()
+{
+	if (!syncInstance)
+		syncInstance = new CloudSync;
+	return syncInstance;
+}
+
+CloudSync::CloudSync() : currentState(CLOUD_SYNC_IDLE), running(false), pending(false)
+{
+	setObjectName(QStringLiteral("cloud sync"));
+}
+
+// Sync the local cache of the given remote with the remote. If a sync is
+// running, the newest request is done once it is finished.
+void CloudSync::requestSync(const QString &remoteIn, const QString &branchIn)
+{
+	QMutexLocker l(&lock);
+	remote = remoteIn;
+	branch = branchIn;
+	pending = true;
+	if (running)
+		return;
+	running = true;
+	currentState = CLOUD_SYNC_QUEUED;
+	l.unlock();
+
+	emit stateChanged(CLOUD_SYNC_QUEUED);
+	// The thread may still be returning from the previous run
+	wait();
+	start();
+}
+
+// Block until no sync is running or queued anymore
+void CloudSync::waitForSync()
+{
+	QMutexLocker l(&lock);
+	while (running)
+		done.wait(&lock);
+}
+
+enum cloud_sync_state CloudSync::state()
+{
+	QMutexLocker l(&lock);
+	return currentState;
+}
+
+void CloudSync::setState(enum cloud_sync_state state)
+{
+	{
+		QMutexLocker l(&lock);
+		currentState = state;
+	}
+	emit stateChanged(state);
+}
+
+void CloudSync::run()
+{
+	bool success = true;
+	enum cloud_sync_state finalState;
+
+	for (;;) {
+		QByteArray remoteName, branchName;
+		{
+			QMutexLocker l(&lock);
+			if (!pending) {
+				finalState = currentState = success ? CLOUD_SYNC_IDLE : CLOUD_SYNC_FAILED;
+				running = false;
+				done.wakeAll();
+				break;
+			}
+			pending = false;
+			remoteName = remote.toUtf8();
+			branchName = branch.toUtf8();
+		}
+		git_oid oldId, newId;
+		char oldSha[GIT_OID_HEXSZ + 1], newSha[GIT_OID_HEXSZ + 1];
+		success = sync_local_cache(remoteName.constData(), branchName.constData(), &oldId, &newId) == 0;
+		git_oid_tostr(oldSha, sizeof(oldSha), &oldId);
+		git_oid_tostr(newSha, sizeof(newSha), &newId);
+		emit finished(success, QString(oldSha), QString(newSha));
+	}
+	emit stateChanged(finalState);
+}
+
+extern "C" void cloud_sync_request(const char *remote, const char *branch)
+{
+	CloudSync::instance()->requestSync(QString::fromUtf8(remote), QString::fromUtf8(branch));
+}
+
+extern "C" void cloud_sync_wait()
+{
+	// The sync thread itself must not wait for the sync
+	if (syncInstance && QThread::currentThread() != syncInstance)
+		syncInstance->waitForSync();
+}
+
+extern "C" void cloud_sync_lock_cache()
+{
+	cacheLock.lock();
+}
+
+extern "C" void cloud_sync_unlock_cache()
+{
+	cacheLock.unlock();
+}
+
+extern "C" bool in_cloud_sync_thread()
+{
+	return syncInstance && QThread::currentThread() == syncInstance;
+}
+
+extern "C" bool cloud_sync_report_progress(const char *text)
+{
+	if (!in_cloud_sync_thread())
+		return false;
+	emit syncInstance->progress(QString::fromUtf8(text));
+	return true;
+}
+
+extern "C" void cloud_sync_report_state(enum cloud_sync_state state)
+{
+	if (in_cloud_sync_thread())
+		syncInstance->setState(state);
+}
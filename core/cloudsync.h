@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef CLOUDSYNC_H
+#define CLOUDSYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+/*
+ * Syncing the local cache of a remote repository on a background thread.
+ * If cloud_sync_in_background is set, saving to a remote repository only
+ * commits to the local cache and requests a sync, which fetches, merges
+ * and pushes without blocking the caller. Requests that come in while a
+ * sync is running are coalesced into one more sync.
+ *
+ *	IDLE or FAILED -> QUEUED -> FETCHING [-> MERGING] [-> PUSHING] -> IDLE or FAILED
+ */
+enum cloud_sync_state {
+	CLOUD_SYNC_IDLE,
+	CLOUD_SYNC_QUEUED,	/* requested, the thread hasn't started syncing yet */
+	CLOUD_SYNC_FETCHING,
+	CLOUD_SYNC_MERGING,	/* fast-forwarding or merging the local branch */
+	CLOUD_SYNC_PUSHING,
+	CLOUD_SYNC_FAILED	/* the last sync failed, the local commits are kept */
+};
+
+extern bool cloud_sync_in_background;
+
+extern void cloud_sync_request(const char *remote, const char *branch);
+extern void cloud_sync_wait(void);
+
+/*
+ * Held while the branch of a local cache is changed: by a commit and by a
+ * sync that resets or merges the local branch. The fetch and the push of
+ * a sync don't hold it, so that a commit never waits for the network.
+ */
+extern void cloud_sync_lock_cache(void);
+extern void cloud_sync_unlock_cache(void);
+
+/* Used by git-access.c. These do nothing unless called on the sync thread. */
+extern bool in_cloud_sync_thread(void);
+extern bool cloud_sync_report_progress(const char *text);
+extern void cloud_sync_report_state(enum cloud_sync_state state);
+
+#ifdef __cplusplus
+}
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+class CloudSync : public QThread {
+	Q_OBJECT
+public:
+	static CloudSync *instance();
+	void requestSync(const QString &remote, const QString &branch);
+	void waitForSync();
+	enum cloud_sync_state state();
+	void setState(enum cloud_sync_state state);
+signals:
+	// The state is an enum cloud_sync_state, passed as int to be usable in queued connections
+	void stateChanged(int state);
+	void progress(const QString &text);
+	// The commits of the local branch before and after the sync, as hex strings.
+	// They differ if the sync changed the local branch, i.e. brought in remote data.
+	void finished(bool success, const QString &oldId, const QString &newId);
+protected:
+	void run() override;
+private:
+	CloudSync();
+	QMutex lock;
+	QWaitCondition done;
+	enum cloud_sync_state currentState;
+	bool running;		// the thread is started and will look for requests
+	bool pending;		// a sync was requested that hasn't started yet
+	QString remote, branch;
+};
+#endif
+
+#endif // CLOUDSYNC_H
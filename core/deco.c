@@ -33,7 +33,7 @@
 // was introduced in v4.6.3 this can be set to a value of 1.0 which means no correction.
 #define subsurface_conservatism_factor 1.0
 
-extern int plot_depth;
+extern THREAD_LOCAL int plot_depth;
 
 //! Option structure for Buehlmann decompression.
 struct buehlmann_config {
@@ -153,21 +153,46 @@ const double vpmb_conservatism_lvls[] = { 1.0, 1.05, 1.12, 1.22, 1.35 };
 
 #define TISSUE_ARRAY_SZ sizeof(ds->tissue_n2_sat)
 
-int  sum1;
-long sumx, sumxx;
-double sumy, sumxy;
+// Regression of the VPM-B gradients, used to show them as gradient factors in the plan
+static THREAD_LOCAL int  sum1;
+static THREAD_LOCAL long sumx, sumxx;
+static THREAD_LOCAL double sumy, sumxy;
+
+/* The planner may run in several threads at once, e.g. when generating deco tables.
+ * Therefore, plan() doesn't change the global gradient factors and conservatism, which
+ * are used for the profile, but overrides them for the calling thread only. */
+static THREAD_LOCAL bool plan_params_set;
+static THREAD_LOCAL double plan_gf_low, plan_gf_high;
+static THREAD_LOCAL short plan_conservatism;
+
+static double current_gf_low()
+{
+	return plan_params_set ? plan_gf_low : buehlmann_config.gf_low;
+}
+
+static double current_gf_high()
+{
+	return plan_params_set ? plan_gf_high : buehlmann_config.gf_high;
+}
+
+static short current_conservatism()
+{
+	return plan_params_set ? plan_conservatism : vpmb_config.conservatism;
+}
 
 double get_crit_radius_He()
 {
-	if (vpmb_config.conservatism <= 4)
-		return vpmb_config.crit_radius_He * vpmb_conservatism_lvls[vpmb_config.conservatism] * subsurface_conservatism_factor;
+	short conservatism = current_conservatism();
+	if (conservatism <= 4)
+		return vpmb_config.crit_radius_He * vpmb_conservatism_lvls[conservatism] * subsurface_conservatism_factor;
 	return vpmb_config.crit_radius_He;
 }
 
 double get_crit_radius_N2()
 {
-	if (vpmb_config.conservatism <= 4)
-		return vpmb_config.crit_radius_N2 * vpmb_conservatism_lvls[vpmb_config.conservatism] * subsurface_conservatism_factor;
+	short conservatism = current_conservatism();
+	if (conservatism <= 4)
+		return vpmb_config.crit_radius_N2 * vpmb_conservatism_lvls[conservatism] * subsurface_conservatism_factor;
 	return vpmb_config.crit_radius_N2;
 }
 
@@ -224,8 +249,8 @@ double tissue_tolerance_calc(struct deco_state *ds, const struct dive *dive, dou
 {
 	int ci = -1;
 	double ret_tolerance_limit_ambient_pressure = 0.0;
-	double gf_high = buehlmann_config.gf_high;
-	double gf_low = buehlmann_config.gf_low;
+	double gf_high = current_gf_high();
+	double gf_low = current_gf_low();
 	double surface = get_surface_pressure_in_mbar(dive, true) / 1000.0;
 	double lowest_ceiling = 0.0;
 	double tissue_lowest_ceiling[16];
@@ -294,12 +319,12 @@ double tissue_tolerance_calc(struct deco_state *ds, const struct dive *dive, dou
 			sumx += plot_depth;
 			sumxx += plot_depth * plot_depth;
 			double n2_gradient, he_gradient, total_gradient;
-			n2_gradient = update_gradient(ds, depth_to_bar(plot_depth, &displayed_dive), ds->bottom_n2_gradient[ds->ci_pointing_to_guiding_tissue]);
-			he_gradient = update_gradient(ds, depth_to_bar(plot_depth, &displayed_dive), ds->bottom_he_gradient[ds->ci_pointing_to_guiding_tissue]);
+			n2_gradient = update_gradient(ds, depth_to_bar(plot_depth, dive), ds->bottom_n2_gradient[ds->ci_pointing_to_guiding_tissue]);
+			he_gradient = update_gradient(ds, depth_to_bar(plot_depth, dive), ds->bottom_he_gradient[ds->ci_pointing_to_guiding_tissue]);
 			total_gradient = ((n2_gradient * ds->tissue_n2_sat[ds->ci_pointing_to_guiding_tissue]) + (he_gradient * ds->tissue_he_sat[ds->ci_pointing_to_guiding_tissue]))
 					/ (ds->tissue_n2_sat[ds->ci_pointing_to_guiding_tissue] + ds->tissue_he_sat[ds->ci_pointing_to_guiding_tissue]);
 
-			double buehlmann_gradient = (1.0 / ds->buehlmann_inertgas_b[ds->ci_pointing_to_guiding_tissue] - 1.0) * depth_to_bar(plot_depth, &displayed_dive) + ds->buehlmann_inertgas_a[ds->ci_pointing_to_guiding_tissue];
+			double buehlmann_gradient = (1.0 / ds->buehlmann_inertgas_b[ds->ci_pointing_to_guiding_tissue] - 1.0) * depth_to_bar(plot_depth, dive) + ds->buehlmann_inertgas_a[ds->ci_pointing_to_guiding_tissue];
 			double gf = (total_gradient - vpmb_config.other_gases_pressure) / buehlmann_gradient;
 			sumxy += gf * plot_depth;
 			sumy += gf;
@@ -611,21 +636,41 @@ void set_gf(short gflow, short gfhigh)
 		buehlmann_config.gf_high = (double)gfhigh / 100.0;
 }
 
-void set_vpmb_conservatism(short conservatism)
+static short clamp_conservatism(short conservatism)
 {
 	if (conservatism < 0)
-		vpmb_config.conservatism = 0;
+		return 0;
 	else if (conservatism > 4)
-		vpmb_config.conservatism = 4;
+		return 4;
 	else
-		vpmb_config.conservatism = conservatism;
+		return conservatism;
+}
+
+void set_vpmb_conservatism(short conservatism)
+{
+	vpmb_config.conservatism = clamp_conservatism(conservatism);
+}
+
+// Use the gradient factors and conservatism of a plan in the calling thread
+void set_plan_deco_params(short gflow, short gfhigh, short conservatism)
+{
+	plan_gf_low = (double)gflow / 100.0;
+	plan_gf_high = (double)gfhigh / 100.0;
+	plan_conservatism = clamp_conservatism(conservatism);
+	plan_params_set = true;
+}
+
+// Go back to the global settings
+void clear_plan_deco_params()
+{
+	plan_params_set = false;
 }
 
 double get_gf(struct deco_state *ds, double ambpressure_bar, const struct dive *dive)
 {
 	double surface_pressure_bar = get_surface_pressure_in_mbar(dive, true) / 1000.0;
-	double gf_low = buehlmann_config.gf_low;
-	double gf_high = buehlmann_config.gf_high;
+	double gf_low = current_gf_low();
+	double gf_high = current_gf_high();
 	double gf;
 	if (ds->gf_low_pressure_this_dive > surface_pressure_bar)
 		gf = MAX((double)gf_low, (ambpressure_bar - surface_pressure_bar) /
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "decotable.h"
+#include "core/planner.h"
+#include "core/qthelper.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtConcurrent>
+#include <cmath>
+#include <cstring>
+
+// Plan a single cell. This only touches the dive and deco state of the cell,
+// therefore multiple cells can be calculated in parallel.
+static void planCell(const DecoTableGrid &grid, DecoTableCell &cell)
+{
+	struct diveplan diveplan = {};
+	struct deco_state ds;
+	struct deco_state *cache = NULL;
+	struct decostop stoptable[60];
+	int droptime = cell.depth / prefs.descrate;
+
+	cell.valid = cell.depth > 0 && cell.bottomTime > droptime && !grid.gases.isEmpty();
+	if (!cell.valid)
+		return;
+
+	struct dive *dive = alloc_dive();
+	for (int i = 0; i < grid.gases.size() && i < MAX_CYLINDERS; ++i)
+		dive->cylinder[i].gasmix = grid.gases[i].mix;
+	reset_cylinders(dive, true);
+
+	diveplan.surface_pressure = grid.surfacePressure;
+	diveplan.salinity = grid.salinity;
+	diveplan.gflow = cell.gflow;
+	diveplan.gfhigh = cell.gfhigh;
+	diveplan.vpmb_conservatism = grid.vpmbConservatism;
+	diveplan.bottomsac = prefs.bottomsac;
+	diveplan.decosac = prefs.decosac;
+
+	pressure_t po2 = { prefs.decopo2 };
+	for (int i = 1; i < grid.gases.size() && i < MAX_CYLINDERS; ++i) {
+		int depth = grid.gases[i].switchDepth;
+		if (depth <= 0)
+			depth = gas_mod(grid.gases[i].mix, po2, dive, M_OR_FT(3, 10)).mm;
+		plan_add_segment(&diveplan, 0, depth, i, 0, true, OC);
+	}
+	plan_add_segment(&diveplan, droptime, cell.depth, 0, 0, true, OC);
+	plan_add_segment(&diveplan, cell.bottomTime - droptime, cell.depth, 0, 0, true, OC);
+
+	memset(&ds, 0, sizeof(ds));
+	plan(&ds, &diveplan, dive, DECOTIMESTEP, stoptable, &cache, true);
+
+	cell.runtime = dive->dc.duration.seconds;
+	for (const struct decostop *stop = stoptable; stop->depth; ++stop) {
+		if (stop->time)
+			cell.stops.append(*stop);
+	}
+
+	free_dps(&diveplan);
+	free(cache);
+	free_dive(dive);
+}
+
+QVector<DecoTableCell> generateDecoTable(const DecoTableGrid &grid)
+{
+	QVector<DecoTableCell> table;
+	table.reserve(grid.depths.size() * grid.bottomTimes.size() * grid.gradientFactors.size());
+	for (int depth: grid.depths) {
+		for (int bottomTime: grid.bottomTimes) {
+			for (const QPair<int, int> &gf: grid.gradientFactors)
+				table.append({ depth, bottomTime, gf.first, gf.second, false, 0, QVector<struct decostop>() });
+		}
+	}
+	QtConcurrent::blockingMap(table, [&grid](DecoTableCell &cell) { planCell(grid, cell); });
+	return table;
+}
+
+// Tables are printed in whole minutes, rounded up
+static int minutes(int seconds)
+{
+	return (seconds + 59) / 60;
+}
+
+static long depthInUnits(int mm)
+{
+	return lrint(get_depth_units(mm, NULL, NULL));
+}
+
+QByteArray decoTableToCSV(const QVector<DecoTableCell> &table)
+{
+	const char *unit;
+	get_depth_units(0, NULL, &unit);
+
+	QByteArray res = QString("depth [%1],bottom time [min],GF low,GF high,runtime [min],deco time [min],stops [%1:min]\n")
+				.arg(unit).toUtf8();
+	for (const DecoTableCell &cell: table) {
+		if (!cell.valid)
+			continue;
+		QByteArray stops;
+		for (const struct decostop &stop: cell.stops) {
+			if (!stops.isEmpty())
+				stops += ' ';
+			stops += QByteArray::number((qlonglong)depthInUnits(stop.depth)) + ':' + QByteArray::number(minutes(stop.time));
+		}
+		res += QByteArray::number((qlonglong)depthInUnits(cell.depth)) + ',' +
+		       QByteArray::number(minutes(cell.bottomTime)) + ',' +
+		       QByteArray::number(cell.gflow) + ',' +
+		       QByteArray::number(cell.gfhigh) + ',' +
+		       QByteArray::number(minutes(cell.runtime)) + ',' +
+		       QByteArray::number(minutes(cell.runtime - cell.bottomTime)) + ',' +
+		       stops + '\n';
+	}
+	return res;
+}
+
+QByteArray decoTableToJSON(const QVector<DecoTableCell> &table)
+{
+	const char *unit;
+	get_depth_units(0, NULL, &unit);
+
+	QJsonArray cells;
+	for (const DecoTableCell &cell: table) {
+		if (!cell.valid)
+			continue;
+		QJsonArray stops;
+		for (const struct decostop &stop: cell.stops) {
+			QJsonObject s;
+			s["depth"] = (qint64)depthInUnits(stop.depth);
+			s["time"] = minutes(stop.time);
+			stops.append(s);
+		}
+		QJsonObject c;
+		c["depth"] = (qint64)depthInUnits(cell.depth);
+		c["bottom_time"] = minutes(cell.bottomTime);
+		c["gf_low"] = cell.gflow;
+		c["gf_high"] = cell.gfhigh;
+		c["runtime"] = minutes(cell.runtime);
+		c["deco_time"] = minutes(cell.runtime - cell.bottomTime);
+		c["stops"] = stops;
+		cells.append(c);
+	}
+	QJsonObject res;
+	res["depth_unit"] = QString(unit);
+	res["time_unit"] = QStringLiteral("min");
+	res["cells"] = cells;
+	return QJsonDocument(res).toJson();
+}
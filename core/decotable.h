@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef DECOTABLE_H
+#define DECOTABLE_H
+
+#include "core/dive.h"
+#include <QByteArray>
+#include <QPair>
+#include <QVector>
+
+// Generation of printable deco tables (runtimes over depths, bottom times and
+// gradient factors) without the planner UI. For every cell of the grid, plan()
+// is run on its own dive and deco state. The cells are distributed over the
+// global thread pool.
+// The remaining planner settings (ascent and descent rates, last stop, SAC,
+// deco mode, ...) are taken from prefs. Note that the deco mode is only taken
+// from prefs.planner_deco_mode if the application is in the planner state.
+
+struct DecoTableGas {
+	struct gasmix mix;
+	int switchDepth;		// mm, 0 = MOD at the deco pO2. Ignored for the bottom gas.
+};
+
+struct DecoTableGrid {
+	QVector<int> depths;		// mm
+	QVector<int> bottomTimes;	// seconds, including the descent
+	QVector<QPair<int, int>> gradientFactors;	// GF low, GF high in percent
+	QVector<DecoTableGas> gases;	// bottom gas first, followed by the deco gases
+	int surfacePressure;		// mbar
+	int salinity;			// g/10l
+	int vpmbConservatism;
+};
+
+struct DecoTableCell {
+	int depth;			// mm
+	int bottomTime;			// seconds
+	int gflow, gfhigh;
+	bool valid;			// false if the bottom time is shorter than the descent
+	int runtime;			// seconds
+	QVector<struct decostop> stops;	// mandatory stops, deepest first
+};
+
+QVector<DecoTableCell> generateDecoTable(const DecoTableGrid &grid);
+QByteArray decoTableToCSV(const QVector<DecoTableCell> &table);
+QByteArray decoTableToJSON(const QVector<DecoTableCell> &table);
+
+#endif // DECOTABLE_H
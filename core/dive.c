@@ -454,11 +454,11 @@ double get_weight_units(unsigned int grams, int *frac, const char **units)
 
 // we need this to be uniq. oh, and it has no meaning whatsoever
 // - that's why we have the silly initial number and increment by 3 :-)
+// Dives are also allocated by worker threads, hence the atomic increment.
 int dive_getUniqID()
 {
 	static int maxId = 83529;
-	maxId += 3;
-	return maxId;
+	return __sync_add_and_fetch(&maxId, 3);
 }
 
 struct dive *alloc_dive(void)
@@ -3961,11 +3961,18 @@ bool picture_check_valid_time(timestamp_t timestamp, int shift_time)
 void create_picture(const char *filename, int shift_time, bool match_all)
 {
 	struct metadata metadata;
+
+	get_metadata(filename, &metadata);
+	create_picture_from_metadata(filename, &metadata, shift_time, match_all);
+}
+
+/* As create_picture(), but with metadata that was already read by the caller. */
+void create_picture_from_metadata(const char *filename, const struct metadata *metadata, int shift_time, bool match_all)
+{
 	struct dive *dive;
 	timestamp_t timestamp;
 
-	get_metadata(filename, &metadata);
-	timestamp = metadata.timestamp + shift_time;
+	timestamp = metadata->timestamp + shift_time;
 	dive = nearest_selected_dive(timestamp);
 
 	if (!dive)
@@ -3977,8 +3984,8 @@ void create_picture(const char *filename, int shift_time, bool match_all)
 
 	struct picture *picture = alloc_picture();
 	picture->filename = strdup(filename);
-	picture->offset.seconds = metadata.timestamp - dive->when + shift_time;
-	picture->location = metadata.location;
+	picture->offset.seconds = metadata->timestamp - dive->when + shift_time;
+	picture->location = metadata->location;
 
 	dive_add_picture(dive, picture);
 	dive_set_geodata_from_picture(dive, picture);
@@ -374,6 +374,8 @@ struct picture {
 extern struct picture *alloc_picture();
 extern void free_picture(struct picture *picture);
 extern void create_picture(const char *filename, int shift_time, bool match_all);
+struct metadata;
+extern void create_picture_from_metadata(const char *filename, const struct metadata *metadata, int shift_time, bool match_all);
 extern void dive_add_picture(struct dive *d, struct picture *newpic);
 extern bool dive_remove_picture(struct dive *d, const char *filename);
 extern unsigned int dive_get_picture_count(struct dive *d);
@@ -488,6 +490,7 @@ extern int parse_divinglog_buffer(sqlite3 *handle, const char *url, const char *
 extern int parse_dlf_buffer(unsigned char *buffer, size_t size, struct dive_table *table, struct trip_table *trips);
 
 extern int parse_file(const char *filename, struct dive_table *table, struct trip_table *trips);
+extern int reload_file(const char *filename);
 extern int save_dives(const char *filename);
 extern int save_dives_logic(const char *filename, bool select_only, bool anonymize);
 extern int save_dive(FILE *f, struct dive *dive, bool anonymize);
@@ -495,6 +498,7 @@ extern int export_dives_xslt(const char *filename, const bool selected, const in
 
 struct membuffer;
 extern void save_one_dive_to_mb(struct membuffer *b, struct dive *dive, bool anonymize);
+extern void save_dive_table_buffer(struct membuffer *b, struct dive_table *table, struct dive_site_table *sites);
 
 int cylinderuse_from_text(const char *text);
 
@@ -649,6 +653,8 @@ extern void clear_deco(struct deco_state *ds, double surface_pressure);
 extern void dump_tissues(struct deco_state *ds);
 extern void set_gf(short gflow, short gfhigh);
 extern void set_vpmb_conservatism(short conservatism);
+extern void set_plan_deco_params(short gflow, short gfhigh, short conservatism);
+extern void clear_plan_deco_params(void);
 extern void cache_deco_state(struct deco_state *source, struct deco_state **datap);
 extern void restore_deco_state(struct deco_state *data, struct deco_state *target, bool keep_vpmb_state);
 extern void nuclear_regeneration(struct deco_state *ds, double time);
@@ -671,6 +677,19 @@ struct divedatapoint {
 	enum divemode_t divemode;
 };
 
+/* Gas budget of a plan, see gasbudget.h */
+struct cylinder_budget {
+	volume_t used;
+	volume_t deco_used;	/* used during the planned ascent */
+	pressure_t start, end;
+	pressure_t turn;	/* left at the start of the ascent */
+	pressure_t minimum;	/* minimum gas to get two divers to the surface, 0 if not calculated */
+};
+
+struct gas_budget {
+	struct cylinder_budget cyl[MAX_CYLINDERS];
+};
+
 struct diveplan {
 	timestamp_t when;
 	int surface_pressure; /* mbar */
@@ -683,6 +702,10 @@ struct diveplan {
 	struct divedatapoint *dp;
 	int eff_gflow, eff_gfhigh;
 	int surface_interval;
+	struct deco_checkpoints *checkpoints; /* optional, lets plan() resume from the first changed waypoint */
+	struct plan_results *results; /* optional, lets plan() reuse the results of previous plans */
+	struct gas_budget gas;
+	int error;	/* set by plan(), e.g. LONGDECO */
 };
 
 struct divedatapoint *plan_add_segment(struct diveplan *diveplan, int duration, int depth, int cylinderid, int po2, bool entered, enum divemode_t divemode);
@@ -694,7 +717,7 @@ struct decostop {
 	int depth;
 	int time;
 };
-extern bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, int timestep, struct decostop *decostoptable, struct deco_state **cached_datap, bool is_planner, bool show_disclaimer);
+extern bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, int timestep, struct decostop *decostoptable, struct deco_state **cached_datap, bool is_planner);
 extern void calc_crushing_pressure(struct deco_state *ds, double pressure);
 extern void vpmb_start_gradient(struct deco_state *ds);
 extern void clear_vpmb_state(struct deco_state *ds);
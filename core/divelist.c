@@ -65,6 +65,7 @@
 #include "planner.h"
 #include "qthelper.h"
 #include "git-access.h"
+#include "trace.h"
 
 static bool dive_list_changed = false;
 
@@ -1654,6 +1655,7 @@ void process_imported_dives(struct dive_table *import_table, struct trip_table *
 	int preexisting;
 	bool sequence_changed = false;
 	bool new_dive_has_number = false;
+	struct trace_span span;
 
 	/* Make sure that output parameters don't contain garbage */
 	clear_table(dives_to_add);
@@ -1673,6 +1675,7 @@ void process_imported_dives(struct dive_table *import_table, struct trip_table *
 	/* If no dives were imported, don't bother doing anything */
 	if (!import_table->nr)
 		return;
+	span = trace_begin("process_imported_dives");
 
 	/* check if we need a nickname for the divecomputer for newly downloaded dives;
 	 * since we know they all came from the same divecomputer we just check for the
@@ -1750,6 +1753,7 @@ void process_imported_dives(struct dive_table *import_table, struct trip_table *
 		for (i = start_renumbering_at; i < dives_to_add->nr; i++)
 			dives_to_add->dives[i]->number = ++nr;
 	}
+	trace_end(&span);
 }
 
 /* return the number a dive gets when inserted at the given index.
@@ -4,6 +4,9 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QTextStream>
+#include <QtConcurrent>
+#include <atomic>
+#include <numeric>
 #include "divelogexportlogic.h"
 #include "qthelper.h"
 #include "units.h"
@@ -122,6 +125,51 @@ static void exportHTMLstatistics(const QString filename, struct htmlExportSettin
 
 }
 
+// Copy the photos of the exported dives. The shards only refer to the photos by
+// filename, therefore pictures with the same filename end up in the same file.
+// Copy each of them once, from the first dive that refers to it.
+static void exportHTMLphotos(const struct html_export &e, const QString &photosDirectory)
+{
+	QMap<QString, QString> photos;		// destination -> source
+	for (int i = 0; i < e.nr; ++i) {
+		FOR_EACH_PICTURE(e.dives[i]) {
+			QString source = localFilePath(picture->filename);
+			QString destination = photosDirectory + QFileInfo(source).fileName();
+			if (!photos.contains(destination))
+				photos.insert(destination, source);
+		}
+	}
+	for (auto it = photos.cbegin(); it != photos.cend(); ++it)
+		file_copy_and_overwrite(it.value(), it.key());
+}
+
+// Write the index of the dives and serialize the shards with the dive details in parallel.
+static void exportHTMLdives(const QString &indexFile, const QString &shardDir, const QString &photosDirectory, struct htmlExportSetting &hes)
+{
+	struct html_export e = { 0 };
+	prepare_HTML_export(&e, hes.selectedOnly);
+	export_HTML_index(qPrintable(indexFile), &e, hes.listOnly);
+
+	if (!hes.listOnly) {
+		QByteArray dir = shardDir.toUtf8();
+		QByteArray photos = photosDirectory.toUtf8();
+		std::atomic<int> failed(-1);
+		QVector<int> shards(e.nr_shards);
+		std::iota(shards.begin(), shards.end(), 0);
+		QtConcurrent::blockingMap(shards, [&](int shard) {
+			if (export_HTML_shard(dir.constData(), &e, shard, photos.constData()))
+				failed = shard;
+		});
+		if (failed >= 0)
+			report_error(qPrintable(gettextFromC::tr("Can't open file %1").arg(shardDir + QString("/dives_%1.js").arg(failed))));
+		// Copying is done serially after the shards were written: different shards
+		// may refer to the same destination file.
+		if (!photosDirectory.isEmpty())
+			exportHTMLphotos(e, photosDirectory);
+	}
+	free_HTML_export(&e);
+}
+
 void exportHtmlInitLogic(const QString &filename, struct htmlExportSetting &hes)
 {
 	QString photosDirectory;
@@ -130,6 +178,7 @@ void exportHtmlInitLogic(const QString &filename, struct htmlExportSetting &hes)
 	QDir mainDir = info.absoluteDir();
 	mainDir.mkdir(file.fileName() + "_files");
 	QString exportFiles = file.fileName() + "_files";
+	QString shardDir = exportFiles;
 
 	QString json_dive_data = exportFiles + QDir::separator() + "file.js";
 	QString json_settings = exportFiles + QDir::separator() + "settings.js";
@@ -147,7 +196,7 @@ void exportHtmlInitLogic(const QString &filename, struct htmlExportSetting &hes)
 	exportHTMLstatistics(stat_file, hes);
 	export_translation(qPrintable(translation));
 
-	export_HTML(qPrintable(json_dive_data), qPrintable(photosDirectory), hes.selectedOnly, hes.listOnly);
+	exportHTMLdives(json_dive_data, shardDir, photosDirectory, hes);
 
 	QString searchPath = getSubsurfaceDataPath("theme");
 	if (searchPath.isEmpty()) {
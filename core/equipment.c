@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <time.h>
+#include "ssrf.h"
 #include "gettext.h"
 #include "dive.h"
 #include "display.h"
@@ -95,7 +96,7 @@ void get_gas_string(struct gasmix gasmix, char *text, int len)
 /* Returns a static char buffer - only good for immediate use by printf etc */
 const char *gasname(struct gasmix gasmix)
 {
-	static char gas[64];
+	static THREAD_LOCAL char gas[64];
 	get_gas_string(gasmix, gas, sizeof(gas));
 	return gas;
 }
@@ -291,6 +291,30 @@ int check_git_sha(const char *filename, struct git_repository **git_p, const cha
 	return 1;
 }
 
+/*
+ * Read the file that is currently loaded again, e.g. to pick up the
+ * changes brought in by a cloud sync. For git repositories only the
+ * changed dives are read, everything else is loaded from scratch.
+ */
+int reload_file(const char *filename)
+{
+	struct git_repository *git;
+	const char *branch = NULL;
+
+	git = is_git_repository(filename, &branch, NULL, false);
+	if (prefs.cloud_git_url &&
+	    strstr(filename, prefs.cloud_git_url)
+	    && git == dummy_git_repository)
+		/* opening the cloud storage repository failed for some reason
+		 * give up here and don't send errors about git repositories */
+		return -1;
+	if (git)
+		return git_reload_dives(git, branch);
+
+	clear_dive_file_data();
+	return parse_file(filename, &dive_table, &trip_table);
+}
+
 int parse_file(const char *filename, struct dive_table *table, struct trip_table *trips)
 {
 	struct git_repository *git;
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "findmovedimages.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+MovedImagesSearch::MovedImagesSearch(int numWalkersIn) : numWalkers(numWalkersIn)
+{
+	// The matches are sent via queued connections to the UI thread
+	qRegisterMetaType<QVector<MovedImageMatch>>("QVector<MovedImageMatch>");
+}
+
+// Compare two full paths and return the number of matching levels, starting from the filename.
+// String comparison is case-insensitive.
+static int matchPath(const QString &path1, const QString &path2)
+{
+	QFileInfo f1(path1);
+	QFileInfo f2(path2);
+
+	int score = 0;
+	for (;;) {
+		QString fn1 = f1.fileName();
+		QString fn2 = f2.fileName();
+		if (fn1.isEmpty() || fn2.isEmpty())
+			break;
+		if (fn1 == ".") {
+			f1 = QFileInfo(f1.path());
+			continue;
+		}
+		if (fn2 == ".") {
+			f2 = QFileInfo(f2.path());
+			continue;
+		}
+		if (QString::compare(fn1, fn2, Qt::CaseInsensitive) != 0)
+			break;
+		f1 = QFileInfo(f1.path());
+		f2 = QFileInfo(f2.path());
+		++score;
+	}
+	return score;
+}
+
+// Insert or replace a match if it is better than the existing one. If two files match
+// with the same score, take the one with the smaller path, so that the result doesn't
+// depend on the order in which the threads found the files. Returns true if the match
+// was inserted.
+bool MovedImagesSearch::addMatch(QMap<QString, ImageMatch> &matches, const QString &originalFilename, const ImageMatch &match)
+{
+	auto it = matches.find(originalFilename);
+	if (it == matches.end()) {
+		matches.insert(originalFilename, match);
+		return true;
+	}
+	if (it->score < match.score || (it->score == match.score && match.localFilename < it->localFilename)) {
+		*it = match;
+		return true;
+	}
+	return false;
+}
+
+void MovedImagesSearch::learnImage(const QString &filename, QMap<QString, ImageMatch> &matches, const ImageIndex &index)
+{
+	// Find the images with the same filename by a hash lookup
+	auto candidates = index.find(QFileInfo(filename).fileName().toUpper());
+	if (candidates == index.end())
+		return;
+
+	QStringList newMatches;
+	int bestScore = 1;
+	for (const QString &path: *candidates) {
+		int score = matchPath(filename, path);
+		if (score < bestScore)
+			continue;
+		if (score > bestScore)
+			newMatches.clear();
+		newMatches.append(path);
+		bestScore = score;
+	}
+
+	// Add the new original filenames to the list of matches, if the score is higher than previously
+	for (const QString &originalFilename: newMatches)
+		addMatch(matches, originalFilename, { filename, bestScore });
+}
+
+// For each directory we keep track of the part of the total progress it represents.
+// When a directory is listed, this range is split among its subdirectories.
+struct Dir {
+	QString path;
+	int depth;
+	double progressFrom, progressTo;
+};
+
+// State shared by all threads walking the directory tree. All fields are protected by lock.
+struct MovedImagesSearch::Walk {
+	QMutex lock;
+	QWaitCondition wakeUp;
+	QVector<Dir> todo;		// Directories still to be listed
+	int busy = 0;			// Number of directories currently being listed
+	double progress = 0.0;		// Fraction of the tree that has been processed
+	QMap<QString, ImageMatch> matches;
+};
+
+void MovedImagesSearch::walkDirectories(Walk &walk, const ImageIndex &index, int maxRecursions, const QAtomicInt &stop)
+{
+	QMutexLocker l(&walk.lock);
+	for (;;) {
+		// Wait for work. If there is nothing to do and nobody is listing a
+		// directory (i.e. might produce more work) we are done.
+		while (walk.todo.isEmpty() && walk.busy > 0 && stop == 0)
+			walk.wakeUp.wait(&walk.lock);
+		if (walk.todo.isEmpty() || stop != 0) {
+			walk.wakeUp.wakeAll();
+			return;
+		}
+		Dir entry = walk.todo.takeLast();
+		++walk.busy;
+		double progressDone = walk.progress;
+		l.unlock();
+
+		emit progress(progressDone, entry.path);
+
+		// Fetch files and subdirectories in one go
+		QDir dir(entry.path);
+		QVector<Dir> subdirs;
+		QMap<QString, ImageMatch> matches;
+		for (const QFileInfo &info: dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot, QDir::NoSort)) {
+			if (stop != 0)
+				break;
+			if (info.isDir()) {
+				if (entry.depth < maxRecursions)
+					subdirs.append({ info.filePath(), entry.depth + 1, 0.0, 0.0 });
+			} else {
+				learnImage(info.absoluteFilePath(), matches, index);
+			}
+		}
+		int num = subdirs.size();
+		double diff = entry.progressTo - entry.progressFrom;
+		for (int i = 0; i < num; ++i) {
+			subdirs[i].progressFrom = (i / (double)num) * diff + entry.progressFrom;
+			subdirs[i].progressTo = ((i + 1) / (double)num) * diff + entry.progressFrom;
+		}
+
+		l.relock();
+		QVector<MovedImageMatch> found;
+		for (auto it = matches.begin(); it != matches.end(); ++it) {
+			if (addMatch(walk.matches, it.key(), *it))
+				found.append({ it.key(), it->localFilename, it->score });
+		}
+		if (subdirs.isEmpty())
+			walk.progress += diff;
+		walk.todo.append(subdirs);
+		--walk.busy;
+		walk.wakeUp.wakeAll();
+
+		// Don't make the other walkers wait for the receivers of the signal
+		if (!found.isEmpty()) {
+			l.unlock();
+			emit matchesFound(found);
+			l.relock();
+		}
+	}
+}
+
+QVector<MovedImageMatch> MovedImagesSearch::search(const QString &dir, int maxRecursions, const QVector<QString> &imagePaths,
+						   const QAtomicInt &stop)
+{
+	// For divelogs with thousands of images, we don't want to compare the path of every image.
+	// Therefore, build an index of the image paths by filename in upper case. Thus, we can
+	// access all paths ending in the same filename by a hash lookup. We suppose that
+	// there aren't many pictures with the same filename but different paths.
+	ImageIndex index;
+	index.reserve(imagePaths.size());
+	for (const QString &path: imagePaths)
+		index[QFileInfo(path).fileName().toUpper()].append(path);
+
+	// Directories are listed by multiple threads in parallel. Listing a directory is mostly
+	// waiting for the file system (which may well be on the network), therefore we use
+	// more threads than there are cores.
+	Walk walk;
+	walk.todo.append({ dir, 0, 0.0, 1.0 });
+	QThreadPool pool;
+	pool.setMaxThreadCount(numWalkers);
+	for (int i = 0; i < numWalkers; ++i)
+		QtConcurrent::run(&pool, [this, &walk, &index, maxRecursions, &stop]() { walkDirectories(walk, index, maxRecursions, stop); });
+	pool.waitForDone();
+
+	emit progress(1.0, QString());
+	QVector<MovedImageMatch> ret;
+	ret.reserve(walk.matches.size());
+	for (auto it = walk.matches.begin(); it != walk.matches.end(); ++it)
+		ret.append({ it.key(), it->localFilename, it->score });
+	return ret;
+}
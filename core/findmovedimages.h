@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0
+// Search a directory tree for media files that were moved away from their
+// original location. The tree is listed by multiple threads and matches are
+// reported as they are found.
+#ifndef FINDMOVEDIMAGES_CORE_H
+#define FINDMOVEDIMAGES_CORE_H
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+#include <QAtomicInteger>
+
+struct MovedImageMatch {
+	QString originalFilename;
+	QString localFilename;
+	int matchingPathItems;		// Number of path components that match, starting from the filename
+};
+
+class MovedImagesSearch : public QObject {
+	Q_OBJECT
+public:
+	MovedImagesSearch(int numWalkers = 8);
+
+	// Search the tree below dir for the files in imagePaths and return the best
+	// match for every file that was found. Blocks until the walk is finished or
+	// stop is set, therefore this is usually run in a worker thread.
+	QVector<MovedImageMatch> search(const QString &dir, int maxRecursions, const QVector<QString> &imagePaths,
+					const QAtomicInt &stop);
+signals:
+	// Emitted from the walker threads whenever a directory was listed.
+	void progress(double progress, QString path);
+	// New or improved matches, emitted from the walker threads as they are found.
+	// A file may be reported multiple times if a better match turns up later.
+	void matchesFound(QVector<MovedImageMatch> matches);
+private:
+	struct ImageMatch {
+		QString localFilename;
+		int score;
+	};
+	// Index of the searched images: filename in upper case -> original paths
+	using ImageIndex = QHash<QString, QVector<QString>>;
+	struct Walk;
+	int numWalkers;
+
+	static bool addMatch(QMap<QString, ImageMatch> &matches, const QString &originalFilename, const ImageMatch &match);
+	static void learnImage(const QString &filename, QMap<QString, ImageMatch> &matches, const ImageIndex &index);
+	void walkDirectories(Walk &walk, const ImageIndex &index, int maxRecursions, const QAtomicInt &stop);
+};
+
+Q_DECLARE_METATYPE(MovedImageMatch)
+
+#endif
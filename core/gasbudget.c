@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: GPL-2.0
+/* gasbudget.c
+ *
+ * gas consumption, minimum gas and turn pressures of planned dives
+ */
+#include "gasbudget.h"
+#include "pref.h"
+#include "qthelper.h"
+
+/* Start from the current pressures of the cylinders */
+void gas_budget_init(struct gas_budget *budget, const struct dive *dive)
+{
+	for (int i = 0; i < MAX_CYLINDERS; i++) {
+		struct cylinder_budget *cyl = &budget->cyl[i];
+		cyl->used.mliter = 0;
+		cyl->deco_used.mliter = 0;
+		cyl->start = dive->cylinder[i].start;
+		cyl->end = cyl->turn = dive->cylinder[i].end;
+		cyl->minimum.mbar = 0;
+	}
+}
+
+/* Account for a segment breathed from the given cylinder. The duration may be
+ * negative to take back a segment. The turn pressure only accounts for the
+ * segments that are not part of the ascent, independent of the order in which
+ * the segments are added (in recreational mode, the ascent is added first). */
+void gas_budget_add_segment(struct gas_budget *budget, const struct dive *dive, int cylinderid, int old_depth, int new_depth,
+			    int duration, int sac, bool in_deco, enum divemode_t divemode)
+{
+	const cylinder_t *cylinder;
+	struct cylinder_budget *cyl;
+	volume_t gas_used;
+	pressure_t delta_p;
+	depth_t mean_depth;
+	int factor = 1000;
+
+	if (cylinderid < 0 || cylinderid >= MAX_CYLINDERS)
+		return;
+	if (divemode == PSCR)
+		factor = prefs.pscr_ratio;
+
+	cylinder = &dive->cylinder[cylinderid];
+	cyl = &budget->cyl[cylinderid];
+	mean_depth.mm = (old_depth + new_depth) / 2;
+	gas_used.mliter = lrint(depth_to_atm(mean_depth.mm, dive) * sac / 60 * duration * factor / 1000);
+	cyl->used.mliter += gas_used.mliter;
+	if (in_deco)
+		cyl->deco_used.mliter += gas_used.mliter;
+	if (cylinder->type.size.mliter) {
+		delta_p.mbar = lrint(gas_used.mliter * 1000.0 / cylinder->type.size.mliter * gas_compressibility_factor(cylinder->gasmix, cyl->end.mbar / 1000.0));
+		cyl->end.mbar -= delta_p.mbar;
+		if (!in_deco) {
+			delta_p.mbar = lrint(gas_used.mliter * 1000.0 / cylinder->type.size.mliter * gas_compressibility_factor(cylinder->gasmix, cyl->turn.mbar / 1000.0));
+			cyl->turn.mbar -= delta_p.mbar;
+		}
+	}
+}
+
+/* Determine if there is enough gas left for the planned ascent.
+ * Also return true if this cannot be calculated because the cylinder doesn't have
+ * size or a starting pressure.
+ */
+bool gas_budget_enough(const struct gas_budget *budget, const struct dive *dive, int cylinderid, int reserve)
+{
+	const struct cylinder_budget *cyl = &budget->cyl[cylinderid];
+	int size = dive->cylinder[cylinderid].type.size.mliter;
+
+	if (!cyl->start.mbar || !size)
+		return true;
+	return (cyl->end.mbar - reserve) / 1000.0 * size > cyl->deco_used.mliter;
+}
+
+/* The gas needed to solve a problem at the given depth and to bring two divers
+ * to the surface, based on the SAC factor and problem solving time of the
+ * preferences. Stores the corresponding cylinder pressure as minimum gas. */
+volume_t gas_budget_minimum_gas(struct gas_budget *budget, const struct dive *dive, int cylinderid, int depth)
+{
+	const cylinder_t *cylinder = &dive->cylinder[cylinderid];
+	struct cylinder_budget *cyl = &budget->cyl[cylinderid];
+	volume_t mingas;
+
+	mingas.mliter = lrint(prefs.sacfactor / 100.0 * prefs.problemsolvingtime * prefs.bottomsac
+			      * depth_to_bar(depth, dive)
+			      + prefs.sacfactor / 100.0 * cyl->deco_used.mliter);
+	cyl->minimum.mbar = lrint(isothermal_pressure(cylinder->gasmix, 1.0, mingas.mliter, cylinder->type.size.mliter) * 1000);
+	return mingas;
+}
+
+/* Calculate the minimum gas for the last manually entered waypoint before the
+ * ascent. As in the notes, this is only done for open circuit dives that are
+ * not planned in recreational mode. */
+void gas_budget_plan_minimum_gas(struct gas_budget *budget, struct diveplan *diveplan, const struct dive *dive)
+{
+	struct divedatapoint *dp, *nextdp, *lastbottomdp = NULL;
+
+	if (dive->dc.divemode != OC || decoMode() == RECREATIONAL)
+		return;
+	for (dp = diveplan->dp; dp; dp = dp->next) {
+		if (dp->time == 0 || !dp->entered)
+			continue;
+		for (nextdp = dp->next; nextdp && nextdp->time == 0; nextdp = nextdp->next)
+			;
+		if (nextdp && !nextdp->entered)
+			lastbottomdp = dp;
+	}
+	if (!lastbottomdp || !dive->cylinder[lastbottomdp->cylinderid].type.size.mliter)
+		return;
+	gas_budget_minimum_gas(budget, dive, lastbottomdp->cylinderid, lastbottomdp->depth.mm);
+	lastbottomdp->minimum_gas = budget->cyl[lastbottomdp->cylinderid].minimum;
+}
+
+/* Store the consumption in the cylinders of the dive */
+void gas_budget_apply(const struct gas_budget *budget, struct dive *dive)
+{
+	for (int i = 0; i < MAX_CYLINDERS; i++) {
+		cylinder_t *cyl = &dive->cylinder[i];
+		cyl->gas_used = budget->cyl[i].used;
+		cyl->deco_gas_used = budget->cyl[i].deco_used;
+		cyl->end = budget->cyl[i].end;
+	}
+}
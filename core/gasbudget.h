@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef GASBUDGET_H
+#define GASBUDGET_H
+
+#include "dive.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Gas consumption of planned dives. The budget is accumulated segment by
+ * segment and is independent of the decompression calculation. Thus, it can
+ * be recalculated from the waypoints of a plan when only the SAC rates, the
+ * reserve or the cylinders change.
+ */
+extern void gas_budget_init(struct gas_budget *budget, const struct dive *dive);
+extern void gas_budget_add_segment(struct gas_budget *budget, const struct dive *dive, int cylinderid, int old_depth, int new_depth,
+				   int duration, int sac, bool in_deco, enum divemode_t divemode);
+extern bool gas_budget_enough(const struct gas_budget *budget, const struct dive *dive, int cylinderid, int reserve);
+extern volume_t gas_budget_minimum_gas(struct gas_budget *budget, const struct dive *dive, int cylinderid, int depth);
+extern void gas_budget_plan_minimum_gas(struct gas_budget *budget, struct diveplan *diveplan, const struct dive *dive);
+extern void gas_budget_apply(const struct gas_budget *budget, struct dive *dive);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GASBUDGET_H
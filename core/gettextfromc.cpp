@@ -1,17 +1,80 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "gettextfromc.h"
+#include <QAtomicPointer>
 #include <QHash>
 #include <QMutex>
+#include <cstring>
 
-static QHash<QByteArray, QByteArray> translationCache;
+// The translations are cached in an open-addressing hash table, which is only
+// ever appended to. Readers don't take a lock: they load the current table and
+// the entries with acquire semantics. Writers are serialized by a mutex and
+// publish new entries (and, when the table is grown, new tables) with release
+// semantics. Entries are never freed, since the returned strings are used by
+// the C code indefinitely. Old tables are never freed either, because readers
+// might still be probing them. Since the tables grow by doubling, this wastes at
+// most as much memory as the current table uses.
+namespace {
+	struct Entry {
+		QByteArray text;
+		QByteArray translation;
+		uint hash;
+	};
+
+	struct Table {
+		int size;		// power of two
+		int used;
+		QAtomicPointer<const Entry> *slots;
+		Table(int sizeIn) : size(sizeIn), used(0), slots(new QAtomicPointer<const Entry>[sizeIn]) { }
+	};
+}
+
+static QAtomicPointer<Table> translationCache(new Table(1024));
 static QMutex lock;
 
+static const Entry *lookup(const Table *t, const char *text, uint hash)
+{
+	for (int idx = hash & (t->size - 1);; idx = (idx + 1) & (t->size - 1)) {
+		const Entry *e = t->slots[idx].loadAcquire();
+		if (!e)
+			return nullptr;
+		if (e->hash == hash && strcmp(e->text.constData(), text) == 0)
+			return e;
+	}
+}
+
+// Must be called with the lock held and with a table that has a free slot.
+static void insert(Table *t, const Entry *e)
+{
+	int idx = e->hash & (t->size - 1);
+	while (t->slots[idx].loadAcquire())
+		idx = (idx + 1) & (t->size - 1);
+	t->slots[idx].storeRelease(e);
+	++t->used;
+}
+
 extern "C" const char *trGettext(const char *text)
 {
-	QByteArray key(text);
+	uint hash = qHash(QByteArray::fromRawData(text, strlen(text)));
+	const Entry *e = lookup(translationCache.loadAcquire(), text, hash);
+	if (e)
+		return e->translation.constData();
+
 	QMutexLocker l(&lock);
-	auto it = translationCache.find(key);
-	if (it == translationCache.end())
-		it = translationCache.insert(key, gettextFromC::tr(text).toUtf8());
-	return it->constData();
+	Table *t = translationCache.loadAcquire();
+	if ((e = lookup(t, text, hash)) != nullptr)
+		return e->translation.constData();
+
+	// Keep the load factor below 1/2
+	if (2 * (t->used + 1) > t->size) {
+		Table *newTable = new Table(2 * t->size);
+		for (int i = 0; i < t->size; ++i) {
+			if (const Entry *old = t->slots[i].loadAcquire())
+				insert(newTable, old);
+		}
+		translationCache.storeRelease(newTable);
+		t = newTable;
+	}
+	e = new Entry { QByteArray(text), gettextFromC::tr(text).toUtf8(), hash };
+	insert(t, e);
+	return e->translation.constData();
 }
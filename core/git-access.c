@@ -24,6 +24,7 @@
 #include "qthelper.h"
 #include "git-access.h"
 #include "gettext.h"
+#include "cloudsync.h"
 
 bool is_subsurface_cloud = false;
 
@@ -38,6 +39,13 @@ bool git_local_only = false;
 
 int (*update_progress_cb)(const char *) = NULL;
 
+/*
+ * The commit of the local branch before and after the last foreground sync
+ * with the remote. They are the same if the sync didn't bring in any new
+ * data. The background sync passes its commits to the caller instead.
+ */
+static git_oid sync_old_id, sync_new_id;
+
 static bool includes_string_caseinsensitive(const char *haystack, const char *needle)
 {
 	if (!needle)
@@ -67,6 +75,9 @@ void set_git_update_cb(int(*cb)(const char *))
 int git_storage_update_progress(const char *text)
 {
 	int ret = 0;
+	/* The UI callback must not be called from the background sync thread */
+	if (cloud_sync_report_progress(text))
+		return 0;
 	if (update_progress_cb)
 		ret = (*update_progress_cb)(text);
 	return ret;
@@ -447,7 +458,9 @@ static int try_to_git_merge(git_repository *repo, git_reference **local_p, git_r
 	}
 	if (git_reference_set_target(local_p, *local_p, &commit_oid, "Subsurface merge event"))
 		goto write_error;
-	set_git_id(&commit_oid);
+	/* In the background, the loaded dives are still those of the old commit */
+	if (!in_cloud_sync_thread())
+		set_git_id(&commit_oid);
 	git_signature_free(author);
 	if (verbose)
 		fprintf(stderr, "Successfully merged repositories");
@@ -471,19 +484,17 @@ static int cleanup_local_cache(const char *remote_url, const char *branch)
 	free(backup_path);
 	return -1;
 }
-static int try_to_update(git_repository *repo, git_remote *origin, git_reference *local, git_reference *remote,
-			 const char *remote_url, const char *branch, enum remote_transport rt)
+/*
+ * Bring the local branch up to date with the remote branch. Sets *push if
+ * the remote has to be updated with the local branch afterwards.
+ */
+static int update_local_branch(git_repository *repo, git_reference **local_p, git_reference *remote,
+			       const char *remote_url, const char *branch, bool *push)
 {
 	git_oid base;
 	const git_oid *local_id, *remote_id;
 	int ret = 0;
 
-	if (verbose)
-		fprintf(stderr, "git storage: try to update\n");
-
-	if (!git_reference_cmp(local, remote))
-		return 0;
-
 	// Dirty modified state in the working tree? We're not going
 	// to update either way
 	if (git_status_foreach(repo, check_clean, NULL)) {
@@ -492,7 +503,7 @@ static int try_to_update(git_repository *repo, git_remote *origin, git_reference
 		else
 			return report_error("local cached copy is dirty, skipping update");
 	}
-	local_id = git_reference_target(local);
+	local_id = git_reference_target(*local_p);
 	remote_id = git_reference_target(remote);
 
 	if (!local_id || !remote_id) {
@@ -514,8 +525,9 @@ static int try_to_update(git_repository *repo, git_remote *origin, git_reference
 	}
 	/* Is the remote strictly newer? Use it */
 	if (git_oid_equal(&base, local_id)) {
+		cloud_sync_report_state(CLOUD_SYNC_MERGING);
 		git_storage_update_progress(translate("gettextFromC", "Update local storage to match cloud storage"));
-		return reset_to_remote(repo, local, remote_id);
+		return reset_to_remote(repo, *local_p, remote_id);
 	}
 
 	/* Is the local repo the more recent one? See if we can update upstream */
@@ -523,7 +535,8 @@ static int try_to_update(git_repository *repo, git_remote *origin, git_reference
 		if (verbose)
 			fprintf(stderr, "local is newer than remote, update remote\n");
 		git_storage_update_progress(translate("gettextFromC", "Push local changes to cloud storage"));
-		return update_remote(repo, origin, local, remote, rt);
+		*push = true;
+		return 0;
 	}
 	/* Merging a bare repository always needs user action */
 	if (git_repository_is_bare(repo)) {
@@ -533,19 +546,19 @@ static int try_to_update(git_repository *repo, git_remote *origin, git_reference
 			return report_error("Local and remote have diverged, merge of bare branch needed");
 	}
 	/* Merging will definitely need the head branch too */
-	if (git_branch_is_head(local) != 1) {
+	if (git_branch_is_head(*local_p) != 1) {
 		if (is_subsurface_cloud)
 			goto cloud_data_error;
 		else
 			return report_error("Local and remote do not match, local branch not HEAD - cannot update");
 	}
 	/* Ok, let's try to merge these */
+	cloud_sync_report_state(CLOUD_SYNC_MERGING);
 	git_storage_update_progress(translate("gettextFromC", "Try to merge local changes into cloud storage"));
-	ret = try_to_git_merge(repo, &local, remote, &base, local_id, remote_id);
+	ret = try_to_git_merge(repo, local_p, remote, &base, local_id, remote_id);
 	if (ret == 0)
-		return update_remote(repo, origin, local, remote, rt);
-	else
-		return ret;
+		*push = true;
+	return ret;
 
 cloud_data_error:
 	// since we are working with Subsurface cloud storage we want to make the user interaction
@@ -554,6 +567,28 @@ cloud_data_error:
 	return cleanup_local_cache(remote_url, branch);
 }
 
+static int try_to_update(git_repository *repo, git_remote *origin, git_reference *local, git_reference *remote,
+			 const char *remote_url, const char *branch, enum remote_transport rt)
+{
+	int ret;
+	bool push = false;
+
+	if (verbose)
+		fprintf(stderr, "git storage: try to update\n");
+
+	if (!git_reference_cmp(local, remote))
+		return 0;
+
+	/* Don't let a local commit change the branch while it is updated, but push without the lock */
+	cloud_sync_lock_cache();
+	ret = update_local_branch(repo, &local, remote, remote_url, branch, &push);
+	cloud_sync_unlock_cache();
+	if (ret || !push)
+		return ret;
+	cloud_sync_report_state(CLOUD_SYNC_PUSHING);
+	return update_remote(repo, origin, local, remote, rt);
+}
+
 static int check_remote_status(git_repository *repo, git_remote *origin, const char *remote, const char *branch, enum remote_transport rt)
 {
 	int error = 0;
@@ -582,6 +617,7 @@ static int check_remote_status(git_repository *repo, git_remote *origin, const c
 		else if (rt == RT_HTTPS)
 			opts.callbacks.credentials = credential_https_cb;
 		opts.callbacks.certificate_check = certificate_check_cb;
+		cloud_sync_report_state(CLOUD_SYNC_PUSHING);
 		git_storage_update_progress(translate("gettextFromC", "Store data into cloud storage"));
 		error = git_remote_push(origin, &refspec, &opts);
 	} else {
@@ -592,14 +628,51 @@ static int check_remote_status(git_repository *repo, git_remote *origin, const c
 	return error;
 }
 
-int sync_with_remote(git_repository *repo, const char *remote, const char *branch, enum remote_transport rt)
+static void get_branch_id(git_repository *repo, const char *branch, git_oid *id)
+{
+	git_reference *ref;
+
+	memset(id, 0, sizeof(*id));
+	if (git_branch_lookup(&ref, repo, branch, GIT_BRANCH_LOCAL))
+		return;
+	if (git_reference_target(ref))
+		git_oid_cpy(id, git_reference_target(ref));
+	git_reference_free(ref);
+}
+
+/*
+ * Get the commits of the local branch before and after the last foreground
+ * sync with the remote, so that the caller can find out what changed.
+ * Returns true if the sync updated the local branch.
+ */
+bool get_last_sync(git_oid *old_id, git_oid *new_id)
+{
+	if (old_id)
+		git_oid_cpy(old_id, &sync_old_id);
+	if (new_id)
+		git_oid_cpy(new_id, &sync_new_id);
+	return !git_oid_equal(&sync_old_id, &sync_new_id);
+}
+
+/*
+ * In the background, the sync ignores git_local_only and a failed fetch
+ * is an error, which is only reported as CLOUD_SYNC_FAILED by the sync
+ * thread. Notably, it must not switch the UI to offline mode. In the
+ * foreground, a failed fetch switches to offline mode.
+ * The commits of the local branch before and after the sync are returned
+ * in old_id and new_id.
+ */
+static int do_sync_with_remote(git_repository *repo, const char *remote, const char *branch, enum remote_transport rt,
+			       bool background, git_oid *old_id, git_oid *new_id)
 {
 	int error;
 	git_remote *origin;
 	char *proxy_string;
 	git_config *conf;
 
-	if (git_local_only) {
+	get_branch_id(repo, branch, old_id);
+	git_oid_cpy(new_id, old_id);
+	if (git_local_only && !background) {
 		if (verbose)
 			fprintf(stderr, "don't sync with remote - read from cache only\n");
 		return 0;
@@ -627,10 +700,13 @@ int sync_with_remote(git_repository *repo, const char *remote, const char *branc
 	if (error) {
 		if (!is_subsurface_cloud)
 			report_error("Repository '%s' origin lookup failed (%s)", remote, giterr_last()->message);
-		return 0;
+		return background ? -1 : 0;
 	}
 
-	if (is_subsurface_cloud && !canReachCloudServer()) {
+	if (is_subsurface_cloud && !canReachCloudServer(!background)) {
+		git_remote_free(origin);
+		if (background)
+			return -1;
 		// this is not an error, just a warning message, so return 0
 		report_error("Cannot connect to cloud server, working with local copy");
 		git_storage_update_progress(translate("gettextFromC", "Can't reach cloud server, working with local data"));
@@ -638,6 +714,7 @@ int sync_with_remote(git_repository *repo, const char *remote, const char *branc
 	}
 	if (verbose)
 		fprintf(stderr, "git storage: fetch remote\n");
+	cloud_sync_report_state(CLOUD_SYNC_FETCHING);
 	git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
 	opts.callbacks.transfer_progress = &transfer_progress_cb;
 	auth_attempt = 0;
@@ -650,26 +727,64 @@ int sync_with_remote(git_repository *repo, const char *remote, const char *branc
 	error = git_remote_fetch(origin, NULL, &opts, NULL);
 	// NOTE! A fetch error is not fatal, we just report it
 	if (error) {
-		if (is_subsurface_cloud)
-			report_error("Cannot sync with cloud server, working with offline copy");
-		else
-			report_error("Unable to fetch remote '%s'", remote);
 		if (verbose)
 			// If we returned GIT_EUSER during authentication, giterr_last() returns NULL
 			fprintf(stderr, "remote fetch failed (%s)\n",
 				giterr_last() ? giterr_last()->message : "authentication failed");
-		// Since we failed to sync with online repository, enter offline mode
-		git_local_only = true;
-		error = 0;
+		// In the background, the sync thread reports the failure. In the foreground,
+		// since we failed to sync with online repository, enter offline mode
+		if (background) {
+			error = -1;
+		} else {
+			if (is_subsurface_cloud)
+				report_error("Cannot sync with cloud server, working with offline copy");
+			else
+				report_error("Unable to fetch remote '%s'", remote);
+			git_local_only = true;
+			error = 0;
+		}
 	} else {
 		error = check_remote_status(repo, origin, remote, branch, rt);
+		/* try_to_update() may have reset or merged the local branch */
+		get_branch_id(repo, branch, new_id);
 	}
 	git_remote_free(origin);
 	git_storage_update_progress(translate("gettextFromC", "Done syncing with cloud storage"));
 	return error;
 }
 
-static git_repository *update_local_repo(const char *localdir, const char *remote, const char *branch, enum remote_transport rt)
+int sync_with_remote(git_repository *repo, const char *remote, const char *branch, enum remote_transport rt)
+{
+	return do_sync_with_remote(repo, remote, branch, rt, false, &sync_old_id, &sync_new_id);
+}
+
+/*
+ * Sync the local cache of a remote repository with the remote. This is
+ * what the background sync thread runs (see cloudsync.cpp), so it opens
+ * its own handle of the local cache. The commits of the local branch
+ * before and after the sync are returned in old_id and new_id.
+ */
+int sync_local_cache(const char *remote, const char *branch, git_oid *old_id, git_oid *new_id)
+{
+	int error;
+	git_repository *repo;
+	char *localdir = get_local_dir(remote, branch);
+
+	memset(old_id, 0, sizeof(*old_id));
+	memset(new_id, 0, sizeof(*new_id));
+	error = git_repository_open(&repo, localdir);
+	if (error) {
+		report_error("Unable to open git cache repository at %s: %s", localdir, giterr_last()->message);
+		free(localdir);
+		return -1;
+	}
+	free(localdir);
+	error = do_sync_with_remote(repo, remote, branch, url_to_remote_transport(remote), true, old_id, new_id);
+	git_repository_free(repo);
+	return error;
+}
+
+static git_repository *update_local_repo(const char *localdir, const char *remote, const char *branch, enum remote_transport rt, bool commit_only)
 {
 	int error;
 	git_repository *repo = NULL;
@@ -685,7 +800,7 @@ static git_repository *update_local_repo(const char *localdir, const char *remot
 			report_error("Unable to open git cache repository at %s: %s", localdir, giterr_last()->message);
 		return NULL;
 	}
-	if (!git_local_only)
+	if (!git_local_only && !commit_only)
 		sync_with_remote(repo, remote, branch, rt);
 
 	return repo;
@@ -776,7 +891,7 @@ static git_repository *create_local_repo(const char *localdir, const char *remot
 	opts.fetch_opts.callbacks.certificate_check = certificate_check_cb;
 
 	opts.checkout_branch = branch;
-	if (is_subsurface_cloud && !canReachCloudServer())
+	if (is_subsurface_cloud && !canReachCloudServer(true))
 		return 0;
 	if (verbose > 1)
 		fprintf(stderr, "git storage: calling git_clone()\n");
@@ -821,14 +936,29 @@ enum remote_transport url_to_remote_transport(const char *remote)
 		return RT_OTHER;
 }
 
-static struct git_repository *get_remote_repo(const char *localdir, const char *remote, const char *branch)
+/*
+ * With the background sync, a save only commits to the local cache and
+ * leaves the sync to the sync thread (see do_git_save()). Such a commit
+ * neither syncs nor waits for a running sync. Only the commit itself and
+ * the update of the local branch by the sync exclude each other (see
+ * cloud_sync_lock_cache()), the fetch and the push run in parallel. All
+ * other accesses of the local cache wait for the sync thread, so that they
+ * see a consistent cache.
+ */
+static struct git_repository *get_remote_repo(const char *localdir, const char *remote, const char *branch, bool for_save)
 {
 	struct stat st;
 	enum remote_transport rt = url_to_remote_transport(remote);
+	bool commit_only = for_save && cloud_sync_in_background;
 
 	if (verbose > 1) {
 		fprintf(stderr, "git_remote_repo: accessing %s\n", remote);
 	}
+	/* A local commit only needs the existing local cache */
+	if (commit_only && !subsurface_stat(localdir, &st) && S_ISDIR(st.st_mode))
+		return update_local_repo(localdir, remote, branch, rt, true);
+	/* Don't touch the local cache while a background sync updates it */
+	cloud_sync_wait();
 	git_storage_update_progress(translate("gettextFromC", "Synchronising data file"));
 	/* Do we already have a local cache? */
 	if (!subsurface_stat(localdir, &st)) {
@@ -839,7 +969,7 @@ static struct git_repository *get_remote_repo(const char *localdir, const char *
 				report_error("local git cache at '%s' is corrupt");
 			return NULL;
 		}
-		return update_local_repo(localdir, remote, branch, rt);
+		return update_local_repo(localdir, remote, branch, rt, false);
 	} else {
 		/* We have no local cache yet.
 		 * Take us temporarly online to create a local and
@@ -867,7 +997,7 @@ static struct git_repository *get_remote_repo(const char *localdir, const char *
  *    https://host/repo[branch]
  *    file://repo[branch]
  */
-static struct git_repository *is_remote_git_repository(char *remote, const char *branch)
+static struct git_repository *is_remote_git_repository(char *remote, const char *branch, bool for_save)
 {
 	char c, *localdir;
 	char *p = remote;
@@ -927,7 +1057,7 @@ static struct git_repository *is_remote_git_repository(char *remote, const char
 	 * this is used to create more user friendly error message and warnings */
 	is_subsurface_cloud = strstr(remote, prefs.cloud_git_url) != NULL;
 
-	return get_remote_repo(localdir, remote, branch);
+	return get_remote_repo(localdir, remote, branch, for_save);
 }
 
 /*
@@ -998,7 +1128,8 @@ struct git_repository *is_git_repository(const char *filename, const char **bran
 		*remote = loc;
 		return dummy_git_repository;
 	}
-	repo = is_remote_git_repository(loc, branch);
+	/* Only save_dives() asks for the remote */
+	repo = is_remote_git_repository(loc, branch, remote != NULL);
 	if (repo) {
 		if (remote)
 			*remote = loc;
@@ -18,12 +18,16 @@ struct git_repository;
 extern struct git_repository *is_git_repository(const char *filename, const char **branchp, const char **remote, bool dry_run);
 extern int check_git_sha(const char *filename, git_repository **git_p, const char **branch_p);
 extern int sync_with_remote(struct git_repository *repo, const char *remote, const char *branch, enum remote_transport rt);
+extern bool get_last_sync(git_oid *old_id, git_oid *new_id);
+extern int sync_local_cache(const char *remote, const char *branch, git_oid *old_id, git_oid *new_id);
 extern int git_save_dives(struct git_repository *, const char *, const char *remote, bool select_only);
 extern int git_load_dives(struct git_repository *, const char *);
+extern int git_reload_dives(struct git_repository *, const char *);
 extern const char *get_sha(git_repository *repo, const char *branch);
 extern int do_git_save(git_repository *repo, const char *branch, const char *remote, bool select_only, bool create_empty);
 extern const char *saved_git_id;
 extern bool git_local_only;
+extern bool is_subsurface_cloud;
 extern void clear_git_id(void);
 extern void set_git_id(const struct git_oid *);
 extern enum remote_transport url_to_remote_transport(const char *remote);
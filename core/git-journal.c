@@ -0,0 +1,533 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifdef __clang__
+// Clang has a bug on zero-initialization of C structs.
+#pragma clang diagnostic ignored "-Wmissing-field-initializers"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <git2.h>
+
+#include "dive.h"
+#include "divelist.h"
+#include "file.h"
+#include "membuffer.h"
+#include "git-journal.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ * The journal holds a single entry, which describes all changes since the
+ * base, i.e. the loaded or last committed dives. Every write replaces that
+ * entry, so the journal doesn't grow with the number of edits:
+ *
+ *	journal <length of the rest of the entry> <SHA1 of the rest of the entry>
+ *	removed <git id of a dive of the base that was deleted or changed>
+ *	site <uuid of a dive site that is saved below>
+ *	removed-site <uuid of a dive site of the base that was deleted>
+ *
+ *	<divelog> with the new and changed dives, their trips and the saved dive sites </divelog>
+ *
+ * The entry is first written to "<journal>.new", which then replaces the
+ * journal. An entry that was cut short by a crash fails the checksum and
+ * the previous entry is replayed instead.
+ *
+ * A dive that was moved to another trip, and all dives of a trip whose
+ * notes, location or dives changed, count as changed. Thus a changed
+ * trip is always saved as a whole.
+ */
+
+struct tree_id {
+	unsigned char id[20];
+	dive_trip_t *trip;
+};
+
+struct base_trip {
+	dive_trip_t *trip;
+	int nr;
+	unsigned char hash[20];
+};
+
+struct base_site {
+	uint32_t uuid;
+	unsigned char hash[20];
+};
+
+/* The git ids of the dives of the base sorted by id, and the trips and dive sites of the base */
+static struct tree_id *base_ids;
+static int base_nr;
+static struct base_trip *base_trips;
+static int base_trip_nr;
+static struct base_site *base_sites;
+static int base_site_nr;
+
+static int comp_tree_ids(const void *a, const void *b)
+{
+	return memcmp(((const struct tree_id *)a)->id, ((const struct tree_id *)b)->id, 20);
+}
+
+/* Sort by address; the base trips start with the trip pointer */
+static int comp_pointers(const void *a, const void *b)
+{
+	uintptr_t p1 = (uintptr_t)*(void *const *)a;
+	uintptr_t p2 = (uintptr_t)*(void *const *)b;
+	return p1 < p2 ? -1 : p1 > p2;
+}
+
+static int comp_base_sites(const void *a, const void *b)
+{
+	uint32_t u1 = ((const struct base_site *)a)->uuid;
+	uint32_t u2 = ((const struct base_site *)b)->uuid;
+	return u1 < u2 ? -1 : u1 > u2;
+}
+
+/* Find the first of the sorted ids that is equal to the given id */
+static int find_tree_id(const struct tree_id *ids, int nr, const unsigned char *id)
+{
+	int low = 0, high = nr;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (memcmp(ids[mid].id, id, 20) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low < nr && !memcmp(ids[low].id, id, 20) ? low : -1;
+}
+
+/* Find an id in the sorted ids that isn't used yet, and mark it as used */
+static int use_tree_id(const struct tree_id *ids, int nr, bool *used, const unsigned char *id)
+{
+	int i = find_tree_id(ids, nr, id);
+
+	for (; i >= 0 && i < nr && !memcmp(ids[i].id, id, 20); i++) {
+		if (!used[i]) {
+			used[i] = true;
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void hash_string(SHA_CTX *ctx, const char *s)
+{
+	if (s)
+		SHA1_Update(ctx, s, strlen(s));
+	SHA1_Update(ctx, "", 1);
+}
+
+static void hash_trip(const dive_trip_t *trip, unsigned char *hash)
+{
+	SHA_CTX ctx;
+
+	SHA1_Init(&ctx);
+	hash_string(&ctx, trip->location);
+	hash_string(&ctx, trip->notes);
+	SHA1_Update(&ctx, &trip->autogen, sizeof(trip->autogen));
+	SHA1_Final(hash, &ctx);
+}
+
+static void hash_dive_site(const struct dive_site *ds, unsigned char *hash)
+{
+	int i;
+	SHA_CTX ctx;
+
+	SHA1_Init(&ctx);
+	hash_string(&ctx, ds->name);
+	hash_string(&ctx, ds->description);
+	hash_string(&ctx, ds->notes);
+	SHA1_Update(&ctx, &ds->location.lat.udeg, sizeof(ds->location.lat.udeg));
+	SHA1_Update(&ctx, &ds->location.lon.udeg, sizeof(ds->location.lon.udeg));
+	for (i = 0; i < ds->taxonomy.nr; i++) {
+		const struct taxonomy *t = &ds->taxonomy.category[i];
+		SHA1_Update(&ctx, &t->category, sizeof(t->category));
+		SHA1_Update(&ctx, &t->origin, sizeof(t->origin));
+		hash_string(&ctx, t->value);
+	}
+	SHA1_Final(hash, &ctx);
+}
+
+static const struct base_trip *find_base_trip(const dive_trip_t *trip)
+{
+	return bsearch(&trip, base_trips, base_trip_nr, sizeof(*base_trips), comp_pointers);
+}
+
+static const struct base_site *find_base_site(uint32_t uuid)
+{
+	struct base_site key = { uuid };
+	return bsearch(&key, base_sites, base_site_nr, sizeof(*base_sites), comp_base_sites);
+}
+
+/* Was the dive, which is unchanged itself, moved to another trip since the base? */
+static bool dive_moved(const struct dive *dive)
+{
+	int i;
+
+	if (!dive_cache_is_valid(dive))
+		return false;
+	i = find_tree_id(base_ids, base_nr, dive->git_id);
+	return i >= 0 && base_ids[i].trip != dive->divetrip;
+}
+
+static bool trip_changed(const dive_trip_t *trip)
+{
+	int i;
+	unsigned char hash[20];
+	const struct base_trip *base = find_base_trip(trip);
+
+	if (!base || base->nr != trip->dives.nr)
+		return true;
+	hash_trip(trip, hash);
+	if (memcmp(hash, base->hash, 20))
+		return true;
+	for (i = 0; i < trip->dives.nr; i++) {
+		if (dive_moved(trip->dives.dives[i]))
+			return true;
+	}
+	return false;
+}
+
+/* The journal of a dive log is kept in the data directory, named after a hash of the file name */
+char *get_journal_name(const char *filename)
+{
+	SHA_CTX ctx;
+	unsigned char hash[20];
+
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, filename, strlen(filename));
+	SHA1_Final(hash, &ctx);
+
+	return format_string("%s/journal-%02x%02x%02x%02x%02x%02x%02x%02x",
+			system_default_directory(),
+			hash[0], hash[1], hash[2], hash[3],
+			hash[4], hash[5], hash[6], hash[7]);
+}
+
+static void sha1_hex(const char *data, unsigned int len, char *hex)
+{
+	SHA_CTX ctx;
+	git_oid oid;
+
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, data, len);
+	SHA1_Final(oid.id, &ctx);
+	git_oid_tostr(hex, GIT_OID_HEXSZ + 1, &oid);
+}
+
+void git_journal_set_base(void)
+{
+	int i;
+	struct dive *dive;
+	dive_trip_t *trip;
+	struct dive_site *ds;
+
+	free(base_ids);
+	base_ids = malloc((dive_table.nr + 1) * sizeof(*base_ids));
+	base_nr = 0;
+	for_each_dive (i, dive) {
+		if (!dive_cache_is_valid(dive))
+			continue;
+		memcpy(base_ids[base_nr].id, dive->git_id, 20);
+		base_ids[base_nr++].trip = dive->divetrip;
+	}
+	qsort(base_ids, base_nr, sizeof(*base_ids), comp_tree_ids);
+
+	free(base_trips);
+	base_trips = malloc((trip_table.nr + 1) * sizeof(*base_trips));
+	base_trip_nr = trip_table.nr;
+	for (i = 0; i < trip_table.nr; i++) {
+		trip = trip_table.trips[i];
+		base_trips[i].trip = trip;
+		base_trips[i].nr = trip->dives.nr;
+		hash_trip(trip, base_trips[i].hash);
+	}
+	qsort(base_trips, base_trip_nr, sizeof(*base_trips), comp_pointers);
+
+	free(base_sites);
+	base_sites = malloc((dive_site_table.nr + 1) * sizeof(*base_sites));
+	base_site_nr = 0;
+	for_each_dive_site (i, ds) {
+		base_sites[base_site_nr].uuid = ds->uuid;
+		hash_dive_site(ds, base_sites[base_site_nr++].hash);
+	}
+	qsort(base_sites, base_site_nr, sizeof(*base_sites), comp_base_sites);
+}
+
+static char *get_new_journal_name(const char *name)
+{
+	return format_string("%s.new", name);
+}
+
+static int write_file(const char *name, struct membuffer *entry)
+{
+	int fd, ret = 0;
+
+	fd = subsurface_open(name, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (fd < 0)
+		return report_error("Failed to open journal %s", name);
+	if (write(fd, entry->buffer, entry->len) != (ssize_t)entry->len)
+		ret = report_error("Failed to write journal %s", name);
+#ifndef WIN32
+	else if (fsync(fd) < 0)
+		ret = report_error("Failed to write journal %s", name);
+#endif
+	if (close(fd) < 0 && !ret)
+		ret = report_error("Failed to write journal %s", name);
+	return ret;
+}
+
+static int write_entry(const char *name, struct membuffer *entry)
+{
+	int ret;
+	char *new_name = get_new_journal_name(name);
+
+	ret = write_file(new_name, entry);
+	/*
+	 * Windows doesn't rename onto an existing file. Then the journal is
+	 * overwritten in place, and the new file, which is replayed first,
+	 * covers a crash while doing so.
+	 */
+	if (!ret && subsurface_rename(new_name, name))
+		ret = write_file(name, entry);
+	free(new_name);
+	return ret;
+}
+
+static void add_dive_site_to_journal(struct dive_site_table *sites, struct membuffer *b, struct dive_site *ds)
+{
+	put_format(b, "site %08x\n", ds->uuid);
+	sites->dive_sites[sites->nr++] = ds;
+}
+
+/* Replace the journal by the changes since the base and make sure they are on disk */
+int git_journal_write(const char *filename)
+{
+	int i, j, ret;
+	struct dive *dive;
+	struct dive_site *ds;
+	struct dive_table changed = { 0 };
+	struct dive_site_table sites = { 0 };
+	struct membuffer payload = { 0 }, entry = { 0 };
+	bool *kept = calloc(base_nr + 1, sizeof(bool));
+	bool *kept_sites = calloc(base_site_nr + 1, sizeof(bool));
+	dive_trip_t **changed_trips = malloc((trip_table.nr + 1) * sizeof(*changed_trips));
+	int changed_trip_nr = 0;
+	char hex[GIT_OID_HEXSZ + 1], *name;
+	git_oid oid;
+
+	for (i = 0; i < trip_table.nr; i++) {
+		if (trip_changed(trip_table.trips[i]))
+			changed_trips[changed_trip_nr++] = trip_table.trips[i];
+	}
+	qsort(changed_trips, changed_trip_nr, sizeof(*changed_trips), comp_pointers);
+
+	/*
+	 * The dives that aren't in the base were added or changed. The dives
+	 * of changed trips and moved dives are saved even if they are in the
+	 * base, so their ids aren't marked as kept...
+	 */
+	for_each_dive (i, dive) {
+		if (!dive_cache_is_valid(dive) ||
+		    (dive->divetrip && bsearch(&dive->divetrip, changed_trips, changed_trip_nr, sizeof(*changed_trips), comp_pointers)) ||
+		    dive_moved(dive) ||
+		    use_tree_id(base_ids, base_nr, kept, dive->git_id) < 0) {
+			struct dive **dives = grow_dive_table(&changed);
+			dives[changed.nr++] = dive;
+		}
+	}
+	/* ...and the dives of the base that weren't found were deleted or changed */
+	for (i = 0; i < base_nr; i++) {
+		if (kept[i])
+			continue;
+		git_oid_fromraw(&oid, base_ids[i].id);
+		git_oid_tostr(hex, sizeof(hex), &oid);
+		put_format(&payload, "removed %s\n", hex);
+	}
+
+	/* Save the dive sites that are new, changed or used by a saved dive */
+	sites.dive_sites = malloc((dive_site_table.nr + 1) * sizeof(*sites.dive_sites));
+	for_each_dive_site (i, ds) {
+		const struct base_site *base = find_base_site(ds->uuid);
+		unsigned char hash[20];
+
+		if (base)
+			kept_sites[base - base_sites] = true;
+		hash_dive_site(ds, hash);
+		if (!base || memcmp(hash, base->hash, 20)) {
+			add_dive_site_to_journal(&sites, &payload, ds);
+			continue;
+		}
+		for (j = 0; j < changed.nr; j++) {
+			if (changed.dives[j]->dive_site == ds) {
+				add_dive_site_to_journal(&sites, &payload, ds);
+				break;
+			}
+		}
+	}
+	for (i = 0; i < base_site_nr; i++) {
+		if (!kept_sites[i])
+			put_format(&payload, "removed-site %08x\n", base_sites[i].uuid);
+	}
+	put_string(&payload, "\n");
+	save_dive_table_buffer(&payload, &changed, &sites);
+
+	sha1_hex(payload.buffer, payload.len, hex);
+	put_format(&entry, "journal %u %s\n", payload.len, hex);
+	put_bytes(&entry, payload.buffer, payload.len);
+
+	name = get_journal_name(filename);
+	ret = write_entry(name, &entry);
+
+	free(name);
+	free_buffer(&entry);
+	free_buffer(&payload);
+	free(changed.dives);
+	free(sites.dive_sites);
+	free(changed_trips);
+	free(kept_sites);
+	free(kept);
+	return ret;
+}
+
+/* Read the entry of a journal file, if it is complete */
+static const char *read_entry(const char *name, struct memblock *mem, unsigned int *len)
+{
+	char sum[GIT_OID_HEXSZ + 1], hex[GIT_OID_HEXSZ + 1];
+	const char *p, *end, *data;
+
+	if (readfile(name, mem) <= 0)
+		goto fail;
+	p = mem->buffer;
+	end = p + mem->size;
+	data = memchr(p, '\n', end - p);
+	if (!data || sscanf(p, "journal %u %40s", len, sum) != 2)
+		goto fail;
+	data++;
+	if (*len > (unsigned int)(end - data))
+		goto fail;
+	sha1_hex(data, *len, hex);
+	if (strcmp(hex, sum))
+		goto fail;
+	return data;
+
+fail:
+	free(mem->buffer);
+	mem->buffer = NULL;
+	return NULL;
+}
+
+int git_journal_replay(const char *filename)
+{
+	int i, ret = 1;
+	unsigned int len;
+	struct memblock mem;
+	struct tree_id *removed = NULL;
+	int removed_nr = 0;
+	uint32_t *removed_sites = NULL;
+	int removed_site_nr = 0;
+	bool *used;
+	const char *entry, *p, *end;
+	struct dive *dive;
+	struct dive_table table = { 0 };
+	struct trip_table trips = { 0 };
+	char *name = get_journal_name(filename);
+	char *new_name = get_new_journal_name(name);
+
+	/* A complete new file wasn't renamed to the journal yet */
+	if (!(entry = read_entry(new_name, &mem, &len)) && !(entry = read_entry(name, &mem, &len))) {
+		free(new_name);
+		free(name);
+		return 0;
+	}
+	end = entry + len;
+
+	/* The list of removed dives and dive sites and saved dive sites ends with an empty line */
+	for (p = entry; p < end && *p != '\n'; p++) {
+		git_oid oid;
+		unsigned int uuid;
+
+		if (!strncmp(p, "removed ", 8) && !git_oid_fromstrn(&oid, p + 8, GIT_OID_HEXSZ)) {
+			removed = realloc(removed, (removed_nr + 1) * sizeof(*removed));
+			memcpy(removed[removed_nr++].id, oid.id, 20);
+		} else if (sscanf(p, "removed-site %x", &uuid) == 1) {
+			removed_sites = realloc(removed_sites, (removed_site_nr + 1) * sizeof(*removed_sites));
+			removed_sites[removed_site_nr++] = uuid;
+		} else if (sscanf(p, "site %x", &uuid) == 1) {
+			/* The saved dive site replaces the loaded one */
+			struct dive_site *ds = get_dive_site_by_uuid(uuid);
+			if (ds) {
+				clear_dive_site(ds);
+				ds->uuid = uuid;
+			}
+		}
+		p = memchr(p, '\n', end - p);
+		if (!p)
+			break;
+	}
+	if (!p || p >= end) {
+		report_error("Journal %s is damaged", name);
+		ret = -1;
+		goto out;
+	}
+	p++;
+
+	qsort(removed, removed_nr, sizeof(*removed), comp_tree_ids);
+	used = calloc(removed_nr + 1, sizeof(bool));
+	for (i = dive_table.nr - 1; i >= 0; i--) {
+		dive = get_dive(i);
+		if (dive_cache_is_valid(dive) && use_tree_id(removed, removed_nr, used, dive->git_id) >= 0)
+			delete_single_dive(i);
+	}
+	free(used);
+
+	/* Only now that the removed dives are gone, their dive sites are unused */
+	for (i = 0; i < removed_site_nr; i++) {
+		struct dive_site *ds = get_dive_site_by_uuid(removed_sites[i]);
+		if (ds && !is_dive_site_used(ds, false))
+			delete_dive_site(ds);
+	}
+
+	if (parse_xml_buffer(name, p, end - p, &table, &trips, NULL)) {
+		report_error("Failed to read the dives of journal %s", name);
+		ret = -1;
+	} else {
+		add_imported_dives(&table, &trips, true, false, true);
+	}
+	free(table.dives);
+	free(trips.trips);
+	mark_divelist_changed(true);
+
+out:
+	free(removed);
+	free(removed_sites);
+	free(mem.buffer);
+	free(new_name);
+	free(name);
+	return ret;
+}
+
+static void truncate_file(const char *name)
+{
+	int fd = subsurface_open(name, O_WRONLY | O_TRUNC | O_BINARY, 0);
+
+	if (fd >= 0)
+		close(fd);
+}
+
+/* The changes were committed, start a new journal */
+void git_journal_clear(const char *filename)
+{
+	char *name = get_journal_name(filename);
+	char *new_name = get_new_journal_name(name);
+
+	truncate_file(new_name);
+	truncate_file(name);
+	free(new_name);
+	free(name);
+}
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef GITJOURNAL_H
+#define GITJOURNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A write-behind journal for git storage: every change is appended to
+ * a small file right away, and many changes are folded into one commit
+ * later. The journal of a repository is identified by its file name.
+ *
+ * git_journal_set_base() has to be called after the dives were loaded
+ * from or committed to git, since the journal only contains what changed
+ * since then. git_journal_replay() applies the journal to the loaded
+ * dives and returns 1 if there was something to replay.
+ * get_journal_name() returns the malloc()ed path of the journal.
+ */
+extern char *get_journal_name(const char *filename);
+extern void git_journal_set_base(void);
+extern int git_journal_write(const char *filename);
+extern int git_journal_replay(const char *filename);
+extern void git_journal_clear(const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GITJOURNAL_H
@@ -215,6 +215,7 @@ static void copy_gps_location(struct gpsTracker &gps, struct dive *d)
 		d->dive_site = ds;
 	}
 	ds->location = gps.location;
+	invalidate_dive_cache(d);
 }
 
 #define SAME_GROUP 6 * 3600 /* six hours */
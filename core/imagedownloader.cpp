@@ -4,9 +4,11 @@
 #include "divelist.h"
 #include "qthelper.h"
 #include "imagedownloader.h"
+#include "thumbnailcache.h"
 #include "videoframeextractor.h"
 #include "qt-models/divepicturemodel.h"
 #include "metadata.h"
+#include "trace.h"
 #include <unistd.h>
 #include <QString>
 #include <QImageReader>
@@ -16,6 +18,9 @@
 
 #include <QtConcurrent>
 
+// Maximum size of the in-memory thumbnail cache in kB
+static const int memoryCacheSize = 64 * 1024;
+
 // Note: this is a global instead of a function-local variable on purpose.
 // We don't want this to be generated in a different thread context if
 // ImageDownloader::instance() is called from a worker thread.
@@ -185,11 +190,12 @@ Thumbnailer::Thumbnailer() : failImage(renderIcon(":filter-close", maxThumbnailS
 	// Currently, we only process one image at a time. Stefan Fuchs reported problems when
 	// calculating multiple thumbnails at once and this hopefully helps.
 	pool.setMaxThreadCount(1);
+	memoryCache.setMaxCost(memoryCacheSize);
 	connect(ImageDownloader::instance(), &ImageDownloader::loaded, this, &Thumbnailer::imageDownloaded);
 	connect(ImageDownloader::instance(), &ImageDownloader::failed, this, &Thumbnailer::imageDownloadFailed);
 	connect(VideoFrameExtractor::instance(), &VideoFrameExtractor::extracted, this, &Thumbnailer::frameExtracted);
 	connect(VideoFrameExtractor::instance(), &VideoFrameExtractor::failed, this, &Thumbnailer::frameExtractionFailed);
-	connect(VideoFrameExtractor::instance(), &VideoFrameExtractor::failed, this, &Thumbnailer::frameExtractionInvalid);
+	connect(VideoFrameExtractor::instance(), &VideoFrameExtractor::invalid, this, &Thumbnailer::frameExtractionInvalid);
 }
 
 Thumbnailer *Thumbnailer::instance()
@@ -250,38 +256,35 @@ Thumbnailer::Thumbnail Thumbnailer::getVideoThumbnailFromStream(QDataStream &str
 	return { res, MEDIATYPE_VIDEO, (int32_t)duration };
 }
 
-// Fetch a thumbnail from cache.
-// If Thumbnail::QImage is null, the thumbnail is scheduled for recreation.
-Thumbnailer::Thumbnail Thumbnailer::getThumbnailFromCache(const QString &picture_filename)
+// Returns true if the picture was modified after the thumbnail was written
+// and the user asked for thumbnails to be recalculated in that case.
+static bool thumbnailIsStale(const QString &picture_filename, const QDateTime &thumbnailTime)
 {
-	QString filename = thumbnailFileName(picture_filename);
-	if (filename.isEmpty())
-		return { QImage(), MEDIATYPE_UNKNOWN, 0 };
-	QFile file(filename);
-
-	if (prefs.auto_recalculate_thumbnails) {
-		// Check if thumbnails is older than the (local) image file
-		QString filenameLocal = localFilePath(qPrintable(picture_filename));
-		QFileInfo pictureInfo(filenameLocal);
-		QFileInfo thumbnailInfo(file);
-		if (pictureInfo.exists() && thumbnailInfo.exists()) {
-			QDateTime pictureTime = pictureInfo.lastModified();
-			QDateTime thumbnailTime = thumbnailInfo.lastModified();
-			if (pictureTime.isValid() && thumbnailTime.isValid() && thumbnailTime < pictureTime) {
-				// Both files exist, have valid timestamps and thumbnail was calculated before picture.
-				// Return an empty thumbnail to signal recalculation of the thumbnail
-				return { QImage(), MEDIATYPE_UNKNOWN, 0 };
-			}
-		}
-	}
+	if (!prefs.auto_recalculate_thumbnails || !thumbnailTime.isValid())
+		return false;
+	QFileInfo pictureInfo(localFilePath(picture_filename));
+	if (!pictureInfo.exists())
+		return false;
+	QDateTime pictureTime = pictureInfo.lastModified();
+	return pictureTime.isValid() && thumbnailTime < pictureTime;
+}
 
-	if (!file.open(QIODevice::ReadOnly))
-		return { QImage(), MEDIATYPE_UNKNOWN, 0 };
-	QDataStream stream(&file);
+// Add thumbnail to the LRU-cache of decoded thumbnails. The cost is the size of the image in kB.
+void Thumbnailer::addToMemoryCache(const QString &picture_filename, const Thumbnail &thumbnail)
+{
+	if (thumbnail.img.isNull())
+		return;
+	int cost = std::max(thumbnail.img.bytesPerLine() * thumbnail.img.height() / 1024, 1);
+	QMutexLocker l(&lock);
+	memoryCache.insert(picture_filename, new Thumbnail(thumbnail), cost);
+}
 
-	// Each thumbnail file is composed of a media-type and an image file.
+// Decode a serialized thumbnail.
+// Each thumbnail is composed of a media-type and an image file.
+Thumbnailer::Thumbnail Thumbnailer::getThumbnailFromData(const QByteArray &data, const QString &picture_filename)
+{
+	QDataStream stream(data);
 	quint32 type;
-	QImage res;
 	stream >> type;
 
 	switch (type) {
@@ -292,6 +295,56 @@ Thumbnailer::Thumbnail Thumbnailer::getThumbnailFromCache(const QString &picture
 	}
 }
 
+// Fetch a thumbnail from cache.
+// First, the in-memory cache of decoded thumbnails is searched, then the pack file.
+// Thumbnails written by older versions as individual files are moved into the pack file.
+// If Thumbnail::QImage is null, the thumbnail is scheduled for recreation.
+Thumbnailer::Thumbnail Thumbnailer::getThumbnailFromCache(const QString &picture_filename)
+{
+	if (picture_filename.isEmpty())
+		return { QImage(), MEDIATYPE_UNKNOWN, 0 };
+
+	{
+		QMutexLocker l(&lock);
+		if (Thumbnail *thumbnail = memoryCache.object(picture_filename))
+			return *thumbnail;
+	}
+
+	ThumbnailCache::Entry entry = ThumbnailCache::instance()->read(picture_filename);
+	bool legacy = entry.data.isEmpty();
+	if (legacy) {
+		QFile file(thumbnailFileName(picture_filename));
+		if (!file.open(QIODevice::ReadOnly))
+			return { QImage(), MEDIATYPE_UNKNOWN, 0 };
+		entry.data = file.readAll();
+		entry.written = QFileInfo(file).lastModified();
+	}
+
+	// Return an empty thumbnail to signal recalculation of the thumbnail
+	if (thumbnailIsStale(picture_filename, entry.written))
+		return { QImage(), MEDIATYPE_UNKNOWN, 0 };
+
+	if (legacy) {
+		ThumbnailCache::instance()->write(picture_filename, entry.data);
+		QFile::remove(thumbnailFileName(picture_filename));
+	}
+
+	Thumbnail res = getThumbnailFromData(entry.data, picture_filename);
+	addToMemoryCache(picture_filename, res);
+	return res;
+}
+
+// Store serialized thumbnail in the pack file and the decoded thumbnail in the memory cache.
+Thumbnailer::Thumbnail Thumbnailer::writeThumbnailToCache(const QString &picture_filename, const QByteArray &data,
+							  const Thumbnail &thumbnail)
+{
+	if (!picture_filename.isEmpty()) {
+		ThumbnailCache::instance()->write(picture_filename, data);
+		addToMemoryCache(picture_filename, thumbnail);
+	}
+	return thumbnail;
+}
+
 Thumbnailer::Thumbnail Thumbnailer::addVideoThumbnailToCache(const QString &picture_filename, duration_t duration,
 							     const QImage &image, duration_t position)
 {
@@ -302,26 +355,24 @@ Thumbnailer::Thumbnail Thumbnailer::addVideoThumbnailToCache(const QString &pict
 	//	for each picture:
 	//		uint32	offset in msec from begining of video
 	//		QImage	frame
-	QString filename = thumbnailFileName(picture_filename);
-	QSaveFile file(filename);
-	if (file.open(QIODevice::WriteOnly)) {
-		QDataStream stream(&file);
-
-		stream << (quint32)MEDIATYPE_VIDEO;
-		stream << (quint32)duration.seconds;
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
 
-		if (image.isNull()) {
-			// No image provided
-			stream << (quint32)0;
-		} else {
-			// Currently, we support at most one image
-			stream << (quint32)1;
-			stream << (quint32)position.seconds;
-			stream << image;
-		}
+	stream << (quint32)MEDIATYPE_VIDEO;
+	stream << (quint32)duration.seconds;
 
-		file.commit();
+	if (image.isNull()) {
+		// No image provided
+		stream << (quint32)0;
+	} else {
+		// Currently, we support at most one image
+		stream << (quint32)1;
+		stream << (quint32)position.seconds;
+		stream << image;
 	}
+
+	// Remember the frame (which is already marked as video) or the place holder in the memory cache
+	writeThumbnailToCache(picture_filename, data, { image.isNull() ? videoImage : image, MEDIATYPE_VIDEO, duration });
 	return { videoImage, MEDIATYPE_VIDEO, duration };
 }
 
@@ -344,27 +395,20 @@ Thumbnailer::Thumbnail Thumbnailer::addPictureThumbnailToCache(const QString &pi
 	// The format of a picture-thumbnail is very simple:
 	// 	uint32	MEDIATYPE_PICTURE
 	// 	QImage	thumbnail
-	QString filename = thumbnailFileName(picture_filename);
-	QSaveFile file(filename);
-	if (file.open(QIODevice::WriteOnly)) {
-		QDataStream stream(&file);
-
-		stream << (quint32)MEDIATYPE_PICTURE;
-		stream << thumbnail;
-		file.commit();
-	}
-	return { thumbnail, MEDIATYPE_PICTURE, 0 };
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+
+	stream << (quint32)MEDIATYPE_PICTURE;
+	stream << thumbnail;
+	return writeThumbnailToCache(picture_filename, data, { thumbnail, MEDIATYPE_PICTURE, 0 });
 }
 
 Thumbnailer::Thumbnail Thumbnailer::addUnknownThumbnailToCache(const QString &picture_filename)
 {
-	QString filename = thumbnailFileName(picture_filename);
-	QSaveFile file(filename);
-	if (file.open(QIODevice::WriteOnly)) {
-		QDataStream stream(&file);
-		stream << (quint32)MEDIATYPE_UNKNOWN;
-	}
-	return { unknownImage, MEDIATYPE_UNKNOWN, 0 };
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+	stream << (quint32)MEDIATYPE_UNKNOWN;
+	return writeThumbnailToCache(picture_filename, data, { unknownImage, MEDIATYPE_UNKNOWN, 0 });
 }
 
 void Thumbnailer::frameExtracted(QString filename, QImage thumbnail, duration_t duration, duration_t offset)
@@ -407,6 +451,7 @@ void Thumbnailer::frameExtractionInvalid(QString filename, duration_t)
 
 void Thumbnailer::recalculate(QString filename)
 {
+	TraceSpan span("recalculateThumbnail");
 	Thumbnail thumbnail = getHashedImage(filename, true);
 
 	// If we couldn't load the image from disk -> leave old thumbnail.
@@ -422,6 +467,7 @@ void Thumbnailer::recalculate(QString filename)
 
 void Thumbnailer::processItem(QString filename, bool tryDownload)
 {
+	TraceSpan span("processThumbnail");
 	Thumbnail thumbnail = getThumbnailFromCache(filename);
 
 	if (thumbnail.img.isNull()) {
@@ -460,6 +506,14 @@ QImage Thumbnailer::fetchThumbnail(const QString &filename)
 {
 	QMutexLocker l(&lock);
 
+	// If the thumbnail was already decoded, return it immediately. For videos, the duration
+	// is sent via signal, since the receiver paints it on top of the thumbnail.
+	if (Thumbnail *thumbnail = memoryCache.object(filename)) {
+		if (thumbnail->type == MEDIATYPE_VIDEO)
+			emit thumbnailChanged(filename, thumbnail->img, thumbnail->duration);
+		return thumbnail->img;
+	}
+
 	// We are not currently fetching this thumbnail - add it to the list.
 	if (!workingOn.contains(filename)) {
 		workingOn.insert(filename,
@@ -472,6 +526,7 @@ void Thumbnailer::calculateThumbnails(const QVector<QString> &filenames)
 {
 	QMutexLocker l(&lock);
 	for (const QString &filename: filenames) {
+		memoryCache.remove(filename);
 		if (!workingOn.contains(filename)) {
 			workingOn.insert(filename,
 					 QtConcurrent::run(&pool, [this, filename]() { recalculate(filename); }));
@@ -479,16 +534,46 @@ void Thumbnailer::calculateThumbnails(const QVector<QString> &filenames)
 	}
 }
 
-void Thumbnailer::clearWorkQueue()
+void Thumbnailer::prefetchItems(QVector<QString> filenames)
 {
-	// We also want to clear the working-queue of the video-frame-extractor so that
-	// we don't get thumbnails that we don't care about.
-	VideoFrameExtractor::instance()->clearWorkQueue();
+	QVector<ThumbnailCache::Entry> entries = ThumbnailCache::instance()->readMany(filenames);
+	for (int i = 0; i < filenames.size(); ++i) {
+		if (entries[i].data.isEmpty() || thumbnailIsStale(filenames[i], entries[i].written))
+			continue;
+		addToMemoryCache(filenames[i], getThumbnailFromData(entries[i].data, filenames[i]));
+	}
+}
 
+void Thumbnailer::prefetchThumbnails(const QVector<QString> &filenames)
+{
 	QMutexLocker l(&lock);
-	for (auto it = workingOn.begin(); it != workingOn.end(); ++it)
+	QVector<QString> todo;
+	for (const QString &filename: filenames) {
+		if (!filename.isEmpty() && !memoryCache.contains(filename) && !workingOn.contains(filename))
+			todo.push_back(filename);
+	}
+	if (todo.isEmpty())
+		return;
+
+	// The pool processes jobs in order, therefore this is run after the
+	// thumbnails that are currently shown. The previous prefetch was for
+	// a different selection, so don't bother finishing it.
+	prefetching.cancel();
+	prefetching = QtConcurrent::run(&pool, [this, todo]() { prefetchItems(todo); });
+}
+
+void Thumbnailer::cancelThumbnails(const QVector<QString> &filenames)
+{
+	VideoFrameExtractor::instance()->cancel(filenames);
+
+	QMutexLocker l(&lock);
+	for (const QString &filename: filenames) {
+		auto it = workingOn.find(filename);
+		if (it == workingOn.end())
+			continue;
 		it->cancel();
-	workingOn.clear();
+		workingOn.erase(it);
+	}
 }
 
 static const int maxZoom = 3;	// Maximum zoom: thrice of standard size
@@ -4,6 +4,7 @@
 
 #include "metadata.h"
 #include <QImage>
+#include <QCache>
 #include <QFuture>
 #include <QNetworkReply>
 #include <QThreadPool>
@@ -38,8 +39,12 @@ public:
 	// Schedule multiple thumbnails for forced recalculation
 	void calculateThumbnails(const QVector<QString> &filenames);
 
-	// If we change dive, clear all unfinished thumbnail creations
-	void clearWorkQueue();
+	// Load thumbnails that will likely be needed soon (e.g. of the neighboring dives)
+	// into the in-memory cache. No thumbnailChanged() signals are sent.
+	void prefetchThumbnails(const QVector<QString> &filenames);
+
+	// Cancel the unfinished thumbnail creations of pictures that aren't shown anymore
+	void cancelThumbnails(const QVector<QString> &filenames);
 	static int maxThumbnailSize();
 	static int defaultThumbnailSize();
 	static int thumbnailSize(double zoomLevel);
@@ -67,6 +72,10 @@ private:
 	void recalculate(QString filename);
 	void processItem(QString filename, bool tryDownload);
 	Thumbnail getThumbnailFromCache(const QString &picture_filename);
+	Thumbnail getThumbnailFromData(const QByteArray &data, const QString &picture_filename);
+	Thumbnail writeThumbnailToCache(const QString &picture_filename, const QByteArray &data, const Thumbnail &thumbnail);
+	void addToMemoryCache(const QString &picture_filename, const Thumbnail &thumbnail);
+	void prefetchItems(QVector<QString> filenames);
 	Thumbnail getPictureThumbnailFromStream(QDataStream &stream);
 	Thumbnail getVideoThumbnailFromStream(QDataStream &stream, const QString &filename);
 	Thumbnail fetchImage(const QString &filename, const QString &originalFilename, bool tryDownload);
@@ -82,6 +91,8 @@ private:
 	QImage unknownImage;		// Place holder for files where we couldn't determine the type
 
 	QMap<QString,QFuture<void>> workingOn;
+	QFuture<void> prefetching;
+	QCache<QString, Thumbnail> memoryCache;	// LRU of decoded thumbnails, cost in kB, protected by lock
 };
 
 #endif // IMAGEDOWNLOADER_H
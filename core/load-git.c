@@ -22,6 +22,7 @@
 #include "membuffer.h"
 #include "git-access.h"
 #include "qthelper.h"
+#include "trace.h"
 
 const char *saved_git_id = NULL;
 
@@ -1172,6 +1173,23 @@ static struct divecomputer *active_dc;
 static struct dive *active_dive;
 static dive_trip_t *active_trip;
 
+/*
+ * When reloading a repository (see git_reload_dives()), these are the
+ * dives of the previously loaded commit, sorted by time. A dive whose
+ * directory didn't change is taken from here instead of being parsed
+ * again, and the slot is cleared. Likewise, a dive site file that didn't
+ * change isn't parsed again.
+ */
+struct reusable_dive {
+	timestamp_t when;
+	struct dive *dive;
+};
+static bool reloading;
+static struct reusable_dive *reusable_dives;
+static int nr_reusable_dives;
+static git_tree *reusable_sites;
+static struct trip_table old_trips;
+
 static void finish_active_trip(void)
 {
 	dive_trip_t *trip = active_trip;
@@ -1204,6 +1222,30 @@ static struct dive *create_new_dive(timestamp_t when)
 	return dive;
 }
 
+static struct dive *reuse_dive(timestamp_t when, const git_oid *id)
+{
+	int lo = 0, hi = nr_reusable_dives;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (reusable_dives[mid].when < when)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < nr_reusable_dives && reusable_dives[lo].when == when; lo++) {
+		struct dive *dive = reusable_dives[lo].dive;
+		if (dive && !memcmp(dive->git_id, id->id, 20)) {
+			reusable_dives[lo].dive = NULL;
+			if (active_trip)
+				add_dive_to_trip(dive, active_trip);
+			add_single_dive(dive_table.nr, dive);
+			return dive;
+		}
+	}
+	return NULL;
+}
+
 static bool validate_date(int yyyy, int mm, int dd)
 {
 	return yyyy > 1930 && yyyy < 3000 &&
@@ -1320,6 +1362,9 @@ static int dive_directory(const char *root, const git_tree_entry *entry, const c
 	tm.tm_mday = dd;
 
 	finish_active_dive();
+	/* An unchanged dive of a reload is taken as is, without reading its files */
+	if (reloading && reuse_dive(utc_mktime(&tm), git_tree_entry_id(entry)))
+		return GIT_WALK_SKIP;
 	active_dive = create_new_dive(utc_mktime(&tm));
 	memcpy(active_dive->git_id, git_tree_entry_id(entry)->id, 20);
 	return GIT_WALK_OK;
@@ -1504,8 +1549,18 @@ static int parse_site_entry(git_repository *repo, const git_tree_entry *entry, c
 	if (*suffix == '\0')
 		return report_error("Dive site without uuid");
 	uint32_t uuid = strtoul(suffix, NULL, 16);
-	struct dive_site *ds = alloc_or_get_dive_site(uuid);
-	git_blob *blob = git_tree_entry_blob(repo, entry);
+	struct dive_site *ds;
+	git_blob *blob;
+
+	if (reloading && (ds = get_dive_site_by_uuid(uuid)) != NULL) {
+		const git_tree_entry *old = reusable_sites ? git_tree_entry_byname(reusable_sites, git_tree_entry_name(entry)) : NULL;
+		if (old && git_oid_equal(git_tree_entry_id(old), git_tree_entry_id(entry)))
+			return 0;
+		clear_dive_site(ds);
+		ds->uuid = uuid;
+	}
+	ds = alloc_or_get_dive_site(uuid);
+	blob = git_tree_entry_blob(repo, entry);
 	if (!blob)
 		return report_error("Unable to read dive site file");
 	for_each_line(blob, site_parser, ds);
@@ -1685,13 +1740,168 @@ const char *get_sha(git_repository *repo, const char *branch)
 int git_load_dives(struct git_repository *repo, const char *branch)
 {
 	int ret;
+	struct trace_span span;
 
 	if (repo == dummy_git_repository)
 		return report_error("Unable to open git repository at '%s'", branch);
+	span = trace_begin("git_load_dives");
 	ret = do_git_load(repo, branch);
+	trace_end(&span);
 	git_repository_free(repo);
 	free((void *)branch);
 	finish_active_dive();
 	finish_active_trip();
 	return ret;
 }
+
+static int comp_reusable_dives(const void *_a, const void *_b)
+{
+	const struct reusable_dive *a = _a, *b = _b;
+
+	if (a->when < b->when)
+		return -1;
+	return a->when > b->when;
+}
+
+/* Get the "01-Divesites" tree of a commit, or NULL if there is none */
+static git_tree *divesites_tree(git_repository *repo, git_commit *commit)
+{
+	git_tree *tree, *sites;
+	git_tree_entry *entry;
+
+	if (git_commit_tree(&tree, commit))
+		return NULL;
+	if (git_tree_entry_bypath(&entry, tree, "01-Divesites")) {
+		git_tree_free(tree);
+		return NULL;
+	}
+	if (git_tree_lookup(&sites, repo, git_tree_entry_id(entry)))
+		sites = NULL;
+	git_tree_entry_free(entry);
+	git_tree_free(tree);
+	return sites;
+}
+
+/*
+ * Take the dives of the previously loaded commit out of the dive table,
+ * so that the unchanged ones can be reused. The trips are small and are
+ * always read again, so the dives are removed from their trips. Nothing
+ * is freed before the load is done, since the UI may still refer to the
+ * old dives and trips while the progress is shown.
+ */
+static void start_reload(git_repository *repo, git_commit *old_commit)
+{
+	int i;
+	struct dive *dive;
+
+	for_each_dive (i, dive) {
+		deselect_dive(dive);
+		unregister_dive_from_trip(dive);
+	}
+	current_dive = NULL;
+	old_trips = trip_table;
+	memset(&trip_table, 0, sizeof(trip_table));
+
+	nr_reusable_dives = dive_table.nr;
+	reusable_dives = malloc(nr_reusable_dives * sizeof(*reusable_dives));
+	for_each_dive (i, dive) {
+		reusable_dives[i].when = dive->when;
+		reusable_dives[i].dive = dive;
+	}
+	qsort(reusable_dives, nr_reusable_dives, sizeof(*reusable_dives), comp_reusable_dives);
+	dive_table.nr = 0;
+
+	reusable_sites = divesites_tree(repo, old_commit);
+	clear_dive(&displayed_dive);
+	reset_min_datafile_version();
+	reloading = true;
+}
+
+/*
+ * Free the old trips, the dives that weren't reused and, if the load
+ * succeeded, the dive sites that were removed from the repository.
+ */
+static void finish_reload(git_repository *repo, const char *branch, bool success)
+{
+	int i;
+	git_commit *commit;
+	git_tree *sites = NULL;
+
+	for (i = 0; i < old_trips.nr; i++)
+		free_trip(old_trips.trips[i]);
+	free(old_trips.trips);
+	memset(&old_trips, 0, sizeof(old_trips));
+	for (i = 0; i < nr_reusable_dives; i++) {
+		if (reusable_dives[i].dive)
+			free_dive(reusable_dives[i].dive);
+	}
+	free(reusable_dives);
+	reusable_dives = NULL;
+	nr_reusable_dives = 0;
+	git_tree_free(reusable_sites);
+	reusable_sites = NULL;
+	reloading = false;
+
+	if (!success || find_commit(repo, branch, &commit))
+		return;
+	sites = divesites_tree(repo, commit);
+	git_commit_free(commit);
+	for (i = 0; i < dive_site_table.nr; i++) {
+		struct dive_site *ds = get_dive_site(i);
+		char name[16];
+
+		snprintf(name, sizeof(name), "Site-%08x", ds->uuid);
+		if ((sites && git_tree_entry_byname(sites, name)) || is_dive_site_used(ds, false))
+			continue;
+		delete_dive_site(ds);
+		i--;
+	}
+	git_tree_free(sites);
+}
+
+/*
+ * Reload a repository of which an older commit is loaded, e.g. after
+ * syncing with the cloud. Only the dive directories and dive site files
+ * that changed since the loaded commit (saved_git_id) are read, the
+ * unchanged dives and dive sites are kept. If the loaded commit isn't
+ * found or there are unsaved changes, this does a full load.
+ *
+ * This doesn't diff the two commits with git_diff_tree_to_tree(). Instead
+ * it walks the new tree like a full load and compares the id of each dive
+ * directory with the git_id of the loaded dive at the same time. That is
+ * the same test the diff does for each tree entry. The walk itself only
+ * reads the small year, month and trip trees, and it is needed anyway,
+ * because the trips are read again and the dives have to be put back into
+ * them in the right order. A dive directory is named after the time of the
+ * dive, so (when, git_id) is the same directory with the same contents.
+ *
+ * Like git_load_dives(), this takes ownership of the repository and the
+ * branch name.
+ */
+int git_reload_dives(struct git_repository *repo, const char *branch)
+{
+	int ret;
+	git_oid old_id;
+	git_commit *old_commit;
+	struct trace_span span;
+
+	if (repo == dummy_git_repository || empty_string(saved_git_id) || unsaved_changes() ||
+	    git_oid_fromstr(&old_id, saved_git_id) || git_commit_lookup(&old_commit, repo, &old_id)) {
+		clear_dive_file_data();
+		return git_load_dives(repo, branch);
+	}
+
+	span = trace_begin("git_reload_dives");
+	start_reload(repo, old_commit);
+	git_commit_free(old_commit);
+	ret = do_git_load(repo, branch);
+	finish_active_dive();
+	finish_active_trip();
+	finish_reload(repo, branch, !ret);
+	if (ret)
+		clear_dive_file_data();
+	trace_end(&span);
+	git_repository_free(repo);
+	free((void *)branch);
+	return ret;
+}
@@ -6,6 +6,7 @@
 #include <QString>
 #include <QFile>
 #include <QDateTime>
+#include <QtConcurrent>
 
 // Weirdly, android builds fail owing to undefined UINT64_MAX
 #ifndef UINT64_MAX
@@ -546,6 +547,18 @@ extern "C" mediatype_t get_metadata(const char *filename_in, metadata *data)
 	return res;
 }
 
+static metadata getMetadataSingle(const QString &filename)
+{
+	metadata data;
+	get_metadata(qPrintable(filename), &data);
+	return data;
+}
+
+QFuture<metadata> getMetadataParallel(const QStringList &filenames)
+{
+	return QtConcurrent::mapped(filenames, getMetadataSingle);
+}
+
 extern "C" timestamp_t picture_get_timestamp(const char *filename)
 {
 	struct metadata data;
@@ -26,6 +26,14 @@ timestamp_t picture_get_timestamp(const char *filename);
 
 #ifdef __cplusplus
 }
+
+#include <QFuture>
+#include <QStringList>
+
+// Read the metadata of multiple files in parallel on the global thread pool.
+// The results are in the order of the input list and can be accessed with
+// QFuture::resultAt() as soon as they are available.
+QFuture<metadata> getMetadataParallel(const QStringList &filenames);
 #endif
 
 #endif // METADATA_H
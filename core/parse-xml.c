@@ -29,6 +29,7 @@
 #include "device.h"
 #include "membuffer.h"
 #include "qthelper.h"
+#include "trace.h"
 
 int verbose, quit, force_root;
 int last_xml_version = -1;
@@ -1643,6 +1644,7 @@ int parse_xml_buffer(const char *url, const char *buffer, int size,
 	const char *res = preprocess_divelog_de(buffer);
 	int ret = 0;
 	struct parser_state state;
+	struct trace_span span = trace_begin("parse_xml_buffer");
 
 	init_parser_state(&state);
 	state.target_table = table;
@@ -1654,8 +1656,10 @@ int parse_xml_buffer(const char *url, const char *buffer, int size,
 	if (res != buffer)
 		free((char *)res);
 
-	if (!doc)
+	if (!doc) {
+		trace_end(&span);
 		return report_error(translate("gettextFromC", "Failed to parse '%s'"), url);
+	}
 
 	reset_all(&state);
 	dive_start(&state);
@@ -1667,6 +1671,7 @@ int parse_xml_buffer(const char *url, const char *buffer, int size,
 	dive_end(&state);
 	free_parser_state(&state);
 	xmlFreeDoc(doc);
+	trace_end(&span);
 	return ret;
 }
 
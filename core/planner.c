@@ -15,6 +15,7 @@
 #include "deco.h"
 #include "divelist.h"
 #include "planner.h"
+#include "gasbudget.h"
 #include "gettext.h"
 #include "libdivecomputer/parser.h"
 #include "qthelper.h"
@@ -22,13 +23,13 @@
 
 #define TIMESTEP 2 /* second */
 
-int decostoplevels_metric[] = { 0, 3000, 6000, 9000, 12000, 15000, 18000, 21000, 24000, 27000,
+static const int decostoplevels_metric[] = { 0, 3000, 6000, 9000, 12000, 15000, 18000, 21000, 24000, 27000,
 				  30000, 33000, 36000, 39000, 42000, 45000, 48000, 51000, 54000, 57000,
 				  60000, 63000, 66000, 69000, 72000, 75000, 78000, 81000, 84000, 87000,
 				  90000, 100000, 110000, 120000, 130000, 140000, 150000, 160000, 170000,
 				  180000, 190000, 200000, 220000, 240000, 260000, 280000, 300000,
 				  320000, 340000, 360000, 380000 };
-int decostoplevels_imperial[] = { 0, 3048, 6096, 9144, 12192, 15240, 18288, 21336, 24384, 27432,
+static const int decostoplevels_imperial[] = { 0, 3048, 6096, 9144, 12192, 15240, 18288, 21336, 24384, 27432,
 				30480, 33528, 36576, 39624, 42672, 45720, 48768, 51816, 54864, 57912,
 				60960, 64008, 67056, 70104, 73152, 76200, 79248, 82296, 85344, 88392,
 				91440, 101600, 111760, 121920, 132080, 142240, 152400, 162560, 172720,
@@ -42,7 +43,7 @@ extern double regressionb();
 extern void reset_regression();
 
 char *disclaimer;
-int plot_depth = 0;
+THREAD_LOCAL int plot_depth = 0;
 #if DEBUG_PLAN
 void dump_plan(struct diveplan *diveplan)
 {
@@ -109,11 +110,130 @@ void interpolate_transition(struct deco_state *ds, struct dive *dive, duration_t
 		add_segment(ds, depth_to_bar(depth, dive), gasmix, 1, po2.mbar, divemode, prefs.bottomsac);
 	}
 	if (d1.mm > d0.mm)
-		calc_crushing_pressure(ds, depth_to_bar(d1.mm, &displayed_dive));
+		calc_crushing_pressure(ds, depth_to_bar(d1.mm, dive));
+}
+
+/* Tissue state after each sample of the manually entered part of a plan.
+ * When the user edits a waypoint, the segments before it are unchanged. Thus,
+ * tissue_at_end() compares the samples to the stored checkpoints and resumes
+ * from the last one that is still valid, instead of recalculating from the surface. */
+struct deco_checkpoint {
+	int time;
+	int depth;
+	int setpoint;
+	struct gasmix gas;
+	enum divemode_t divemode;
+	bool vpmb_checked;	/* the bottom ceiling was checked at or before this sample */
+	struct deco_state state;
+};
+
+struct deco_checkpoints {
+	/* Parameters the tissue state depends on */
+	timestamp_t when;
+	int surface_pressure;
+	int salinity;
+	short gflow, gfhigh, vpmb_conservatism;
+	enum deco_mode deco_mode;
+	bool valid;
+
+	int surface_interval;
+	struct deco_state initial;
+	int nr, allocated;
+	struct deco_checkpoint *cp;
+};
+
+struct deco_checkpoints *alloc_deco_checkpoints(void)
+{
+	return calloc(1, sizeof(struct deco_checkpoints));
+}
+
+void free_deco_checkpoints(struct deco_checkpoints *cps)
+{
+	if (!cps)
+		return;
+	free(cps->cp);
+	free(cps);
+}
+
+void invalidate_deco_checkpoints(struct deco_checkpoints *cps)
+{
+	if (!cps)
+		return;
+	cps->valid = false;
+	cps->nr = 0;
+}
+
+/* Throw away the checkpoints if any of the parameters changed since they were recorded */
+static void check_deco_checkpoints(struct deco_checkpoints *cps, const struct diveplan *diveplan, const struct dive *dive)
+{
+	if (!cps)
+		return;
+	if (cps->valid &&
+	    cps->when == dive->when &&
+	    cps->surface_pressure == dive->surface_pressure.mbar &&
+	    cps->salinity == dive->salinity &&
+	    cps->gflow == diveplan->gflow &&
+	    cps->gfhigh == diveplan->gfhigh &&
+	    cps->vpmb_conservatism == diveplan->vpmb_conservatism &&
+	    cps->deco_mode == decoMode())
+		return;
+	invalidate_deco_checkpoints(cps);
+	cps->when = dive->when;
+	cps->surface_pressure = dive->surface_pressure.mbar;
+	cps->salinity = dive->salinity;
+	cps->gflow = diveplan->gflow;
+	cps->gfhigh = diveplan->gfhigh;
+	cps->vpmb_conservatism = diveplan->vpmb_conservatism;
+	cps->deco_mode = decoMode();
+}
+
+static bool checkpoint_matches(const struct deco_checkpoint *cp, const struct sample *sample, o2pressure_t setpoint,
+			       struct gasmix gas, enum divemode_t divemode)
+{
+	return cp->time == sample->time.seconds && cp->depth == sample->depth.mm &&
+	       cp->setpoint == setpoint.mbar && same_gasmix(cp->gas, gas) && cp->divemode == divemode;
+}
+
+static void add_checkpoint(struct deco_checkpoints *cps, const struct sample *sample, o2pressure_t setpoint,
+			   struct gasmix gas, enum divemode_t divemode, bool vpmb_checked, const struct deco_state *ds)
+{
+	struct deco_checkpoint *cp;
+
+	if (cps->nr >= cps->allocated) {
+		cps->allocated = (cps->allocated + 8) * 3 / 2;
+		cps->cp = realloc(cps->cp, cps->allocated * sizeof(struct deco_checkpoint));
+	}
+	cp = &cps->cp[cps->nr++];
+	cp->time = sample->time.seconds;
+	cp->depth = sample->depth.mm;
+	cp->setpoint = setpoint.mbar;
+	cp->gas = gas;
+	cp->divemode = divemode;
+	cp->vpmb_checked = vpmb_checked;
+	cp->state = *ds;
+}
+
+/* Continue from a checkpoint. The VPM-B gradients and the bottom ceiling are
+ * kept as passed in by the caller, unless they were set while processing the
+ * samples up to the checkpoint. This gives the same result as going through
+ * all samples. */
+static void restore_checkpoint(const struct deco_checkpoint *cp, struct deco_state *ds)
+{
+	struct deco_state caller = *ds;
+
+	*ds = cp->state;
+	ds->first_ceiling_pressure = caller.first_ceiling_pressure;
+	if (!cp->vpmb_checked) {
+		memcpy(ds->bottom_n2_gradient, caller.bottom_n2_gradient, sizeof(ds->bottom_n2_gradient));
+		memcpy(ds->bottom_he_gradient, caller.bottom_he_gradient, sizeof(ds->bottom_he_gradient));
+		memcpy(ds->initial_n2_gradient, caller.initial_n2_gradient, sizeof(ds->initial_n2_gradient));
+		memcpy(ds->initial_he_gradient, caller.initial_he_gradient, sizeof(ds->initial_he_gradient));
+		ds->max_bottom_ceiling_pressure = caller.max_bottom_ceiling_pressure;
+	}
 }
 
 /* returns the tissue tolerance at the end of this (partial) dive */
-int tissue_at_end(struct deco_state *ds, struct dive *dive, struct deco_state **cached_datap)
+static int tissue_at_end(struct deco_state *ds, struct dive *dive, struct deco_state **cached_datap, struct deco_checkpoints *cps)
 {
 	struct divecomputer *dc;
 	struct sample *sample, *psample;
@@ -122,15 +242,32 @@ int tissue_at_end(struct deco_state *ds, struct dive *dive, struct deco_state **
 	duration_t t0 = {}, t1 = {};
 	struct gasmix gas;
 	int surface_interval = 0;
+	bool resuming = cps && cps->valid;
+	bool vpmb_checked = false;
 
 	if (!dive)
 		return 0;
-	if (*cached_datap) {
+	if (resuming) {
+		/* restore_deco_state() overwrites the VPM-B fields of its source,
+		 * so restore from a copy to keep the checkpoint intact */
+		struct deco_state initial = cps->initial;
+		restore_deco_state(&initial, ds, true);
+		surface_interval = cps->surface_interval;
+		/* The caller may use the state at the start of the dive later on */
+		if (!*cached_datap)
+			cache_deco_state(ds, cached_datap);
+	} else if (*cached_datap) {
 		restore_deco_state(*cached_datap, ds, true);
 	} else {
 		surface_interval = init_decompression(ds, dive);
 		cache_deco_state(ds, cached_datap);
 	}
+	if (cps && !cps->valid) {
+		cps->initial = *ds;
+		cps->surface_interval = surface_interval;
+		cps->nr = 0;
+		cps->valid = true;
+	}
 	dc = &dive->dc;
 	if (!dc->samples)
 		return 0;
@@ -151,6 +288,21 @@ int tissue_at_end(struct deco_state *ds, struct dive *dive, struct deco_state **
 		gas = get_gasmix_at_time(dive, dc, t0);
 		if (i > 0)
 			lastdepth = psample->depth;
+		divemode = get_current_divemode(&dive->dc, t0.seconds + 1, &evdm, &divemode);
+
+		if (resuming) {
+			if (i < cps->nr && checkpoint_matches(&cps->cp[i], sample, setpoint, gas, divemode)) {
+				vpmb_checked = cps->cp[i].vpmb_checked;
+				psample = sample;
+				t0 = t1;
+				continue;
+			}
+			/* This is the first changed sample: continue from the previous one */
+			resuming = false;
+			cps->nr = i;
+			if (i > 0)
+				restore_checkpoint(&cps->cp[i - 1], ds);
+		}
 
 		/* The ceiling in the deeper portion of a multilevel dive is sometimes critical for the VPM-B
 		 * Boyle's law compensation.  We should check the ceiling prior to ascending during the bottom
@@ -173,13 +325,20 @@ int tissue_at_end(struct deco_state *ds, struct dive *dive, struct deco_state **
 								dive);
 			if (ceiling_pressure.mbar > ds->max_bottom_ceiling_pressure.mbar)
 				ds->max_bottom_ceiling_pressure.mbar = ceiling_pressure.mbar;
+			vpmb_checked = true;
 		}
 
-		divemode = get_current_divemode(&dive->dc, t0.seconds + 1, &evdm, &divemode);
 		interpolate_transition(ds, dive, t0, t1, lastdepth, sample->depth, gas, setpoint, divemode);
+		if (cps)
+			add_checkpoint(cps, sample, setpoint, gas, divemode, vpmb_checked, ds);
 		psample = sample;
 		t0 = t1;
 	}
+	/* Nothing changed: continue from the last sample */
+	if (resuming) {
+		cps->nr = dc->samples;
+		restore_checkpoint(&cps->cp[dc->samples - 1], ds);
+	}
 	return surface_interval;
 }
 
@@ -214,31 +373,6 @@ void fill_default_cylinder(cylinder_t *cyl)
 	cyl->depth = gas_mod(cyl->gasmix, pO2, &displayed_dive, 1);
 }
 
-/* calculate the new end pressure of the cylinder, based on its current end pressure and the
- * latest segment. */
-static void update_cylinder_pressure(struct dive *d, int old_depth, int new_depth, int duration, int sac, cylinder_t *cyl, bool in_deco, enum divemode_t divemode)
-{
-	volume_t gas_used;
-	pressure_t delta_p;
-	depth_t mean_depth;
-	int factor = 1000;
-
-	if (divemode == PSCR)
-		factor = prefs.pscr_ratio;
-
-	if (!cyl)
-		return;
-	mean_depth.mm = (old_depth + new_depth) / 2;
-	gas_used.mliter = lrint(depth_to_atm(mean_depth.mm, d) * sac / 60 * duration * factor / 1000);
-	cyl->gas_used.mliter += gas_used.mliter;
-	if (in_deco)
-		cyl->deco_gas_used.mliter += gas_used.mliter;
-	if (cyl->type.size.mliter) {
-		delta_p.mbar = lrint(gas_used.mliter * 1000.0 / cyl->type.size.mliter * gas_compressibility_factor(cyl->gasmix, cyl->end.mbar / 1000.0));
-		cyl->end.mbar -= delta_p.mbar;
-	}
-}
-
 /* simply overwrite the data in the displayed_dive
  * return false if something goes wrong */
 static void create_dive_from_plan(struct diveplan *diveplan, struct dive *dive, bool track_gas)
@@ -247,7 +381,7 @@ static void create_dive_from_plan(struct diveplan *diveplan, struct dive *dive,
 	struct divecomputer *dc;
 	struct sample *sample;
 	struct event *ev;
-	cylinder_t *cyl;
+	struct gas_budget *budget = &diveplan->gas;
 	int oldpo2 = 0;
 	int lasttime = 0, last_manual_point = 0;
 	depth_t lastdepth = {.mm = 0};
@@ -264,6 +398,7 @@ static void create_dive_from_plan(struct diveplan *diveplan, struct dive *dive,
 	// reset the cylinders and clear out the samples and events of the
 	// displayed dive so we can restart
 	reset_cylinders(dive, track_gas);
+	gas_budget_init(budget, dive);
 	dc = &dive->dc;
 	dc->when = dive->when = diveplan->when;
 	dc->surface_pressure.mbar = diveplan->surface_pressure;
@@ -277,11 +412,10 @@ static void create_dive_from_plan(struct diveplan *diveplan, struct dive *dive,
 	/* Create first sample at time = 0, not based on dp because
 	 * there is no real dp for time = 0, set first cylinder to 0
 	 * O2 setpoint for this sample will be filled later from next dp */
-	cyl = &dive->cylinder[0];
 	sample = prepare_sample(dc);
 	sample->sac.mliter = prefs.bottomsac;
-	if (track_gas && cyl->type.workingpressure.mbar)
-		sample->pressure[0].mbar = cyl->end.mbar;
+	if (track_gas && dive->cylinder[0].type.workingpressure.mbar)
+		sample->pressure[0].mbar = budget->cyl[0].end.mbar;
 	sample->manually_entered = true;
 	finish_sample(dc);
 	lastcylid = 0;
@@ -311,7 +445,6 @@ static void create_dive_from_plan(struct diveplan *diveplan, struct dive *dive,
 		if (dp->cylinderid != lastcylid) {
 			/* need to insert a first sample for the new gas */
 			add_gas_switch_event(dive, dc, lasttime + 1, dp->cylinderid);
-			cyl = &dive->cylinder[dp->cylinderid];
 			sample = prepare_sample(dc);
 			sample[-1].setpoint.mbar = po2;
 			sample->time.seconds = lasttime + 1;
@@ -338,15 +471,19 @@ static void create_dive_from_plan(struct diveplan *diveplan, struct dive *dive,
 		sample->manually_entered = dp->entered;
 		sample->sac.mliter = dp->entered ? prefs.bottomsac : prefs.decosac;
 		if (track_gas && !sample[-1].setpoint.mbar) {    /* Don't track gas usage for CCR legs of dive */
-			update_cylinder_pressure(dive, sample[-1].depth.mm, depth.mm, time - sample[-1].time.seconds,
-					dp->entered ? diveplan->bottomsac : diveplan->decosac, cyl, !dp->entered, type);
-			if (cyl->type.workingpressure.mbar)
-				sample->pressure[0].mbar = cyl->end.mbar;
+			gas_budget_add_segment(budget, dive, lastcylid, sample[-1].depth.mm, depth.mm, time - sample[-1].time.seconds,
+					       dp->entered ? diveplan->bottomsac : diveplan->decosac, !dp->entered, type);
+			if (dive->cylinder[lastcylid].type.workingpressure.mbar)
+				sample->pressure[0].mbar = budget->cyl[lastcylid].end.mbar;
 		}
 		finish_sample(dc);
 		dp = dp->next;
 	}
 	dive->dc.last_manual_time.seconds = last_manual_point;
+	if (track_gas) {
+		gas_budget_apply(budget, dive);
+		gas_budget_plan_minimum_gas(budget, diveplan, dive);
+	}
 
 #if DEBUG_PLAN & 32
 	save_dive(stdout, &displayed_dive);
@@ -413,12 +550,12 @@ struct gaschanges {
 };
 
 
-static struct gaschanges *analyze_gaslist(struct diveplan *diveplan, int *gaschangenr, int depth, int *asc_cylinder)
+static struct gaschanges *analyze_gaslist(struct diveplan *diveplan, struct dive *dive, int *gaschangenr, int depth, int *asc_cylinder)
 {
 	int nr = 0;
 	struct gaschanges *gaschanges = NULL;
 	struct divedatapoint *dp = diveplan->dp;
-	int best_depth = displayed_dive.cylinder[*asc_cylinder].depth.mm;
+	int best_depth = dive->cylinder[*asc_cylinder].depth.mm;
 	bool total_time_zero = true;
 	while (dp) {
 		if (dp->time == 0 && total_time_zero) {
@@ -453,7 +590,7 @@ static struct gaschanges *analyze_gaslist(struct diveplan *diveplan, int *gascha
 	for (nr = 0; nr < *gaschangenr; nr++) {
 		int idx = gaschanges[nr].gasidx;
 		printf("gaschange nr %d: @ %5.2lfm gasidx %d (%s)\n", nr, gaschanges[nr].depth / 1000.0,
-		       idx, gasname(&displayed_dive.cylinder[idx].gasmix));
+		       idx, gasname(&dive->cylinder[idx].gasmix));
 	}
 #endif
 	return gaschanges;
@@ -534,15 +671,15 @@ int ascent_velocity(int depth, int avg_depth, int bottom_time)
 	}
 }
 
-void track_ascent_gas(int depth, cylinder_t *cylinder, int avg_depth, int bottom_time, bool safety_stop, enum divemode_t divemode)
+void track_ascent_gas(struct gas_budget *budget, const struct dive *dive, int depth, int cylinderid, int avg_depth, int bottom_time, bool safety_stop, enum divemode_t divemode)
 {
 	while (depth > 0) {
 		int deltad = ascent_velocity(depth, avg_depth, bottom_time) * TIMESTEP;
 		if (deltad > depth)
 			deltad = depth;
-		update_cylinder_pressure(&displayed_dive, depth, depth - deltad, TIMESTEP, prefs.decosac, cylinder, true, divemode);
+		gas_budget_add_segment(budget, dive, cylinderid, depth, depth - deltad, TIMESTEP, prefs.decosac, true, divemode);
 		if (depth <= 5000 && depth >= (5000 - deltad) && safety_stop) {
-			update_cylinder_pressure(&displayed_dive, 5000, 5000, 180, prefs.decosac, cylinder, true, divemode);
+			gas_budget_add_segment(budget, dive, cylinderid, 5000, 5000, 180, prefs.decosac, true, divemode);
 			safety_stop = false;
 		}
 		depth -= deltad;
@@ -554,12 +691,11 @@ bool trial_ascent(struct deco_state *ds, int wait_time, int trial_depth, int sto
 {
 
 	bool clear_to_ascend = true;
-	struct deco_state *trial_cache = NULL;
+	struct deco_state trial_cache = *ds;
 
 	// For consistency with other VPM-B implementations, we should not start the ascent while the ceiling is
 	// deeper than the next stop (thus the offgasing during the ascent is ignored).
 	// However, we still need to make sure we don't break the ceiling due to on-gassing during ascent.
-	cache_deco_state(ds, &trial_cache);
 	if (wait_time)
 		add_segment(ds, depth_to_bar(trial_depth, dive),
 			    gasmix,
@@ -567,8 +703,7 @@ bool trial_ascent(struct deco_state *ds, int wait_time, int trial_depth, int sto
 	if (decoMode() == VPMB && (deco_allowed_depth(tissue_tolerance_calc(ds, dive,depth_to_bar(stoplevel, dive)),
 						      surface_pressure, dive, 1)
 				   > stoplevel)) {
-		restore_deco_state(trial_cache, ds, false);
-		free(trial_cache);
+		*ds = trial_cache;
 		return false;
 	}
 
@@ -587,49 +722,105 @@ bool trial_ascent(struct deco_state *ds, int wait_time, int trial_depth, int sto
 		}
 		trial_depth -= deltad;
 	}
-	restore_deco_state(trial_cache, ds, false);
-	free(trial_cache);
+	*ds = trial_cache;
 	return clear_to_ascend;
 }
 
-/* Determine if there is enough gas for the dive.  Return true if there is enough.
- * Also return true if this cannot be calculated because the cylinder doesn't have
- * size or a starting pressure.
- */
-bool enough_gas(int current_cylinder)
+/* Everything needed to decide whether a stop of a given length is long enough */
+struct stop_probe {
+	struct deco_state *ds;
+	struct dive *dive;
+	int clock, depth, target_depth, avg_depth, bottom_time, po2;
+	struct gasmix gasmix;
+	double surface_pressure;
+	enum divemode_t divemode;
+};
+
+/* Is the ceiling at the end of a stop lasting until time above the next stop?
+ * The tissue loading during the stop is calculated in one step using the
+ * exponential loading equation, the ascent is not simulated. This is much
+ * cheaper than trial_ascent() and is used to estimate the length of the stop. */
+static bool ceiling_clear(const struct stop_probe *p, int time)
 {
-	cylinder_t *cyl;
-	cyl = &displayed_dive.cylinder[current_cylinder];
+	struct deco_state ds = *p->ds;
 
-	if (!cyl->start.mbar)
-		return true;
-	if (cyl->type.size.mliter)
-		return (cyl->end.mbar - prefs.reserve_gas) / 1000.0 * cyl->type.size.mliter > cyl->deco_gas_used.mliter;
-	else
-		return true;
+	add_segment(&ds, depth_to_bar(p->depth, p->dive), p->gasmix, time - p->clock, p->po2, p->divemode, prefs.decosac);
+	return deco_allowed_depth(tissue_tolerance_calc(&ds, p->dive, depth_to_bar(p->target_depth, p->dive)),
+				  p->surface_pressure, p->dive, 1) <= p->target_depth;
 }
 
-/* Do a binary search for the time the ceiling is clear to ascent to target_depth.
- * Minimal solution is min + 1, and the solution should be an integer multiple of stepsize.
- * leap is a guess for the maximum but there is no guarantee that leap is an upper limit.
- * So we always test at the upper bundary, not in the middle!
- */
+static bool ascent_clear(const struct stop_probe *p, int time)
+{
+	return trial_ascent(p->ds, time - p->clock, p->depth, p->target_depth, p->avg_depth, p->bottom_time,
+			    p->gasmix, p->po2, p->surface_pressure, p->dive, p->divemode);
+}
 
-int wait_until(struct deco_state *ds, struct dive *dive, int clock, int min, int leap, int stepsize, int depth, int target_depth, int avg_depth, int bottom_time, struct gasmix gasmix, int po2, double surface_pressure, enum divemode_t divemode)
+/* Find the first of the candidate times first + n * stepsize (n >= 0) for which
+ * the predicate is true, starting at the guess n. Walk away from the guess with
+ * doubling steps until the result is bracketed, then bisect. Returns -1 if the
+ * stop would be longer than two days. */
+static int search_stop(const struct stop_probe *p, bool (*clear)(const struct stop_probe *, int), int first, int stepsize, int n)
 {
+	int lo, hi, inc;
+
+	if (clear(p, first + n * stepsize)) {
+		hi = n;
+		for (inc = 1; hi - inc >= 0 && clear(p, first + (hi - inc) * stepsize); inc *= 2)
+			hi -= inc;
+		lo = hi - inc >= 0 ? hi - inc : -1;
+	} else {
+		lo = n;
+		for (inc = 1; !clear(p, first + (lo + inc) * stepsize); inc *= 2) {
+			lo += inc;
+			if (first + lo * stepsize >= 48 * 3600)
+				return -1;
+		}
+		hi = lo + inc;
+	}
+	while (hi - lo > 1) {
+		int mid = lo + (hi - lo) / 2;
+		if (clear(p, first + mid * stepsize))
+			hi = mid;
+		else
+			lo = mid;
+	}
+	return hi;
+}
+
+/* Find the end of the stop at depth, i.e. the first multiple of stepsize after clock at
+ * which we can ascend to target_depth without breaking the ceiling.
+ * First, the end of the stop is estimated by searching for the time at which the ceiling
+ * clears the next stop. Then, the result is verified by proper trial ascents. Usually, this
+ * takes two trial ascents: one at the estimate and one a step earlier.
+ * If the caller has a guess for the length of the stop (e.g. from a previous iteration
+ * of the VPM-B CVA), it is passed in hint and used as the starting point of the
+ * search. Otherwise hint is negative.
+ */
+static int wait_until(struct deco_state *ds, struct dive *dive, int clock, int stepsize, int hint, int depth, int target_depth, int avg_depth, int bottom_time, struct gasmix gasmix, int po2, double surface_pressure, enum divemode_t divemode)
+{
+	struct stop_probe p = { ds, dive, clock, depth, target_depth, avg_depth, bottom_time, po2, gasmix, surface_pressure, divemode };
+	int first = clock + stepsize - clock % stepsize;
+	int n;
+
 	// When a deco stop exceeds two days, there is something wrong...
-	if (min >= 48 * 3600)
+	if (clock >= 48 * 3600)
 		return 50 * 3600;
-	// Round min + leap up to the next multiple of stepsize
-	int upper = min + leap + stepsize - 1 - (min + leap - 1) % stepsize;
-	// Is the upper boundary too small?
-	if (!trial_ascent(ds, upper - clock, depth, target_depth, avg_depth, bottom_time, gasmix, po2, surface_pressure, dive, divemode))
-		return wait_until(ds, dive, clock, upper, leap, stepsize, depth, target_depth, avg_depth, bottom_time, gasmix, po2, surface_pressure, divemode);
-
-	if (upper - min <= stepsize)
-		return upper;
 
-	return wait_until(ds, dive, clock, min, leap / 2, stepsize, depth, target_depth, avg_depth, bottom_time, gasmix, po2, surface_pressure, divemode);
+	n = 0;
+	if (hint >= 0)
+		n = (clock + hint - first + stepsize - 1) / stepsize;
+	if (n < 0)
+		n = 0;
+	n = search_stop(&p, ceiling_clear, first, stepsize, n);
+	if (n < 0 || first + n * stepsize > 48 * 3600)
+		n = (48 * 3600 - first) / stepsize + 1;
+
+	n = search_stop(&p, ascent_clear, first, stepsize, n);
+	if (n < 0)
+		return 50 * 3600;
+	if (first + (n - 1) * stepsize >= 48 * 3600)
+		return 50 * 3600;
+	return first + n * stepsize;
 }
 
 // Work out the stops. Return value is if there were any mandatory stops.
@@ -643,7 +834,313 @@ void printdecotable(struct decostop *table)
 	}
 }
 
-bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, int timestep, struct decostop *decostoptable, struct deco_state **cached_datap, bool is_planner, bool show_disclaimer)
+/* Results of the last plans. The planner recalculates the plan whenever any
+ * setting changes, including settings that only affect how the plan is shown
+ * (e.g. verbatim or runtime display). plan() therefore hashes everything the
+ * calculation depends on and, if the same input was planned before, only
+ * recreates the dive and the notes from the stored result. */
+#define MAX_PLAN_RESULTS 16
+
+struct plan_result {
+	unsigned char key[20];
+	unsigned int id;
+	unsigned int last_used;
+	struct divedatapoint *dp;
+	int eff_gflow, eff_gfhigh;
+	int surface_interval;
+	int error;
+	bool decodive;
+	int nr_stops;
+	struct decostop *stops;
+	struct deco_state ds;
+	struct deco_state initial;	/* tissues at the start of the dive, for the caller's cache */
+};
+
+struct plan_results {
+	int nr;
+	unsigned int clock;
+	unsigned int next_id;
+	unsigned int last_id;		/* result of the last plan() call, 0 if it was not stored */
+	bool unchanged;			/* the last plan() call gave the same result as the one before */
+	int hits;
+	struct plan_result entries[MAX_PLAN_RESULTS];
+};
+
+struct plan_results *alloc_plan_results(void)
+{
+	return calloc(1, sizeof(struct plan_results));
+}
+
+static void free_dp_list(struct divedatapoint *dp)
+{
+	while (dp) {
+		struct divedatapoint *ndp = dp->next;
+		free(dp);
+		dp = ndp;
+	}
+}
+
+static struct divedatapoint *copy_dp_list(const struct divedatapoint *dp)
+{
+	struct divedatapoint *res = NULL, **last = &res;
+
+	for (; dp; dp = dp->next) {
+		*last = malloc(sizeof(struct divedatapoint));
+		**last = *dp;
+		last = &(*last)->next;
+	}
+	*last = NULL;
+	return res;
+}
+
+void invalidate_plan_results(struct plan_results *results)
+{
+	if (!results)
+		return;
+	for (int i = 0; i < results->nr; i++) {
+		free_dp_list(results->entries[i].dp);
+		free(results->entries[i].stops);
+	}
+	results->nr = 0;
+	results->last_id = 0;
+	results->unchanged = false;
+}
+
+int plan_results_hits(const struct plan_results *results)
+{
+	return results ? results->hits : 0;
+}
+
+/* True if the last plan() was answered from the stored results with the same
+ * result as the plan() before it, i.e. only the presentation of the plan changed. */
+bool plan_result_unchanged(const struct plan_results *results)
+{
+	return results && results->unchanged;
+}
+
+void free_plan_results(struct plan_results *results)
+{
+	invalidate_plan_results(results);
+	free(results);
+}
+
+static void hash_int(SHA_CTX *ctx, int value)
+{
+	SHA1_Update(ctx, &value, sizeof(value));
+}
+
+/* The gas consumption is recalculated from the waypoints when the dive is
+ * created (see gasbudget.c). It only changes the waypoints in recreational
+ * mode, where the bottom time is limited by the gas, and for PSCR legs, where
+ * the SAC determines the inspired pO2. */
+static bool gas_changes_plan(const struct diveplan *diveplan, const struct dive *dive)
+{
+	const struct divedatapoint *dp;
+
+	if (decoMode() == RECREATIONAL || dive->dc.divemode == PSCR)
+		return true;
+	for (dp = diveplan->dp; dp; dp = dp->next) {
+		if (dp->divemode == PSCR)
+			return true;
+	}
+	return false;
+}
+
+/* The tissues at the start of the plan are loaded by the dives in the 48 hours
+ * before it (see init_decompression()). Hash everything of these dives that
+ * goes into the tissue calculation, so that editing, adding or deleting one of
+ * them changes the key. Dives of other trips are included, too, which at worst
+ * causes a superfluous replan. */
+static void hash_previous_dives(SHA_CTX *ctx, const struct dive *dive)
+{
+	timestamp_t last_starttime = dive->when;
+	const struct dive *pdive;
+	const struct sample *sample;
+	const struct event *ev;
+	int i, j;
+
+	for (i = dive_table.nr - 1; i >= 0; i--) {
+		pdive = get_dive(i);
+		if (pdive->when >= dive->when)
+			continue;
+		if (dive_endtime(pdive) + 48 * 60 * 60 < last_starttime)
+			break;
+		last_starttime = pdive->when;
+
+		SHA1_Update(ctx, &pdive->when, sizeof(pdive->when));
+		SHA1_Update(ctx, &pdive->divetrip, sizeof(pdive->divetrip));
+		hash_int(ctx, pdive->id);
+		hash_int(ctx, pdive->surface_pressure.mbar);
+		hash_int(ctx, pdive->salinity);
+		hash_int(ctx, pdive->sac);
+		hash_int(ctx, pdive->dc.divemode);
+		for (j = 0; j < MAX_CYLINDERS; j++) {
+			hash_int(ctx, pdive->cylinder[j].gasmix.o2.permille);
+			hash_int(ctx, pdive->cylinder[j].gasmix.he.permille);
+		}
+		for (j = 0, sample = pdive->dc.sample; j < pdive->dc.samples; j++, sample++) {
+			hash_int(ctx, sample->time.seconds);
+			hash_int(ctx, sample->depth.mm);
+			hash_int(ctx, sample->setpoint.mbar);
+		}
+		for (ev = pdive->dc.events; ev; ev = ev->next) {
+			hash_int(ctx, ev->time.seconds);
+			hash_int(ctx, ev->type);
+			hash_int(ctx, ev->value);
+			hash_int(ctx, ev->gas.index);
+		}
+		hash_int(ctx, -1);
+	}
+	hash_int(ctx, -1);
+}
+
+/* Hash everything the calculated plan depends on. The cylinder pressures are
+ * not included, since the planner resets them to the working pressure. */
+static void plan_key(const struct diveplan *diveplan, const struct dive *dive, int timestep, unsigned char key[20])
+{
+	SHA_CTX ctx;
+	const struct divedatapoint *dp;
+	bool hash_gas = gas_changes_plan(diveplan, dive);
+
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, &diveplan->when, sizeof(diveplan->when));
+	hash_int(&ctx, diveplan->surface_pressure);
+	hash_int(&ctx, diveplan->salinity);
+	hash_int(&ctx, diveplan->gflow);
+	hash_int(&ctx, diveplan->gfhigh);
+	hash_int(&ctx, diveplan->vpmb_conservatism);
+	for (dp = diveplan->dp; dp; dp = dp->next) {
+		hash_int(&ctx, dp->time);
+		hash_int(&ctx, dp->depth.mm);
+		hash_int(&ctx, dp->cylinderid);
+		hash_int(&ctx, dp->setpoint);
+		hash_int(&ctx, dp->entered);
+		hash_int(&ctx, dp->divemode);
+	}
+	hash_int(&ctx, -1);
+
+	hash_int(&ctx, timestep);
+	hash_int(&ctx, dive->dc.divemode);
+	SHA1_Update(&ctx, &dive->when, sizeof(dive->when));
+	SHA1_Update(&ctx, &dive->divetrip, sizeof(dive->divetrip));
+	hash_previous_dives(&ctx, dive);
+	hash_int(&ctx, decoMode());
+	for (int i = 0; i < MAX_CYLINDERS; i++) {
+		const cylinder_t *cyl = &dive->cylinder[i];
+		hash_int(&ctx, cyl->gasmix.o2.permille);
+		hash_int(&ctx, cyl->gasmix.he.permille);
+		hash_int(&ctx, cyl->depth.mm);
+		hash_int(&ctx, cyl->cylinder_use);
+		if (hash_gas) {
+			hash_int(&ctx, cyl->type.size.mliter);
+			hash_int(&ctx, cyl->type.workingpressure.mbar);
+		}
+	}
+
+	hash_int(&ctx, prefs.units.length);
+	hash_int(&ctx, prefs.last_stop);
+	hash_int(&ctx, prefs.ascrate75);
+	hash_int(&ctx, prefs.ascrate50);
+	hash_int(&ctx, prefs.ascratestops);
+	hash_int(&ctx, prefs.ascratelast6m);
+	hash_int(&ctx, prefs.descrate);
+	hash_int(&ctx, prefs.safetystop);
+	hash_int(&ctx, prefs.switch_at_req_stop);
+	hash_int(&ctx, prefs.min_switch_duration);
+	hash_int(&ctx, prefs.doo2breaks);
+	hash_int(&ctx, prefs.dobailout);
+	hash_int(&ctx, prefs.decopo2);
+	if (hash_gas) {
+		hash_int(&ctx, diveplan->bottomsac);
+		hash_int(&ctx, diveplan->decosac);
+		hash_int(&ctx, prefs.reserve_gas);
+		hash_int(&ctx, prefs.bottomsac);
+		hash_int(&ctx, prefs.decosac);
+		hash_int(&ctx, prefs.pscr_ratio);
+		hash_int(&ctx, prefs.o2consumption);
+	}
+	SHA1_Final(key, &ctx);
+}
+
+static struct plan_result *find_plan_result(struct plan_results *results, const unsigned char key[20])
+{
+	for (int i = 0; i < results->nr; i++) {
+		if (!memcmp(results->entries[i].key, key, 20))
+			return &results->entries[i];
+	}
+	return NULL;
+}
+
+static void store_plan_result(struct plan_results *results, const unsigned char key[20], const struct diveplan *diveplan,
+			      const struct decostop *decostoptable, const struct deco_state *ds, const struct deco_state *initial,
+			      int error, bool decodive)
+{
+	struct plan_result *res;
+	int nr_stops = 0;
+
+	if (results->nr < MAX_PLAN_RESULTS) {
+		res = &results->entries[results->nr++];
+	} else {
+		/* Replace the least recently used result */
+		res = &results->entries[0];
+		for (int i = 1; i < results->nr; i++) {
+			if (results->entries[i].last_used < res->last_used)
+				res = &results->entries[i];
+		}
+		free_dp_list(res->dp);
+		free(res->stops);
+	}
+	while (decostoptable && decostoptable[nr_stops].depth)
+		nr_stops++;
+
+	memcpy(res->key, key, 20);
+	res->id = ++results->next_id;
+	results->last_id = res->id;
+	results->unchanged = false;
+	res->last_used = ++results->clock;
+	res->dp = copy_dp_list(diveplan->dp);
+	res->eff_gflow = diveplan->eff_gflow;
+	res->eff_gfhigh = diveplan->eff_gfhigh;
+	res->surface_interval = diveplan->surface_interval;
+	res->error = error;
+	res->decodive = decodive;
+	res->nr_stops = nr_stops;
+	res->stops = malloc((nr_stops + 1) * sizeof(struct decostop));
+	if (nr_stops)
+		memcpy(res->stops, decostoptable, nr_stops * sizeof(struct decostop));
+	res->stops[nr_stops].depth = 0;
+	res->stops[nr_stops].time = 0;
+	res->ds = *ds;
+	res->initial = *initial;
+}
+
+/* Recreate the dive, the notes and the deco state of a stored plan */
+static bool restore_plan_result(struct plan_results *results, struct plan_result *res, struct deco_state *ds, struct diveplan *diveplan,
+				struct dive *dive, struct decostop *decostoptable, struct deco_state **cached_datap)
+{
+	results->hits++;
+	results->unchanged = res->id == results->last_id;
+	results->last_id = res->id;
+	res->last_used = ++results->clock;
+	free_dps(diveplan);
+	diveplan->dp = copy_dp_list(res->dp);
+	for (struct divedatapoint *dp = diveplan->dp; dp; dp = dp->next)
+		dp->minimum_gas.mbar = 0;	/* recalculated when the dive is created */
+	diveplan->eff_gflow = res->eff_gflow;
+	diveplan->eff_gfhigh = res->eff_gfhigh;
+	diveplan->surface_interval = res->surface_interval;
+	*ds = res->ds;
+	cache_deco_state(&res->initial, cached_datap);
+	memcpy(decostoptable, res->stops, (res->nr_stops + 1) * sizeof(struct decostop));
+
+	dive->surface_pressure.mbar = diveplan->surface_pressure;
+	create_dive_from_plan(diveplan, dive, true);
+	diveplan->error = res->error;
+	fixup_dc_duration(&dive->dc);
+	return res->decodive;
+}
+
+bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, int timestep, struct decostop *decostoptable, struct deco_state **cached_datap, bool is_planner)
 {
 
 	int bottom_depth;
@@ -661,7 +1158,7 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 	int depth;
 	struct gaschanges *gaschanges = NULL;
 	int gaschangenr;
-	int *decostoplevels;
+	int decostoplevels[sizeof(decostoplevels_metric) / sizeof(int)];
 	int decostoplevelcount;
 	int *stoplevels = NULL;
 	bool stopping = false;
@@ -680,23 +1177,42 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 	int laststoptime = timestep;
 	bool o2breaking = false;
 	int decostopcounter = 0;
+	int *stop_hints = NULL;
+	int i;
 	enum divemode_t divemode = dive->dc.divemode;
+	unsigned char key[20];
+	struct plan_result *result;
+	bool use_results;
 
-	set_gf(diveplan->gflow, diveplan->gfhigh);
-	set_vpmb_conservatism(diveplan->vpmb_conservatism);
 	if (!diveplan->surface_pressure)
 		diveplan->surface_pressure = SURFACE_PRESSURE;
+	if (is_planner) {
+		/* The notes are rendered on demand by add_plan_to_notes() */
+		free(dive->notes);
+		dive->notes = NULL;
+	}
+	/* The key doesn't cover a deco state passed in by the caller */
+	use_results = is_planner && diveplan->results && !*cached_datap;
+	if (use_results) {
+		plan_key(diveplan, dive, timestep, key);
+		if ((result = find_plan_result(diveplan->results, key)) != NULL)
+			return restore_plan_result(diveplan->results, result, ds, diveplan, dive, decostoptable, cached_datap);
+	} else if (diveplan->results) {
+		diveplan->results->last_id = 0;
+		diveplan->results->unchanged = false;
+	}
+	set_plan_deco_params(diveplan->gflow, diveplan->gfhigh, diveplan->vpmb_conservatism);
 	dive->surface_pressure.mbar = diveplan->surface_pressure;
 	clear_deco(ds, dive->surface_pressure.mbar / 1000.0);
 	ds->max_bottom_ceiling_pressure.mbar = ds->first_ceiling_pressure.mbar = 0;
 	create_dive_from_plan(diveplan, dive, is_planner);
 
-	// Do we want deco stop array in metres or feet?
+	// Do we want deco stop array in metres or feet? Use a copy, since the last stop is adjusted below.
 	if (prefs.units.length == METERS ) {
-		decostoplevels = decostoplevels_metric;
+		memcpy(decostoplevels, decostoplevels_metric, sizeof(decostoplevels_metric));
 		decostoplevelcount = sizeof(decostoplevels_metric) / sizeof(int);
 	} else {
-		decostoplevels = decostoplevels_imperial;
+		memcpy(decostoplevels, decostoplevels_imperial, sizeof(decostoplevels_imperial));
 		decostoplevelcount = sizeof(decostoplevels_imperial) / sizeof(int);
 	}
 
@@ -734,6 +1250,7 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 		transitiontime = lrint(depth / (double)prefs.ascratelast6m);
 		plan_add_segment(diveplan, transitiontime, 0, current_cylinder, po2, false, divemode);
 		create_dive_from_plan(diveplan, dive, is_planner);
+		clear_plan_deco_params();
 		return false;
 	}
 
@@ -754,7 +1271,7 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 		gaschanges = NULL;
 		gaschangenr = 0;
 	} else {
-		gaschanges = analyze_gaslist(diveplan, &gaschangenr, depth, &best_first_ascend_cylinder);
+		gaschanges = analyze_gaslist(diveplan, dive, &gaschangenr, depth, &best_first_ascend_cylinder);
 	}
 	/* Find the first potential decostopdepth above current depth */
 	for (stopidx = 0; stopidx < decostoplevelcount; stopidx++)
@@ -766,31 +1283,37 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 	stoplevels = sort_stops(decostoplevels, stopidx + 1, gaschanges, gaschangenr);
 	stopidx += gaschangenr;
 
+	/* Length of the stops in the previous CVA iteration, used as starting point for the search */
+	stop_hints = malloc((stopidx + 1) * sizeof(int));
+	for (i = 0; i <= stopidx; i++)
+		stop_hints[i] = -1;
+
 	gi = gaschangenr - 1;
 
 	/* Set tissue tolerance and initial vpmb gradient at start of ascent phase */
-	diveplan->surface_interval = tissue_at_end(ds, dive, cached_datap);
+	check_deco_checkpoints(diveplan->checkpoints, diveplan, dive);
+	diveplan->surface_interval = tissue_at_end(ds, dive, cached_datap, diveplan->checkpoints);
 	nuclear_regeneration(ds, clock);
 	vpmb_start_gradient(ds);
 	if (decoMode() == RECREATIONAL) {
 		bool safety_stop = prefs.safetystop && max_depth >= 10000;
-		track_ascent_gas(depth, &dive->cylinder[current_cylinder], avg_depth, bottom_time, safety_stop, divemode);
+		track_ascent_gas(&diveplan->gas, dive, depth, current_cylinder, avg_depth, bottom_time, safety_stop, divemode);
 		// How long can we stay at the current depth and still directly ascent to the surface?
 		do {
 			add_segment(ds, depth_to_bar(depth, dive),
 				    dive->cylinder[current_cylinder].gasmix,
 				    timestep, po2, divemode, prefs.bottomsac);
-			update_cylinder_pressure(dive, depth, depth, timestep, prefs.bottomsac, &dive->cylinder[current_cylinder], false, divemode);
+			gas_budget_add_segment(&diveplan->gas, dive, current_cylinder, depth, depth, timestep, prefs.bottomsac, false, divemode);
 			clock += timestep;
 		} while (trial_ascent(ds, 0, depth, 0, avg_depth, bottom_time, dive->cylinder[current_cylinder].gasmix,
 				      po2, diveplan->surface_pressure / 1000.0, dive, divemode) &&
-			 enough_gas(current_cylinder) && clock < 6 * 3600);
+			 gas_budget_enough(&diveplan->gas, dive, current_cylinder, prefs.reserve_gas) && clock < 6 * 3600);
 
 		// We did stay one DECOTIMESTEP too many.
 		// In the best of all worlds, we would roll back also the last add_segment in terms of caching deco state, but
 		// let's ignore that since for the eventual ascent in recreational mode, nobody looks at the ceiling anymore,
 		// so we don't really have to compute the deco state.
-		update_cylinder_pressure(dive, depth, depth, -timestep, prefs.bottomsac, &dive->cylinder[current_cylinder], false, divemode);
+		gas_budget_add_segment(&diveplan->gas, dive, current_cylinder, depth, depth, -timestep, prefs.bottomsac, false, divemode);
 		clock -= timestep;
 		plan_add_segment(diveplan, clock - previous_point_time, depth, current_cylinder, po2, true, divemode);
 		previous_point_time = clock;
@@ -818,11 +1341,15 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 		} while (depth > 0);
 		plan_add_segment(diveplan, clock - previous_point_time, 0, current_cylinder, po2, false, divemode);
 		create_dive_from_plan(diveplan, dive, is_planner);
-		add_plan_to_notes(diveplan, dive, show_disclaimer, error);
+		diveplan->error = error;
 		fixup_dc_duration(&dive->dc);
+		if (use_results)
+			store_plan_result(diveplan->results, key, diveplan, NULL, ds, *cached_datap, error, false);
 
 		free(stoplevels);
 		free(gaschanges);
+		free(stop_hints);
+		clear_plan_deco_params();
 		return false;
 	}
 
@@ -837,7 +1364,7 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 	}
 
 	// VPM-B or Buehlmann Deco
-	tissue_at_end(ds, dive, cached_datap);
+	tissue_at_end(ds, dive, cached_datap, diveplan->checkpoints);
 	previous_deco_time = 100000000;
 	ds->deco_time = 10000000;
 	cache_deco_state(ds, &bottom_cache);  // Lets us make several iterations
@@ -999,9 +1526,10 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 					pendinggaschange = false;
 				}
 
-				int new_clock = wait_until(ds, dive, clock, clock, laststoptime * 2 + 1, timestep, depth, stoplevels[stopidx], avg_depth,
+				int new_clock = wait_until(ds, dive, clock, timestep, stop_hints[stopidx], depth, stoplevels[stopidx], avg_depth,
 					bottom_time, dive->cylinder[current_cylinder].gasmix, po2, diveplan->surface_pressure / 1000.0, divemode);
 				laststoptime = new_clock - clock;
+				stop_hints[stopidx] = laststoptime;
 				/* Finish infinite deco */
 				if (laststoptime >= 48 * 3600 && depth >= 6000) {
 					error = LONGDECO;
@@ -1081,12 +1609,16 @@ bool plan(struct deco_state *ds, struct diveplan *diveplan, struct dive *dive, i
 	}
 
 	create_dive_from_plan(diveplan, dive, is_planner);
-	add_plan_to_notes(diveplan, dive, show_disclaimer, error);
+	diveplan->error = error;
 	fixup_dc_duration(&dive->dc);
+	if (use_results)
+		store_plan_result(diveplan->results, key, diveplan, decostoptable, ds, *cached_datap, error, decodive);
 
 	free(stoplevels);
 	free(gaschanges);
+	free(stop_hints);
 	free(bottom_cache);
+	clear_plan_deco_params();
 	return decodive;
 }
 
@@ -20,9 +20,18 @@ extern void set_display_transitions(bool display);
 extern int get_cylinderid_at_time(struct dive *dive, struct divecomputer *dc, duration_t time);
 extern int get_gasidx(struct dive *dive, struct gasmix mix);
 extern bool diveplan_empty(struct diveplan *diveplan);
-extern void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_disclaimer, int error);
+extern char *render_plan_notes(struct diveplan *diveplan, struct dive *dive, bool show_disclaimer);
+extern void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_disclaimer);
 
 extern void free_dps(struct diveplan *diveplan);
+extern struct deco_checkpoints *alloc_deco_checkpoints(void);
+extern void free_deco_checkpoints(struct deco_checkpoints *cps);
+extern void invalidate_deco_checkpoints(struct deco_checkpoints *cps);
+extern struct plan_results *alloc_plan_results(void);
+extern void free_plan_results(struct plan_results *results);
+extern void invalidate_plan_results(struct plan_results *results);
+extern int plan_results_hits(const struct plan_results *results);
+extern bool plan_result_unchanged(const struct plan_results *results);
 extern struct dive *planned_dive;
 extern char *cache_data;
 extern char *disclaimer;
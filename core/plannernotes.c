@@ -13,6 +13,7 @@
 #include "deco.h"
 #include "divelist.h"
 #include "planner.h"
+#include "gasbudget.h"
 #include "gettext.h"
 #include "libdivecomputer/parser.h"
 #include "qthelper.h"
@@ -70,7 +71,10 @@ static void add_icd_entry(struct membuffer *b, struct icd_data *icdvalues, bool
 		ambientpressure_mbar * -icdvalues->dHe / 5e6f, translate("gettextFromC", "bar"));
 }
 
-void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_disclaimer, int error)
+/* Render the notes of a plan calculated by plan(). This is not done by plan()
+ * itself, since the notes are only needed when they are shown or saved.
+ * Returns a newly allocated string, or NULL if there is no plan. */
+char *render_plan_notes(struct diveplan *diveplan, struct dive *dive, bool show_disclaimer)
 {
 	struct membuffer buf = { 0 };
 	struct membuffer icdbuf = { 0 };
@@ -101,9 +105,9 @@ void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_d
 	}
 
 	if (!dp)
-		return;
+		return NULL;
 
-	if (error) {
+	if (diveplan->error) {
 		put_format(&buf, "<span style='color: red;'>%s </span> %s<br>",
 				translate("gettextFromC", "Warning:"),
 				translate("gettextFromC", "Decompression calculation aborted due to excessive time"));
@@ -444,6 +448,7 @@ void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_d
 		const char *unit, *pressure_unit, *depth_unit;
 		char warning[1000] = "";
 		char mingas[1000] = "";
+		char turn[1000] = "";
 		cylinder_t *cyl = &dive->cylinder[gasidx];
 		if (cylinder_none(cyl))
 			break;
@@ -476,13 +481,8 @@ void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_d
 				if (lastbottomdp && gasidx == lastbottomdp->cylinderid
 					&& dive->dc.divemode == OC && decoMode() != RECREATIONAL) {
 					/* Calculate minimum gas volume. */
-					volume_t mingasv;
-					mingasv.mliter = lrint(prefs.sacfactor / 100.0 * prefs.problemsolvingtime * prefs.bottomsac
-						* depth_to_bar(lastbottomdp->depth.mm, dive)
-						+ prefs.sacfactor / 100.0 * cyl->deco_gas_used.mliter);
-					/* Calculate minimum gas pressure for cyclinder. */
-					lastbottomdp->minimum_gas.mbar = lrint(isothermal_pressure(cyl->gasmix, 1.0,
-						mingasv.mliter, cyl->type.size.mliter) * 1000);
+					volume_t mingasv = gas_budget_minimum_gas(&diveplan->gas, dive, gasidx, lastbottomdp->depth.mm);
+					lastbottomdp->minimum_gas = diveplan->gas.cyl[gasidx].minimum;
 					/* Translate all results into correct units */
 					mingas_volume = get_volume_units(mingasv.mliter, NULL, &unit);
 					mingas_pressure = get_pressure_units(lastbottomdp->minimum_gas.mbar, &pressure_unit);
@@ -510,6 +510,13 @@ void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_d
 							translate("gettextFromC", "required minimum gas for ascent already exceeding start pressure of cylinder!"));
 					}
 				}
+			/* Print the pressure at the start of the ascent for cylinders used at the bottom */
+			if (diveplan->gas.cyl[gasidx].turn.mbar < cyl->start.mbar) {
+				const char *turn_unit;
+				double turn_pressure = get_pressure_units(diveplan->gas.cyl[gasidx].turn.mbar, &turn_unit);
+				snprintf_loc(turn, sizeof(turn), "<br>&nbsp;&mdash; %s: %.0f%s",
+					     translate("gettextFromC", "Turn pressure"), turn_pressure, turn_unit);
+			}
 			/* Print the gas consumption for every cylinder here to temp buffer. */
 			if (lrint(volume) > 0) {
 				asprintf_loc(&temp, translate("gettextFromC", "%.0f%s/%.0f%s of <span style='color: red;'><b>%s</b></span> (%.0f%s/%.0f%s in planned ascent)"),
@@ -528,7 +535,7 @@ void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_d
 			}
 		}
 		/* Gas consumption: Now finally print all strings to output */
-		put_format(&buf, "%s%s%s<br></div>", temp, warning, mingas);
+		put_format(&buf, "%s%s%s%s<br></div>", temp, warning, mingas, turn);
 		free(temp);
 	}
 
@@ -594,6 +601,15 @@ void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_d
 	put_string(&buf, "</div>");
 finished:
 	mb_cstring(&buf);
+	return detach_buffer(&buf);
+}
+
+void add_plan_to_notes(struct diveplan *diveplan, struct dive *dive, bool show_disclaimer)
+{
+	char *notes = render_plan_notes(diveplan, dive, show_disclaimer);
+
+	if (!notes)
+		return;
 	free(dive->notes);
-	dive->notes = detach_buffer(&buf);
+	dive->notes = notes;
 }
@@ -403,7 +403,7 @@ struct plot_info calculate_max_limits_new(struct dive *dive, struct divecomputer
 {
 	struct divecomputer *dc = &(dive->dc);
 	bool seen = false;
-	static struct plot_info pi;
+	struct plot_info pi;
 	int maxdepth = dive->maxdepth.mm;
 	int maxtime = 0;
 	int maxpressure = 0, minpressure = INT_MAX;
@@ -930,8 +930,9 @@ static void calculate_ndl_tts(struct deco_state *ds, const struct dive *dive, st
 					 surface_pressure, dive, 1), deco_stepsize);
 	int ascent_depth = entry->depth;
 	/* at what time should we give up and say that we got enuff NDL? */
-	/* If iterating through a dive, entry->tts_calc needs to be reset */
+	/* If iterating through a dive, entry->tts_calc and entry->ndl_calc need to be reset */
 	entry->tts_calc = 0;
+	entry->ndl_calc = 0;
 
 	/* If we don't have a ceiling yet, calculate ndl. Don't try to calculate
 	 * a ndl for lower values than 3m it would take forever */
@@ -1009,15 +1010,37 @@ void calculate_deco_information(struct deco_state *ds, const struct deco_state *
 		ds->first_ceiling_pressure = planner_ds->first_ceiling_pressure;
 	}
 	struct deco_state *cache_data_initial = NULL;
-	lock_planner();
+	lock_planner_shared();
 	/* For VPM-B outside the planner, cache the initial deco state for CVA iterations */
 	if (decoMode() == VPMB) {
 		cache_deco_state(ds, &cache_data_initial);
 	}
 	/* For VPM-B outside the planner, iterate until deco time converges (usually one or two iterations after the initial)
-	 * Set maximum number of iterations to 10 just in case */
-
-	while ((abs(prev_deco_time - ds->deco_time) >= 30) && (count_iteration < 10)) {
+	 * Set maximum number of iterations to 10 just in case.
+	 * Only the TTS at the last data point feeds the next iteration, so the CVA iterations skip the NDL/TTS
+	 * along the profile. Once deco time has converged, the last iteration is repeated from its cached
+	 * start state to fill in the NDL/TTS values for display. */
+	bool cva = decoMode() == VPMB && !in_planner();
+	bool ndl_pass = false, iteration_first = true;
+	int iteration_prev_deco_time = 0, iteration_time_deep_ceiling = 0;
+	struct deco_state *cache_data_iteration = NULL;
+
+	for (;;) {
+		if (abs(prev_deco_time - ds->deco_time) < 30 || count_iteration >= 10) {
+			/* Converged: repeat the last iteration with NDL/TTS, unless that was the first (estimated) one */
+			if (!cva || ndl_pass || !prefs.calcndltts || print_mode || iteration_first)
+				break;
+			*ds = *cache_data_iteration;
+			prev_deco_time = iteration_prev_deco_time;
+			time_deep_ceiling = iteration_time_deep_ceiling;
+			first_iteration = false;
+			ndl_pass = true;
+		} else if (cva) {
+			cache_deco_state(ds, &cache_data_iteration);
+			iteration_prev_deco_time = prev_deco_time;
+			iteration_time_deep_ceiling = time_deep_ceiling;
+			iteration_first = first_iteration;
+		}
 		int last_ndl_tts_calc_time = 0, first_ceiling = 0, current_ceiling, last_ceiling = 0, final_tts = 0 , time_clear_ceiling = 0;
 		if (decoMode() == VPMB)
 			ds->first_ceiling_pressure.mbar = depth_to_mbar(first_ceiling, dive);
@@ -1103,9 +1126,9 @@ void calculate_deco_information(struct deco_state *ds, const struct deco_state *
 			/* should we do more calculations?
 			* We don't for print-mode because this info doesn't show up there
 			* If the ceiling hasn't cleared by the last data point, we need tts for VPM-B CVA calculation
-			* It is not necessary to do these calculation on the first VPMB iteration, except for the last data point */
-			if ((prefs.calcndltts && !print_mode && (decoMode() != VPMB || in_planner() || !first_iteration)) ||
-			    (decoMode() == VPMB && !in_planner() && i == pi->nr - 1)) {
+			* It is not necessary to do these calculation in the VPMB CVA iterations, except for the last data point */
+			if ((prefs.calcndltts && !print_mode && (!cva || ndl_pass)) ||
+			    (cva && i == pi->nr - 1)) {
 				/* only calculate ndl/tts on every 30 seconds */
 				if ((entry->sec - last_ndl_tts_calc_time) < 30 && i != pi->nr - 1) {
 					struct plot_data *prev_entry = (entry - 1);
@@ -1156,6 +1179,7 @@ void calculate_deco_information(struct deco_state *ds, const struct deco_state *
 	}
 
 	free(cache_data_initial);
+	free(cache_data_iteration);
 #if DECO_CALC_DEBUG & 1
 	dump_tissues(ds);
 #endif
@@ -1323,6 +1347,20 @@ static void debug_print_profiledata(struct plot_info *pi)
  * about it.
  */
 void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool fast, struct deco_state *planner_ds)
+{
+	/* Create the new plot data */
+	free((void *)last_pi_entry_new);
+	calculate_plot_info(dive, dc, pi, fast, planner_ds);
+	last_pi_entry_new = pi->entry;
+}
+
+/*
+ * Same as create_plot_info_new(), but the plot entries are owned by
+ * the caller and have to be freed with free_plot_info_data().
+ * This does not touch any global state and can therefore be called
+ * for different dives in parallel.
+ */
+void calculate_plot_info(struct dive *dive, struct divecomputer *dc, struct plot_info *pi, bool fast, struct deco_state *planner_ds)
 {
 	int o2, he, o2max;
 #ifndef SUBSURFACE_MOBILE
@@ -1331,8 +1369,6 @@ void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plo
 #else
 	UNUSED(planner_ds);
 #endif
-	/* Create the new plot data */
-	free((void *)last_pi_entry_new);
 
 	get_dive_gas(dive, &o2, &he, &o2max);
 	if (dc->divemode == FREEDIVE){
@@ -1346,7 +1382,7 @@ void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plo
 			pi->dive_type = AIR;
 	}
 
-	last_pi_entry_new = populate_plot_entries(dive, dc, pi);
+	populate_plot_entries(dive, dc, pi);
 
 	check_setpoint_events(dive, dc, pi);     /* Populate setpoints */
 	setup_gas_sensor_pressure(dive, dc, pi); /* Try to populate our gas pressure knowledge */
@@ -1369,6 +1405,13 @@ void create_plot_info_new(struct dive *dive, struct divecomputer *dc, struct plo
 	analyze_plot_info(pi);
 }
 
+void free_plot_info_data(struct plot_info *pi)
+{
+	free(pi->entry);
+	pi->entry = NULL;
+	pi->nr = 0;
+}
+
 struct divecomputer *select_dc(struct dive *dive)
 {
 	unsigned int max = number_of_computers(dive);
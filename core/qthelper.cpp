@@ -33,6 +33,7 @@
 #include <QProgressDialog>	// TODO: remove with convertThumbnails()
 #include <cstdarg>
 #include <cstdint>
+#include <cmath>
 
 #include <libxslt/documents.h>
 
@@ -41,17 +42,136 @@ static QLocale loc;
 
 static const QString DEGREE_SIGNS("dD" UTF8_DEGREE);
 
+// Formatting values with units is done for every cell of the dive list, every
+// tooltip of the profile and every value of the exports. Therefore, the unit
+// strings and the number formatting data of the locale are looked up only when
+// the unit preferences change. The formatter is immutable and published
+// atomically, so that it can be used from multiple threads without locking.
+// Outdated formatters are never freed, since other threads might still use them.
+// Unit preferences change rarely, so this is not a problem.
+namespace {
+	struct UnitFormatter {
+		units::LENGTH length;
+		units::VOLUME volume;
+		units::PRESSURE pressure;
+		units::TEMPERATURE temperature;
+		units::WEIGHT weight;
+		QString depthUnit, weightUnit, pressureUnit, volumeUnit, temperatureUnit;
+		QLocale locale;		// the separators and digits below depend on the locale
+		QChar decimalPoint, groupSeparator, minusSign, zeroDigit;
+		bool groupDigits;
+
+		UnitFormatter(const struct units &u);
+		bool isCurrent(const struct units &u) const;
+		QString format(double value, int decimals, const QString &unit = QString()) const;
+	};
+}
+
+UnitFormatter::UnitFormatter(const struct units &u) :
+	length(u.length), volume(u.volume), pressure(u.pressure), temperature(u.temperature), weight(u.weight)
+{
+	depthUnit = length == units::METERS ? gettextFromC::tr("m") : gettextFromC::tr("ft");
+	weightUnit = weight == units::KG ? gettextFromC::tr("kg") : gettextFromC::tr("lbs");
+	pressureUnit = pressure == units::BAR ? gettextFromC::tr("bar") : gettextFromC::tr("psi");
+	temperatureUnit = temperature == units::CELSIUS ? QString(UTF8_DEGREE) + gettextFromC::tr("C") :
+							  QString(UTF8_DEGREE) + gettextFromC::tr("F");
+	const char *unit;
+	(void) get_volume_units(0, NULL, &unit);
+	volumeUnit = QString(unit);
+	decimalPoint = locale.decimalPoint();
+	groupSeparator = locale.groupSeparator();
+	minusSign = locale.negativeSign();
+	zeroDigit = locale.zeroDigit();
+	groupDigits = !(locale.numberOptions() & QLocale::OmitGroupSeparator);
+}
+
+bool UnitFormatter::isCurrent(const struct units &u) const
+{
+	// Comparing locales only compares pointers to the locale data and the number options
+	return length == u.length && volume == u.volume && pressure == u.pressure &&
+	       temperature == u.temperature && weight == u.weight && locale == QLocale();
+}
+
+// Equivalent to QString("%L1%2").arg(value, 0, 'f', decimals).arg(unit), but
+// without the intermediate strings and the lookup of the locale.
+QString UnitFormatter::format(double value, int decimals, const QString &unit) const
+{
+	// printf() rounds values that lie exactly halfway between two outputs to even,
+	// Qt rounds them away from zero (1.25 -> 1.3, 2.5 -> 3). The fma() is exact when
+	// the value is such a tie: then round the value away from zero ourselves.
+	if (std::isfinite(value) && decimals >= 0 && decimals < 16) {
+		static const double powersOfTen[16] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+							1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+		double scale = powersOfTen[decimals];
+		double half = std::floor(value * scale) + 0.5;
+		// Beyond 2^52 doubles have no fractional part, so there are no ties
+		if (std::fabs(half) < 4503599627370496.0 && std::fma(value, scale, -half) == 0.0)
+			value = std::copysign(std::fabs(half) + 0.5, value) / scale;
+	}
+
+	char digits[64];
+	int len = std::isfinite(value) ? snprintf(digits, sizeof(digits), "%.*f", decimals, value) : -1;
+	if (len <= 0 || len >= (int)sizeof(digits))
+		return QString("%L1%2").arg(value, 0, 'f', decimals).arg(unit);
+
+	// Room for the digits, one group separator per three digits and the decimal point
+	QChar buf[2 * sizeof(digits)];
+	int n = 0;
+	const char *p = digits;
+	if (*p == '-') {
+		buf[n++] = minusSign;
+		++p;
+	}
+	int intDigits = 0;
+	while (p[intDigits] >= '0' && p[intDigits] <= '9')
+		++intDigits;
+	for (int i = 0; i < intDigits; ++i) {
+		if (groupDigits && i > 0 && (intDigits - i) % 3 == 0)
+			buf[n++] = groupSeparator;
+		buf[n++] = QChar(zeroDigit.unicode() + (p[i] - '0'));
+	}
+	p += intDigits;
+	// printf() uses the decimal point of the C locale, which is not necessarily '.'
+	if (*p) {
+		buf[n++] = decimalPoint;
+		for (++p; *p >= '0' && *p <= '9'; ++p)
+			buf[n++] = QChar(zeroDigit.unicode() + (*p - '0'));
+	}
+
+	QString res;
+	res.reserve(n + unit.size());
+	res.append(buf, n);
+	res.append(unit);
+	return res;
+}
+
+static QAtomicPointer<const UnitFormatter> currentFormatter;
+static QMutex formatterLock;
+
+static const UnitFormatter &formatter()
+{
+	const UnitFormatter *f = currentFormatter.loadAcquire();
+	if (f && f->isCurrent(*get_units()))
+		return *f;
+	QMutexLocker l(&formatterLock);
+	f = currentFormatter.loadAcquire();
+	if (!f || !f->isCurrent(*get_units())) {
+		f = new UnitFormatter(*get_units());
+		currentFormatter.storeRelease(f);
+	}
+	return *f;
+}
+
 QString weight_string(int weight_in_grams)
 {
-	QString str;
-	if (get_units()->weight == units::KG) {
+	const UnitFormatter &f = formatter();
+	if (f.weight == units::KG) {
 		double kg = (double) weight_in_grams / 1000.0;
-		str = QString("%L1").arg(kg, 0, 'f', kg >= 20.0 ? 0 : 1);
+		return f.format(kg, kg >= 20.0 ? 0 : 1);
 	} else {
 		double lbs = grams_to_lbs(weight_in_grams);
-		str = QString("%L1").arg(lbs, 0, 'f', lbs >= 40.0 ? 0 : 1);
+		return f.format(lbs, lbs >= 40.0 ? 0 : 1);
 	}
-	return str;
 }
 
 QString distance_string(int distanceInMeters)
@@ -350,18 +470,6 @@ extern "C" char *get_file_name(const char *fileName)
 	return copy_qstring(fileInfo.fileName());
 }
 
-extern "C" void copy_image_and_overwrite(const char *cfileName, const char *path, const char *cnewName)
-{
-	QString fileName(cfileName);
-	QString newName(path);
-	newName += cnewName;
-	QFile file(newName);
-	if (file.exists())
-		file.remove();
-	if (!QFile::copy(fileName, newName))
-		qDebug() << "copy of" << fileName << "to" << newName << "failed";
-}
-
 static bool lessThan(const QPair<QString, int> &a, const QPair<QString, int> &b)
 {
 	return a.second < b.second;
@@ -519,12 +627,13 @@ QString get_dc_nickname(const char *model, uint32_t deviceid)
 
 QString get_depth_string(int mm, bool showunit, bool showdecimal)
 {
-	if (prefs.units.length == units::METERS) {
+	const UnitFormatter &f = formatter();
+	if (f.length == units::METERS) {
 		double meters = mm / 1000.0;
-		return QString("%L1%2").arg(meters, 0, 'f', (showdecimal && meters < 20.0) ? 1 : 0).arg(showunit ? gettextFromC::tr("m") : QString());
+		return f.format(meters, (showdecimal && meters < 20.0) ? 1 : 0, showunit ? f.depthUnit : QString());
 	} else {
 		double feet = mm_to_feet(mm);
-		return QString("%L1%2").arg(feet, 0, 'f', 0).arg(showunit ? gettextFromC::tr("ft") : QString());
+		return f.format(feet, 0, showunit ? f.depthUnit : QString());
 	}
 }
 
@@ -535,41 +644,33 @@ QString get_depth_string(depth_t depth, bool showunit, bool showdecimal)
 
 QString get_depth_unit()
 {
-	if (prefs.units.length == units::METERS)
-		return gettextFromC::tr("m");
-	else
-		return gettextFromC::tr("ft");
+	return formatter().depthUnit;
 }
 
 QString get_weight_string(weight_t weight, bool showunit)
 {
 	QString str = weight_string(weight.grams);
-	if (get_units()->weight == units::KG) {
-		str = QString("%1%2").arg(str, showunit ? gettextFromC::tr("kg") : QString());
-	} else {
-		str = QString("%1%2").arg(str, showunit ? gettextFromC::tr("lbs") : QString());
-	}
+	if (showunit)
+		str += formatter().weightUnit;
 	return str;
 }
 
 QString get_weight_unit()
 {
-	if (prefs.units.weight == units::KG)
-		return gettextFromC::tr("kg");
-	else
-		return gettextFromC::tr("lbs");
+	return formatter().weightUnit;
 }
 
 QString get_temperature_string(temperature_t temp, bool showunit)
 {
+	const UnitFormatter &f = formatter();
 	if (temp.mkelvin == 0) {
 		return ""; //temperature not defined
-	} else if (prefs.units.temperature == units::CELSIUS) {
+	} else if (f.temperature == units::CELSIUS) {
 		double celsius = mkelvin_to_C(temp.mkelvin);
-		return QString("%L1%2%3").arg(celsius, 0, 'f', 1).arg(showunit ? (UTF8_DEGREE) : "").arg(showunit ? gettextFromC::tr("C") : QString());
+		return f.format(celsius, 1, showunit ? f.temperatureUnit : QString());
 	} else {
 		double fahrenheit = mkelvin_to_F(temp.mkelvin);
-		return QString("%L1%2%3").arg(fahrenheit, 0, 'f', 1).arg(showunit ? (UTF8_DEGREE) : "").arg(showunit ? gettextFromC::tr("F") : QString());
+		return f.format(fahrenheit, 1, showunit ? f.temperatureUnit : QString());
 	}
 }
 
@@ -583,10 +684,10 @@ QString get_temp_unit()
 
 QString get_volume_string(int mliter, bool showunit)
 {
-	const char *unit;
+	const UnitFormatter &f = formatter();
 	int decimals;
-	double value = get_volume_units(mliter, &decimals, &unit);
-	return QString("%L1%2").arg(value, 0, 'f', decimals).arg(showunit ? unit : "");
+	double value = get_volume_units(mliter, &decimals, NULL);
+	return f.format(value, decimals, showunit ? f.volumeUnit : QString());
 }
 
 QString get_volume_string(volume_t volume, bool showunit)
@@ -596,19 +697,18 @@ QString get_volume_string(volume_t volume, bool showunit)
 
 QString get_volume_unit()
 {
-	const char *unit;
-	(void) get_volume_units(0, NULL, &unit);
-	return QString(unit);
+	return formatter().volumeUnit;
 }
 
 QString get_pressure_string(pressure_t pressure, bool showunit)
 {
-	if (prefs.units.pressure == units::BAR) {
+	const UnitFormatter &f = formatter();
+	if (f.pressure == units::BAR) {
 		double bar = pressure.mbar / 1000.0;
-		return QString("%L1%2").arg(bar, 0, 'f', 0).arg(showunit ? gettextFromC::tr("bar") : QString());
+		return f.format(bar, 0, showunit ? f.pressureUnit : QString());
 	} else {
 		double psi = mbar_to_PSI(pressure.mbar);
-		return QString("%L1%2").arg(psi, 0, 'f', 0).arg(showunit ? gettextFromC::tr("psi") : QString());
+		return f.format(psi, 0, showunit ? f.pressureUnit : QString());
 	}
 }
 
@@ -1593,11 +1693,19 @@ extern "C" void print_qt_versions()
 	printf("%s\n", qPrintable(QStringLiteral("built with Qt Version %1, runtime from Qt Version %2").arg(QT_VERSION_STR).arg(qVersion())));
 }
 
-QMutex planLock;
+// The profile calculation only reads the planner state. Therefore, multiple
+// profiles can be calculated in parallel (e.g. when printing), while the
+// planner takes the lock exclusively.
+QReadWriteLock planLock;
 
 extern "C" void lock_planner()
 {
-	planLock.lock();
+	planLock.lockForWrite();
+}
+
+extern "C" void lock_planner_shared()
+{
+	planLock.lockForRead();
 }
 
 extern "C" void unlock_planner()
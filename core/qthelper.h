@@ -126,11 +126,10 @@ extern "C" {
 const char *printGPSCoords(const location_t *loc);
 bool in_planner();
 bool getProxyString(char **buffer);
-bool canReachCloudServer();
+bool canReachCloudServer(bool setOffline);
 void updateWindowTitle();
 void subsurface_mkdir(const char *dir);
 char *get_file_name(const char *fileName);
-void copy_image_and_overwrite(const char *cfileName, const char *path, const char *cnewName);
 char *move_away(const char *path);
 const char *local_file_path(struct picture *picture);
 char *cloud_url();
@@ -144,6 +143,7 @@ double cache_value(int tissue, int timestep, enum inertgas gas);
 void cache_insert(int tissue, int timestep, enum inertgas gas, double value);
 void print_qt_versions();
 void lock_planner();
+void lock_planner_shared();
 void unlock_planner();
 
 #ifdef __cplusplus
@@ -23,8 +23,10 @@
 #include "device.h"
 #include "membuffer.h"
 #include "git-access.h"
+#include "cloudsync.h"
 #include "version.h"
 #include "qthelper.h"
+#include "trace.h"
 #include "gettext.h"
 
 #define VA_BUF(b, fmt) do { va_list args; va_start(args, fmt); put_vformat(b, fmt, args); va_end(args); } while (0)
@@ -457,6 +459,7 @@ static void create_dive_buffer(struct dive *dive, struct membuffer *b)
 struct dir {
 	git_treebuilder *files;
 	struct dir *subdirs, *sibling;
+	struct dive *dive;	/* the dive saved in this directory, if any */
 	char unique, name[1];
 };
 
@@ -503,6 +506,7 @@ static struct dir *new_directory(git_repository *repo, struct dir *parent, struc
 	 * and an empty treebuilder list of files.
 	 */
 	subdir->subdirs = NULL;
+	subdir->dive = NULL;
 	git_treebuilder_new(&subdir->files, repo, NULL);
 	memcpy(subdir->name, name, len);
 	subdir->unique = 0;
@@ -657,6 +661,7 @@ static int save_one_dive(git_repository *repo, struct dir *tree, struct dive *di
 
 	subdir = new_directory(repo, tree, &name);
 	subdir->unique = 1;
+	subdir->dive = dive;
 	free_buffer(&name);
 
 	create_dive_buffer(dive, &buf);
@@ -1193,8 +1198,17 @@ static int write_git_tree(git_repository *repo, struct dir *tree, git_oid *resul
 	while ((subdir = tree->subdirs) != NULL) {
 		git_oid id;
 
-		if (!write_git_tree(repo, subdir, &id))
+		if (!write_git_tree(repo, subdir, &id)) {
 			tree_insert(tree->files, subdir->name, subdir->unique, &id, GIT_FILEMODE_TREE);
+			/*
+			 * Remember the tree of the dive as if it had been loaded from
+			 * this commit: the next save only reuses it if it finds this
+			 * commit in its repository (cached_ok), and the journal needs
+			 * it to tell unchanged dives from changed ones after a commit.
+			 */
+			if (subdir->dive)
+				memcpy(subdir->dive->git_id, id.id, 20);
+		}
 		tree->subdirs = subdir->sibling;
 		free(subdir);
 	};
@@ -1213,6 +1227,7 @@ int do_git_save(git_repository *repo, const char *branch, const char *remote, bo
 	struct dir tree;
 	git_oid id;
 	bool cached_ok;
+	int ret;
 
 	if (verbose)
 		fprintf(stderr, "git storage: do git save\n");
@@ -1243,23 +1258,35 @@ int do_git_save(git_repository *repo, const char *branch, const char *remote, bo
 	if (write_git_tree(repo, &tree, &id))
 		return report_error("git tree write failed");
 
-	/* And save the tree! */
-	if (create_new_commit(repo, remote, branch, &id, create_empty))
+	/* And save the tree! The background sync may update the branch of a local cache */
+	cloud_sync_lock_cache();
+	ret = create_new_commit(repo, remote, branch, &id, create_empty);
+	cloud_sync_unlock_cache();
+	if (ret)
 		return report_error("creating commit failed");
 
 	/* now sync the tree with the remote server */
-	if (remote && !git_local_only)
+	if (remote && !git_local_only) {
+		/* the commit is safe in the local cache, the push can happen later */
+		if (cloud_sync_in_background && !create_empty) {
+			cloud_sync_request(remote, branch);
+			return 0;
+		}
 		return sync_with_remote(repo, remote, branch, url_to_remote_transport(remote));
+	}
 	return 0;
 }
 
 int git_save_dives(struct git_repository *repo, const char *branch, const char *remote, bool select_only)
 {
 	int ret;
+	struct trace_span span;
 
 	if (repo == dummy_git_repository)
 		return report_error("Unable to open git repository '%s'", branch);
+	span = trace_begin("git_save_dives");
 	ret = do_git_save(repo, branch, remote, select_only, false);
+	trace_end(&span);
 	git_repository_free(repo);
 	free((void *)branch);
 	return ret;
@@ -18,7 +18,12 @@ void write_attribute(struct membuffer *b, const char *att_name, const char *valu
 	put_format(b, "\"%s", separator);
 }
 
-void save_photos(struct membuffer *b, const char *photos_dir, struct dive *dive)
+/*
+ * Only the filenames of the photos are written. The files themselves are copied
+ * once all shards were written, since different shards may refer to the same
+ * pictures or to pictures with the same filename.
+ */
+void save_photos(struct membuffer *b, struct dive *dive)
 {
 	struct picture *pic = dive->picture_list;
 
@@ -29,12 +34,13 @@ void save_photos(struct membuffer *b, const char *photos_dir, struct dive *dive)
 	do {
 		put_string(b, separator);
 		separator = ", ";
-		char *fname = get_file_name(local_file_path(pic));
+		const char *local = local_file_path(pic);
+		char *fname = get_file_name(local);
 		put_string(b, "{\"filename\":\"");
 		put_quoted(b, fname, 1, 0);
 		put_string(b, "\"}");
-		copy_image_and_overwrite(local_file_path(pic), photos_dir, fname);
 		free(fname);
+		free((void *)local);
 		pic = pic->next;
 	} while (pic);
 	put_string(b, "],");
@@ -338,11 +344,10 @@ void put_HTML_tags(struct membuffer *b, struct dive *dive, const char *pre, cons
 	put_string(b, post);
 }
 
-/* if exporting list_only mode, we neglect exporting the samples, bookmarks and cylinders */
-void write_one_dive(struct membuffer *b, struct dive *dive, const char *photos_dir, int *dive_no, const bool list_only)
+/* the data shown in the dive list and used for searching */
+static void write_dive_summary(struct membuffer *b, struct dive *dive, int dive_no)
 {
-	put_string(b, "{");
-	put_format(b, "\"number\":%d,", *dive_no);
+	put_format(b, "\"number\":%d,", dive_no);
 	put_format(b, "\"subsurface_number\":%d,", dive->number);
 	put_HTML_date(b, dive, "\"date\":\"", "\",");
 	put_HTML_time(b, dive, "\"time\":\"", "\",");
@@ -360,16 +365,28 @@ void write_one_dive(struct membuffer *b, struct dive *dive, const char *photos_d
 	write_attribute(b, "divemaster", dive->divemaster, ", ");
 	write_attribute(b, "suit", dive->suit, ", ");
 	put_HTML_tags(b, dive, "\"tags\":", ",");
-	if (!list_only) {
-		put_cylinder_HTML(b, dive);
-		put_weightsystem_HTML(b, dive);
-		put_HTML_samples(b, dive);
-		put_HTML_bookmarks(b, dive);
-		write_dive_status(b, dive);
-		if (photos_dir && strcmp(photos_dir, ""))
-			save_photos(b, photos_dir, dive);
-		write_divecomputers(b, dive);
-	}
+}
+
+/* the data only shown in the detailed view of a dive */
+static void write_dive_details(struct membuffer *b, struct dive *dive, const char *photos_dir)
+{
+	put_cylinder_HTML(b, dive);
+	put_weightsystem_HTML(b, dive);
+	put_HTML_samples(b, dive);
+	put_HTML_bookmarks(b, dive);
+	write_dive_status(b, dive);
+	if (photos_dir && strcmp(photos_dir, ""))
+		save_photos(b, dive);
+	write_divecomputers(b, dive);
+}
+
+/* if exporting list_only mode, we neglect exporting the samples, bookmarks and cylinders */
+void write_one_dive(struct membuffer *b, struct dive *dive, const char *photos_dir, int *dive_no, const bool list_only)
+{
+	put_string(b, "{");
+	write_dive_summary(b, dive, *dive_no);
+	if (!list_only)
+		write_dive_details(b, dive, photos_dir);
 	put_HTML_notes(b, dive, "\"notes\":\"", "\"");
 	put_string(b, "}\n");
 	(*dive_no)++;
@@ -465,21 +482,149 @@ void export_list(struct membuffer *b, const char *photos_dir, bool selected_only
 	put_string(b, "]");
 }
 
-void export_HTML(const char *file_name, const char *photos_dir, const bool selected_only, const bool list_only)
+static void add_export_dive(struct html_export *e, struct dive *dive)
 {
-	FILE *f;
+	/* start a new shard at trip boundaries and when the current one is full */
+	if (e->nr == 0 || dive->divetrip != e->dives[e->nr - 1]->divetrip ||
+	    e->nr - e->shard_start[e->nr_shards - 1] >= HTML_SHARD_SIZE)
+		e->shard_start[e->nr_shards++] = e->nr;
+	e->dives[e->nr++] = dive;
+	e->shard_start[e->nr_shards] = e->nr;
+}
+
+/*
+ * Collect the exported dives in the same order as write_trips():
+ * the trips in order of their first dive and the dives without
+ * trip at the end. Their position is the number of the dive in
+ * the export.
+ */
+void prepare_HTML_export(struct html_export *e, bool selected_only)
+{
+	int i, j;
+	struct dive *dive;
+
+	e->nr = e->nr_shards = 0;
+	e->dives = malloc(dive_table.nr * sizeof(struct dive *));
+	/* in the worst case, every dive gets its own shard */
+	e->shard_start = malloc((dive_table.nr + 1) * sizeof(int));
+	e->shard_start[0] = 0;
+
+	for (i = 0; i < trip_table.nr; ++i)
+		trip_table.trips[i]->saved = 0;
+
+	for_each_dive (i, dive) {
+		dive_trip_t *trip = dive->divetrip;
+		if (!trip || trip->saved)
+			continue;
+		trip->saved = 1;
+		for (j = 0; j < trip->dives.nr; j++) {
+			if (!trip->dives.dives[j]->selected && selected_only)
+				continue;
+			add_export_dive(e, trip->dives.dives[j]);
+		}
+	}
+
+	for_each_dive (i, dive) {
+		if (!dive->divetrip && (dive->selected || !selected_only))
+			add_export_dive(e, dive);
+	}
+}
 
+void free_HTML_export(struct html_export *e)
+{
+	free(e->dives);
+	free(e->shard_start);
+	e->dives = NULL;
+	e->shard_start = NULL;
+	e->nr = e->nr_shards = 0;
+}
+
+static int write_HTML_file(const char *file_name, struct membuffer *b)
+{
+	FILE *f = subsurface_fopen(file_name, "w+");
+	if (!f)
+		return -1;
+	flush_buffer(b, f); /*check for writing errors? */
+	fclose(f);
+	return 0;
+}
+
+/*
+ * The index lists all trips with the summary of their dives. Unless exporting
+ * the list only, each dive refers to the shard containing its details.
+ */
+void export_HTML_index(const char *file_name, const struct html_export *e, const bool list_only)
+{
 	struct membuffer buf = { 0 };
-	export_list(&buf, photos_dir, selected_only, list_only);
+	struct membuffer *b = &buf;
+	int i, shard = 0;
 
-	f = subsurface_fopen(file_name, "w+");
-	if (!f) {
+	put_string(b, "trips=[");
+	for (i = 0; i < e->nr; i++) {
+		struct dive *dive = e->dives[i];
+		dive_trip_t *trip = dive->divetrip;
+
+		if (i == 0 || trip != e->dives[i - 1]->divetrip) {
+			if (i > 0)
+				put_string(b, "]}\n\n,");
+			put_string(b, "{");
+			if (trip)
+				write_attribute(b, "name", trip->location, ", ");
+			else
+				put_string(b, "\"name\":\"Other\",");
+			put_string(b, "\"dives\":[");
+		} else {
+			put_string(b, ", ");
+		}
+		put_string(b, "{");
+		write_dive_summary(b, dive, i);
+		put_format(b, "\"maxdepth\":%d,", dive->dc.maxdepth.mm);
+		put_format(b, "\"duration\":%d,", dive->dc.duration.seconds);
+		if (!list_only) {
+			while (e->shard_start[shard + 1] <= i)
+				shard++;
+			put_format(b, "\"shard\":%d,", shard);
+		}
+		put_HTML_notes(b, dive, "\"notes\":\"", "\"");
+		put_string(b, "}\n");
+	}
+	if (e->nr)
+		put_string(b, "]}\n\n");
+	put_string(b, "]");
+
+	if (write_HTML_file(file_name, b))
 		report_error(translate("gettextFromC", "Can't open file %s"), file_name);
-	} else {
-		flush_buffer(&buf, f); /*check for writing errors? */
-		fclose(f);
+	free_buffer(b);
+}
+
+/*
+ * Write the details of the dives of one shard to dir/dives_<shard>.js, which
+ * are merged into the dives of the index when the page loads the shard.
+ * Different shards can be written in parallel. Returns 0 on success.
+ */
+int export_HTML_shard(const char *dir, const struct html_export *e, int shard, const char *photos_dir)
+{
+	struct membuffer buf = { 0 };
+	struct membuffer *b = &buf;
+	struct membuffer name = { 0 };
+	char *separator = "";
+	int i, res;
+
+	put_string(b, "shardLoaded([");
+	for (i = e->shard_start[shard]; i < e->shard_start[shard + 1]; i++) {
+		put_string(b, separator);
+		separator = ", ";
+		put_format(b, "{\"number\":%d,", i);
+		write_dive_details(b, e->dives[i], photos_dir);
+		put_string(b, "\"details_loaded\":true}\n");
 	}
-	free_buffer(&buf);
+	put_string(b, "]);");
+
+	put_format(&name, "%s/dives_%d.js", dir, shard);
+	res = write_HTML_file(mb_cstring(&name), b);
+	free_buffer(&name);
+	free_buffer(b);
+	return res;
 }
 
 void export_translation(const char *file_name)
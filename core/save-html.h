@@ -20,7 +20,25 @@ void put_HTML_pressure_units(struct membuffer *b, pressure_t pressure, const cha
 void put_HTML_weight_units(struct membuffer *b, unsigned int grams, const char *pre, const char *post);
 void put_HTML_volume_units(struct membuffer *b, unsigned int ml, const char *pre, const char *post);
 
-void export_HTML(const char *file_name, const char *photos_dir, const bool selected_only, const bool list_only);
+/*
+ * The HTML export writes a small index of all dives, which is sufficient for
+ * the dive list and the search, and the details of the dives (notably the
+ * samples) into shards, which are only loaded when a dive is shown. A shard
+ * holds the dives of one trip, but no more than HTML_SHARD_SIZE dives.
+ */
+#define HTML_SHARD_SIZE 100
+
+struct html_export {
+	int nr;			/* number of exported dives */
+	struct dive **dives;	/* exported dives, indexed by their number in the export */
+	int nr_shards;
+	int *shard_start;	/* index of the first dive of each shard, shard_start[nr_shards] == nr */
+};
+
+void prepare_HTML_export(struct html_export *e, bool selected_only);
+void free_HTML_export(struct html_export *e);
+void export_HTML_index(const char *file_name, const struct html_export *e, const bool list_only);
+int export_HTML_shard(const char *dir, const struct html_export *e, int shard, const char *photos_dir);
 void export_list(struct membuffer *b, const char *photos_dir, bool selected_only, const bool list_only);
 
 void export_translation(const char *file_name);
@@ -21,6 +21,7 @@
 #include "strndup.h"
 #include "git-access.h"
 #include "qthelper.h"
+#include "trace.h"
 
 /*
  * We're outputting utf8 in xml.
@@ -514,10 +515,10 @@ int save_dive(FILE *f, struct dive *dive, bool anonymize)
 	return 0;
 }
 
-static void save_trip(struct membuffer *b, dive_trip_t *trip, bool anonymize)
+/* Save the trip with those of its dives that are in the given table */
+static void save_trip(struct membuffer *b, dive_trip_t *trip, struct dive_table *table, bool anonymize)
 {
 	int i;
-	struct dive *dive;
 
 	put_format(b, "<trip");
 	show_date(b, trip_date(trip));
@@ -531,14 +532,35 @@ static void save_trip(struct membuffer *b, dive_trip_t *trip, bool anonymize)
 	 * list in the trip, we just traverse the global dive array and
 	 * check the divetrip pointer..
 	 */
-	for_each_dive(i, dive) {
-		if (dive->divetrip == trip)
-			save_one_dive_to_mb(b, dive, anonymize);
+	for (i = 0; i < table->nr; i++) {
+		if (table->dives[i]->divetrip == trip)
+			save_one_dive_to_mb(b, table->dives[i], anonymize);
 	}
 
 	put_format(b, "</trip>\n");
 }
 
+static void save_dive_site(struct membuffer *b, struct dive_site *ds, bool anonymize)
+{
+	put_format(b, "<site uuid='%8x'", ds->uuid);
+	show_utf8_blanked(b, ds->name, " name='", "'", 1, anonymize);
+	put_location(b, &ds->location, " gps='", "'");
+	show_utf8_blanked(b, ds->description, " description='", "'", 1, anonymize);
+	put_format(b, ">\n");
+	show_utf8_blanked(b, ds->notes, "  <notes>", " </notes>\n", 0, anonymize);
+	if (ds->taxonomy.nr) {
+		for (int j = 0; j < ds->taxonomy.nr; j++) {
+			struct taxonomy *t = &ds->taxonomy.category[j];
+			if (t->category != TC_NONE && t->value) {
+				put_format(b, "  <geo cat='%d'", t->category);
+				put_format(b, " origin='%d'", t->origin);
+				show_utf8_blanked(b, t->value, " value='", "'/>\n", 1, anonymize);
+			}
+		}
+	}
+	put_format(b, "</site>\n");
+}
+
 static void save_one_device(void *_f, const char *model, uint32_t deviceid,
 			    const char *nickname, const char *serial_nr, const char *firmware)
 {
@@ -618,23 +640,7 @@ void save_dives_buffer(struct membuffer *b, const bool select_only, bool anonymi
 		if (select_only && !is_dive_site_used(ds, true))
 				continue;
 
-		put_format(b, "<site uuid='%8x'", ds->uuid);
-		show_utf8_blanked(b, ds->name, " name='", "'", 1, anonymize);
-		put_location(b, &ds->location, " gps='", "'");
-		show_utf8_blanked(b, ds->description, " description='", "'", 1, anonymize);
-		put_format(b, ">\n");
-		show_utf8_blanked(b, ds->notes, "  <notes>", " </notes>\n", 0, anonymize);
-		if (ds->taxonomy.nr) {
-			for (int j = 0; j < ds->taxonomy.nr; j++) {
-				struct taxonomy *t = &ds->taxonomy.category[j];
-				if (t->category != TC_NONE && t->value) {
-					put_format(b, "  <geo cat='%d'", t->category);
-					put_format(b, " origin='%d'", t->origin);
-					show_utf8_blanked(b, t->value, " value='", "'/>\n", 1, anonymize);
-				}
-			}
-		}
-		put_format(b, "</site>\n");
+		save_dive_site(b, ds, anonymize);
 	}
 	put_format(b, "</divesites>\n<dives>\n");
 	for (i = 0; i < trip_table.nr; ++i)
@@ -663,7 +669,37 @@ void save_dives_buffer(struct membuffer *b, const bool select_only, bool anonymi
 
 			/* We haven't seen this trip before - save it and all dives */
 			trip->saved = 1;
-			save_trip(b, trip, anonymize);
+			save_trip(b, trip, &dive_table, anonymize);
+		}
+	}
+	put_format(b, "</dives>\n</divelog>\n");
+}
+
+/*
+ * Save only the dives of the given sorted table, in their trips, and the
+ * given dive sites. No settings are saved.
+ */
+void save_dive_table_buffer(struct membuffer *b, struct dive_table *table, struct dive_site_table *sites)
+{
+	int i;
+	struct dive *dive;
+
+	put_format(b, "<divelog program='subsurface' version='%d'>\n", DATAFORMAT_VERSION);
+	put_format(b, "<divesites>\n");
+	for (i = 0; i < sites->nr; i++)
+		save_dive_site(b, sites->dive_sites[i], false);
+	put_format(b, "</divesites>\n<dives>\n");
+	for (i = 0; i < table->nr; i++) {
+		if (table->dives[i]->divetrip)
+			table->dives[i]->divetrip->saved = 0;
+	}
+	for (i = 0; i < table->nr; i++) {
+		dive = table->dives[i];
+		if (!dive->divetrip) {
+			save_one_dive_to_mb(b, dive, false);
+		} else if (!dive->divetrip->saved) {
+			dive->divetrip->saved = 1;
+			save_trip(b, dive->divetrip, table, false);
 		}
 	}
 	put_format(b, "</dives>\n</divelog>\n");
@@ -733,12 +769,15 @@ int save_dives_logic(const char *filename, const bool select_only, bool anonymiz
 	void *git;
 	const char *branch, *remote;
 	int error = 0;
+	struct trace_span span;
 
 	git = is_git_repository(filename, &branch, &remote, false);
 	if (git)
 		return git_save_dives(git, branch, remote, select_only);
 
+	span = trace_begin("save_dives_buffer");
 	save_dives_buffer(&buf, select_only, anonymize);
+	trace_end(&span);
 
 	if (same_string(filename, "-")) {
 		f = stdout;
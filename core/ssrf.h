@@ -32,6 +32,15 @@ extern void log_stp(const char *ident, QString *buf);
 
 // Macro to be used for silencing unused parameters
 #define UNUSED(x) (void)x
+
+// Thread-local storage for C code, used by the parts of the core that run in several threads
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
 #endif
 
 #endif // SSRF_H
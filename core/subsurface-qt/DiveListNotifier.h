@@ -31,6 +31,10 @@ signals:
 	void divesMovedBetweenTrips(dive_trip *from, dive_trip *to, bool deleteFrom, bool createTo, const QVector<dive *> &dives);
 	void divesTimeChanged(dive_trip *trip, timestamp_t delta, const QVector<dive *> &dives);
 
+	// The dive list was replaced as a whole, e.g. by loading or closing a file.
+	// Listeners rebuild their state from the dive table.
+	void dataReset();
+
 	// Selection-signals come in two kinds:
 	//  - divesSelected, divesDeselected and currentDiveChanged are finer grained and are
 	//    called batch-wise per trip (except currentDiveChanged, of course). These signals
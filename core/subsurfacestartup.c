@@ -7,6 +7,7 @@
 #include "gettext.h"
 #include "qthelper.h"
 #include "git-access.h"
+#include "trace.h"
 #include "libdivecomputer/version.h"
 
 struct preferences prefs, git_prefs;
@@ -183,7 +184,8 @@ static void print_help()
 	printf("\n --version             Prints current version");
 	printf("\n --survey              Offer to submit a user survey");
 	printf("\n --user=<test>         Choose configuration space for user <test>");
-	printf("\n --cloud-timeout=<nr>  Set timeout for cloud connection (0 < timeout < 60)\n\n");
+	printf("\n --cloud-timeout=<nr>  Set timeout for cloud connection (0 < timeout < 60)");
+	printf("\n --trace=<file>        Write a trace of slow operations to <file> on exit (Chrome trace-event format)\n\n");
 }
 
 void parse_argument(const char *arg)
@@ -216,6 +218,10 @@ void parse_argument(const char *arg)
 					default_prefs.cloud_timeout = to;
 				return;
 			}
+			if (strncmp(arg, "--trace=", sizeof("--trace=") - 1) == 0) {
+				trace_start(arg + sizeof("--trace=") - 1);
+				return;
+			}
 			if (strcmp(arg, "--help") == 0) {
 				print_help();
 				exit(0);
@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "thumbnailcache.h"
+#include "core/pref.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+
+// Layout of the pack file:
+//	char[8]	"SSRFTHPK"
+//	uint32	version
+// followed by records of the form
+//	uint32	record magic
+//	char[20]	SHA1 of the picture filename
+//	int64	write time in ms since epoch
+//	uint32	size of payload (0 = thumbnail was removed)
+//	char[]	payload
+static const char packMagic[8] = { 'S', 'S', 'R', 'F', 'T', 'H', 'P', 'K' };
+static const quint32 packVersion = 1;
+static const quint32 recordMagic = 0x54484d42;	// "THMB"
+static const qint64 fileHeaderSize = sizeof(packMagic) + sizeof(quint32);
+static const qint64 recordHeaderSize = sizeof(quint32) + 20 + sizeof(qint64) + sizeof(quint32);
+
+// Don't bother compacting small files
+static const qint64 minCompactSize = 1024 * 1024;
+
+static QString packFileName()
+{
+	return QString(system_default_directory()) + "/thumbnails.pack";
+}
+
+ThumbnailCache *ThumbnailCache::instance()
+{
+	static ThumbnailCache self;
+	return &self;
+}
+
+ThumbnailCache::ThumbnailCache() : liveBytes(0)
+{
+	QMutexLocker l(&lock);
+	if (open()) {
+		scan();
+		compact();
+	}
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+	pack.close();
+}
+
+QByteArray ThumbnailCache::hashFilename(const QString &filename)
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(filename.toUtf8());
+	return hash.result();
+}
+
+// Open pack file and check header. If the file doesn't exist or has an unknown
+// format, start from scratch. Must be called with lock held.
+bool ThumbnailCache::open()
+{
+	pack.setFileName(packFileName());
+	if (!pack.open(QIODevice::ReadWrite)) {
+		qWarning() << "Cannot open thumbnail pack" << pack.fileName();
+		return false;
+	}
+
+	char magic[sizeof(packMagic)] = { 0 };
+	quint32 version = 0;
+	if (pack.read(magic, sizeof(magic)) == sizeof(magic)) {
+		QDataStream stream(&pack);
+		stream >> version;
+	}
+	if (memcmp(magic, packMagic, sizeof(packMagic)) != 0 || version != packVersion) {
+		pack.resize(0);
+		pack.seek(0);
+		pack.write(packMagic, sizeof(packMagic));
+		QDataStream stream(&pack);
+		stream << packVersion;
+		pack.flush();
+	}
+	return true;
+}
+
+// Build the index by walking over the record headers. A truncated or garbled
+// record at the end (e.g. after a crash) is cut off. Must be called with lock held.
+void ThumbnailCache::scan()
+{
+	index.clear();
+	liveBytes = 0;
+
+	qint64 size = pack.size();
+	qint64 pos = fileHeaderSize;
+	QDataStream stream(&pack);
+	while (pos + recordHeaderSize <= size) {
+		pack.seek(pos);
+		quint32 magic, payloadSize;
+		qint64 written;
+		char key[20];
+		stream >> magic;
+		if (stream.readRawData(key, sizeof(key)) != sizeof(key))
+			break;
+		stream >> written >> payloadSize;
+		if (stream.status() != QDataStream::Ok || magic != recordMagic ||
+		    pos + recordHeaderSize + payloadSize > size)
+			break;
+
+		QByteArray hash(key, sizeof(key));
+		auto it = index.find(hash);
+		if (it != index.end()) {
+			liveBytes -= it->size;
+			index.erase(it);
+		}
+		if (payloadSize > 0) {
+			index.insert(hash, { pos + recordHeaderSize, payloadSize, written });
+			liveBytes += payloadSize;
+		}
+		pos += recordHeaderSize + payloadSize;
+	}
+
+	if (pos < size) {
+		qWarning() << "Truncating damaged thumbnail pack at offset" << pos;
+		pack.resize(pos);
+	}
+}
+
+// Rewrite the pack file if it consists mostly of dead records.
+// Must be called with lock held.
+void ThumbnailCache::compact()
+{
+	qint64 size = pack.size();
+	if (size < minCompactSize || size - fileHeaderSize - (qint64)index.size() * recordHeaderSize < 2 * liveBytes)
+		return;
+
+	// Write the records in file order to keep reading sequential.
+	QVector<QPair<QByteArray, IndexEntry>> entries;
+	entries.reserve(index.size());
+	for (auto it = index.cbegin(); it != index.cend(); ++it)
+		entries.push_back({ it.key(), it.value() });
+	std::sort(entries.begin(), entries.end(),
+		  [](const QPair<QByteArray, IndexEntry> &a, const QPair<QByteArray, IndexEntry> &b)
+		  { return a.second.offset < b.second.offset; });
+
+	QSaveFile file(pack.fileName());
+	if (!file.open(QIODevice::WriteOnly))
+		return;
+	QDataStream stream(&file);
+	file.write(packMagic, sizeof(packMagic));
+	stream << packVersion;
+	for (const auto &entry: entries) {
+		pack.seek(entry.second.offset);
+		QByteArray data = pack.read(entry.second.size);
+		stream << recordMagic;
+		stream.writeRawData(entry.first.constData(), entry.first.size());
+		stream << entry.second.written << (quint32)data.size();
+		stream.writeRawData(data.constData(), data.size());
+	}
+	pack.close();
+	if (!file.commit())
+		qWarning() << "Failed compacting thumbnail pack";
+	if (open())
+		scan();
+}
+
+// Must be called with lock held.
+ThumbnailCache::Entry ThumbnailCache::readLocked(const QByteArray &key)
+{
+	auto it = index.find(key);
+	if (it == index.end() || !pack.seek(it->offset))
+		return { QByteArray(), QDateTime() };
+	QByteArray data = pack.read(it->size);
+	if (data.size() != (int)it->size)
+		return { QByteArray(), QDateTime() };
+	return { data, QDateTime::fromMSecsSinceEpoch(it->written) };
+}
+
+ThumbnailCache::Entry ThumbnailCache::read(const QString &filename)
+{
+	QByteArray key = hashFilename(filename);
+	QMutexLocker l(&lock);
+	return readLocked(key);
+}
+
+QVector<ThumbnailCache::Entry> ThumbnailCache::readMany(const QVector<QString> &filenames)
+{
+	QVector<ThumbnailCache::Entry> res(filenames.size());
+	QVector<QPair<qint64, int>> order;	// offset, index into filenames
+	QVector<QByteArray> keys;
+	keys.reserve(filenames.size());
+	order.reserve(filenames.size());
+	for (const QString &filename: filenames)
+		keys.push_back(hashFilename(filename));
+
+	QMutexLocker l(&lock);
+	for (int i = 0; i < keys.size(); ++i) {
+		auto it = index.find(keys[i]);
+		if (it != index.end())
+			order.push_back({ it->offset, i });
+	}
+	std::sort(order.begin(), order.end());
+	for (const QPair<qint64, int> &o: order)
+		res[o.second] = readLocked(keys[o.second]);
+	return res;
+}
+
+bool ThumbnailCache::contains(const QString &filename) const
+{
+	QByteArray key = hashFilename(filename);
+	QMutexLocker l(&lock);
+	return index.contains(key);
+}
+
+void ThumbnailCache::write(const QString &filename, const QByteArray &data)
+{
+	QByteArray key = hashFilename(filename);
+	qint64 written = QDateTime::currentMSecsSinceEpoch();
+
+	QMutexLocker l(&lock);
+	if (!pack.isOpen())
+		return;
+	qint64 pos = pack.size();
+	pack.seek(pos);
+	QDataStream stream(&pack);
+	stream << recordMagic;
+	stream.writeRawData(key.constData(), key.size());
+	stream << written << (quint32)data.size();
+	stream.writeRawData(data.constData(), data.size());
+	pack.flush();
+	if (stream.status() != QDataStream::Ok) {
+		// Don't leave a partial record lying around
+		pack.resize(pos);
+		return;
+	}
+
+	auto it = index.find(key);
+	if (it != index.end()) {
+		liveBytes -= it->size;
+		index.erase(it);
+	}
+	if (!data.isEmpty()) {
+		index.insert(key, { pos + recordHeaderSize, (quint32)data.size(), written });
+		liveBytes += data.size();
+	}
+}
+
+void ThumbnailCache::remove(const QString &filename)
+{
+	// An empty record is a tombstone
+	if (contains(filename))
+		write(filename, QByteArray());
+}
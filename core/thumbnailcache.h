@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+// On-disk store of serialized thumbnails.
+// All thumbnails are kept in a single append-only pack file. Each record consists
+// of a header (magic, SHA1 of the picture filename, write-time and payload size)
+// followed by the opaque payload. On open, the headers are scanned to build an
+// in-memory index of hash -> (offset, size). Overwriting a thumbnail simply appends
+// a new record and the index points to the newest one. When the dead records take
+// up more space than the live ones, the pack is compacted on the next open.
+// Thus, reading a thumbnail costs one seek and one read on an already opened
+// file instead of an open() and stat() per picture.
+class ThumbnailCache {
+public:
+	static ThumbnailCache *instance();
+
+	struct Entry {
+		QByteArray data;	// Serialized thumbnail, empty if not found
+		QDateTime written;	// Time the thumbnail was written
+	};
+
+	// Fetch a single thumbnail
+	Entry read(const QString &filename);
+	// Fetch multiple thumbnails in one go. The reads are sorted by offset into
+	// the pack file so that the file is read (mostly) sequentially.
+	QVector<Entry> readMany(const QVector<QString> &filenames);
+	void write(const QString &filename, const QByteArray &data);
+	void remove(const QString &filename);
+	bool contains(const QString &filename) const;
+private:
+	struct IndexEntry {
+		qint64 offset;		// Offset of the payload in the pack file
+		quint32 size;		// Size of payload
+		qint64 written;		// Time the record was written in ms since epoch
+	};
+
+	ThumbnailCache();
+	~ThumbnailCache();
+	bool open();
+	void scan();
+	void compact();
+	Entry readLocked(const QByteArray &key);
+	static QByteArray hashFilename(const QString &filename);
+
+	mutable QMutex lock;
+	QFile pack;
+	QHash<QByteArray, IndexEntry> index;
+	qint64 liveBytes;		// Size of live payloads, used to decide on compaction
+};
+
+#endif // THUMBNAILCACHE_H
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+#include <stdio.h>
+
+// Number of spans kept per thread. Older spans are overwritten.
+#define TRACE_BUFFER_SIZE 16384
+
+struct TraceEvent {
+	const char *name;
+	int64_t start, duration;
+};
+
+struct TraceBuffer {
+	int tid;
+	QString threadName;
+	uint64_t count;		// number of recorded spans, including the overwritten ones
+	TraceEvent events[TRACE_BUFFER_SIZE];
+};
+
+static std::atomic<bool> traceEnabled(false);
+// Number of threads in trace_add(). trace_stop() waits until this is zero,
+// so that it doesn't read a buffer that is still being written.
+static std::atomic<int> traceWriters(0);
+
+static QString traceFilename;
+static QElapsedTimer traceTimer;
+// The buffers of all threads that recorded spans. The buffers are never
+// freed, so that spans of finished threads aren't lost.
+static QMutex traceLock;
+static QVector<TraceBuffer *> traceBuffers;
+static thread_local TraceBuffer *traceBuffer = nullptr;
+
+static TraceBuffer *registerThread()
+{
+	TraceBuffer *buffer = new TraceBuffer;
+	QThread *thread = QThread::currentThread();
+	QCoreApplication *app = QCoreApplication::instance();
+	buffer->count = 0;
+	if (app && thread == app->thread())
+		buffer->threadName = QStringLiteral("main");
+	else if (thread)
+		buffer->threadName = thread->objectName();
+
+	QMutexLocker l(&traceLock);
+	buffer->tid = traceBuffers.size() + 1;
+	if (buffer->threadName.isEmpty())
+		buffer->threadName = QStringLiteral("thread %1").arg(buffer->tid);
+	traceBuffers.append(buffer);
+	return buffer;
+}
+
+extern "C" void trace_start(const char *filename)
+{
+	// Drop the spans of an earlier trace
+	QMutexLocker l(&traceLock);
+	for (TraceBuffer *buffer: traceBuffers)
+		buffer->count = 0;
+	traceFilename = QString::fromUtf8(filename);
+	traceTimer.start();
+	traceEnabled = true;
+}
+
+extern "C" bool trace_is_enabled()
+{
+	return traceEnabled.load(std::memory_order_relaxed);
+}
+
+extern "C" int64_t trace_now()
+{
+	return traceTimer.nsecsElapsed() / 1000;
+}
+
+extern "C" void trace_add(const char *name, int64_t start, int64_t end)
+{
+	// Announce the write before checking the flag. Thus, either trace_stop()
+	// waits for this write or this thread sees that tracing was stopped.
+	++traceWriters;
+	if (traceEnabled) {
+		if (!traceBuffer)
+			traceBuffer = registerThread();
+		TraceEvent &event = traceBuffer->events[traceBuffer->count % TRACE_BUFFER_SIZE];
+		event.name = name;
+		event.start = start;
+		event.duration = end - start;
+		++traceBuffer->count;
+	}
+	--traceWriters;
+}
+
+// Stop tracing and write the recorded spans. Other threads may still run:
+// their spans that end after this call are dropped.
+extern "C" int trace_stop()
+{
+	if (!traceEnabled.exchange(false))
+		return 0;
+	while (traceWriters > 0)
+		QThread::yieldCurrentThread();
+
+	QJsonArray events;
+	QMutexLocker l(&traceLock);
+	for (TraceBuffer *buffer: traceBuffers) {
+		QJsonObject threadName;
+		threadName["name"] = QStringLiteral("thread_name");
+		threadName["ph"] = QStringLiteral("M");
+		threadName["pid"] = 1;
+		threadName["tid"] = buffer->tid;
+		threadName["args"] = QJsonObject { { "name", buffer->threadName } };
+		events.append(threadName);
+
+		uint64_t first = buffer->count > TRACE_BUFFER_SIZE ? buffer->count - TRACE_BUFFER_SIZE : 0;
+		for (uint64_t i = first; i < buffer->count; ++i) {
+			const TraceEvent &event = buffer->events[i % TRACE_BUFFER_SIZE];
+			QJsonObject e;
+			e["name"] = QString::fromUtf8(event.name);
+			e["cat"] = QStringLiteral("subsurface");
+			e["ph"] = QStringLiteral("X");
+			e["ts"] = (qint64)event.start;
+			e["dur"] = (qint64)event.duration;
+			e["pid"] = 1;
+			e["tid"] = buffer->tid;
+			events.append(e);
+		}
+	}
+
+	QJsonObject trace;
+	trace["traceEvents"] = events;
+	trace["displayTimeUnit"] = QStringLiteral("ms");
+	QFile f(traceFilename);
+	if (!f.open(QIODevice::WriteOnly) || f.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) < 0) {
+		fprintf(stderr, "Could not write trace file %s\n", qPrintable(traceFilename));
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+/*
+ * Tracing of slow operations, written as Chrome trace-event file
+ * (to be opened in chrome://tracing or https://ui.perfetto.dev).
+ *
+ * A span is the time between trace_begin() and trace_end(). The span
+ * names must be string literals, because only the pointers are stored.
+ * Every thread records into its own ring buffer, so that recording is
+ * cheap and doesn't take locks. If tracing is not enabled, a span is
+ * a check of an atomic flag.
+ *
+ *	struct trace_span span = trace_begin("load_git");
+ *	...
+ *	trace_end(&span);
+ *
+ * In C++, TraceSpan ends the span when it goes out of scope.
+ */
+
+struct trace_span {
+	const char *name;
+	int64_t start;		/* microseconds since trace_start(), -1 if not tracing */
+};
+
+extern void trace_start(const char *filename);
+extern int trace_stop(void);
+extern bool trace_is_enabled(void);
+extern int64_t trace_now(void);
+extern void trace_add(const char *name, int64_t start, int64_t end);
+
+static inline struct trace_span trace_begin(const char *name)
+{
+	struct trace_span span = { name, trace_is_enabled() ? trace_now() : -1 };
+	return span;
+}
+
+static inline void trace_end(const struct trace_span *span)
+{
+	if (span->start >= 0)
+		trace_add(span->name, span->start, trace_now());
+}
+
+#ifdef __cplusplus
+}
+
+class TraceSpan {
+public:
+	TraceSpan(const char *name) : span(trace_begin(name))
+	{
+	}
+	~TraceSpan()
+	{
+		trace_end(&span);
+	}
+private:
+	struct trace_span span;
+};
+#endif
+
+#endif // TRACE_H
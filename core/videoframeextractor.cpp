@@ -6,6 +6,14 @@
 
 #include <QtConcurrent>
 #include <QProcess>
+#include <QThread>
+
+// Maximum number of ffmpeg processes running concurrently.
+// Each process is restricted to one thread, see processItem().
+static const int maxExtractors = 4;
+
+// Time in ms after which we give up on an ffmpeg process
+static const int extractionTimeout = 30000;
 
 // Note: this is a global instead of a function-local variable on purpose.
 // We don't want this to be generated in a different thread context if
@@ -18,9 +26,9 @@ VideoFrameExtractor *VideoFrameExtractor::instance()
 
 VideoFrameExtractor::VideoFrameExtractor()
 {
-	// Currently, we only process one video at a time.
-	// Eventually, we might want to increase this value.
-	pool.setMaxThreadCount(1);
+	// Extracting a frame is mostly waiting for an external process.
+	// Run a bounded number of these in parallel.
+	pool.setMaxThreadCount(std::min(std::max(QThread::idealThreadCount(), 1), maxExtractors));
 }
 
 void VideoFrameExtractor::extract(QString originalFilename, QString filename, duration_t duration)
@@ -43,12 +51,17 @@ void VideoFrameExtractor::fail(const QString &originalFilename, duration_t durat
 	workingOn.remove(originalFilename);
 }
 
-void VideoFrameExtractor::clearWorkQueue()
+// Cancel the extraction of videos that aren't shown anymore
+void VideoFrameExtractor::cancel(const QVector<QString> &originalFilenames)
 {
 	QMutexLocker l(&lock);
-	for (auto it = workingOn.begin(); it != workingOn.end(); ++it)
+	for (const QString &filename: originalFilenames) {
+		auto it = workingOn.find(filename);
+		if (it == workingOn.end())
+			continue;
 		it->cancel();
-	workingOn.clear();
+		workingOn.erase(it);
+	}
 }
 
 // Trivial helper: bring value into given range
@@ -82,34 +95,45 @@ void VideoFrameExtractor::processItem(QString originalFilename, QString filename
 					       .arg((position.seconds % 3600) / 60, 2, 10, QChar('0'))
 					       .arg(position.seconds % 60, 2, 10, QChar('0'));
 
+	// Since multiple ffmpeg processes are running in parallel, restrict each of them
+	// to a single thread. Don't let ffmpeg touch stdin and don't decode audio and subtitle
+	// streams. The frame is passed back via the stdout pipe.
 	QProcess ffmpeg;
 	ffmpeg.start(prefs.ffmpeg_executable, QStringList {
-		"-ss", posString, "-i", filename, "-vframes", "1", "-q:v", "2", "-f", "image2", "-"
+		"-nostdin", "-loglevel", "error", "-threads", "1",
+		"-ss", posString, "-i", filename, "-an", "-sn",
+		"-vframes", "1", "-q:v", "2", "-f", "image2", "-"
 	});
 	if (!ffmpeg.waitForStarted()) {
-		// Since we couldn't sart ffmpeg, turn off thumbnailing
+		// Since we couldn't start ffmpeg, turn off thumbnailing. Multiple workers might
+		// fail at the same time, but we only want to report the error once.
 		// TODO: call the proper preferences-functions
-		prefs.extract_video_thumbnails = false;
-		report_error(qPrintable(tr("ffmpeg failed to start - video thumbnail creation suspended")));
-		qDebug() << "Failed to start ffmpeg";
+		QMutexLocker l(&lock);
+		if (prefs.extract_video_thumbnails) {
+			prefs.extract_video_thumbnails = false;
+			report_error(qPrintable(tr("ffmpeg failed to start - video thumbnail creation suspended")));
+			qDebug() << "Failed to start ffmpeg";
+		}
+		l.unlock();
 		return fail(originalFilename, duration, false);
 	}
-	if (!ffmpeg.waitForFinished()) {
+	if (!ffmpeg.waitForFinished(extractionTimeout)) {
 		qDebug() << "Failed waiting for ffmpeg";
-		report_error(qPrintable(tr("failed waiting for ffmpeg - video thumbnail creation suspended")));
+		ffmpeg.kill();
+		ffmpeg.waitForFinished();
+		report_error(qPrintable(tr("ffmpeg timed out - no thumbnail for video %1").arg(originalFilename)));
 		return fail(originalFilename, duration, false);
 	}
 
-	QByteArray data = ffmpeg.readAll();
+	QByteArray data = ffmpeg.readAllStandardOutput();
 	QImage img;
 	img.loadFromData(data);
 	if (img.isNull()) {
 		qInfo() << "Failed reading ffmpeg output";
 		// For debugging:
 		//qInfo() << "stdout: " << QString::fromUtf8(data);
-		ffmpeg.setReadChannel(QProcess::StandardError);
 		// For debugging:
-		//QByteArray stderr_output = ffmpeg.readAll();
+		//QByteArray stderr_output = ffmpeg.readAllStandardError();
 		//qInfo() << "stderr: " << QString::fromUtf8(stderr_output);
 		return fail(originalFilename, duration, true);
 	}
@@ -10,6 +10,7 @@
 #include <QQueue>
 #include <QString>
 #include <QPair>
+#include <QVector>
 
 class VideoFrameExtractor : public QObject {
 	Q_OBJECT
@@ -25,7 +26,7 @@ signals:
 	void invalid(QString filename, duration_t duration);
 public slots:
 	void extract(QString originalFilename, QString filename, duration_t duration);
-	void clearWorkQueue();
+	void cancel(const QVector<QString> &originalFilenames);
 private:
 	void processItem(QString originalFilename, QString filename, duration_t duration);
 	void fail(const QString &originalFilename, duration_t duration, bool isInvalid);
@@ -5,4 +5,86 @@
 const char *map_options = "center: new google.maps.LatLng(0,0),\n\tzoom: 3,\n\tminZoom: 2,\n\tmapTypeId: google.maps.MapTypeId.SATELLITE\n\t";
 const char *css = "\n\thtml { height: 100% }\n\tbody { height: 100%; margin: 0; padding: 0 }\n\t#map-canvas { height: 100% }\n";
 
+/* Creates the markers of the current zoom level on demand, see writeMarkers() */
+const char *map_script =
+	"var shownMarkers = [];\n"
+	"var siteMarkers = [];\n"
+	"var clusterMarkers = [];\n"
+	"var shownZoom = -1;\n"
+	"var infowindow = null;\n"
+	"\n"
+	"function siteContent(s) {\n"
+	"\tvar site = sites[s];\n"
+	"\tvar res = '<div id=\"content\"><div id=\"bodyContent\"><p>' + labels.location + ' <b>' + site[2] + '</b></p>';\n"
+	"\tfor (var i = site[3]; i < site[3] + site[4]; i++) {\n"
+	"\t\tvar d = dives[i];\n"
+	"\t\tif (i > site[3])\n"
+	"\t\t\tres += '<hr>';\n"
+	"\t\tres += '<p>' + labels.date + ' ' + d[0] + '</p><p>' + labels.time + ' ' + d[1] + '</p>';\n"
+	"\t\tif (d[2])\n"
+	"\t\t\tres += '<p>' + labels.duration + ' ' + d[2] + ' ' + labels.min + '</p>';\n"
+	"\t\tres += '<p>' + labels.depth + ' ' + d[3] + '</p><p>' + labels.airtemp + ' ' + d[4] + '</p>';\n"
+	"\t\tres += '<p>' + labels.watertemp + ' ' + d[5] + '</p><p>' + labels.notes + ' ' + d[6] + '</p>';\n"
+	"\t}\n"
+	"\treturn res + '</div></div>';\n"
+	"}\n"
+	"\n"
+	"function getSiteMarker(s) {\n"
+	"\tif (siteMarkers[s])\n"
+	"\t\treturn siteMarkers[s];\n"
+	"\tvar marker = new google.maps.Marker({position: new google.maps.LatLng(sites[s][0], sites[s][1])});\n"
+	"\tmarker.addListener('mouseover', function() {\n"
+	"\t\tif (!infowindow)\n"
+	"\t\t\tinfowindow = new google.maps.InfoWindow();\n"
+	"\t\tinfowindow.setContent(siteContent(s));\n"
+	"\t\tinfowindow.open(map, marker);\n"
+	"\t});\n"
+	"\tmarker.addListener('mouseout', function() { infowindow.close(); });\n"
+	"\tsiteMarkers[s] = marker;\n"
+	"\treturn marker;\n"
+	"}\n"
+	"\n"
+	"function createClusterMarker(c) {\n"
+	"\tvar marker = new google.maps.Marker({position: new google.maps.LatLng(c[0], c[1]), label: String(c[2])});\n"
+	"\tmarker.addListener('click', function() {\n"
+	"\t\tvar bounds = new google.maps.LatLngBounds();\n"
+	"\t\tfor (var i = 0; i < c[3].length; i++)\n"
+	"\t\t\tbounds.extend(new google.maps.LatLng(sites[c[3][i]][0], sites[c[3][i]][1]));\n"
+	"\t\tmap.fitBounds(bounds);\n"
+	"\t});\n"
+	"\treturn marker;\n"
+	"}\n"
+	"\n"
+	"function getClusterMarkers(zoom) {\n"
+	"\tif (clusterMarkers[zoom])\n"
+	"\t\treturn clusterMarkers[zoom];\n"
+	"\tvar markers = [];\n"
+	"\tfor (var i = 0; i < clusters[zoom].length; i++) {\n"
+	"\t\tvar c = clusters[zoom][i];\n"
+	"\t\tmarkers.push(typeof c === 'number' ? getSiteMarker(c) : createClusterMarker(c));\n"
+	"\t}\n"
+	"\tclusterMarkers[zoom] = markers;\n"
+	"\treturn markers;\n"
+	"}\n"
+	"\n"
+	"function showMarkers() {\n"
+	"\tvar zoom = Math.max(map.getZoom(), minClusterZoom);\n"
+	"\tif (zoom > maxClusterZoom)\n"
+	"\t\tzoom = maxClusterZoom + 1;\n"
+	"\tif (zoom == shownZoom)\n"
+	"\t\treturn;\n"
+	"\tfor (var i = 0; i < shownMarkers.length; i++)\n"
+	"\t\tshownMarkers[i].setMap(null);\n"
+	"\tif (zoom > maxClusterZoom) {\n"
+	"\t\tshownMarkers = [];\n"
+	"\t\tfor (var s = 0; s < sites.length; s++)\n"
+	"\t\t\tshownMarkers.push(getSiteMarker(s));\n"
+	"\t} else {\n"
+	"\t\tshownMarkers = getClusterMarkers(zoom);\n"
+	"\t}\n"
+	"\tfor (var i = 0; i < shownMarkers.length; i++)\n"
+	"\t\tshownMarkers[i].setMap(map);\n"
+	"\tshownZoom = zoom;\n"
+	"}\n";
+
 #endif //  WORLDMAP-OPTIONS_H
@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <math.h>
 
 #include "membuffer.h"
 #include "save-html.h"
@@ -21,11 +23,155 @@ char *getGoogleApi()
 	return "https://maps.googleapis.com/maps/api/js?";
 }
 
+/*
+ * Markers are grouped by dive site and the sites are clustered in a grid of
+ * CLUSTER_CELL_SIZE pixels for each zoom level up to CLUSTER_MAX_ZOOM. Above
+ * that zoom level, every site gets its own marker. The page only creates the
+ * markers of the current zoom level and formats the popup of a site when it
+ * is shown.
+ */
+#define CLUSTER_MIN_ZOOM 2	/* must match minZoom in map_options */
+#define CLUSTER_MAX_ZOOM 12
+#define CLUSTER_CELL_SIZE 64
+
+struct site_dive {
+	struct dive_site *ds;
+	struct dive *dive;
+	int idx;
+};
+
+struct site_key {
+	uint64_t key;
+	int site;
+};
+
+static int site_dive_cmp(const void *_a, const void *_b)
+{
+	const struct site_dive *a = _a, *b = _b;
+	if (a->ds->uuid != b->ds->uuid)
+		return a->ds->uuid < b->ds->uuid ? -1 : 1;
+	return a->idx - b->idx;
+}
+
+static int site_key_cmp(const void *_a, const void *_b)
+{
+	const struct site_key *a = _a, *b = _b;
+	if (a->key != b->key)
+		return a->key < b->key ? -1 : 1;
+	return a->site - b->site;
+}
+
+/* Web mercator pixel coordinates at zoom level 0, i.e. in the range [0, 256) */
+static void mercator(const location_t *loc, double *x, double *y)
+{
+	double lat = loc->lat.udeg / 1000000.0;
+	double lon = loc->lon.udeg / 1000000.0;
+	double siny;
+
+	if (lat > 85.0)
+		lat = 85.0;
+	if (lat < -85.0)
+		lat = -85.0;
+	siny = sin(lat * M_PI / 180.0);
+	*x = (lon + 180.0) / 360.0 * 256.0;
+	*y = (0.5 - log((1.0 + siny) / (1.0 - siny)) / (4.0 * M_PI)) * 256.0;
+}
+
+static void put_site_location(struct membuffer *b, double lat, double lon)
+{
+	put_format(b, "%.6f,%.6f", lat, lon);
+}
+
+/* The data of a dive, to be formatted by the page when the popup is shown */
+static void write_dive_data(struct membuffer *b, struct dive *dive)
+{
+	put_HTML_date(b, dive, "[\"", "\",");
+	put_HTML_time(b, dive, "\"", "\",\"");
+	put_duration(b, dive->duration, "", "");
+	put_HTML_depth(b, dive, "\",\"", "\",");
+	put_HTML_airtemp(b, dive, "\"", "\",");
+	put_HTML_watertemp(b, dive, "\"", "\",");
+	put_HTML_notes(b, dive, "\"", "\"]");
+}
+
+static void write_labels(struct membuffer *b)
+{
+	static const char *labels[][2] = {
+		{ "date", "Date:" }, { "time", "Time:" }, { "duration", "Duration:" },
+		{ "min", "min" }, { "depth", "Max. depth:" }, { "airtemp", "Air temp.:" },
+		{ "watertemp", "Water temp.:" }, { "location", "Location:" }, { "notes", "Notes:" }
+	};
+	unsigned int i;
+
+	put_string(b, "var labels = {");
+	for (i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+		put_format(b, "%s%s:\"", i ? "," : "", labels[i][0]);
+		put_HTML_quoted(b, translate("gettextFromC", labels[i][1]));
+		put_string(b, "\"");
+	}
+	put_string(b, "};\n");
+}
+
+static void write_clusters(struct membuffer *b, struct site_dive *site_dives, int *site_start, int nr_sites)
+{
+	int zoom, i, j, k;
+	double *x = malloc(nr_sites * sizeof(double));
+	double *y = malloc(nr_sites * sizeof(double));
+	struct site_key *keys = malloc(nr_sites * sizeof(struct site_key));
+
+	for (i = 0; i < nr_sites; i++)
+		mercator(&site_dives[site_start[i]].ds->location, x + i, y + i);
+
+	put_string(b, "var clusters = [];\n");
+	for (zoom = CLUSTER_MIN_ZOOM; zoom <= CLUSTER_MAX_ZOOM; zoom++) {
+		double scale = (double)(1 << zoom) / CLUSTER_CELL_SIZE;
+		for (i = 0; i < nr_sites; i++) {
+			uint64_t cx = (uint64_t)(x[i] * scale);
+			uint64_t cy = (uint64_t)(y[i] * scale);
+			keys[i].key = (cx << 32) | cy;
+			keys[i].site = i;
+		}
+		qsort(keys, nr_sites, sizeof(struct site_key), site_key_cmp);
+
+		/* A cluster consisting of a single site is written as the index of the site */
+		put_format(b, "clusters[%d] = [", zoom);
+		for (i = 0; i < nr_sites; i = j) {
+			double lat = 0.0, lon = 0.0;
+			int dives = 0;
+			for (j = i; j < nr_sites && keys[j].key == keys[i].key; j++) {
+				int site = keys[j].site;
+				const location_t *loc = &site_dives[site_start[site]].ds->location;
+				lat += loc->lat.udeg / 1000000.0;
+				lon += loc->lon.udeg / 1000000.0;
+				dives += site_start[site + 1] - site_start[site];
+			}
+			if (i)
+				put_string(b, ",");
+			if (j - i == 1) {
+				put_format(b, "%d", keys[i].site);
+				continue;
+			}
+			put_string(b, "[");
+			put_site_location(b, lat / (j - i), lon / (j - i));
+			put_format(b, ",%d,[", dives);
+			for (k = i; k < j; k++)
+				put_format(b, "%s%d", k > i ? "," : "", keys[k].site);
+			put_string(b, "]]");
+		}
+		put_string(b, "];\n");
+	}
+
+	free(keys);
+	free(x);
+	free(y);
+}
+
 void writeMarkers(struct membuffer *b, const bool selected_only)
 {
-	int i, dive_no = 0;
+	int i, nr = 0, nr_sites = 0;
 	struct dive *dive;
-	char pre[1000], post[1000];
+	struct site_dive *site_dives = malloc(dive_table.nr * sizeof(struct site_dive));
+	int *site_start = malloc((dive_table.nr + 1) * sizeof(int));
 
 	for_each_dive (i, dive) {
 		if (selected_only) {
@@ -35,36 +181,45 @@ void writeMarkers(struct membuffer *b, const bool selected_only)
 		struct dive_site *ds = get_dive_site_for_dive(dive);
 		if (!ds || !dive_site_has_gps_location(ds))
 			continue;
-		put_degrees(b, ds->location.lat, "temp = new google.maps.Marker({position: new google.maps.LatLng(", "");
-		put_degrees(b, ds->location.lon, ",", ")});\n");
-		put_string(b, "markers.push(temp);\ntempinfowindow = new google.maps.InfoWindow({content: '<div id=\"content\">'+'<div id=\"siteNotice\">'+'</div>'+'<div id=\"bodyContent\">");
-		snprintf(pre, sizeof(pre), "<p>%s ", translate("gettextFromC", "Date:"));
-		put_HTML_date(b, dive, pre, "</p>");
-		snprintf(pre, sizeof(pre), "<p>%s ", translate("gettextFromC", "Time:"));
-		put_HTML_time(b, dive, pre, "</p>");
-		snprintf(pre, sizeof(pre), "<p>%s ", translate("gettextFromC", "Duration:"));
-		snprintf(post, sizeof(post), " %s</p>", translate("gettextFromC", "min"));
-		put_duration(b, dive->duration, pre, post);
-		put_string(b, "<p> ");
-		put_HTML_quoted(b, translate("gettextFromC", "Max. depth:"));
-		put_HTML_depth(b, dive, " ", "</p>");
-		put_string(b, "<p> ");
-		put_HTML_quoted(b, translate("gettextFromC", "Air temp.:"));
-		put_HTML_airtemp(b, dive, " ", "</p>");
-		put_string(b, "<p> ");
-		put_HTML_quoted(b, translate("gettextFromC", "Water temp.:"));
-		put_HTML_watertemp(b, dive, " ", "</p>");
-		snprintf(pre, sizeof(pre), "<p>%s <b>", translate("gettextFromC", "Location:"));
-		put_string(b, pre);
-		put_HTML_quoted(b, get_dive_location(dive));
-		put_string(b, "</b></p>");
-		snprintf(pre, sizeof(pre), "<p> %s ", translate("gettextFromC", "Notes:"));
-		put_HTML_notes(b, dive, pre, " </p>");
-		put_string(b, "</p>'+'</div>'+'</div>'});\ninfowindows.push(tempinfowindow);\n");
-		put_format(b, "google.maps.event.addListener(markers[%d], 'mouseover', function() {\ninfowindows[%d].open(map,markers[%d]);}", dive_no, dive_no, dive_no);
-		put_format(b, ");google.maps.event.addListener(markers[%d], 'mouseout', function() {\ninfowindows[%d].close();});\n", dive_no, dive_no);
-		dive_no++;
+		site_dives[nr].ds = ds;
+		site_dives[nr].dive = dive;
+		site_dives[nr].idx = i;
+		nr++;
 	}
+
+	/* group the dives by site, keeping the order of the dives at a site */
+	qsort(site_dives, nr, sizeof(struct site_dive), site_dive_cmp);
+	for (i = 0; i < nr; i++) {
+		if (i == 0 || site_dives[i].ds != site_dives[i - 1].ds)
+			site_start[nr_sites++] = i;
+	}
+	site_start[nr_sites] = nr;
+
+	/* site: latitude, longitude, name, first dive, number of dives */
+	put_string(b, "var sites = [");
+	for (i = 0; i < nr_sites; i++) {
+		struct dive_site *ds = site_dives[site_start[i]].ds;
+		put_string(b, i ? ",\n[" : "\n[");
+		put_degrees(b, ds->location.lat, "", ",");
+		put_degrees(b, ds->location.lon, "", ",\"");
+		put_HTML_quoted(b, ds->name);
+		put_format(b, "\",%d,%d]", site_start[i], site_start[i + 1] - site_start[i]);
+	}
+	put_string(b, "];\n");
+
+	/* dive: date, time, duration, max. depth, air temp., water temp., notes */
+	put_string(b, "var dives = [");
+	for (i = 0; i < nr; i++) {
+		put_string(b, i ? ",\n" : "\n");
+		write_dive_data(b, site_dives[i].dive);
+	}
+	put_string(b, "];\n");
+
+	write_labels(b);
+	write_clusters(b, site_dives, site_start, nr_sites);
+
+	free(site_start);
+	free(site_dives);
 }
 
 void insert_html_header(struct membuffer *b)
@@ -86,10 +241,11 @@ void insert_javascript(struct membuffer *b, const bool selected_only)
 	put_string(b, "&amp;sensor=false\">\n</script>\n<script type=\"text/javascript\">\nvar map;\n");
 	put_format(b, "function initialize() {\nvar mapOptions = {\n\t%s,", map_options);
 	put_string(b, "rotateControl: false,\n\tstreetViewControl: false,\n\tmapTypeControl: false\n};\n");
-	put_string(b, "map = new google.maps.Map(document.getElementById(\"map-canvas\"),mapOptions);\nvar markers = new Array();");
-	put_string(b, "\nvar infowindows = new Array();\nvar temp;\nvar tempinfowindow;\n");
+	put_string(b, "map = new google.maps.Map(document.getElementById(\"map-canvas\"),mapOptions);\n");
+	put_string(b, "map.addListener('zoom_changed', showMarkers);\nshowMarkers();\n}\n");
 	writeMarkers(b, selected_only);
-	put_string(b, "\nfor(var i=0;i<markers.length;i++)\n\tmarkers[i].setMap(map);\n}\n");
+	put_format(b, "var minClusterZoom = %d;\nvar maxClusterZoom = %d;\n", CLUSTER_MIN_ZOOM, CLUSTER_MAX_ZOOM);
+	put_string(b, map_script);
 	put_string(b, "google.maps.event.addDomListener(window, 'load', initialize);</script>\n");
 }
 
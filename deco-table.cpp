@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-2.0
+// Generate deco tables over a grid of depths, bottom times and gradient factors
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+
+#include "core/decotable.h"
+#include "core/planner.h"
+#include "core/qthelper.h"
+#include "core/subsurfacestartup.h"
+#include "core/units.h"
+#include <stdio.h>
+
+// Parse a comma separated list of values and ranges of the form "from-to/step",
+// e.g. "30-60/3,70". Returns an empty list on error.
+static QVector<int> parseList(const QString &text)
+{
+	QVector<int> res;
+	for (const QString &item: text.split(',', QString::SkipEmptyParts)) {
+		bool ok1, ok2 = true, ok3 = true;
+		QString range = item.section('/', 0, 0);
+		int step = item.contains('/') ? item.section('/', 1).toInt(&ok3) : 1;
+		int from = range.section('-', 0, 0).toInt(&ok1);
+		int to = range.contains('-') ? range.section('-', 1).toInt(&ok2) : from;
+		if (!ok1 || !ok2 || !ok3 || step <= 0 || to < from)
+			return QVector<int>();
+		for (int v = from; v <= to; v += step)
+			res.append(v);
+	}
+	return res;
+}
+
+// Parse a comma separated list of gradient factors of the form "low/high"
+static QVector<QPair<int, int>> parseGradientFactors(const QString &text)
+{
+	QVector<QPair<int, int>> res;
+	for (const QString &item: text.split(',', QString::SkipEmptyParts)) {
+		bool ok1, ok2;
+		int low = item.section('/', 0, 0).toInt(&ok1);
+		int high = item.section('/', 1).toInt(&ok2);
+		if (!ok1 || !ok2 || low <= 0 || high <= 0 || low > high)
+			return QVector<QPair<int, int>>();
+		res.append({ low, high });
+	}
+	return res;
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication application(argc, argv);
+	copy_prefs(&default_prefs, &prefs);
+	// The deco mode of the planner is only used in the planner state
+	setCurrentAppState("PlanDive");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Generate deco tables for all combinations of depth, bottom time and gradient factors.");
+	parser.addHelpOption();
+	QCommandLineOption depthsOption(QStringList() << "d" << "depths",
+					"Depths, e.g. 30-60/3,70 (default: 30-60/3)", "list", "30-60/3");
+	QCommandLineOption timesOption(QStringList() << "t" << "times",
+				       "Bottom times in minutes, including the descent (default: 10-40/5)", "list", "10-40/5");
+	QCommandLineOption gfOption(QStringList() << "g" << "gf",
+				    "Gradient factors, e.g. 30/70,50/80 (default: 30/75)", "list", "30/75");
+	QCommandLineOption gasOption(QStringList() << "gas",
+				     "Gas, e.g. 18/45, EAN50 or oxygen. The first gas is the bottom gas, the following are deco gases, "
+				     "which are switched to at their MOD (default: air)", "gas");
+	QCommandLineOption vpmbOption(QStringList() << "vpmb", "Use VPM-B instead of Bühlmann");
+	QCommandLineOption conservatismOption(QStringList() << "conservatism", "VPM-B conservatism (0-4, default: 0)", "level", "0");
+	QCommandLineOption imperialOption(QStringList() << "imperial", "Depths in feet");
+	QCommandLineOption lastStopOption(QStringList() << "last-stop-6m", "Last stop at 6m/20ft");
+	QCommandLineOption jsonOption(QStringList() << "json", "Write JSON instead of CSV");
+	QCommandLineOption outputOption(QStringList() << "o" << "output", "Write table to <file> instead of stdout", "file");
+	parser.addOption(depthsOption);
+	parser.addOption(timesOption);
+	parser.addOption(gfOption);
+	parser.addOption(gasOption);
+	parser.addOption(vpmbOption);
+	parser.addOption(conservatismOption);
+	parser.addOption(imperialOption);
+	parser.addOption(lastStopOption);
+	parser.addOption(jsonOption);
+	parser.addOption(outputOption);
+	parser.process(application);
+
+	if (parser.isSet(imperialOption)) {
+		prefs.unit_system = IMPERIAL;
+		prefs.units = IMPERIAL_units;
+	}
+	prefs.planner_deco_mode = parser.isSet(vpmbOption) ? VPMB : BUEHLMANN;
+	prefs.last_stop = parser.isSet(lastStopOption);
+
+	DecoTableGrid grid;
+	grid.surfacePressure = SURFACE_PRESSURE;
+	grid.salinity = SEAWATER_SALINITY;
+	grid.vpmbConservatism = parser.value(conservatismOption).toInt();
+	for (int depth: parseList(parser.value(depthsOption)))
+		grid.depths.append(parser.isSet(imperialOption) ? feet_to_mm(depth) : depth * 1000);
+	for (int time: parseList(parser.value(timesOption)))
+		grid.bottomTimes.append(time * 60);
+	grid.gradientFactors = parseGradientFactors(parser.value(gfOption));
+
+	QStringList gases = parser.values(gasOption);
+	if (gases.isEmpty())
+		gases.append("air");
+	for (const QString &gas: gases) {
+		DecoTableGas g = { {}, 0 };
+		if (!validate_gas(qPrintable(gas), &g.mix)) {
+			fprintf(stderr, "invalid gas %s\n", qPrintable(gas));
+			return 1;
+		}
+		grid.gases.append(g);
+	}
+	if (grid.depths.isEmpty() || grid.bottomTimes.isEmpty() || grid.gradientFactors.isEmpty()) {
+		fprintf(stderr, "need valid --depths, --times and --gf\n");
+		return 1;
+	}
+
+	QVector<DecoTableCell> table = generateDecoTable(grid);
+	QByteArray data = parser.isSet(jsonOption) ? decoTableToJSON(table) : decoTableToCSV(table);
+
+	QString output = parser.value(outputOption);
+	if (output.isEmpty()) {
+		fwrite(data.constData(), 1, data.size(), stdout);
+		return 0;
+	}
+	QFile file(output);
+	if (!file.open(QIODevice::WriteOnly)) {
+		fprintf(stderr, "can't open %s\n", qPrintable(output));
+		return 1;
+	}
+	file.write(data);
+	return 0;
+}
@@ -12,6 +12,7 @@ namespace Command {
 // 1) General commands
 
 void clear();				// Reset the undo stack. Delete all commands.
+bool isEmpty();				// Return whether there is nothing to undo or redo.
 QAction *undoAction(QObject *parent);	// Create an undo action.
 QAction *redoAction(QObject *parent);	// Create an redo action.
 
@@ -12,6 +12,11 @@ void clear()
 	undoStack.clear();
 }
 
+bool isEmpty()
+{
+	return undoStack.count() == 0;
+}
+
 QAction *undoAction(QObject *parent)
 {
 	return undoStack.createUndoAction(parent, QCoreApplication::translate("Command", "&Undo"));
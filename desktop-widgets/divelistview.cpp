@@ -978,8 +978,10 @@ void DiveListView::matchImagesToDives(QStringList fileNames)
 		return;
 	updateLastImageTimeOffset(shiftDialog.amount());
 
-	for (const QString &fileName: fileNames)
-		create_picture(qPrintable(fileName), shiftDialog.amount(), shiftDialog.matchAll());
+	// The dialog has already read the metadata of all files
+	const QVector<metadata> &media = shiftDialog.mediaMetadata();
+	for (int i = 0; i < fileNames.size(); ++i)
+		create_picture_from_metadata(qPrintable(fileNames[i]), &media[i], shiftDialog.amount(), shiftDialog.matchAll());
 
 	mark_divelist_changed(true);
 	copy_dive(current_dive, &displayed_dive);
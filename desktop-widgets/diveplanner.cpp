@@ -682,3 +682,9 @@ PlannerDetails::PlannerDetails(QWidget *parent) : QWidget(parent)
 {
 	ui.setupUi(this);
 }
+
+void PlannerDetails::showEvent(QShowEvent *event)
+{
+	QWidget::showEvent(event);
+	emit shown();
+}
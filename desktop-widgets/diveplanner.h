@@ -106,6 +106,11 @@ public:
 	QPushButton *printPlan() const { return ui.printPlan; }
 	QTextEdit *divePlanOutput() const { return ui.divePlanOutput; }
 	QLabel *divePlannerOutputLabel() const { return ui.divePlanOutputLabel; }
+protected:
+	void showEvent(QShowEvent *event) override;
+
+signals:
+	void shown();
 
 private:
 	Ui::plannerDetails ui;
@@ -3,9 +3,9 @@
 #define FINDMOVEDIMAGES_H
 
 #include "ui_findmovedimagesdialog.h"
+#include "core/findmovedimages.h"
 #include <QFutureWatcher>
 #include <QVector>
-#include <QMap>
 #include <QAtomicInteger>
 
 class FindMovedImagesDialog : public QDialog {
@@ -18,32 +18,16 @@ slots:
 	void apply();
 	void on_buttonBox_rejected();
 	void setProgress(double progress, QString path);
+	void addMatches(QVector<MovedImageMatch> matches);
 	void searchDone();
 private:
-	struct Match {
-		QString originalFilename;
-		QString localFilename;
-		int matchingPathItems;
-	};
-	struct ImageMatch {
-		QString localFilename;
-		int score;
-	};
-	struct ImagePath {
-		QString fullPath;
-		QString	filenameUpperCase;
-		ImagePath() = default;		// For some reason QVector<...>::reserve() needs a default constructor!?
-		ImagePath(const QString &path);
-		inline bool operator<(const ImagePath &path2) const;
-	};
 	Ui::FindMovedImagesDialog ui;
-	QFutureWatcher<QVector<Match>> watcher;
-	QVector<Match> matches;
+	MovedImagesSearch search;
+	QFutureWatcher<QVector<MovedImageMatch>> watcher;
+	QVector<MovedImageMatch> matches;
+	int numFound;				// Number of files at new locations reported while scanning
 	QAtomicInt stopScanning;
 	QScopedPointer<QFontMetrics> fontMetrics;		// Needed to format elided paths
-
-	void learnImage(const QString &filename, QMap<QString, ImageMatch> &matches, const QVector<ImagePath> &imagePaths);
-	QVector<Match> learnImages(const QString &dir, int maxRecursions, QVector<QString> imagePaths);
 };
 
 #endif
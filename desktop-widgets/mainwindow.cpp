@@ -17,6 +17,7 @@
 #include <QUndoStack>
 #include <QtConcurrentRun>
 
+#include "core/cloudsync.h"
 #include "core/color.h"
 #include "core/divecomputer.h"
 #include "core/divesitehelpers.h"
@@ -230,6 +231,7 @@ MainWindow::MainWindow() : QMainWindow(),
 	connect(DivePlannerPointsModel::instance(), SIGNAL(planCreated()), this, SLOT(planCreated()));
 	connect(DivePlannerPointsModel::instance(), SIGNAL(planCanceled()), this, SLOT(planCanceled()));
 	connect(DivePlannerPointsModel::instance(), SIGNAL(variationsComputed(QString)), this, SLOT(updateVariations(QString)));
+	connect(plannerDetails, &PlannerDetails::shown, this, &MainWindow::showPlanNotes);
 	connect(plannerDetails->printPlan(), SIGNAL(pressed()), divePlannerWidget, SLOT(printDecoPlan()));
 	connect(this, SIGNAL(startDiveSiteEdit()), this, SLOT(on_actionDiveSiteEdit_triggered()));
 	connect(mainTab, &MainTab::diveSiteChanged, mapWidget, &MapWidget::centerOnSelectedDiveSite);
@@ -293,6 +295,11 @@ MainWindow::MainWindow() : QMainWindow(),
 	set_git_update_cb(&updateProgress);
 	set_error_cb(&showErrorFromC);
 
+	// Saving to the cloud only commits locally, the push happens in the background
+	cloud_sync_in_background = true;
+	connect(CloudSync::instance(), &CloudSync::progress, this, &MainWindow::cloudSyncProgress);
+	connect(CloudSync::instance(), &CloudSync::finished, this, &MainWindow::cloudSyncFinished);
+
 	// Toolbar Connections related to the Profile Update
 	auto tec = qPrefTechnicalDetails::instance();
 	connect(ui.profCalcAllTissues, &QAction::triggered, tec, &qPrefTechnicalDetails::set_calcalltissues);
@@ -610,18 +617,47 @@ void MainWindow::on_actionCloudstorageopen_triggered()
 	if (verbose)
 		qDebug() << "Opening cloud storage from:" << filename;
 
+	QByteArray fileNamePtr = QFile::encodeName(filename);
+	if (same_string(existing_filename, fileNamePtr.data())) {
+		// The cloud storage is already open: after syncing, only read what changed
+		reloadCurrentFile();
+		return;
+	}
+
 	closeCurrentFile();
 
 	showProgressBar();
-	QByteArray fileNamePtr = QFile::encodeName(filename);
 	if (!parse_file(fileNamePtr.data(), &dive_table, &trip_table))
 		setCurrentFile(fileNamePtr.data());
 	process_loaded_dives();
 	Command::clear();
+	emit diveListNotifier.dataReset();
 	hideProgressBar();
 	refreshDisplay();
 }
 
+// Read the current file again, but only what changed if it is a git repository.
+// The undo history refers to the old dives, so it is cleared.
+void MainWindow::reloadCurrentFile()
+{
+	graphics->setEmptyState();
+	clear_events();
+	dcList.dcs.clear();
+	showProgressBar();
+	if (reload_file(existing_filename))
+		setCurrentFile(nullptr);
+	process_loaded_dives();
+	// If the user discarded unsaved changes, reload_file() did a full load.
+	// Either way, the dives are now the ones of the file.
+	mark_divelist_changed(false);
+	Command::clear();
+	emit diveListNotifier.dataReset();
+	// Refresh before hiding the progress bar, which processes events:
+	// the dive list may still refer to dives that don't exist anymore.
+	refreshDisplay();
+	hideProgressBar();
+}
+
 // Return whether saving to cloud is OK. If it isn't, show an error return false.
 static bool saveToCloudOK()
 {
@@ -727,6 +763,7 @@ void MainWindow::closeCurrentFile()
 	/* free the dives and trips */
 	clear_git_id();
 	clear_dive_file_data();
+	emit diveListNotifier.dataReset();
 	setCurrentFile(nullptr);
 	cleanUpEmpty();
 	mark_divelist_changed(false);
@@ -889,21 +926,28 @@ void MainWindow::planCreated()
 
 void MainWindow::setPlanNotes()
 {
+	// Render the notes only if they are visible. Otherwise, they are rendered when shown.
+	if (plannerDetails->isVisible())
+		showPlanNotes();
+}
+
+void MainWindow::showPlanNotes()
+{
+	DivePlannerPointsModel::instance()->renderPlanNotes();
 	plannerDetails->divePlanOutput()->setHtml(displayed_dive.notes);
 }
 
 void MainWindow::updateVariations(QString variations)
 {
-	QString notes = QString(displayed_dive.notes);
-	free(displayed_dive.notes);
-	displayed_dive.notes = copy_qstring(notes.replace("VARIATIONS", variations));
-	plannerDetails->divePlanOutput()->setHtml(displayed_dive.notes);
+	DivePlannerPointsModel::instance()->setVariations(variations);
+	if (plannerDetails->isVisible())
+		showPlanNotes();
 }
 
 void MainWindow::printPlan()
 {
 #ifndef NO_PRINTING
-	QString diveplan = plannerDetails->divePlanOutput()->toHtml();
+	QString diveplan = DivePlannerPointsModel::instance()->printablePlanNotes();
 	QString withDisclaimer = QString("<img height=50 src=\":subsurface-icon\"> ") + diveplan + QString(disclaimer);
 
 	QPrinter printer;
@@ -942,7 +986,7 @@ void MainWindow::printPlan()
 
 	plannerDetails->divePlanOutput()->setHtml(withDisclaimer);
 	plannerDetails->divePlanOutput()->print(&printer);
-	plannerDetails->divePlanOutput()->setHtml(displayed_dive.notes);
+	showPlanNotes();
 #endif
 }
 
@@ -1739,6 +1783,7 @@ void MainWindow::loadFiles(const QStringList fileNames)
 	updateRecentFiles();
 	process_loaded_dives();
 	Command::clear();
+	emit diveListNotifier.dataReset();
 
 	refreshDisplay();
 
@@ -1946,6 +1991,35 @@ void MainWindow::cancelCloudStorageOperation()
 	progressDialogCanceled = true;
 }
 
+void MainWindow::cloudSyncProgress(const QString &text)
+{
+	statusBar()->showMessage(text, 5000);
+}
+
+void MainWindow::cloudSyncFinished(bool success, const QString &oldId, const QString &newId)
+{
+	if (!success) {
+		statusBar()->showMessage(tr("Cloud storage sync failed, the changes are kept in the local cache"), 10000);
+		return;
+	}
+	// Show the changes the sync brought in, unless they are loaded already or the user is busy with the dives.
+	// A sync that only pushed our own commits doesn't change the local branch.
+	if (oldId == newId || newId == QString(saved_git_id) || !existing_filename || unsaved_changes() ||
+	    mainTab->isEditing() || DivePlannerPointsModel::instance()->currentMode() != DivePlannerPointsModel::NOTHING)
+		return;
+	// The reload replaces the dives the undo history refers to
+	bool hadHistory = !Command::isEmpty();
+	// The local cache was just synced, don't sync again
+	bool glo = git_local_only;
+	git_local_only = true;
+	reloadCurrentFile();
+	git_local_only = glo;
+	if (hadHistory)
+		statusBar()->showMessage(tr("Loaded the changes from the cloud storage. The undo history was cleared."), 10000);
+	else
+		statusBar()->showMessage(tr("Loaded the changes from the cloud storage"), 5000);
+}
+
 void MainWindow::hideProgressBar()
 {
 	if (progressDialog) {
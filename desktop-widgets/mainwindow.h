@@ -149,6 +149,8 @@ slots:
 	void setDefaultState();
 	void setAutomaticTitle();
 	void cancelCloudStorageOperation();
+	void cloudSyncProgress(const QString &text);
+	void cloudSyncFinished(bool success, const QString &oldId, const QString &newId);
 	void unsetProfHR();
 	void unsetProfTissues();
 
@@ -172,6 +174,7 @@ slots:
 	void planCreated();
 	void setEnabledToolbar(bool arg1);
 	void setPlanNotes();
+	void showPlanNotes();
 	// Some shortcuts like "change DC" or "copy/paste dive components"
 	// should only be enabled when the profile's visible.
 	void disableShortcuts(bool disablePaste = true);
@@ -202,6 +205,7 @@ private:
 	bool askSaveChanges();
 	bool okToClose(QString message);
 	void closeCurrentFile();
+	void reloadCurrentFile();
 	void setCurrentFile(const char *f);
 	void updateCloudOnlineStatus();
 	void showProgressBar();
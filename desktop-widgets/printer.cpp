@@ -3,10 +3,13 @@
 #include "templatelayout.h"
 #include "core/statistics.h"
 #include "core/qthelper.h"
+#include "core/profile.h"
+#include "core/device.h"
 #include "core/settings/qPrefDisplay.h"
 
 #include <algorithm>
 #include <QPainter>
+#include <QtConcurrent>
 #ifdef USE_WEBENGINE
 #include <QtWebEngineWidgets>
 #else
@@ -16,6 +19,11 @@
 #endif
 #include "profile-widget/profilewidget2.h"
 
+// Large selections are printed in chunks of dives, so that the HTML document and
+// the web view don't grow with the number of printed dives. The number is divisible
+// by the number of dives per page of all bundled templates.
+static const int divesPerChunk = 60;
+
 Printer::Printer(QPaintDevice *paintDevice, print_options *printOptions, template_options *templateOptions,  PrintMode printMode)
 {
 	this->paintDevice = paintDevice;
@@ -36,13 +44,30 @@ Printer::~Printer()
 	delete webView;
 }
 
-void Printer::putProfileImage(QRect profilePlaceholder, QRect viewPort, QPainter *painter, struct dive *dive, QPointer<ProfileWidget2> profile)
+// Calculate the plot data of a dive for the dive computer that is shown in the profile.
+// The dive must be a private copy, since this is run in parallel for many dives. Don't
+// use select_dc(), which writes the global dc_number. The caller has to free the plot entries.
+struct PlotInfoCalculator {
+	typedef struct plot_info result_type;
+	int dcNr;
+	struct plot_info operator()(struct dive *dive) const
+	{
+		struct divecomputer *dc = get_dive_dc(dive, dcNr);
+		if (!dc->samples)
+			fake_dc(dc);
+		struct plot_info pi = calculate_max_limits_new(dive, dc);
+		calculate_plot_info(dive, dc, &pi, false, nullptr);
+		return pi;
+	}
+};
+
+void Printer::putProfileImage(QRect profilePlaceholder, QRect viewPort, QPainter *painter, struct dive *dive, const struct plot_info *pi, QPointer<ProfileWidget2> profile)
 {
 	int x = profilePlaceholder.x() - viewPort.x();
 	int y = profilePlaceholder.y() - viewPort.y();
 	// use the placeHolder and the viewPort position to calculate the relative position of the dive profile.
 	QRect pos(x, y, profilePlaceholder.width(), profilePlaceholder.height());
-	profile->plotDive(dive, true, true);
+	profile->plotDive(dive, true, true, pi);
 
 	if (!printOptions->color_selected) {
 		QImage image(pos.width(), pos.height(), QImage::Format_ARGB32);
@@ -131,52 +156,62 @@ void Printer::flowRender()
 #endif
 }
 
-void Printer::render(int Pages = 0)
+// Render the pages of the currently loaded HTML, which are pages
+// [firstPage, firstPage + Pages) of a print job of totalPages pages.
+void Printer::renderPages(QPainter &painter, QPointer<ProfileWidget2> profile, int firstPage, int Pages, int totalPages)
 {
-	// keep original preferences
-	QPointer<ProfileWidget2> profile = MainWindow::instance()->graphics;
-	int profileFrameStyle = profile->frameStyle();
-	int animationOriginal = qPrefDisplay::animation_speed();
-	double fontScale = profile->getFontPrintScale();
-	double printFontScale = 1.0;
-
-	// apply printing settings to profile
-	profile->setFrameStyle(QFrame::NoFrame);
-	profile->setPrintMode(true, !printOptions->color_selected);
-	profile->setToolTipVisibile(false);
-	qPrefDisplay::set_animation_speed(0);
-
-	// render the Qwebview
-	QPainter painter;
-	QRect viewPort(0, 0, pageSize.width(), pageSize.height());
-	painter.begin(paintDevice);
-	painter.setRenderHint(QPainter::Antialiasing);
-	painter.setRenderHint(QPainter::SmoothPixmapTransform);
-
-	// get all refereces to diveprofile class in the Html template
 #ifdef USE_WEBENGINE
 	//FIX ME
 #else
+	QRect viewPort(0, 0, pageSize.width(), pageSize.height());
+	double printFontScale = 1.0;
+
+	// get all refereces to diveprofile class in the Html template
 	QWebElementCollection collection = webView->page()->mainFrame()->findAllElements(".diveprofile");
 
-	QSize originalSize = profile->size();
 	if (collection.count() > 0) {
 		printFontScale = (double)collection.at(0).geometry().size().height() / (double)profile->size().height();
 		profile->resize(collection.at(0).geometry().size());
 	}
 	profile->setFontPrintScale(printFontScale);
 
+	// Only the profiles that start on the rendered pages are drawn. When previewing,
+	// that is a single page of the loaded chunk.
+	int numProfiles = 0;
+	while (numProfiles < collection.count() && collection.at(numProfiles).geometry().y() < Pages * pageSize.height())
+		++numProfiles;
+
+	// The calculation of the profiles (notably the deco information) dominates
+	// printing. Therefore, calculate the plot data of these dives in parallel in
+	// the background. The results are picked up in order as the pages are rendered.
+	// Copying the dives touches global state and is done up front.
+	QVector<struct dive *> dives;
+	QVector<struct dive *> copies;
+	dives.reserve(numProfiles);
+	copies.reserve(numProfiles);
+	for (int i = 0; i < numProfiles; ++i) {
+		// dive id field should be dive_{{dive_no}} se we remove the first 5 characters
+		QString diveIdString = collection.at(i).attribute("id");
+		int diveId = diveIdString.remove(0, 5).toInt(0, 10);
+		struct dive *dive = get_dive_by_uniq_id(diveId);
+		struct dive *copy = alloc_dive();
+		if (dive)
+			copy_dive(dive, copy);
+		dives.append(dive);
+		copies.append(copy);
+	}
+	// The workers must not read the global dc_number, which may change while they run
+	QFuture<struct plot_info> plotInfos = QtConcurrent::mapped(copies, PlotInfoCalculator{ (int)dc_number });
+
 	int elemNo = 0;
 	for (int i = 0; i < Pages; i++) {
 		// render the base Html template
 		webView->page()->mainFrame()->render(&painter, QWebFrame::ContentsLayer);
 
 		// render all the dive profiles in the current page
-		while (elemNo < collection.count() && collection.at(elemNo).geometry().y() < viewPort.y() + viewPort.height()) {
-			// dive id field should be dive_{{dive_no}} se we remove the first 5 characters
-			QString diveIdString = collection.at(elemNo).attribute("id");
-			int diveId = diveIdString.remove(0, 5).toInt(0, 10);
-			putProfileImage(collection.at(elemNo).geometry(), viewPort, &painter, get_dive_by_uniq_id(diveId), profile);
+		while (elemNo < numProfiles && collection.at(elemNo).geometry().y() < viewPort.y() + viewPort.height()) {
+			struct plot_info pi = plotInfos.resultAt(elemNo);
+			putProfileImage(collection.at(elemNo).geometry(), viewPort, &painter, dives[elemNo], &pi, profile);
 			elemNo++;
 		}
 
@@ -185,23 +220,61 @@ void Printer::render(int Pages = 0)
 		viewPort.adjust(0, pageSize.height(), 0, pageSize.height());
 
 		// rendering progress is 4/5 of total work
-		emit(progessUpdated(lrint((i * 80.0 / Pages) + done)));
-		if (i < Pages - 1 && printMode == Printer::PRINT)
+		emit(progessUpdated(lrint(((firstPage + i) * 80.0 / totalPages) + done)));
+		if (firstPage + i < totalPages - 1 && printMode == Printer::PRINT)
 			static_cast<QPrinter*>(paintDevice)->newPage();
 	}
-	painter.end();
+
+	// replot the current dive, so that the profile doesn't reference
+	// the precalculated plot data anymore
+	profile->plotDive(0, true, true);
+	plotInfos.waitForFinished();
+	for (struct plot_info pi: plotInfos.results())
+		free_plot_info_data(&pi);
+	for (struct dive *copy: copies)
+		free_dive(copy);
 #endif
+}
+
+// If a template layout is passed, only the first pagesPerChunk pages are loaded
+// into the web view. The following chunks are generated when they are needed.
+// Thus, the size of the HTML document stays bounded for large print jobs.
+void Printer::render(int Pages, TemplateLayout *layout, int divesPerPage, int pagesPerChunk)
+{
+	// keep original preferences
+	QPointer<ProfileWidget2> profile = MainWindow::instance()->graphics;
+	int profileFrameStyle = profile->frameStyle();
+	int animationOriginal = qPrefDisplay::animation_speed();
+	double fontScale = profile->getFontPrintScale();
+
+	// apply printing settings to profile
+	profile->setFrameStyle(QFrame::NoFrame);
+	profile->setPrintMode(true, !printOptions->color_selected);
+	profile->setToolTipVisibile(false);
+	qPrefDisplay::set_animation_speed(0);
+
+	// render the Qwebview
+	QPainter painter;
+	painter.begin(paintDevice);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.setRenderHint(QPainter::SmoothPixmapTransform);
+
+	QSize originalSize = profile->size();
+	if (!layout)
+		pagesPerChunk = Pages;
+	for (int page = 0; page < Pages; page += pagesPerChunk) {
+		if (page > 0)
+			webView->setHtml(layout->generate(page * divesPerPage, pagesPerChunk * divesPerPage));
+		renderPages(painter, profile, page, std::min(pagesPerChunk, Pages - page), Pages);
+	}
+	painter.end();
 
 	// return profle settings
 	profile->setFrameStyle(profileFrameStyle);
 	profile->setPrintMode(false);
 	profile->setFontPrintScale(fontScale);
 	profile->setToolTipVisibile(true);
-#ifdef USE_WEBENGINE
-	//FIXME
-#else
 	profile->resize(originalSize);
-#endif
 	qPrefDisplay::set_animation_speed(animationOriginal);
 
 	//replot the dive after returning the settings
@@ -241,7 +314,7 @@ void Printer::print()
 	// export border width with at least 1 pixel
 	// templateOptions->borderwidth = std::max(1, pageSize.width() / 1000);
 	if (printOptions->type == print_options::DIVELIST) {
-		webView->setHtml(t.generate());
+		webView->setHtml(t.generate(0, divesPerChunk));
 	} else if (printOptions->type == print_options::STATISTICS ) {
 		webView->setHtml(t.generateStatistics());
 	}
@@ -266,7 +339,18 @@ void Printer::print()
 #endif
 	int Pages;
 	if (divesPerPage == 0) {
+		// the page breaks of flowing templates depend on the content, therefore
+		// they can't be chunked
+		if (printOptions->type == print_options::DIVELIST && t.numDives() > divesPerChunk)
+			webView->setHtml(t.generate());
 		flowRender();
+	} else if (printOptions->type == print_options::DIVELIST) {
+		Pages = qCeil(t.numDives() / (float)divesPerPage);
+		// chunks have to consist of full pages
+		int pagesPerChunk = std::max(divesPerChunk / divesPerPage, 1);
+		if (pagesPerChunk * divesPerPage != divesPerChunk && t.numDives() > pagesPerChunk * divesPerPage)
+			webView->setHtml(t.generate(0, pagesPerChunk * divesPerPage));
+		render(Pages, &t, divesPerPage, pagesPerChunk);
 	} else {
 		Pages = qCeil(getTotalWork(printOptions) / (float)divesPerPage);
 		render(Pages);
@@ -287,8 +371,9 @@ void Printer::previewOnePage()
 #endif
 		// initialize the border settings
 		// templateOptions->border_width = std::max(1, pageSize.width() / 1000);
+		// only the first page is shown, so there's no need to generate all dives
 		if (printOptions->type == print_options::DIVELIST) {
-			webView->setHtml(t.generate());
+			webView->setHtml(t.generate(0, divesPerChunk));
 		} else if (printOptions->type == print_options::STATISTICS ) {
 			webView->setHtml(t.generateStatistics());
 		}
@@ -303,6 +388,9 @@ void Printer::previewOnePage()
 			//TODO: show warning
 		}
 		if (divesPerPage == 0) {
+			// flowing templates may fit more dives on one page than a chunk
+			if (printOptions->type == print_options::DIVELIST && t.numDives() > divesPerChunk)
+				webView->setHtml(t.generate());
 			flowRender();
 		} else {
 			render(1);
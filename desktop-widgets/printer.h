@@ -14,6 +14,8 @@
 #include "printoptions.h"
 #include "templateedit.h"
 
+class TemplateLayout;
+
 class Printer : public QObject {
 	Q_OBJECT
 
@@ -36,9 +38,10 @@ private:
 	PrintMode printMode;
 	int done;
 	int dpi;
-	void render(int Pages);
+	void render(int Pages, TemplateLayout *layout = nullptr, int divesPerPage = 0, int pagesPerChunk = 0);
+	void renderPages(QPainter &painter, QPointer<ProfileWidget2> profile, int firstPage, int Pages, int totalPages);
 	void flowRender();
-	void putProfileImage(QRect box, QRect viewPort, QPainter *painter, struct dive *dive, QPointer<ProfileWidget2> profile);
+	void putProfileImage(QRect box, QRect viewPort, QPainter *painter, struct dive *dive, const struct plot_info *pi, QPointer<ProfileWidget2> profile);
 
 private slots:
 	void templateProgessUpdated(int value);
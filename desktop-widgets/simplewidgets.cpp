@@ -10,6 +10,7 @@
 #include <QAction>
 #include <QDesktopServices>
 #include <QToolTip>
+#include <QPushButton>
 
 #include "core/file.h"
 #include "desktop-widgets/mainwindow.h"
@@ -343,12 +344,55 @@ ShiftImageTimesDialog::ShiftImageTimesDialog(QWidget *parent, QStringList fileNa
 	connect(ui.matchAllImages, SIGNAL(toggled(bool)), this, SLOT(matchAllImagesToggled(bool)));
 	dcImageEpoch = (time_t)0;
 
-	// Get times of all files. 0 means that the time couldn't be determined.
+	// Get metadata of all files. The files are scanned in parallel in the background
+	// and the dates are checked as they come in. The dialog can only be accepted
+	// once all files were read.
 	int numFiles = fileNames.size();
+	numRead = 0;
+	media.resize(numFiles);
 	timestamps.resize(numFiles);
-	for (int i = 0; i < numFiles; ++i)
-		timestamps[i] = picture_get_timestamp(qPrintable(fileNames[i]));
+	ui.readProgress->setRange(0, numFiles);
+	ui.buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
 	updateInvalid();
+	connect(&metadataWatcher, &QFutureWatcher<metadata>::resultsReadyAt, this, &ShiftImageTimesDialog::metadataRead);
+	connect(&metadataWatcher, &QFutureWatcher<metadata>::finished, this, &ShiftImageTimesDialog::metadataFinished);
+	metadataWatcher.setFuture(getMetadataParallel(fileNames));
+}
+
+ShiftImageTimesDialog::~ShiftImageTimesDialog()
+{
+	// If the dialog was cancelled, don't read the rest of the files
+	metadataWatcher.cancel();
+	metadataWatcher.waitForFinished();
+}
+
+void ShiftImageTimesDialog::metadataRead(int begin, int end)
+{
+	QFuture<metadata> future = metadataWatcher.future();
+	for (int i = begin; i < end; ++i) {
+		media[i] = future.resultAt(i);
+		// 0 means that the time couldn't be determined.
+		timestamps[i] = media[i].timestamp;
+	}
+	// The results may arrive out of order, but the list of invalid
+	// files is in the order of the files
+	int oldNumRead = numRead;
+	while (numRead < fileNames.size() && future.isResultReadyAt(numRead))
+		++numRead;
+	for (int i = oldNumRead; i < numRead; ++i)
+		appendInvalid(i);
+	ui.readProgress->setValue(numRead);
+}
+
+void ShiftImageTimesDialog::metadataFinished()
+{
+	ui.readProgress->hide();
+	ui.buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
+}
+
+const QVector<metadata> &ShiftImageTimesDialog::mediaMetadata() const
+{
+	return media;
 }
 
 time_t ShiftImageTimesDialog::amount() const
@@ -369,7 +413,6 @@ void ShiftImageTimesDialog::setOffset(time_t offset)
 
 void ShiftImageTimesDialog::updateInvalid()
 {
-	bool allValid = true;
 	ui.warningLabel->hide();
 	ui.invalidFilesText->hide();
 	QDateTime time_first = QDateTime::fromTime_t(first_selected_dive()->when, Qt::UTC);
@@ -382,24 +425,24 @@ void ShiftImageTimesDialog::updateInvalid()
 	}
 	ui.invalidFilesText->append(tr("\nFiles with inappropriate date/time") + ":");
 
-	int numFiles = fileNames.size();
-	for (int i = 0; i < numFiles; ++i) {
-		if (picture_check_valid_time(timestamps[i], m_amount))
-			continue;
-
-		// We've found an invalid image
-		time_first.setTime_t(timestamps[i] + m_amount);
-		if (timestamps[i] == 0)
-			ui.invalidFilesText->append(fileNames[i] + " - " + tr("No Exif date/time found"));
-		else
-			ui.invalidFilesText->append(fileNames[i] + " - " + time_first.toString());
-		allValid = false;
-	}
+	for (int i = 0; i < numRead; ++i)
+		appendInvalid(i);
+}
 
-	if (!allValid) {
-		ui.warningLabel->show();
-		ui.invalidFilesText->show();
-	}
+// Add a file to the list of invalid files, if its date doesn't fit to the selected dives
+void ShiftImageTimesDialog::appendInvalid(int i)
+{
+	if (picture_check_valid_time(timestamps[i], m_amount))
+		return;
+
+	// We've found an invalid image
+	QDateTime time = QDateTime::fromTime_t(timestamps[i] + m_amount, Qt::UTC);
+	if (timestamps[i] == 0)
+		ui.invalidFilesText->append(fileNames[i] + " - " + tr("No Exif date/time found"));
+	else
+		ui.invalidFilesText->append(fileNames[i] + " - " + time.toString());
+	ui.warningLabel->show();
+	ui.invalidFilesText->show();
 }
 
 void ShiftImageTimesDialog::timeEditChanged(const QTime &time)
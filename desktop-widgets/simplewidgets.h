@@ -22,6 +22,9 @@ class FilterModelBase;
 #include "ui_listfilter.h"
 #include "core/exif.h"
 #include "core/dive.h"
+#include "core/metadata.h"
+
+#include <QFutureWatcher>
 
 
 class MinMaxAvgWidget : public QWidget {
@@ -105,6 +108,8 @@ public:
 	time_t amount() const;
 	void setOffset(time_t offset);
 	bool matchAll();
+	~ShiftImageTimesDialog();
+	const QVector<metadata> &mediaMetadata() const;
 private
 slots:
 	void buttonClicked(QAbstractButton *button);
@@ -114,9 +119,15 @@ slots:
 	void timeEditChanged();
 	void updateInvalid();
 	void matchAllImagesToggled(bool);
+	void metadataRead(int begin, int end);
+	void metadataFinished();
 
 private:
+	void appendInvalid(int i);
 	QStringList fileNames;
+	QFutureWatcher<metadata> metadataWatcher;
+	int numRead;		// the metadata of the files before this index are read
+	QVector<metadata> media;
 	QVector<timestamp_t> timestamps;
 	Ui::ShiftImageTimesDialog ui;
 	time_t m_amount;
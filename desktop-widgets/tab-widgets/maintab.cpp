@@ -626,9 +626,6 @@ void MainTab::addWeight_clicked()
 
 void MainTab::reload()
 {
-	suitModel.updateModel();
-	buddyModel.updateModel();
-	diveMasterModel.updateModel();
 	tagModel.updateModel();
 	LocationInformationModel::instance()->update();
 }
@@ -894,6 +891,11 @@ void MainTab::acceptChanges()
 		// dive sites
 		displayed_dive.dive_site = current_dive->dive_site;
 
+		// these edits don't go through the undo commands, so the completions aren't notified
+		suitModel.updateDives(selectedDives);
+		buddyModel.updateDives(selectedDives);
+		diveMasterModel.updateDives(selectedDives);
+
 		// each dive that was selected might have had the temperatures in its active divecomputer changed
 		// so re-populate the temperatures - easiest way to do this is by calling fixup_dive
 		for_each_dive (i, d) {
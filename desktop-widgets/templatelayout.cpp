@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0
 #include <QFileDevice>
+#include <QFileInfo>
 #include <string>
+#include <algorithm>
 
 #include "templatelayout.h"
 #include "core/display.h"
@@ -91,7 +93,8 @@ void copy_bundled_templates(QString src, QString dst, QStringList *templateBacku
 }
 
 TemplateLayout::TemplateLayout(print_options *PrintOptions, template_options *templateOptions) :
-	m_engine(NULL)
+	m_engine(NULL),
+	divesCollected(false)
 {
 	this->PrintOptions = PrintOptions;
 	this->templateOptions = templateOptions;
@@ -135,49 +138,105 @@ static QString preprocessTemplate(const QString &in)
 	return out;
 }
 
-QString TemplateLayout::generate()
+/* Compiled dive templates are kept for the lifetime of the application, because
+ * the preview re-renders the same template on every change of the print options
+ * and large print jobs render it once per chunk of dives. A template is recompiled
+ * when its file was changed behind our back. The engine has to outlive the templates
+ * and is therefore never freed.
+ */
+struct CompiledTemplate {
+	QDateTime modified;
+	Grantlee::Template t;
+};
+static QHash<QString, CompiledTemplate> compiledTemplates;
+
+static Grantlee::Template compileTemplate(const QString &template_name)
 {
-	int progress = 0;
-	int totalWork = getTotalWork(PrintOptions);
+	static Grantlee::Engine *engine = new Grantlee::Engine;
 
-	QString htmlContent;
-	delete m_engine;
-	m_engine = new Grantlee::Engine(this);
-	Grantlee::registerMetaType<template_options>();
-	Grantlee::registerMetaType<print_options>();
+	QDateTime modified = QFileInfo(getPrintingTemplatePathUser() + QDir::separator() + template_name).lastModified();
+	auto it = compiledTemplates.find(template_name);
+	if (it != compiledTemplates.end() && it->modified == modified)
+		return it->t;
 
-	QVariantList diveList;
+	/* don't use the Grantlee loader API */
+	QString templateContents = TemplateLayout::readTemplate(template_name);
+	QString preprocessed = preprocessTemplate(templateContents);
 
-	struct dive *dive;
+	/* create the template from QString; is this thing allocating memory? */
+	Grantlee::Template t = engine->newTemplate(preprocessed, template_name);
+	if (!t || t->error())
+		compiledTemplates.remove(template_name);
+	else
+		compiledTemplates.insert(template_name, { modified, t });
+	return t;
+}
+
+void TemplateLayout::collectDives()
+{
+	if (divesCollected)
+		return;
+	divesCollected = true;
 	if (in_planner()) {
-		DiveObjectHelper *d = new DiveObjectHelper(&displayed_dive);
-		diveList.append(QVariant::fromValue(d));
-		emit progressUpdated(100.0);
+		dives.append(&displayed_dive);
 	} else {
 		int i;
+		struct dive *dive;
 		for_each_dive (i, dive) {
 			//TODO check for exporting selected dives only
 			if (!dive->selected && PrintOptions->print_selected)
 				continue;
-			DiveObjectHelper *d = new DiveObjectHelper(dive);
-			diveList.append(QVariant::fromValue(d));
-			progress++;
-			emit progressUpdated(lrint(progress * 100.0 / totalWork));
+			dives.append(dive);
 		}
 	}
+}
+
+int TemplateLayout::numDives()
+{
+	collectDives();
+	return dives.size();
+}
+
+QString TemplateLayout::generate()
+{
+	return generate(0, numDives());
+}
+
+QString TemplateLayout::generate(int first, int count)
+{
+	int totalWork = getTotalWork(PrintOptions);
+	QString htmlContent;
+
+	Grantlee::registerMetaType<template_options>();
+	Grantlee::registerMetaType<print_options>();
+
+	collectDives();
+	first = std::max(first, 0);
+	int last = std::min(first + count, dives.size());
+
+	// The helpers of one chunk are freed after rendering, so that the
+	// memory use doesn't grow with the number of printed dives.
+	QVariantList diveList;
+	QVector<DiveObjectHelper *> helpers;
+	helpers.reserve(last - first);
+	for (int i = first; i < last; ++i) {
+		DiveObjectHelper *d = new DiveObjectHelper(dives[i]);
+		helpers.append(d);
+		diveList.append(QVariant::fromValue(d));
+		if (in_planner())
+			emit progressUpdated(100.0);
+		else
+			emit progressUpdated(lrint((i + 1) * 100.0 / totalWork));
+	}
 	Grantlee::Context c;
 	c.insert("dives", diveList);
 	c.insert("template_options", QVariant::fromValue(*templateOptions));
 	c.insert("print_options", QVariant::fromValue(*PrintOptions));
 
-	/* don't use the Grantlee loader API */
-	QString templateContents = readTemplate(PrintOptions->p_template);
-	QString preprocessed = preprocessTemplate(templateContents);
-
-	/* create the template from QString; is this thing allocating memory? */
-	Grantlee::Template t = m_engine->newTemplate(preprocessed, PrintOptions->p_template);
+	Grantlee::Template t = compileTemplate(PrintOptions->p_template);
 	if (!t || t->error()) {
 		qDebug() << "Can't load template";
+		qDeleteAll(helpers);
 		return htmlContent;
 	}
 
@@ -186,6 +245,7 @@ QString TemplateLayout::generate()
 	if (t->error()) {
 		qDebug() << "Can't render template";
 	}
+	qDeleteAll(helpers);
 	return htmlContent;
 }
 
@@ -249,6 +309,7 @@ QString TemplateLayout::readTemplate(QString template_name)
 
 void TemplateLayout::writeTemplate(QString template_name, QString grantlee_template)
 {
+	compiledTemplates.remove(template_name);
 	QFile qfile(getPrintingTemplatePathUser() + QDir::separator() + template_name);
 	if (qfile.open(QFile::ReadWrite | QFile::Text)) {
 		qfile.write(qPrintable(grantlee_template));
@@ -23,7 +23,11 @@ public:
 	TemplateLayout(print_options *PrintOptions, template_options *templateOptions);
 	~TemplateLayout();
 	QString generate();
+	// Render only the dives [first, first + count) of the dives to be printed.
+	// Used to print large selections in chunks of a few pages.
+	QString generate(int first, int count);
 	QString generateStatistics();
+	int numDives();
 	static QString readTemplate(QString template_name);
 	static void writeTemplate(QString template_name, QString grantlee_template);
 
@@ -31,6 +35,9 @@ private:
 	Grantlee::Engine *m_engine;
 	print_options *PrintOptions;
 	template_options *templateOptions;
+	QVector<struct dive *> dives;
+	bool divesCollected;
+	void collectDives();
 
 signals:
 	void progressUpdated(int value);
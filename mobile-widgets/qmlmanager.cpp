@@ -29,7 +29,9 @@
 #include "core/qthelper.h"
 #include "core/qt-gui.h"
 #include "core/git-access.h"
+#include "core/git-journal.h"
 #include "core/cloudstorage.h"
+#include "core/cloudsync.h"
 #include "core/membuffer.h"
 #include "qt-models/tankinfomodel.h"
 #include "core/downloadfromdcthread.h"
@@ -42,6 +44,9 @@
 #include "core/settings/qPrefPartialPressureGas.h"
 #include "core/settings/qPrefUnit.h"
 
+// milliseconds without changes after which the journal is committed
+#define JOURNAL_IDLE_TIME 30000
+
 QMLManager *QMLManager::m_instance = NULL;
 bool noCloudToCloud = false;
 
@@ -221,6 +226,16 @@ QMLManager::QMLManager() : m_locationServiceEnabled(false),
 	set_git_update_cb(&gitProgressCB);
 	LOG_STP("qmlmgr git update");
 
+	// saving to the cloud only commits locally, the sync happens in the background
+	cloud_sync_in_background = true;
+	connect(CloudSync::instance(), &CloudSync::progress, this, [this](const QString &text) { appendTextToLog(text); });
+	connect(CloudSync::instance(), &CloudSync::finished, this, &QMLManager::cloudSyncFinished);
+
+	// changes go to the journal right away and are committed once the user stops editing
+	journalTimer.setSingleShot(true);
+	journalTimer.setInterval(JOURNAL_IDLE_TIME);
+	connect(&journalTimer, &QTimer::timeout, this, &QMLManager::commitJournal);
+
 	// make sure we know if the current cloud repo has been successfully synced
 	syncLoadFromCloud();
 	LOG_STP("qmlmgr sync load cloud");
@@ -260,6 +275,8 @@ void QMLManager::applicationStateChanged(Qt::ApplicationState state)
 		//       make sure the user sees that we are saving data if they come back
 		//       while this is running
 		saveChangesCloud(false);
+		// we may not get to run anymore, so don't leave the push to the background
+		cloud_sync_wait();
 		appendTextToLog("done saving to git local / remote");
 	}
 }
@@ -302,6 +319,7 @@ void QMLManager::openLocalThenRemote(QString url)
 		qPrefTechnicalDetails::set_show_ccr_sensors(git_prefs.show_ccr_sensors);
 		qPrefPartialPressureGas::set_po2(git_prefs.pp_graphs.po2);
 		process_loaded_dives();
+		replayJournal(fileNamePrt.data());
 		DiveListModel::instance()->clear();
 		DiveListModel::instance()->addAllDives();
 		appendTextToLog(QStringLiteral("%1 dives loaded from cache").arg(dive_table.nr));
@@ -329,12 +347,21 @@ void QMLManager::openLocalThenRemote(QString url)
 
 void QMLManager::updateAllGlobalLists()
 {
-	buddyModel.updateModel(); emit buddyListChanged();
-	suitModel.updateModel(); emit suitListChanged();
-	divemasterModel.updateModel(); emit divemasterListChanged();
+	buddyModel.reset(); emit buddyListChanged();
+	suitModel.reset(); emit suitListChanged();
+	divemasterModel.reset(); emit divemasterListChanged();
 	locationModel.update(); emit locationListChanged();
 }
 
+// The mobile edits don't go through the undo commands, so they report the
+// dives they changed and the dives they are about to delete themselves
+void QMLManager::updateCompletions(const QVector<dive *> &changed, const QVector<dive *> &deleted)
+{
+	buddyModel.removeDives(deleted); buddyModel.updateDives(changed); emit buddyListChanged();
+	suitModel.removeDives(deleted); suitModel.updateDives(changed); emit suitListChanged();
+	divemasterModel.removeDives(deleted); divemasterModel.updateDives(changed); emit divemasterListChanged();
+}
+
 void QMLManager::mergeLocalRepo()
 {
 	char *filename = NOCLOUD_LOCALSTORAGE;
@@ -652,19 +679,31 @@ void QMLManager::loadDivesWithValidCredentials()
 		goto successful_exit;
 	}
 	appendTextToLog("Cloud sync brought newer data, reloading the dive list");
+	git_oid oldId, newId;
+	if (get_last_sync(&oldId, &newId)) {
+		char oldSha[GIT_OID_HEXSZ + 1], newSha[GIT_OID_HEXSZ + 1];
+		git_oid_tostr(oldSha, sizeof(oldSha), &oldId);
+		git_oid_tostr(newSha, sizeof(newSha), &newId);
+		appendTextToLog(QString("Cloud sync updated local cache from %1 to %2").arg(oldSha).arg(newSha));
+	}
 
-	// if we aren't switching from no-cloud mode, let's clear the dive data
-	if (!noCloudToCloud) {
-		appendTextToLog("Clear out in memory dive data");
-		clear_dive_file_data();
-	} else {
+	if (noCloudToCloud)
 		appendTextToLog("Switching from no cloud mode; keep in memory dive data");
-	}
 	if (git != dummy_git_repository) {
 		appendTextToLog(QString("have repository and branch %1").arg(branch));
-		error = git_load_dives(git, branch);
+		if (noCloudToCloud) {
+			error = git_load_dives(git, branch);
+		} else {
+			// if we aren't switching from no-cloud mode, only read what changed since the last load
+			appendTextToLog("Update in memory dive data with the changes in the local cache");
+			error = git_reload_dives(git, branch);
+		}
 	} else {
 		appendTextToLog(QString("didn't receive valid git repo, try again"));
+		if (!noCloudToCloud) {
+			appendTextToLog("Clear out in memory dive data");
+			clear_dive_file_data();
+		}
 		error = parse_file(fileNamePrt.data(), &dive_table, &trip_table);
 	}
 	if (!error) {
@@ -751,7 +790,10 @@ void QMLManager::consumeFinishedLoad(timestamp_t currentDiveTimestamp)
 	prefs.pp_graphs.po2 = git_prefs.pp_graphs.po2;
 	DiveListModel::instance()->clear();
 	process_loaded_dives();
+	if (!empty_string(existing_filename))
+		replayJournal(existing_filename);
 	DiveListModel::instance()->addAllDives();
+	updateAllGlobalLists();
 	if (currentDiveTimestamp)
 		setUpdateSelectedDive(dlSortModel->getIdxForId(get_dive_id_closest_to(currentDiveTimestamp)));
 	appendTextToLog(QStringLiteral("%1 dives loaded").arg(dive_table.nr));
@@ -1157,6 +1199,7 @@ void QMLManager::commitChanges(QString diveId, QString date, QString location, Q
 		DiveListModel::instance()->updateDive(modelIdx, d);
 		invalidate_dive_cache(d);
 		mark_divelist_changed(true);
+		updateCompletions({ d });
 	}
 	if (diveChanged || needResort)
 		changesNeedSaving();
@@ -1164,19 +1207,45 @@ void QMLManager::commitChanges(QString diveId, QString date, QString location, Q
 
 void QMLManager::changesNeedSaving()
 {
-	// we no longer save right away on iOS because file access is so slow; on the other hand,
-	// on Android the save as the user switches away doesn't seem to work... drat.
-	// as a compromise for now we save just to local storage on Android right away (that appears
-	// to be reasonably fast), but don't save at all (and only remember that we need to save things
-	// on iOS
-	// on all other platforms we just save the changes and be done with it
+	// a commit is too slow to do after every edit, on iOS file access is particularly slow
+	// and on Android the save as the user switches away doesn't always work. so we only
+	// append the changed dives to the journal, which is cheap and survives a crash, and
+	// commit once the user stopped editing for a while or the app is put in the background
 	mark_divelist_changed(true);
-#if defined(Q_OS_ANDROID)
+	if (empty_string(existing_filename)) {
+		// there is no repository yet that the journal could belong to
+		saveChangesLocal();
+	} else {
+		if (git_journal_write(existing_filename))
+			appendTextToLog("writing the journal failed: " + consumeError());
+		journalTimer.start();
+	}
+	locationModel.update(); emit locationListChanged();
+}
+
+void QMLManager::commitJournal()
+{
+	enum cloud_sync_state state = CloudSync::instance()->state();
+	if (alreadySaving || (state != CLOUD_SYNC_IDLE && state != CLOUD_SYNC_FAILED)) {
+		// try again once the ongoing save, load or sync is done
+		journalTimer.start();
+		return;
+	}
+#if defined(Q_OS_ANDROID) || defined(Q_OS_IOS)
 	saveChangesLocal();
-#elif !defined(Q_OS_IOS)
+#else
 	saveChangesCloud(false);
 #endif
-	updateAllGlobalLists();
+}
+
+// Apply the changes of the journal that weren't committed yet, e.g. because the app was killed
+void QMLManager::replayJournal(const char *filename)
+{
+	git_journal_set_base();
+	if (git_journal_replay(filename) > 0) {
+		appendTextToLog(QStringLiteral("restored the changes from the journal, %1 dives").arg(dive_table.nr));
+		journalTimer.start();
+	}
 }
 
 void QMLManager::openNoCloudRepo()
@@ -1237,6 +1306,10 @@ void QMLManager::saveChangesLocal()
 		}
 		git_local_only = glo;
 		mark_divelist_changed(false);
+		// the changes of the journal are in the commit now
+		git_journal_clear(existing_filename);
+		git_journal_set_base();
+		journalTimer.stop();
 		alreadySaving = false;
 	} else {
 		appendTextToLog("local save requested with no unsaved changes");
@@ -1266,8 +1339,37 @@ void QMLManager::saveChangesCloud(bool forceRemoteSync)
 		return;
 	}
 
+	// the changes are in the local cache, fetch, merge and push in the background
+	QString url;
+	if (getCloudURL(url)) {
+		appendTextToLog("no cloud URL, can't sync with the cloud");
+		return;
+	}
+	QByteArray fileNamePrt = QFile::encodeName(url);
+	const char *branch = NULL, *remote = NULL;
+	if (is_git_repository(fileNamePrt.data(), &branch, &remote, true) && remote) {
+		appendTextToLog("request background sync with the cloud");
+		CloudSync::instance()->requestSync(QString::fromUtf8(remote), QString::fromUtf8(branch));
+		free((void *)remote);
+		free((void *)branch);
+	}
+}
+
+void QMLManager::cloudSyncFinished(bool success, const QString &oldId, const QString &newId)
+{
+	if (!success) {
+		appendTextToLog("background sync with the cloud failed, the changes are kept in the local cache");
+		return;
+	}
+	appendTextToLog("background sync with the cloud done");
+	if (oldId == newId || alreadySaving)
+		return;
+	appendTextToLog(QString("Cloud sync updated local cache from %1 to %2").arg(oldId).arg(newId));
+
+	// the sync brought in changes from the cloud, read them from the local cache. changes
+	// that weren't committed yet are in the journal and are replayed on top of them
 	bool glo = git_local_only;
-	git_local_only = false;
+	git_local_only = true;
 	alreadySaving = true;
 	loadDivesWithValidCredentials();
 	alreadySaving = false;
@@ -1288,6 +1390,7 @@ bool QMLManager::undoDelete(int id)
 		add_dive_to_trip(deletedDive, trip);
 	}
 	record_dive(deletedDive);
+	updateCompletions({ deletedDive });
 	QList<dive *>diveAsList;
 	diveAsList << deletedDive;
 	DiveListModel::instance()->addDive(diveAsList);
@@ -1324,6 +1427,7 @@ void QMLManager::deleteDive(int id)
 		deletedDive->divetrip = deletedTrip;
 	}
 	DiveListModel::instance()->removeDiveById(id);
+	updateCompletions({}, { d });
 	delete_single_dive(get_idx_by_uniq_id(id));
 	DiveListModel::instance()->resetInternalData();
 	changesNeedSaving();
@@ -1434,6 +1538,7 @@ void QMLManager::pasteDiveData(int id)
 	selective_copy_dive(m_copyPasteDive, d, what, false);
 
 	invalidate_dive_cache(d);
+	updateCompletions({ d });
 	mark_divelist_changed(true);
 	changesNeedSaving();
 	setNotificationText("Paste");
@@ -1479,8 +1584,10 @@ QString QMLManager::getCurrentPosition()
 
 void QMLManager::applyGpsData()
 {
-	if (locationProvider->applyLocations())
+	if (locationProvider->applyLocations()) {
 		refreshDiveList();
+		changesNeedSaving();
+	}
 }
 
 void QMLManager::populateGpsData()
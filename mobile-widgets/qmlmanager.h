@@ -7,6 +7,7 @@
 #include <QNetworkAccessManager>
 #include <QScreen>
 #include <QElapsedTimer>
+#include <QTimer>
 #include <QColor>
 #include <QFile>
 
@@ -164,6 +165,8 @@ public slots:
 	void openNoCloudRepo();
 	void saveChangesLocal();
 	void saveChangesCloud(bool forceRemoteSync);
+	void commitJournal();
+	void cloudSyncFinished(bool success, const QString &oldId, const QString &newId);
 	void deleteDive(int id);
 	void copyDiveData(int id);
 	void pasteDiveData(int id);
@@ -227,6 +230,7 @@ private:
 	int m_selectedDiveTimestamp;
 	qreal m_lastDevicePixelRatio;
 	QElapsedTimer timer;
+	QTimer journalTimer;
 	bool alreadySaving;
 	bool checkDate(DiveObjectHelper *myDive, struct dive * d, QString date);
 	bool checkLocation(DiveObjectHelper *myDive, struct dive *d, QString location, QString gps);
@@ -237,6 +241,8 @@ private:
 	QString m_progressMessage;
 	bool m_btEnabled;
 	void updateAllGlobalLists();
+	void updateCompletions(const QVector<dive *> &changed, const QVector<dive *> &deleted = QVector<dive *>());
+	void replayJournal(const char *filename);
 	QString m_pluggedInDeviceName;
 	struct dive *m_copyPasteDive = NULL;
 	struct dive_components what;
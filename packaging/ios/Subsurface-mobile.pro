@@ -10,10 +10,12 @@ SOURCES += ../../subsurface-mobile-main.cpp \
 	../../subsurface-helper.cpp \
 	../../map-widget/qmlmapwidgethelper.cpp \
 	../../core/cloudstorage.cpp \
+	../../core/cloudsync.cpp \
 	../../core/configuredivecomputerthreads.cpp \
 	../../core/devicedetails.cpp \
 	../../core/gpslocation.cpp \
 	../../core/imagedownloader.cpp \
+	../../core/thumbnailcache.cpp \
 	../../core/downloadfromdcthread.cpp \
 	../../core/qtserialbluetooth.cpp \
 	../../core/plannernotes.c \
@@ -43,8 +45,10 @@ SOURCES += ../../subsurface-mobile-main.cpp \
 	../../core/dive.c \
 	../../core/divelist.c \
 	../../core/gas-model.c \
+	../../core/gasbudget.c \
 	../../core/gaspressures.c \
 	../../core/git-access.c \
+	../../core/git-journal.c \
 	../../core/liquivision.c \
 	../../core/load-git.c \
 	../../core/parse-xml.c \
@@ -73,6 +77,7 @@ SOURCES += ../../subsurface-mobile-main.cpp \
 	../../core/strtod.c \
 	../../core/taxonomy.c \
 	../../core/time.c \
+	../../core/trace.cpp \
 	../../core/uemis.c \
 	../../core/btdiscovery.cpp \
 	../../core/connectionlistmodel.cpp \
@@ -146,11 +151,13 @@ INCLUDEPATH += ./install-root/include/ \
 HEADERS += \
 	../../core/libdivecomputer.h \
 	../../core/cloudstorage.h \
+	../../core/cloudsync.h \
 	../../core/configuredivecomputerthreads.h \
 	../../core/device.h \
 	../../core/devicedetails.h \
 	../../core/dive.h \
 	../../core/git-access.h \
+	../../core/git-journal.h \
 	../../core/gpslocation.h \
 	../../core/imagedownloader.h \
 	../../core/pref.h \
@@ -175,6 +182,7 @@ HEADERS += \
 	../../core/divesitehelpers.h \
 	../../core/exif.h \
 	../../core/file.h \
+	../../core/gasbudget.h \
 	../../core/gaspressures.h \
 	../../core/gettext.h \
 	../../core/gettextfromc.h \
@@ -188,6 +196,7 @@ HEADERS += \
 	../../core/subsurfacestartup.h \
 	../../core/subsurfacesysinfo.h \
 	../../core/taxonomy.h \
+	../../core/trace.h \
 	../../core/uemis.h \
 	../../core/webservice.h \
 	../../core/windowtitleupdate.h \
@@ -19,6 +19,7 @@
 #include "qt-models/models.h"
 #include "qt-models/divepicturemodel.h"
 #include "core/divelist.h"
+#include "core/trace.h"
 #ifndef SUBSURFACE_MOBILE
 #include "desktop-widgets/diveplanner.h"
 #include "desktop-widgets/simplewidgets.h"
@@ -149,6 +150,10 @@ ProfileWidget2::ProfileWidget2(QWidget *parent) : QGraphicsView(parent),
 
 	memset(&plotInfo, 0, sizeof(plotInfo));
 
+	replotTimer.setSingleShot(true);
+	replotTimer.setInterval(40);
+	connect(&replotTimer, &QTimer::timeout, this, [this] { replot(); });
+
 	setupSceneAndFlags();
 	setupItemSizes();
 	setupItemOnScene();
@@ -167,7 +172,7 @@ ProfileWidget2::ProfileWidget2(QWidget *parent) : QGraphicsView(parent),
 	connect(Thumbnailer::instance(), &Thumbnailer::thumbnailChanged, this, &ProfileWidget2::updateThumbnail, Qt::QueuedConnection);
 	connect(DivePictureModel::instance(), SIGNAL(rowsInserted(const QModelIndex &, int, int)), this, SLOT(plotPictures()));
 	connect(DivePictureModel::instance(), &DivePictureModel::picturesRemoved, this, &ProfileWidget2::removePictures);
-	connect(DivePictureModel::instance(), &DivePictureModel::modelReset, this, &ProfileWidget2::plotPictures);
+	connect(DivePictureModel::instance(), SIGNAL(rowsRemoved(const QModelIndex &, int, int)), this, SLOT(plotPictures()));
 #endif // SUBSURFACE_MOBILE
 
 #if !defined(QT_NO_DEBUG) && defined(SHOW_PLOT_INFO_TABLE)
@@ -374,10 +379,22 @@ void ProfileWidget2::replot(struct dive *d)
 {
 	if (!replotEnabled)
 		return;
+	replotTimer.stop();
 	dataModel->clear();
 	plotDive(d, true, false);
 }
 
+// Every edit in the planner causes the plan to be recalculated. Dragging a
+// handle or changing a setting produces bursts of edits, therefore recalculate
+// at most once per timer interval. The timer is not restarted on further edits,
+// so that the profile keeps following a drag.
+void ProfileWidget2::scheduleReplot()
+{
+	if (!replotEnabled || replotTimer.isActive())
+		return;
+	replotTimer.start();
+}
+
 void ProfileWidget2::createPPGas(PartialPressureGasItem *item, int verticalColumn, color_index_t color, color_index_t colorAlert,
 				 const double *thresholdSettingsMin, const double *thresholdSettingsMax)
 {
@@ -548,9 +565,13 @@ void ProfileWidget2::resetZoom()
 }
 
 // Currently just one dive, but the plan is to enable All of the selected dives.
-void ProfileWidget2::plotDive(struct dive *d, bool force, bool doClearPictures)
+// If precalculated is given, it is used instead of calculating the plot data of the dive.
+// The caller keeps ownership of the plot entries and must keep them alive until the
+// next dive is plotted.
+void ProfileWidget2::plotDive(struct dive *d, bool force, bool doClearPictures, const struct plot_info *precalculated)
 {
 	static bool firstCall = true;
+	TraceSpan span("plotDive");
 #ifndef SUBSURFACE_MOBILE
 	QElapsedTimer measureDuration; // let's measure how long this takes us (maybe we'll turn of TTL calculation later
 	measureDuration.start();
@@ -636,12 +657,16 @@ void ProfileWidget2::plotDive(struct dive *d, bool force, bool doClearPictures)
 	 * shown.
 	 */
 
-	plotInfo = calculate_max_limits_new(&displayed_dive, currentdc);
+	if (precalculated) {
+		plotInfo = *precalculated;
+	} else {
+		plotInfo = calculate_max_limits_new(&displayed_dive, currentdc);
 #ifndef SUBSURFACE_MOBILE
-	create_plot_info_new(&displayed_dive, currentdc, &plotInfo, !shouldCalculateMaxDepth, &DivePlannerPointsModel::instance()->final_deco_state);
+		create_plot_info_new(&displayed_dive, currentdc, &plotInfo, !shouldCalculateMaxDepth, &DivePlannerPointsModel::instance()->final_deco_state);
 #else
-	create_plot_info_new(&displayed_dive, currentdc, &plotInfo, !shouldCalculateMaxDepth, nullptr);
+		create_plot_info_new(&displayed_dive, currentdc, &plotInfo, !shouldCalculateMaxDepth, nullptr);
 #endif
+	}
 	int newMaxtime = get_maxtime(&plotInfo);
 	if (shouldCalculateMaxTime || newMaxtime > maxtime)
 		maxtime = newMaxtime;
@@ -1330,8 +1355,8 @@ void ProfileWidget2::setAddState()
 	actionsForKeys[Qt::Key_Delete]->setShortcut(Qt::Key_Delete);
 
 	DivePlannerPointsModel *plannerModel = DivePlannerPointsModel::instance();
-	connect(plannerModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(replot()));
-	connect(plannerModel, SIGNAL(cylinderModelEdited()), this, SLOT(replot()));
+	connect(plannerModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(scheduleReplot()));
+	connect(plannerModel, SIGNAL(cylinderModelEdited()), this, SLOT(scheduleReplot()));
 #ifndef SUBSURFACE_MOBILE
 	connect(plannerModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
 		this, SLOT(pointInserted(const QModelIndex &, int, int)));
@@ -1365,8 +1390,8 @@ void ProfileWidget2::setPlanState()
 	actionsForKeys[Qt::Key_Delete]->setShortcut(Qt::Key_Delete);
 
 	DivePlannerPointsModel *plannerModel = DivePlannerPointsModel::instance();
-	connect(plannerModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(replot()));
-	connect(plannerModel, SIGNAL(cylinderModelEdited()), this, SLOT(replot()));
+	connect(plannerModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(scheduleReplot()));
+	connect(plannerModel, SIGNAL(cylinderModelEdited()), this, SLOT(scheduleReplot()));
 	connect(plannerModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
 		this, SLOT(pointInserted(const QModelIndex &, int, int)));
 	connect(plannerModel, SIGNAL(rowsRemoved(const QModelIndex &, int, int)),
@@ -1815,8 +1840,9 @@ void ProfileWidget2::disconnectTemporaryConnections()
 {
 #ifndef SUBSURFACE_MOBILE
 	DivePlannerPointsModel *plannerModel = DivePlannerPointsModel::instance();
-	disconnect(plannerModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(replot()));
-	disconnect(plannerModel, SIGNAL(cylinderModelEdited()), this, SLOT(replot()));
+	disconnect(plannerModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(scheduleReplot()));
+	disconnect(plannerModel, SIGNAL(cylinderModelEdited()), this, SLOT(scheduleReplot()));
+	replotTimer.stop();
 
 	disconnect(plannerModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
 		   this, SLOT(pointInserted(const QModelIndex &, int, int)));
@@ -3,6 +3,7 @@
 #define PROFILEWIDGET2_H
 
 #include <QGraphicsView>
+#include <QTimer>
 #include <vector>
 #include <memory>
 
@@ -75,7 +76,7 @@ public:
 	ProfileWidget2(QWidget *parent = 0);
 	void resetZoom();
 	void scale(qreal sx, qreal sy);
-	void plotDive(struct dive *d = 0, bool force = false, bool clearPictures = false);
+	void plotDive(struct dive *d = 0, bool force = false, bool clearPictures = false, const struct plot_info *precalculated = nullptr);
 	void setupItem(AbstractProfilePolygonItem *item, DiveCartesianAxis *vAxis, int vData, int hData, int zValue);
 	void setPrintMode(bool mode, bool grayscale = false);
 	bool getPrintMode();
@@ -110,6 +111,7 @@ slots: // Necessary to call from QAction's signals.
 	void setProfileState();
 	void setReplot(bool state);
 	void replot(dive *d = 0);
+	void scheduleReplot();
 #ifndef SUBSURFACE_MOBILE
 	void plotPictures();
 	void removePictures(const QVector<QString> &fileUrls);
@@ -184,6 +186,7 @@ private:
 #endif
 	bool isPlotZoomed;
 	bool replotEnabled;
+	QTimer replotTimer;	// coalesces the edits of the planner
 	// All those here should probably be merged into one structure,
 	// So it's esyer to replicate for more dives later.
 	// In the meantime, keep it here.
@@ -1,48 +1,153 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "qt-models/completionmodels.h"
 #include "core/dive.h"
-#include <QSet>
+#include "core/subsurface-qt/DiveListNotifier.h"
 #include <QString>
+#include <algorithm>
 
-#define CREATE_UPDATE_METHOD(Class, diveStructMember)          \
-	void Class::updateModel()                              \
-	{                                                      \
-		QStringList list;                              \
-		struct dive *dive;                             \
-		int i = 0;                                     \
-		for_each_dive (i, dive)                        \
-		{                                              \
-			QString buddy(dive->diveStructMember); \
-			if (!list.contains(buddy)) {           \
-				list.append(buddy);            \
-			}                                      \
-		}                                              \
-		std::sort(list.begin(), list.end());           \
-		setStringList(list);                           \
+DiveCompletionModel::DiveCompletionModel(bool csvIn) : csv(csvIn)
+{
+	connect(&diveListNotifier, &DiveListNotifier::divesAdded, this, &DiveCompletionModel::divesAdded);
+	connect(&diveListNotifier, &DiveListNotifier::divesDeleted, this, &DiveCompletionModel::divesDeleted);
+	connect(&diveListNotifier, &DiveListNotifier::divesChanged, this, &DiveCompletionModel::divesChanged);
+	connect(&diveListNotifier, &DiveListNotifier::dataReset, this, &DiveCompletionModel::reset);
+}
+
+static QStringList splitTerms(const QByteArray &s, bool csv)
+{
+	QString string = QString::fromUtf8(s);
+	if (!csv)
+		return string.isEmpty() ? QStringList() : QStringList(string);
+	QStringList res;
+	foreach (const QString &value, string.split(",", QString::SkipEmptyParts)) {
+		QString term = value.trimmed();
+		if (!term.isEmpty())
+			res.append(term);
+	}
+	return res;
+}
+
+// The row of a term or, if it isn't in the list, the row where it belongs
+int DiveCompletionModel::termRow(const QString &term) const
+{
+	// The list is shared with the model, so that it isn't copied
+	const QStringList list = stringList();
+	return std::lower_bound(list.begin(), list.end(), term) - list.begin();
+}
+
+// A new term is inserted as a row at its sorted position
+void DiveCompletionModel::addTerms(const QByteArray &s)
+{
+	for (const QString &term: splitTerms(s, csv)) {
+		if (termCount[term]++ > 0)
+			continue;
+		int row = termRow(term);
+		insertRows(row, 1);
+		setData(index(row), term);
+	}
+}
+
+void DiveCompletionModel::removeTerms(const QByteArray &s)
+{
+	for (const QString &term: splitTerms(s, csv)) {
+		auto it = termCount.find(term);
+		if (it == termCount.end() || --*it > 0)
+			continue;
+		termCount.erase(it);
+		int row = termRow(term);
+		if (row < rowCount() && index(row).data().toString() == term)
+			removeRows(row, 1);
+	}
+}
+
+void DiveCompletionModel::updateDives(const QVector<dive *> &dives)
+{
+	for (const dive *d: dives) {
+		const char *s = diveString(d);
+		auto it = diveStrings.find(d);
+		if (it != diveStrings.end()) {
+			if (*it == s)
+				continue;
+			removeTerms(*it);
+		}
+		QByteArray string(s);
+		addTerms(string);
+		diveStrings.insert(d, string);
+	}
+}
+
+void DiveCompletionModel::removeDives(const QVector<dive *> &dives)
+{
+	for (const dive *d: dives) {
+		auto it = diveStrings.find(d);
+		if (it == diveStrings.end())
+			continue;
+		removeTerms(*it);
+		diveStrings.erase(it);
 	}
+}
 
-#define CREATE_CSV_UPDATE_METHOD(Class, diveStructMember)                                        \
-	void Class::updateModel()                                                                \
-	{                                                                                        \
-		QSet<QString> set;                                                               \
-		struct dive *dive;                                                               \
-		int i = 0;                                                                       \
-		for_each_dive (i, dive)                                                          \
-		{                                                                                \
-			QString buddy(dive->diveStructMember);                                   \
-			foreach (const QString &value, buddy.split(",", QString::SkipEmptyParts)) \
-			{                                                                        \
-				set.insert(value.trimmed());                                     \
-			}                                                                        \
-		}                                                                                \
-		QStringList setList = set.toList();                                              \
-		std::sort(setList.begin(), setList.end());                                       \
-		setStringList(setList);                                                     \
+void DiveCompletionModel::reset()
+{
+	diveStrings.clear();
+	termCount.clear();
+	diveStrings.reserve(dive_table.nr);
+
+	int i;
+	struct dive *dive;
+	for_each_dive (i, dive) {
+		QByteArray string(diveString(dive));
+		for (const QString &term: splitTerms(string, csv))
+			termCount[term]++;
+		diveStrings.insert(dive, string);
 	}
 
-CREATE_CSV_UPDATE_METHOD(BuddyCompletionModel, buddy);
-CREATE_CSV_UPDATE_METHOD(DiveMasterCompletionModel, divemaster);
-CREATE_UPDATE_METHOD(SuitCompletionModel, suit);
+	QStringList list = termCount.keys();
+	std::sort(list.begin(), list.end());
+	setStringList(list);
+}
+
+void DiveCompletionModel::divesAdded(dive_trip *, bool, const QVector<dive *> &dives)
+{
+	updateDives(dives);
+}
+
+void DiveCompletionModel::divesDeleted(dive_trip *, bool, const QVector<dive *> &dives)
+{
+	removeDives(dives);
+}
+
+void DiveCompletionModel::divesChanged(dive_trip *, const QVector<dive *> &dives)
+{
+	updateDives(dives);
+}
+
+BuddyCompletionModel::BuddyCompletionModel() : DiveCompletionModel(true)
+{
+}
+
+const char *BuddyCompletionModel::diveString(const struct dive *d) const
+{
+	return d->buddy;
+}
+
+DiveMasterCompletionModel::DiveMasterCompletionModel() : DiveCompletionModel(true)
+{
+}
+
+const char *DiveMasterCompletionModel::diveString(const struct dive *d) const
+{
+	return d->divemaster;
+}
+
+SuitCompletionModel::SuitCompletionModel() : DiveCompletionModel(false)
+{
+}
+
+const char *SuitCompletionModel::diveString(const struct dive *d) const
+{
+	return d->suit;
+}
 
 void TagCompletionModel::updateModel()
 {
@@ -3,23 +3,68 @@
 #define COMPLETIONMODELS_H
 
 #include <QStringListModel>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
 
-class BuddyCompletionModel : public QStringListModel {
+struct dive;
+struct dive_trip;
+
+// Completion model for a string field of the dives. It keeps an index of
+// the field of every dive and a reference count of every term, so that
+// adding, changing or deleting dives only touches the terms of these dives.
+// The string list of the model is kept sorted and only changes if a term
+// appears or disappears. The undo commands keep the index up to date via
+// DiveListNotifier; dives that are changed otherwise have to be reported.
+class DiveCompletionModel : public QStringListModel {
 	Q_OBJECT
 public:
-	void updateModel();
+	// Update the terms of dives that were added or edited without an undo command
+	void updateDives(const QVector<dive *> &dives);
+	// Forget dives that are deleted without an undo command, before they are freed
+	void removeDives(const QVector<dive *> &dives);
+public slots:
+	// Rebuild the index from the dive table, after dives were loaded or cleared
+	void reset();
+protected:
+	// If csv is true, the field is a comma-separated list of terms
+	DiveCompletionModel(bool csv);
+	virtual const char *diveString(const struct dive *d) const = 0;
+private slots:
+	void divesAdded(dive_trip *trip, bool addTrip, const QVector<dive *> &dives);
+	void divesDeleted(dive_trip *trip, bool deleteTrip, const QVector<dive *> &dives);
+	void divesChanged(dive_trip *trip, const QVector<dive *> &dives);
+private:
+	void addTerms(const QByteArray &s);
+	void removeTerms(const QByteArray &s);
+	int termRow(const QString &term) const;
+	bool csv;
+	QHash<const struct dive *, QByteArray> diveStrings;	// the field of every dive when it was last seen
+	QHash<QString, int> termCount;
 };
 
-class DiveMasterCompletionModel : public QStringListModel {
+class BuddyCompletionModel : public DiveCompletionModel {
 	Q_OBJECT
 public:
-	void updateModel();
+	BuddyCompletionModel();
+private:
+	const char *diveString(const struct dive *d) const override;
 };
 
-class SuitCompletionModel : public QStringListModel {
+class DiveMasterCompletionModel : public DiveCompletionModel {
 	Q_OBJECT
 public:
-	void updateModel();
+	DiveMasterCompletionModel();
+private:
+	const char *diveString(const struct dive *d) const override;
+};
+
+class SuitCompletionModel : public DiveCompletionModel {
+	Q_OBJECT
+public:
+	SuitCompletionModel();
+private:
+	const char *diveString(const struct dive *d) const override;
 };
 
 class TagCompletionModel : public QStringListModel {
@@ -8,6 +8,7 @@
 
 #include <QFileInfo>
 #include <QPainter>
+#include <algorithm>
 
 DivePictureModel *DivePictureModel::instance()
 {
@@ -15,7 +16,7 @@ DivePictureModel *DivePictureModel::instance()
 	return self;
 }
 
-DivePictureModel::DivePictureModel() : zoomLevel(0.0)
+DivePictureModel::DivePictureModel() : indexedRows(0), zoomLevel(0.0)
 {
 	connect(Thumbnailer::instance(), &Thumbnailer::thumbnailChanged,
 		this, &DivePictureModel::updateThumbnail, Qt::QueuedConnection);
@@ -38,38 +39,192 @@ void DivePictureModel::updateZoom()
 	size = Thumbnailer::thumbnailSize(zoomLevel);
 }
 
-void DivePictureModel::updateThumbnails()
+// Add the rows [from to) to the index of filenames
+void DivePictureModel::indexRows(int from, int to)
 {
-	updateZoom();
-	for (PictureEntry &entry: pictures)
-		entry.image = Thumbnailer::instance()->fetchThumbnail(entry.filename);
+	for (int i = from; i < to; ++i)
+		rowsOfFilename.insert(pictures[i].filename, i);
 }
 
-void DivePictureModel::updateDivePictures()
+void DivePictureModel::unindexRows(int from, int to)
+{
+	for (int i = from; i < to; ++i)
+		rowsOfFilename.remove(pictures[i].filename, i);
+}
+
+// Rows are about to be inserted or removed at the given row, which shifts all
+// rows from there on. The rows before it keep their entries in the index.
+void DivePictureModel::invalidateIndex(int from)
+{
+	if (from >= indexedRows)
+		return;
+	unindexRows(from, indexedRows);
+	indexedRows = from;
+}
+
+// Add the rows that were shifted or inserted since the last update to the index
+void DivePictureModel::updateIndex()
+{
+	indexRows(indexedRows, pictures.size());
+	indexedRows = pictures.size();
+}
+
+// Insert rows for the given entries. Thumbnails are only fetched for entries without image.
+void DivePictureModel::insertEntries(int row, QVector<PictureEntry> &entries)
+{
+	if (entries.isEmpty())
+		return;
+	for (PictureEntry &entry: entries) {
+		if (entry.image.isNull())
+			entry.image = Thumbnailer::instance()->fetchThumbnail(entry.filename);
+	}
+	invalidateIndex(row);
+	beginInsertRows(QModelIndex(), row, row + entries.size() - 1);
+	pictures.insert(row, entries.size(), PictureEntry());
+	std::copy(entries.begin(), entries.end(), pictures.begin() + row);
+	endInsertRows();
+}
+
+// Remove the rows [from to) and remember the filenames of the removed pictures
+void DivePictureModel::removeEntries(int from, int to, QVector<QString> &removedFilenames)
+{
+	if (from >= to)
+		return;
+	for (int i = from; i < to; ++i)
+		removedFilenames.push_back(pictures[i].filename);
+	invalidateIndex(from);
+	// Qt's model-interface is surprisingly idiosyncratic: you don't pass [first last), but [first last] ranges.
+	// For example, an empty list would be [0 -1].
+	beginRemoveRows(QModelIndex(), from, to - 1);
+	pictures.erase(pictures.begin() + from, pictures.begin() + to);
+	endRemoveRows();
+}
+
+// Number of dives before and after selected dives, whose thumbnails are prefetched
+static const int prefetchDives = 2;
+
+// Collect the pictures of the non-selected dives close to selected dives.
+// If the user moves the selection, chances are that these are shown next.
+static QVector<QString> neighboringPictures()
+{
+	QVector<QString> res;
+	int i;
+	struct dive *dive;
+	for_each_dive (i, dive) {
+		if (dive->selected || !dive->picture_list)
+			continue;
+		int from = std::max(i - prefetchDives, 0);
+		int to = std::min(i + prefetchDives, dive_table.nr - 1);
+		for (int j = from; j <= to; ++j) {
+			if (get_dive(j)->selected) {
+				FOR_EACH_PICTURE(dive)
+					res.push_back(picture->filename);
+				break;
+			}
+		}
+	}
+	return res;
+}
+
+// The pictures of a dive, sorted by offset
+static QVector<PictureEntry> picturesOfDive(struct dive *dive)
+{
+	QVector<PictureEntry> res;
+	FOR_EACH_PICTURE(dive)
+		res.push_back({ dive->id, picture, picture->filename, {}, picture->offset.seconds });
+	std::stable_sort(res.begin(), res.end(),
+			 [](const PictureEntry &a, const PictureEntry &b) { return a.offsetSeconds < b.offsetSeconds; });
+	return res;
+}
+
+static bool samePictures(const PictureEntry *old, const QVector<PictureEntry> &entries)
 {
-	beginResetModel();
-	if (!pictures.isEmpty()) {
-		pictures.clear();
-		Thumbnailer::instance()->clearWorkQueue();
+	for (const PictureEntry &entry: entries) {
+		if (old->picture != entry.picture || old->filename != entry.filename || old->offsetSeconds != entry.offsetSeconds)
+			return false;
+		++old;
 	}
+	return true;
+}
+
+// Bring the model up to date with the selection. Instead of resetting the
+// model, the rows of deselected dives are removed and the rows of newly
+// selected dives are inserted, so that the thumbnails of the other rows are
+// kept and don't have to be fetched again.
+void DivePictureModel::updateDivePictures()
+{
+	updateZoom();
 
+	// The selected dives with pictures, in the order of the dive list
+	QVector<struct dive *> selected;
+	QHash<int, int> selectedIndex;	// dive id -> index in selected
 	int i;
 	struct dive *dive;
 	for_each_dive (i, dive) {
-		if (dive->selected) {
-			int first = pictures.count();
-			FOR_EACH_PICTURE(dive)
-				pictures.push_back({ dive->id, picture, picture->filename, {}, picture->offset.seconds });
-
-			// Sort pictures of this dive by offset.
-			// Thus, the list will be sorted by (diveId, offset).
-			std::sort(pictures.begin() + first, pictures.end(),
-				  [](const PictureEntry &a, const PictureEntry &b) { return a.offsetSeconds < b.offsetSeconds; });
+		if (dive->selected && dive->picture_list) {
+			selectedIndex.insert(dive->id, selected.size());
+			selected.push_back(dive);
+		}
+	}
+
+	// Remove the pictures of the dives that aren't selected anymore.
+	// Go backwards, so that the rows of the ranges still to be checked don't change.
+	QVector<QString> removed;
+	for (int to = pictures.size(); to > 0;) {
+		if (selectedIndex.contains(pictures[to - 1].diveId)) {
+			--to;
+			continue;
+		}
+		int from = to - 1;
+		while (from > 0 && !selectedIndex.contains(pictures[from - 1].diveId))
+			--from;
+		removeEntries(from, to, removed);
+		to = from;
+	}
+
+	// The remaining pictures are in the order of the dive list, unless dives
+	// were moved, for example by changing their time. Then start from scratch.
+	for (i = 1; i < pictures.size(); ++i) {
+		if (selectedIndex.value(pictures[i - 1].diveId) > selectedIndex.value(pictures[i].diveId)) {
+			removeEntries(0, pictures.size(), removed);
+			break;
+		}
+	}
+
+	// Insert the pictures of the newly selected dives and replace the
+	// pictures of dives whose pictures were added, removed or changed.
+	int row = 0;
+	for (struct dive *d: selected) {
+		QVector<PictureEntry> entries = picturesOfDive(d);
+		int end = row;
+		while (end < pictures.size() && pictures[end].diveId == d->id)
+			++end;
+		if (end - row == entries.size() && samePictures(pictures.begin() + row, entries)) {
+			row = end;
+			continue;
+		}
+		// Keep the thumbnails of the pictures that are still there
+		for (PictureEntry &entry: entries) {
+			for (int j = row; j < end; ++j) {
+				if (pictures[j].filename == entry.filename) {
+					entry.image = pictures[j].image;
+					break;
+				}
+			}
 		}
+		removeEntries(row, end, removed);
+		insertEntries(row, entries);
+		row += entries.size();
 	}
+	updateIndex();
 
-	updateThumbnails();
-	endResetModel();
+	// Cancel the thumbnails of the removed pictures, unless the picture is
+	// still shown, e.g. because it belongs to more than one dive.
+	removed.erase(std::remove_if(removed.begin(), removed.end(),
+				     [this](const QString &filename) { return rowsOfFilename.contains(filename); }),
+		      removed.end());
+	Thumbnailer::instance()->cancelThumbnails(removed);
+	Thumbnailer::instance()->prefetchThumbnails(neighboringPictures());
 }
 
 int DivePictureModel::columnCount(const QModelIndex&) const
@@ -112,44 +267,38 @@ QVariant DivePictureModel::data(const QModelIndex &index, int role) const
 	return ret;
 }
 
-// Return true if we actually removed a picture
-static bool removePictureFromSelectedDive(const char *fileUrl)
-{
-	int i;
-	struct dive *dive;
-	for_each_dive (i, dive) {
-		if (dive->selected && dive_remove_picture(dive, fileUrl))
-			return true;
-	}
-	return false;
-}
-
 void DivePictureModel::removePictures(const QVector<QString> &fileUrls)
 {
-	bool removed = false;
-	for (const QString &fileUrl: fileUrls)
-		removed |= removePictureFromSelectedDive(qPrintable(fileUrl));
-	if (!removed)
+	// The model contains the pictures of the selected dives in the order of
+	// the dive list. Remove every picture from the first of these dives that
+	// has it, i.e. from the dive of its first row.
+	QVector<int> rows;
+	for (const QString &fileUrl: fileUrls) {
+		QList<int> rowsOfUrl = rowsOfFilename.values(fileUrl);
+		if (rowsOfUrl.isEmpty())
+			continue;
+		int row = *std::min_element(rowsOfUrl.begin(), rowsOfUrl.end());
+		struct dive *dive = get_dive_by_uniq_id(pictures[row].diveId);
+		if (dive && dive_remove_picture(dive, qPrintable(fileUrl)))
+			rows.push_back(row);
+	}
+	if (rows.isEmpty())
 		return;
 	copy_dive(current_dive, &displayed_dive);
 	mark_divelist_changed(true);
 
-	for (int i = 0; i < pictures.size(); ++i) {
-		// Find range [i j) of pictures to remove
-		if (std::find(fileUrls.begin(), fileUrls.end(), pictures[i].filename) == fileUrls.end())
-			continue;
-		int j;
-		for (j = i + 1; j < pictures.size(); ++j) {
-			if (std::find(fileUrls.begin(), fileUrls.end(), pictures[j].filename) == fileUrls.end())
-				break;
-		}
-
-		// Qt's model-interface is surprisingly idiosyncratic: you don't pass [first last), but [first last] ranges.
-		// For example, an empty list would be [0 -1].
-		beginRemoveRows(QModelIndex(), i, j - 1);
-		pictures.erase(pictures.begin() + i, pictures.begin() + j);
-		endRemoveRows();
+	// Remove ranges of consecutive rows, starting at the end
+	std::sort(rows.begin(), rows.end());
+	rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+	QVector<QString> removed;
+	for (int i = rows.size(); i > 0;) {
+		int j = i - 1;
+		while (j > 0 && rows[j - 1] == rows[j] - 1)
+			--j;
+		removeEntries(rows[j], rows[i - 1] + 1, removed);
+		i = j;
 	}
+	updateIndex();
 	emit picturesRemoved(fileUrls);
 }
 
@@ -158,14 +307,6 @@ int DivePictureModel::rowCount(const QModelIndex&) const
 	return pictures.count();
 }
 
-int DivePictureModel::findPictureId(const QString &filename)
-{
-	for (int i = 0; i < pictures.size(); ++i)
-		if (pictures[i].filename == filename)
-			return i;
-	return -1;
-}
-
 static void addDurationToThumbnail(QImage &img, duration_t duration)
 {
 	int seconds = duration.seconds;
@@ -195,10 +336,12 @@ static void addDurationToThumbnail(QImage &img, duration_t duration)
 
 void DivePictureModel::updateThumbnail(QString filename, QImage thumbnail, duration_t duration)
 {
-	int i = findPictureId(filename);
-	if (i >= 0) {
-		if (duration.seconds > 0)
-			addDurationToThumbnail(thumbnail, duration);	// If we know the duration paint it on top of the thumbnail
+	QList<int> rows = rowsOfFilename.values(filename);
+	if (rows.isEmpty())
+		return;
+	if (duration.seconds > 0)
+		addDurationToThumbnail(thumbnail, duration);	// If we know the duration paint it on top of the thumbnail
+	for (int i: rows) {
 		pictures[i].image = thumbnail;
 		emit dataChanged(createIndex(i, 0), createIndex(i, 1));
 	}
@@ -236,7 +379,12 @@ void DivePictureModel::updateDivePictureOffset(int diveId, const QString &filena
 	int newIndex = newPos - pictures.begin();
 	if (oldIndex == newIndex || oldIndex + 1 == newIndex)
 		return;
+	// Only the rows between the old and the new position change
+	int from = std::min(oldIndex, newIndex);
+	int to = std::max(oldIndex + 1, newIndex);
+	unindexRows(from, to);
 	beginMoveRows(QModelIndex(), oldIndex, oldIndex, QModelIndex(), newIndex);
 	moveInVector(pictures, oldIndex, oldIndex + 1, newIndex);
 	endMoveRows();
+	indexRows(from, to);
 }
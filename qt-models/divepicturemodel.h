@@ -7,6 +7,7 @@
 #include <QAbstractTableModel>
 #include <QImage>
 #include <QFuture>
+#include <QMultiHash>
 
 struct PictureEntry {
 	int diveId;
@@ -33,12 +34,18 @@ public slots:
 	void updateThumbnail(QString filename, QImage thumbnail, duration_t duration);
 private:
 	DivePictureModel();
-	QVector<PictureEntry> pictures;
-	int findPictureId(const QString &filename);	// Return -1 if not found
+	QVector<PictureEntry> pictures;	// sorted by (position of the dive in the dive list, offset)
+	QMultiHash<QString, int> rowsOfFilename;	// the same picture may belong to different dives
+	int indexedRows;	// the rows [0 indexedRows) are in rowsOfFilename
 	double zoomLevel;	// -1.0: minimum, 0.0: standard, 1.0: maximum
 	int size;
-	void updateThumbnails();
 	void updateZoom();
+	void indexRows(int from, int to);
+	void unindexRows(int from, int to);
+	void invalidateIndex(int from);
+	void updateIndex();
+	void insertEntries(int row, QVector<PictureEntry> &entries);
+	void removeEntries(int from, int to, QVector<QString> &removedFilenames);
 };
 
 #endif
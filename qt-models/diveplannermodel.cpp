@@ -85,6 +85,8 @@ void DivePlannerPointsModel::loadFromDive(dive *d)
 	const struct event *evd = NULL;
 	enum divemode_t current_divemode = UNDEF_COMP_TYPE;
 	recalc = false;
+	invalidate_deco_checkpoints(checkpoints);
+	invalidate_plan_results(planResults);
 	CylindersModel::instance()->updateDive();
 	duration_t lasttime = { 0 };
 	duration_t lastrecordedtime = {};
@@ -408,7 +410,10 @@ int DivePlannerPointsModel::rowCount(const QModelIndex&) const
 
 DivePlannerPointsModel::DivePlannerPointsModel(QObject *parent) : QAbstractTableModel(parent),
 	mode(NOTHING),
-	recalc(false)
+	recalc(false),
+	checkpoints(alloc_deco_checkpoints()),
+	planResults(alloc_plan_results()),
+	notesOutdated(false)
 {
 	memset(&diveplan, 0, sizeof(diveplan));
 	startTime.setTimeSpec(Qt::UTC);
@@ -825,6 +830,8 @@ void DivePlannerPointsModel::cancelPlan()
 
 	setPlanMode(NOTHING);
 	free_dps(&diveplan);
+	invalidate_deco_checkpoints(checkpoints);
+	invalidate_plan_results(planResults);
 
 	emit planCanceled();
 }
@@ -858,6 +865,8 @@ void DivePlannerPointsModel::clear()
 		divepoints.clear();
 		endRemoveRows();
 	}
+	invalidate_deco_checkpoints(checkpoints);
+	invalidate_plan_results(planResults);
 	CylindersModel::instance()->clear();
 	setRecalc(oldRecalc);
 }
@@ -905,16 +914,29 @@ void DivePlannerPointsModel::createTemporaryPlan()
 		struct diveplan *plan_copy;
 
 		memset(&plan_deco_state, 0, sizeof(struct deco_state));
-		plan(&plan_deco_state, &diveplan, &displayed_dive, DECOTIMESTEP, stoptable, &cache, isPlanner(), false);
-		plan_copy = (struct diveplan *)malloc(sizeof(struct diveplan));
-		lock_planner();
-		cloneDiveplan(&diveplan, plan_copy);
-		unlock_planner();
+		// plan() only uses the gradient factors and conservatism of the plan internally.
+		// Make the profile of the planned dive use them, too.
+		set_gf(diveplan.gflow, diveplan.gfhigh);
+		set_vpmb_conservatism(diveplan.vpmb_conservatism);
+		// Only recalculate the tissues from the first changed waypoint on
+		diveplan.checkpoints = checkpoints;
+		// Don't replan if only the presentation of the plan changed
+		diveplan.results = planResults;
+		plan(&plan_deco_state, &diveplan, &displayed_dive, DECOTIMESTEP, stoptable, &cache, isPlanner());
+		notesOutdated = true;
+		// If only the presentation of the plan changed, the variations are still valid
+		if (!plan_result_unchanged(planResults) || (prefs.display_variations && planVariations.isEmpty())) {
+			planVariations.clear();
+			plan_copy = (struct diveplan *)malloc(sizeof(struct diveplan));
+			lock_planner();
+			cloneDiveplan(&diveplan, plan_copy);
+			unlock_planner();
 #ifdef VARIATIONS_IN_BACKGROUND
-		QtConcurrent::run(this, &DivePlannerPointsModel::computeVariations, plan_copy, &plan_deco_state);
+			QtConcurrent::run(this, &DivePlannerPointsModel::computeVariations, plan_copy, &plan_deco_state);
 #else
-		computeVariations(plan_copy, &plan_deco_state);
+			computeVariations(plan_copy, &plan_deco_state);
 #endif
+		}
 		final_deco_state = plan_deco_state;
 		emit calculatedPlanNotes();
 	}
@@ -926,6 +948,38 @@ void DivePlannerPointsModel::createTemporaryPlan()
 #endif
 }
 
+// The notes are only rendered when they are shown, since most plans
+// are replaced by the next one before anybody looks at them.
+void DivePlannerPointsModel::renderPlanNotes()
+{
+	if (!notesOutdated)
+		return;
+	add_plan_to_notes(&diveplan, &displayed_dive, false);
+	notesOutdated = false;
+	if (!planVariations.isEmpty())
+		setVariations(planVariations);
+}
+
+// Render the notes for printing straight from the calculated plan,
+// independent of what the planner details currently show.
+QString DivePlannerPointsModel::printablePlanNotes()
+{
+	char *notes = render_plan_notes(&diveplan, &displayed_dive, false);
+	QString res(notes);
+	free(notes);
+	return res.replace("VARIATIONS", planVariations);
+}
+
+void DivePlannerPointsModel::setVariations(const QString &variations)
+{
+	planVariations = variations;
+	if (notesOutdated || !displayed_dive.notes)
+		return;
+	QString notes(displayed_dive.notes);
+	free(displayed_dive.notes);
+	displayed_dive.notes = copy_qstring(notes.replace("VARIATIONS", variations));
+}
+
 void DivePlannerPointsModel::deleteTemporaryPlan()
 {
 	free_dps(&diveplan);
@@ -948,6 +1002,8 @@ struct divedatapoint * DivePlannerPointsModel::cloneDiveplan(struct diveplan *pl
 
 	src = plan_src->dp;
 	*plan_copy = *plan_src;
+	plan_copy->checkpoints = NULL;	// the copies are modified, don't let them overwrite our checkpoints
+	plan_copy->results = NULL;
 	dp = &plan_copy->dp;
 	while (src && (!src->time || src->entered)) {
 		*dp = (struct divedatapoint *)malloc(sizeof(struct divedatapoint));
@@ -1034,7 +1090,7 @@ void DivePlannerPointsModel::computeVariations(struct diveplan *original_plan, s
 			goto finish;
 		if (my_instance != instanceCounter)
 			goto finish;
-		plan(&ds, &plan_copy, dive, 1, original, &cache, true, false);
+		plan(&ds, &plan_copy, dive, 1, original, &cache, true);
 		free_dps(&plan_copy);
 		restore_deco_state(save, &ds, false);
 
@@ -1043,7 +1099,7 @@ void DivePlannerPointsModel::computeVariations(struct diveplan *original_plan, s
 		last_segment->next->depth.mm += delta_depth.mm;
 		if (my_instance != instanceCounter)
 			goto finish;
-		plan(&ds, &plan_copy, dive, 1, deeper, &cache, true, false);
+		plan(&ds, &plan_copy, dive, 1, deeper, &cache, true);
 		free_dps(&plan_copy);
 		restore_deco_state(save, &ds, false);
 
@@ -1052,7 +1108,7 @@ void DivePlannerPointsModel::computeVariations(struct diveplan *original_plan, s
 		last_segment->next->depth.mm -= delta_depth.mm;
 		if (my_instance != instanceCounter)
 			goto finish;
-		plan(&ds, &plan_copy, dive, 1, shallower, &cache, true, false);
+		plan(&ds, &plan_copy, dive, 1, shallower, &cache, true);
 		free_dps(&plan_copy);
 		restore_deco_state(save, &ds, false);
 
@@ -1060,7 +1116,7 @@ void DivePlannerPointsModel::computeVariations(struct diveplan *original_plan, s
 		last_segment->next->time += delta_time.seconds;
 		if (my_instance != instanceCounter)
 			goto finish;
-		plan(&ds, &plan_copy, dive, 1, longer, &cache, true, false);
+		plan(&ds, &plan_copy, dive, 1, longer, &cache, true);
 		free_dps(&plan_copy);
 		restore_deco_state(save, &ds, false);
 
@@ -1068,7 +1124,7 @@ void DivePlannerPointsModel::computeVariations(struct diveplan *original_plan, s
 		last_segment->next->time -= delta_time.seconds;
 		if (my_instance != instanceCounter)
 			goto finish;
-		plan(&ds, &plan_copy, dive, 1, shorter, &cache, true, false);
+		plan(&ds, &plan_copy, dive, 1, shorter, &cache, true);
 		free_dps(&plan_copy);
 		restore_deco_state(save, &ds, false);
 
@@ -1102,7 +1158,10 @@ void DivePlannerPointsModel::createPlan(bool replanCopy)
 
 	//TODO: C-based function here?
 	struct decostop stoptable[60];
-	plan(&ds_after_previous_dives, &diveplan, &displayed_dive, DECOTIMESTEP, stoptable, &cache, isPlanner(), true);
+	plan(&ds_after_previous_dives, &diveplan, &displayed_dive, DECOTIMESTEP, stoptable, &cache, isPlanner());
+	add_plan_to_notes(&diveplan, &displayed_dive, true);
+	notesOutdated = false;
+	planVariations.clear();
 	struct diveplan *plan_copy;
 	plan_copy = (struct diveplan *)malloc(sizeof(struct diveplan));
 	lock_planner();
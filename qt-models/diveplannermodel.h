@@ -55,6 +55,9 @@ public:
 	struct diveplan &getDiveplan();
 	int lastEnteredPoint();
 	void removeDeco();
+	void renderPlanNotes();
+	QString printablePlanNotes();
+	void setVariations(const QString &variations);
 	static bool addingDeco;
 	struct deco_state final_deco_state;
 
@@ -123,6 +126,10 @@ private:
 	QDateTime startTime;
 	int instanceCounter = 0;
 	struct deco_state ds_after_previous_dives;
+	struct deco_checkpoints *checkpoints;	// tissue states at the waypoints of the last plan
+	struct plan_results *planResults;	// results of the last plans, keyed by their input
+	bool notesOutdated;			// the notes of displayed_dive don't describe the last plan
+	QString planVariations;
 };
 
 #endif
@@ -4,6 +4,7 @@
 #include "core/display.h"
 #include "core/qthelper.h"
 #include "core/subsurface-string.h"
+#include "core/trace.h"
 #include "core/subsurface-qt/DiveListNotifier.h"
 #include "qt-models/divetripmodel.h"
 
@@ -180,6 +181,7 @@ void MultiFilterSortModel::filterChanged(const QModelIndex &from, const QModelIn
 
 void MultiFilterSortModel::myInvalidate()
 {
+	TraceSpan span("filter");
 	int i;
 	struct dive *d;
 
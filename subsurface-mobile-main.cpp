@@ -6,11 +6,13 @@
 #include <string.h>
 #include <time.h>
 
+#include "core/cloudsync.h"
 #include "core/color.h"
 #include "core/downloadfromdcthread.h"
 #include "core/qt-gui.h"
 #include "core/qthelper.h"
 #include "core/subsurfacestartup.h"
+#include "core/trace.h"
 #include "core/settings/qPref.h"
 #include "core/settings/qPrefDisplay.h"
 
@@ -109,7 +111,10 @@ int main(int argc, char **argv)
 	LOG_STP("main call run_ui (continue in qmlmanager)");
 	if (!quit)
 		run_ui();
+	// let a running cloud sync push the saved changes
+	cloud_sync_wait();
 	exit_ui();
+	trace_stop();
 	taglist_free(g_tag_list);
 	parse_xml_exit();
 	subsurface_console_exit();
@@ -0,0 +1,4 @@
+#!/bin/sh
+# Stand-in for ffmpeg used by TestVideoFrameExtractor:
+# ignore all arguments and write a fixed JPEG to stdout.
+exec cat "$(dirname "$0")/../dives/images/wreck.jpg"
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testcompletionmodels.h"
+#include "core/dive.h"
+#include "core/divelist.h"
+#include "core/subsurface-string.h"
+#include "core/subsurface-qt/DiveListNotifier.h"
+#include "qt-models/completionmodels.h"
+
+static struct dive *addDive(timestamp_t when, const char *buddy, const char *suit = nullptr)
+{
+	struct dive *d = alloc_dive();
+	d->when = when;
+	d->buddy = copy_string(buddy);
+	d->suit = copy_string(suit);
+	record_dive(d);
+	return d;
+}
+
+static void setBuddy(struct dive *d, const char *buddy)
+{
+	free(d->buddy);
+	d->buddy = copy_string(buddy);
+}
+
+void TestCompletionModels::cleanup()
+{
+	clear_dive_file_data();
+}
+
+void TestCompletionModels::testReset()
+{
+	addDive(1000, "Bob, Alice", "Drysuit, 7mm");
+	addDive(2000, "Alice", "Wetsuit");
+	addDive(3000, nullptr);
+	BuddyCompletionModel buddies;
+	SuitCompletionModel suits;
+	buddies.reset();
+	suits.reset();
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice", "Bob" }));
+	// the suit isn't a comma-separated list
+	QCOMPARE(suits.stringList(), QStringList({ "Drysuit, 7mm", "Wetsuit" }));
+
+	// the dive table was replaced as a whole
+	clear_dive_file_data();
+	addDive(1000, "Carol");
+	emit diveListNotifier.dataReset();
+	QCOMPARE(buddies.stringList(), QStringList({ "Carol" }));
+	QCOMPARE(suits.stringList(), QStringList());
+}
+
+void TestCompletionModels::testAddDives()
+{
+	addDive(1000, "Bob");
+	BuddyCompletionModel buddies;
+	buddies.reset();
+
+	// new terms are inserted at their sorted position
+	struct dive *d1 = addDive(2000, "Carol, Alice");
+	struct dive *d2 = addDive(3000, "Bob");
+	emit diveListNotifier.divesAdded(nullptr, false, { d1, d2 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice", "Bob", "Carol" }));
+
+	// Bob is referenced twice now, so it survives the deletion of one of these dives
+	emit diveListNotifier.divesDeleted(nullptr, false, { d2 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice", "Bob", "Carol" }));
+
+	// adding a dive that was already seen doesn't count its terms twice
+	buddies.updateDives({ d1 });
+	emit diveListNotifier.divesDeleted(nullptr, false, { d1 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Bob" }));
+}
+
+void TestCompletionModels::testEditDives()
+{
+	struct dive *d1 = addDive(1000, "Alice, Bob");
+	struct dive *d2 = addDive(2000, "Bob");
+	BuddyCompletionModel buddies;
+	buddies.reset();
+
+	// Bob is still referenced by the first dive
+	setBuddy(d2, "Carol");
+	emit diveListNotifier.divesChanged(nullptr, { d2 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice", "Bob", "Carol" }));
+
+	// now the last reference to Bob is gone
+	setBuddy(d1, "Alice");
+	emit diveListNotifier.divesChanged(nullptr, { d1 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice", "Carol" }));
+
+	// a dive that didn't change doesn't change the counts
+	emit diveListNotifier.divesChanged(nullptr, { d1 });
+	setBuddy(d2, "Alice");
+	buddies.updateDives({ d2 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice" }));
+	emit diveListNotifier.divesDeleted(nullptr, false, { d1 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice" }));
+	buddies.removeDives({ d2 });
+	QCOMPARE(buddies.stringList(), QStringList());
+}
+
+void TestCompletionModels::testRemoveDives()
+{
+	struct dive *d1 = addDive(1000, "Alice, Bob");
+	struct dive *d2 = addDive(2000, "Bob");
+	BuddyCompletionModel buddies;
+	buddies.reset();
+
+	emit diveListNotifier.divesDeleted(nullptr, false, { d2 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice", "Bob" }));
+
+	// a dive that was already removed doesn't change the counts
+	buddies.removeDives({ d2 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice", "Bob" }));
+
+	buddies.removeDives({ d1 });
+	QCOMPARE(buddies.stringList(), QStringList());
+
+	// adding the dives back restores the terms
+	emit diveListNotifier.divesAdded(nullptr, false, { d1, d2 });
+	QCOMPARE(buddies.stringList(), QStringList({ "Alice", "Bob" }));
+}
+
+QTEST_GUILESS_MAIN(TestCompletionModels)
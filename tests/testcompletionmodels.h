@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTCOMPLETIONMODELS_H
+#define TESTCOMPLETIONMODELS_H
+
+#include <QtTest>
+
+class TestCompletionModels : public QObject {
+	Q_OBJECT
+private slots:
+	void cleanup();
+
+	void testReset();
+	void testAddDives();
+	void testEditDives();
+	void testRemoveDives();
+};
+
+#endif
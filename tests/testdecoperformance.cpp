@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testdecoperformance.h"
+#include "core/dive.h"
+#include "core/divelist.h"
+#include "core/display.h"
+#include "core/planner.h"
+#include "core/profile.h"
+#include "core/qthelper.h"
+#include <string.h>
+
+// Benchmarks of the deco and profile calculations on synthetic dives. These
+// don't need any external data, so that regressions can be tracked offline:
+//	./TestDecoPerformance				all stages and profiles
+//	./TestDecoPerformance addSegment:ccr-1s		a single stage and profile
+// The sample interval of a synthetic dive is part of the row name. The
+// intervals default to 1, 4 and 10 seconds and can be set in the environment:
+//	SUBSURFACE_DECO_INTERVALS=2,30 ./TestDecoPerformance
+
+struct SyntheticGas {
+	struct gasmix mix;
+	int switchDepth;		// mm, where the gas is switched to on the ascent. 0 for the bottom gas.
+	enum cylinderuse use;
+};
+
+struct SyntheticProfile {
+	const char *name;
+	enum divemode_t divemode;
+	int depth;			// mm
+	int bottomTime;			// seconds, including the descent
+	int decoTime;			// seconds, sum of the stops. 0 = 3 minute safety stop.
+	int nrGases;
+	struct SyntheticGas gases[4];
+};
+
+static const struct SyntheticProfile profiles[] = {
+	{ "oc", OC, 30000, 40 * 60, 0, 1,
+	  { { { { 210 }, { 0 } }, 0, OC_GAS } } },
+	{ "ccr", CCR, 45000, 50 * 60, 20 * 60, 2,
+	  { { { { 210 }, { 350 } }, 0, DILUENT },
+	    { { { 1000 }, { 0 } }, 0, OXYGEN } } },
+	{ "multigas", OC, 60000, 25 * 60, 35 * 60, 3,
+	  { { { { 180 }, { 450 } }, 0, OC_GAS },
+	    { { { 500 }, { 0 } }, 21000, OC_GAS },
+	    { { { 1000 }, { 0 } }, 6000, OC_GAS } } },
+	{ "longdeco", OC, 100000, 30 * 60, 150 * 60, 4,
+	  { { { { 100 }, { 700 } }, 0, OC_GAS },
+	    { { { 210 }, { 350 } }, 57000, OC_GAS },
+	    { { { 500 }, { 0 } }, 21000, OC_GAS },
+	    { { { 1000 }, { 0 } }, 6000, OC_GAS } } },
+};
+
+static QVector<int> sampleIntervals()
+{
+	QVector<int> intervals;
+	QStringList custom = QString(qgetenv("SUBSURFACE_DECO_INTERVALS")).split(',', QString::SkipEmptyParts);
+	for (const QString &s: custom) {
+		int interval = s.toInt();
+		if (interval > 0)
+			intervals.append(interval);
+	}
+	if (intervals.isEmpty())
+		intervals = { 1, 4, 10 };
+	return intervals;
+}
+
+#define SETPOINT 1300
+
+// A simple linear congruential generator, so that the dives are the same on all platforms
+static int nextRandom(unsigned int &state)
+{
+	state = state * 1103515245 + 12345;
+	return (state >> 16) & 0x7fff;
+}
+
+struct Waypoint {
+	int time, depth;
+};
+
+// The depths of the dive without noise: descent at 18m/min, ascent at 9m/min
+// and stops every 3m from half the maximum depth. The stop times increase
+// linearly towards the surface.
+static QVector<Waypoint> waypoints(const SyntheticProfile &profile)
+{
+	QVector<Waypoint> res;
+	int time = profile.depth * 60 / 18000;
+	res.append({ 0, 0 });
+	res.append({ time, profile.depth });
+	res.append({ profile.bottomTime, profile.depth });
+	time = profile.bottomTime;
+	int depth = profile.depth;
+
+	QVector<int> stops;
+	QVector<int> stopTimes;
+	if (profile.decoTime <= 0) {
+		stops.append(5000);
+		stopTimes.append(3 * 60);
+	} else {
+		int nr = profile.depth / 2 / 3000;
+		for (int i = 0; i < nr; ++i) {
+			stops.append((nr - i) * 3000);
+			stopTimes.append(profile.decoTime * 2 * (i + 1) / (nr * (nr + 1)));
+		}
+	}
+	for (int i = 0; i < stops.size(); ++i) {
+		time += (depth - stops[i]) * 60 / 9000;
+		depth = stops[i];
+		res.append({ time, depth });
+		time += stopTimes[i];
+		res.append({ time, depth });
+	}
+	time += depth * 60 / 9000;
+	res.append({ time, 0 });
+	return res;
+}
+
+// Generate a dive with samples every "interval" seconds. The same seed gives the same dive.
+static struct dive *generateDive(const SyntheticProfile &profile, int interval, unsigned int seed)
+{
+	struct dive *dive = alloc_dive();
+	struct divecomputer *dc = &dive->dc;
+	unsigned int random = seed;
+
+	dive->when = 1546300800;	// 2019-01-01
+	dive->salinity = SEAWATER_SALINITY;
+	dive->surface_pressure.mbar = SURFACE_PRESSURE;
+	dc->when = dive->when;
+	dc->divemode = profile.divemode;
+	dc->salinity = dive->salinity;
+	dc->surface_pressure = dive->surface_pressure;
+	dc->model = strdup("Synthetic");
+	if (profile.divemode == CCR)
+		dc->no_o2sensors = 3;
+	for (int i = 0; i < profile.nrGases; ++i) {
+		cylinder_t *cyl = &dive->cylinder[i];
+		cyl->gasmix = profile.gases[i].mix;
+		cyl->cylinder_use = profile.gases[i].use;
+		cyl->type.size.mliter = i == 0 ? 24000 : 11100;
+		cyl->type.workingpressure.mbar = 232000;
+		cyl->start.mbar = 220000;
+	}
+
+	QVector<Waypoint> wp = waypoints(profile);
+	int endTime = wp.last().time;
+	int nextGas = 1;
+	int segment = 0;
+	alloc_samples(dc, endTime / interval + 2);
+	for (int time = 0;; time += interval) {
+		if (time > endTime)
+			time = endTime;
+		while (wp[segment + 1].time < time)
+			++segment;
+		const Waypoint &from = wp[segment];
+		const Waypoint &to = wp[segment + 1];
+		int depth = interpolate(from.depth, to.depth, time - from.time, to.time - from.time);
+		if (time > 0 && time < endTime)
+			depth = qMax(depth + nextRandom(random) % 601 - 300, 0);
+
+		struct sample *sample = prepare_sample(dc);
+		sample->time.seconds = time;
+		sample->depth.mm = depth;
+		sample->pressure[0].mbar = 220000 - 150000LL * time / endTime;
+		if (time == 0)
+			sample->temperature.mkelvin = C_to_mkelvin(14.0);
+		if (profile.divemode == CCR) {
+			sample->setpoint.mbar = SETPOINT;
+			for (int i = 0; i < 3; ++i)
+				sample->o2sensor[i].mbar = SETPOINT + nextRandom(random) % 101 - 50;
+		}
+		finish_sample(dc);
+
+		// Switch to the deco gases on the ascent
+		while (time > profile.bottomTime && nextGas < profile.nrGases && depth <= profile.gases[nextGas].switchDepth)
+			add_gas_switch_event(dive, dc, time, nextGas++);
+		if (time == endTime)
+			break;
+	}
+	fixup_dive(dive);
+	return dive;
+}
+
+// The plan of a synthetic dive: the same bottom segment, the ascent is calculated by the planner
+static void createPlan(const SyntheticProfile &profile, struct diveplan *diveplan, struct dive *dive)
+{
+	int droptime = profile.depth * 60 / 18000;
+	int po2 = profile.divemode == CCR ? SETPOINT : 0;
+
+	free_dps(diveplan);
+	diveplan->surface_pressure = SURFACE_PRESSURE;
+	diveplan->salinity = SEAWATER_SALINITY;
+	diveplan->gflow = prefs.gflow;
+	diveplan->gfhigh = prefs.gfhigh;
+	diveplan->bottomsac = prefs.bottomsac;
+	diveplan->decosac = prefs.decosac;
+	for (int i = 0; i < profile.nrGases; ++i) {
+		dive->cylinder[i].gasmix = profile.gases[i].mix;
+		dive->cylinder[i].cylinder_use = profile.gases[i].use;
+		dive->cylinder[i].type.size.mliter = i == 0 ? 24000 : 11100;
+		dive->cylinder[i].type.workingpressure.mbar = 232000;
+	}
+	reset_cylinders(dive, true);
+	for (int i = 1; i < profile.nrGases; ++i) {
+		if (profile.gases[i].use == OC_GAS)
+			plan_add_segment(diveplan, 0, profile.gases[i].switchDepth, i, 0, true, OC);
+	}
+	plan_add_segment(diveplan, droptime, profile.depth, 0, po2, true, profile.divemode);
+	plan_add_segment(diveplan, profile.bottomTime - droptime, profile.depth, 0, po2, true, profile.divemode);
+}
+
+static void addProfileRows(bool withIntervals)
+{
+	QTest::addColumn<int>("profile");
+	QTest::addColumn<int>("interval");
+	for (unsigned int i = 0; i < sizeof(profiles) / sizeof(profiles[0]); ++i) {
+		if (!withIntervals) {
+			QTest::newRow(profiles[i].name) << (int)i << 0;
+			continue;
+		}
+		for (int interval: sampleIntervals()) {
+			QByteArray name = QByteArray(profiles[i].name) + '-' + QByteArray::number(interval) + 's';
+			QTest::newRow(name.constData()) << (int)i << interval;
+		}
+	}
+}
+
+void TestDecoPerformance::initTestCase()
+{
+	copy_prefs(&default_prefs, &prefs);
+}
+
+void TestDecoPerformance::init()
+{
+	setCurrentAppState("Default");
+	set_gf(prefs.gflow, prefs.gfhigh);
+}
+
+void TestDecoPerformance::syntheticDiveIsDeterministic_data()
+{
+	addProfileRows(true);
+}
+
+void TestDecoPerformance::syntheticDiveIsDeterministic()
+{
+	QFETCH(int, profile);
+	QFETCH(int, interval);
+
+	struct dive *dive1 = generateDive(profiles[profile], interval, 1);
+	struct dive *dive2 = generateDive(profiles[profile], interval, 1);
+	QVERIFY(dive1->dc.samples > 0);
+	QCOMPARE(dive1->dc.samples, dive2->dc.samples);
+	for (int i = 0; i < dive1->dc.samples; ++i) {
+		QCOMPARE(dive1->dc.sample[i].time.seconds, dive2->dc.sample[i].time.seconds);
+		QCOMPARE(dive1->dc.sample[i].depth.mm, dive2->dc.sample[i].depth.mm);
+	}
+	QCOMPARE(dive1->dc.duration.seconds, dive2->dc.duration.seconds);
+	QCOMPARE(dive1->maxdepth.mm, dive2->maxdepth.mm);
+	free_dive(dive1);
+	free_dive(dive2);
+}
+
+void TestDecoPerformance::addSegment_data()
+{
+	addProfileRows(true);
+}
+
+// The same as add_dive_to_deco() in divelist.c: integrate the samples in steps of one second
+void TestDecoPerformance::addSegment()
+{
+	QFETCH(int, profile);
+	QFETCH(int, interval);
+
+	struct dive *dive = generateDive(profiles[profile], interval, 1);
+	struct divecomputer *dc = &dive->dc;
+	struct deco_state ds;
+	double surface_pressure = get_surface_pressure_in_mbar(dive, true) / 1000.0;
+
+	QBENCHMARK {
+		struct gasmix gasmix = gasmix_air;
+		const struct event *ev = NULL, *evd = NULL;
+		enum divemode_t current_divemode = UNDEF_COMP_TYPE;
+
+		clear_deco(&ds, surface_pressure);
+		for (int i = 1; i < dc->samples; i++) {
+			struct sample *psample = dc->sample + i - 1;
+			struct sample *sample = dc->sample + i;
+			int t0 = psample->time.seconds;
+			int t1 = sample->time.seconds;
+
+			for (int j = t0; j < t1; j++) {
+				int depth = interpolate(psample->depth.mm, sample->depth.mm, j - t0, t1 - t0);
+				gasmix = get_gasmix(dive, dc, j, &ev, gasmix);
+				add_segment(&ds, depth_to_bar(depth, dive), gasmix, 1, sample->setpoint.mbar,
+					    get_current_divemode(dc, j, &evd, &current_divemode), dive->sac);
+			}
+		}
+	}
+	free_dive(dive);
+}
+
+void TestDecoPerformance::calculateDecoInformation_data()
+{
+	addProfileRows(true);
+}
+
+void TestDecoPerformance::calculateDecoInformation()
+{
+	QFETCH(int, profile);
+	QFETCH(int, interval);
+
+	struct dive *dive = generateDive(profiles[profile], interval, 1);
+	struct divecomputer *dc = &dive->dc;
+	struct plot_info pi = calculate_max_limits_new(dive, dc);
+	struct deco_state ds;
+	populate_plot_entries(dive, dc, &pi);
+
+	QBENCHMARK {
+		init_decompression(&ds, dive);
+		calculate_deco_information(&ds, NULL, dive, dc, &pi, false);
+	}
+	free_plot_info_data(&pi);
+	free_dive(dive);
+}
+
+void TestDecoPerformance::createPlotInfo_data()
+{
+	addProfileRows(true);
+}
+
+void TestDecoPerformance::createPlotInfo()
+{
+	QFETCH(int, profile);
+	QFETCH(int, interval);
+
+	struct dive *dive = generateDive(profiles[profile], interval, 1);
+	struct divecomputer *dc = &dive->dc;
+
+	// Use the variant that hands the entries to the caller, so that they
+	// can be freed on each iteration.
+	QBENCHMARK {
+		struct plot_info pi = calculate_max_limits_new(dive, dc);
+		calculate_plot_info(dive, dc, &pi, false, NULL);
+		free_plot_info_data(&pi);
+	}
+	free_dive(dive);
+}
+
+void TestDecoPerformance::planDive_data()
+{
+	addProfileRows(false);
+}
+
+void TestDecoPerformance::planDive()
+{
+	QFETCH(int, profile);
+
+	struct diveplan diveplan = {};
+	struct deco_state ds;
+	struct deco_state *cache = NULL;
+	struct decostop stoptable[60];
+	struct dive *dive = alloc_dive();
+
+	setCurrentAppState("PlanDive");
+	QBENCHMARK {
+		createPlan(profiles[profile], &diveplan, dive);
+		memset(&ds, 0, sizeof(ds));
+		plan(&ds, &diveplan, dive, DECOTIMESTEP, stoptable, &cache, true);
+	}
+	QVERIFY(dive->dc.duration.seconds > profiles[profile].bottomTime);
+
+	free_dps(&diveplan);
+	free(cache);
+	free_dive(dive);
+}
+
+QTEST_GUILESS_MAIN(TestDecoPerformance)
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTDECOPERFORMANCE_H
+#define TESTDECOPERFORMANCE_H
+
+#include <QtTest>
+
+class TestDecoPerformance : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void init();
+
+	void syntheticDiveIsDeterministic_data();
+	void syntheticDiveIsDeterministic();
+
+	void addSegment_data();
+	void addSegment();
+	void calculateDecoInformation_data();
+	void calculateDecoInformation();
+	void createPlotInfo_data();
+	void createPlotInfo();
+	void planDive_data();
+	void planDive();
+};
+
+#endif
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testfindmovedimages.h"
+#include "core/findmovedimages.h"
+
+#include <QMutex>
+
+// Size of the synthetic tree: every directory has this many subdirectories
+// and media files, down to the given depth. This gives 1023 directories.
+static const int treeDepth = 9;
+static const int treeFanout = 2;
+static const int filesPerDir = 4;
+
+static void createFile(const QString &path)
+{
+	QFile f(path);
+	QVERIFY(f.open(QIODevice::WriteOnly));
+}
+
+// Create a tree below dir and remember where the files were before they were "moved"
+static void createTree(const QString &dir, const QString &originalDir, int depth, QVector<QString> &images)
+{
+	QVERIFY(QDir().mkpath(dir));
+	for (int i = 0; i < filesPerDir; ++i) {
+		QString name = QString("IMG_%1.JPG").arg(i);
+		createFile(dir + "/" + name);
+		images.append(originalDir + "/" + name);
+	}
+	if (depth >= treeDepth)
+		return;
+	for (int i = 0; i < treeFanout; ++i) {
+		QString sub = QString("dir%1").arg(i);
+		createTree(dir + "/" + sub, originalDir + "/" + sub, depth + 1, images);
+	}
+}
+
+static QMap<QString, MovedImageMatch> byOriginal(const QVector<MovedImageMatch> &matches)
+{
+	QMap<QString, MovedImageMatch> res;
+	for (const MovedImageMatch &match: matches)
+		res.insert(match.originalFilename, match);
+	return res;
+}
+
+void TestFindMovedImages::initTestCase()
+{
+	QVERIFY(tree.isValid());
+	createTree(tree.path() + "/deep", "/old/deep", 0, treeImages);
+}
+
+void TestFindMovedImages::testBestMatch()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	QVERIFY(QDir().mkpath(dir.path() + "/a/b/c"));
+	QVERIFY(QDir().mkpath(dir.path() + "/x/c"));
+	createFile(dir.path() + "/a/b/c/img.jpg");
+	createFile(dir.path() + "/x/c/img.jpg");
+	createFile(dir.path() + "/x/IMG2.JPG");
+
+	QVector<QString> images { "/old/a/b/c/img.jpg", "/old/x/c/img.jpg", "/old/X/img2.jpg", "/old/missing.jpg" };
+	MovedImagesSearch search;
+	QAtomicInt stop(0);
+	QMap<QString, MovedImageMatch> matches = byOriginal(search.search(dir.path(), 20, images, stop));
+
+	QCOMPARE(matches.size(), 3);
+	QCOMPARE(matches["/old/a/b/c/img.jpg"].localFilename, dir.path() + "/a/b/c/img.jpg");
+	QCOMPARE(matches["/old/a/b/c/img.jpg"].matchingPathItems, 4);
+	QCOMPARE(matches["/old/x/c/img.jpg"].localFilename, dir.path() + "/x/c/img.jpg");
+	QCOMPARE(matches["/old/x/c/img.jpg"].matchingPathItems, 3);
+	// Comparison is case insensitive
+	QCOMPARE(matches["/old/X/img2.jpg"].localFilename, dir.path() + "/x/IMG2.JPG");
+	QCOMPARE(matches["/old/X/img2.jpg"].matchingPathItems, 2);
+}
+
+void TestFindMovedImages::testStreaming()
+{
+	MovedImagesSearch search;
+	QMutex lock;
+	QMap<QString, MovedImageMatch> streamed;
+	int numBatches = 0;
+	// The signal is emitted from the walker threads - record the batches directly.
+	connect(&search, &MovedImagesSearch::matchesFound, [&](QVector<MovedImageMatch> batch) {
+		QMutexLocker l(&lock);
+		++numBatches;
+		for (const MovedImageMatch &match: batch) {
+			auto it = streamed.find(match.originalFilename);
+			if (it == streamed.end() || it->matchingPathItems <= match.matchingPathItems)
+				streamed.insert(match.originalFilename, match);
+		}
+	});
+	QAtomicInt stop(0);
+	QVector<MovedImageMatch> matches = search.search(tree.path(), 20, treeImages, stop);
+
+	// Every file was found at its place in the tree
+	QCOMPARE(matches.size(), treeImages.size());
+	for (const MovedImageMatch &match: matches)
+		QCOMPARE(match.localFilename, tree.path() + match.originalFilename.mid(4));
+
+	// The results were reported in more than one batch and all of them were reported
+	QVERIFY(numBatches > 1);
+	QCOMPARE(streamed.size(), matches.size());
+	for (const MovedImageMatch &match: matches)
+		QCOMPARE(streamed[match.originalFilename].localFilename, match.localFilename);
+}
+
+void TestFindMovedImages::testStop()
+{
+	MovedImagesSearch search;
+	QAtomicInt stop(1);
+	QVERIFY(search.search(tree.path(), 20, treeImages, stop).isEmpty());
+}
+
+void TestFindMovedImages::searchDeepTree_data()
+{
+	QTest::addColumn<int>("walkers");
+	QTest::newRow("1 walker") << 1;
+	QTest::newRow("8 walkers") << 8;
+}
+
+void TestFindMovedImages::searchDeepTree()
+{
+	QFETCH(int, walkers);
+	MovedImagesSearch search(walkers);
+	QAtomicInt stop(0);
+	QVector<MovedImageMatch> matches;
+	QBENCHMARK {
+		matches = search.search(tree.path(), 20, treeImages, stop);
+	}
+	QCOMPARE(matches.size(), treeImages.size());
+}
+
+QTEST_GUILESS_MAIN(TestFindMovedImages)
@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTFINDMOVEDIMAGES_H
+#define TESTFINDMOVEDIMAGES_H
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+class TestFindMovedImages : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+
+	void testBestMatch();
+	void testStreaming();
+	void testStop();
+	void searchDeepTree_data();
+	void searchDeepTree();
+private:
+	QTemporaryDir tree;
+	QVector<QString> treeImages;		// Original paths of the images in the deep tree
+};
+
+#endif
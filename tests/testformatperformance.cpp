@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testformatperformance.h"
+#include "core/dive.h"
+#include "core/qthelper.h"
+#include "core/gettextfromc.h"
+
+// The unit formatters should give the same results as formatting with
+// QString::arg(), as done previously. These are the reference implementations.
+static QString referenceDepth(int mm)
+{
+	if (prefs.units.length == units::METERS) {
+		double meters = mm / 1000.0;
+		return QString("%L1%2").arg(meters, 0, 'f', meters < 20.0 ? 1 : 0).arg(gettextFromC::tr("m"));
+	} else {
+		double feet = mm_to_feet(mm);
+		return QString("%L1%2").arg(feet, 0, 'f', 0).arg(gettextFromC::tr("ft"));
+	}
+}
+
+static QString referenceTemperature(int mkelvin)
+{
+	if (prefs.units.temperature == units::CELSIUS)
+		return QString("%L1%2%3").arg(mkelvin_to_C(mkelvin), 0, 'f', 1).arg(UTF8_DEGREE).arg(gettextFromC::tr("C"));
+	else
+		return QString("%L1%2%3").arg(mkelvin_to_F(mkelvin), 0, 'f', 1).arg(UTF8_DEGREE).arg(gettextFromC::tr("F"));
+}
+
+static QString referencePressure(int mbar)
+{
+	if (prefs.units.pressure == units::BAR)
+		return QString("%L1%2").arg(mbar / 1000.0, 0, 'f', 0).arg(gettextFromC::tr("bar"));
+	else
+		return QString("%L1%2").arg(mbar_to_PSI(mbar), 0, 'f', 0).arg(gettextFromC::tr("psi"));
+}
+
+static QString referenceVolume(int mliter)
+{
+	const char *unit;
+	int decimals;
+	double value = get_volume_units(mliter, &decimals, &unit);
+	return QString("%L1%2").arg(value, 0, 'f', decimals).arg(unit);
+}
+
+static void setUnits(bool imperial)
+{
+	prefs.units = imperial ? IMPERIAL_units : SI_units;
+}
+
+void TestFormatPerformance::initTestCase()
+{
+	copy_prefs(&default_prefs, &prefs);
+}
+
+void TestFormatPerformance::init()
+{
+	setUnits(false);
+}
+
+void TestFormatPerformance::compareToReference_data()
+{
+	QTest::addColumn<bool>("imperial");
+	QTest::addColumn<QString>("locale");
+	QTest::newRow("metric") << false << "C";
+	QTest::newRow("imperial") << true << "C";
+	QTest::newRow("metric-de") << false << "de_DE";
+	// Only the locale changes: the formatter must not keep the German separators
+	QTest::newRow("metric-en_US") << false << "en_US";
+	QTest::newRow("imperial-en_US") << true << "en_US";
+}
+
+void TestFormatPerformance::compareToReference()
+{
+	QFETCH(bool, imperial);
+	QFETCH(QString, locale);
+
+	QLocale oldLocale;
+	QLocale::setDefault(QLocale(locale));
+	setUnits(imperial);
+
+	// Includes values that lie exactly halfway between two outputs (1.25m, 1.25ℓ, 2.5bar,
+	// 15.25°C, -1.25°C), which are rounded away from zero.
+	static const int values[] = { 0, 1, 49, 50, 51, 125, 999, 1000, 1250, 1500, 2500, 19949, 19950, 20000,
+				      123456, 207000, 232000, 271900, 273150, 288400, 300000, 1234567, 12345678 };
+	for (int v: values) {
+		QCOMPARE(get_depth_string(v, true, true), referenceDepth(v));
+		QCOMPARE(get_pressure_string(pressure_t { v }, true), referencePressure(v));
+		QCOMPARE(get_volume_string(v, true), referenceVolume(v));
+		if (v)
+			QCOMPARE(get_temperature_string(temperature_t { (uint32_t)v }, true), referenceTemperature(v));
+	}
+	QLocale::setDefault(oldLocale);
+}
+
+// The values of a typical dive, as shown in the dive list and the profile
+static const int nrValues = 1000;
+
+void TestFormatPerformance::formatDepth()
+{
+	QBENCHMARK {
+		for (int i = 0; i < nrValues; i++)
+			get_depth_string(i * 50, true);
+	}
+}
+
+void TestFormatPerformance::formatTemperature()
+{
+	QBENCHMARK {
+		for (int i = 0; i < nrValues; i++)
+			get_temperature_string(temperature_t { (uint32_t)(273150 + i * 30) }, true);
+	}
+}
+
+void TestFormatPerformance::formatPressure()
+{
+	QBENCHMARK {
+		for (int i = 0; i < nrValues; i++)
+			get_pressure_string(pressure_t { i * 230 }, true);
+	}
+}
+
+void TestFormatPerformance::formatVolume()
+{
+	QBENCHMARK {
+		for (int i = 0; i < nrValues; i++)
+			get_volume_string(i * 15, true);
+	}
+}
+
+void TestFormatPerformance::formatWeight()
+{
+	QBENCHMARK {
+		for (int i = 0; i < nrValues; i++)
+			get_weight_string(weight_t { i * 50 }, true);
+	}
+}
+
+QTEST_GUILESS_MAIN(TestFormatPerformance)
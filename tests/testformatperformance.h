@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTFORMATPERFORMANCE_H
+#define TESTFORMATPERFORMANCE_H
+
+#include <QtTest>
+
+class TestFormatPerformance : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void init();
+
+	void compareToReference_data();
+	void compareToReference();
+
+	void formatDepth();
+	void formatTemperature();
+	void formatPressure();
+	void formatVolume();
+	void formatWeight();
+};
+
+#endif
@@ -2,15 +2,19 @@
 #include "testgitstorage.h"
 #include "git2.h"
 
+#include "core/cloudsync.h"
 #include "core/dive.h"
 #include "core/divelist.h"
 #include "core/file.h"
+#include "core/git-journal.h"
 #include "core/qthelper.h"
+#include "core/subsurface-string.h"
 #include "core/subsurfacestartup.h"
 #include "core/settings/qPrefProxy.h"
 #include "core/settings/qPrefCloudStorage.h"
 
 #include <QDir>
+#include <QSignalSpy>
 #include <QTextStream>
 #include <QNetworkProxy>
 #include <QTextCodec>
@@ -105,6 +109,410 @@ void TestGitStorage::testGitStorageLocal()
 	QCOMPARE(readin, written);
 }
 
+void TestGitStorage::testGitStorageReload()
+{
+	// load an older commit of a local repository and reload the newer one,
+	// as happens after a cloud sync brought in a new dive
+	git_repository *repo;
+	QDir testDir("./gitreload");
+	QCOMPARE(testDir.removeRecursively(), true);
+	QCOMPARE(QDir().mkdir("./gitreload"), true);
+	QCOMPARE(git_repository_init(&repo, "./gitreload", false), 0);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &dive_table, &trip_table), 0);
+	QCOMPARE(save_dives("./gitreload[reload]"), 0);
+	clear_dive_file_data();
+	QCOMPARE(parse_file("./gitreload[reload]", &dive_table, &trip_table), 0);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/test10.xml", &dive_table, &trip_table), 0);
+	process_loaded_dives();
+	QCOMPARE(save_dives("./gitreload[reload]"), 0);
+	clear_dive_file_data();
+
+	// the dives that didn't change are kept, the new one is added
+	QCOMPARE(parse_file("./gitreload[reload~1]", &dive_table, &trip_table), 0);
+	process_loaded_dives();
+	int nr = dive_table.nr;
+	struct dive *unchanged = get_dive(0);
+	QCOMPARE(reload_file("./gitreload[reload]"), 0);
+	process_loaded_dives();
+	QCOMPARE(dive_table.nr, nr + 1);
+	QVERIFY(get_divenr(unchanged) >= 0);
+	QCOMPARE(save_dives("./SampleDivesV3plus10reloaded.ssrf"), 0);
+	clear_dive_file_data();
+
+	// and the result is the same as loading the newer commit from scratch
+	QCOMPARE(parse_file("./gitreload[reload]", &dive_table, &trip_table), 0);
+	process_loaded_dives();
+	QCOMPARE(save_dives("./SampleDivesV3plus10loaded.ssrf"), 0);
+	QFile org("./SampleDivesV3plus10loaded.ssrf");
+	org.open(QFile::ReadOnly);
+	QFile out("./SampleDivesV3plus10reloaded.ssrf");
+	out.open(QFile::ReadOnly);
+	QTextStream orgS(&org);
+	QTextStream outS(&out);
+	QString readin = orgS.readAll();
+	QString written = outS.readAll();
+	QCOMPARE(readin, written);
+}
+
+// Create a local bare repository that serves as remote, so that no network is needed,
+// and an empty local cache for the given remote URL and branch. The origin of the
+// cache is originUrl, which usually is the bare repository.
+static void setupSyncRepositories(const QString &remote, const QString &branch, const QString &originUrl, QString &localCache)
+{
+	git_repository *bare, *cache;
+	git_remote *origin;
+	QDir remoteDir("./gitremote");
+	QCOMPARE(remoteDir.removeRecursively(), true);
+	QCOMPARE(git_repository_init(&bare, "./gitremote", true), 0);
+	git_repository_free(bare);
+	localCache = get_local_dir(qPrintable(remote), qPrintable(branch));
+	QDir localCacheDir(localCache);
+	QCOMPARE(localCacheDir.removeRecursively(), true);
+	QCOMPARE(git_repository_init(&cache, qPrintable(localCache), false), 0);
+	// like in a clone of the remote, the branch is checked out
+	QCOMPARE(git_repository_set_head(cache, qPrintable("refs/heads/" + branch)), 0);
+	QCOMPARE(git_remote_create(&origin, cache, "origin", qPrintable(originUrl)), 0);
+	git_remote_free(origin);
+	git_repository_free(cache);
+}
+
+static QString bareRemoteUrl()
+{
+	return "file://" + QDir::currentPath() + "/gitremote";
+}
+
+static QString branchId(const QString &repoPath, const QString &branch)
+{
+	git_repository *repo;
+	git_object *object;
+	char id[GIT_OID_HEXSZ + 1] = "";
+	if (git_repository_open(&repo, qPrintable(repoPath)))
+		return QString();
+	if (git_revparse_single(&object, repo, qPrintable(branch)) == 0) {
+		git_oid_tostr(id, sizeof(id), git_object_id(object));
+		git_object_free(object);
+	}
+	git_repository_free(repo);
+	return QString(id);
+}
+
+// Load a branch, change the notes of one dive and save the branch again
+static void changeDiveNotes(const QString &repo, int idx, const char *notes)
+{
+	QCOMPARE(parse_file(qPrintable(repo), &dive_table, &trip_table), 0);
+	struct dive *dive = get_dive(idx);
+	QVERIFY(dive != NULL);
+	free(dive->notes);
+	dive->notes = strdup(notes);
+	invalidate_dive_cache(dive);
+	QCOMPARE(save_dives(qPrintable(repo)), 0);
+	clear_dive_file_data();
+}
+
+// Commit to a new local cache and push it to the bare repository
+static void pushNewBranch(const QString &remote, const QString &branch, QString &localCache)
+{
+	setupSyncRepositories(remote, branch, bareRemoteUrl(), localCache);
+	if (QTest::currentTestFailed())
+		return;
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &dive_table, &trip_table), 0);
+	QCOMPARE(save_dives(qPrintable(localCache + "[" + branch + "]")), 0);
+	CloudSync::instance()->requestSync(remote, branch);
+	CloudSync::instance()->waitForSync();
+	QCOMPARE(CloudSync::instance()->state(), CLOUD_SYNC_IDLE);
+	QCOMPARE(branchId("./gitremote", branch), QString(saved_git_id));
+	clear_dive_file_data();
+}
+
+void TestGitStorage::testGitStorageBackgroundSync()
+{
+	QString remote = bareRemoteUrl();
+	QString branch = "sync";
+	QString localCache;
+	setupSyncRepositories(remote, branch, remote, localCache);
+	if (QTest::currentTestFailed())
+		return;
+
+	// commit to the local cache and let the background sync push it
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &dive_table, &trip_table), 0);
+	QCOMPARE(save_dives(qPrintable(localCache + "[" + branch + "]")), 0);
+	QSignalSpy spy(CloudSync::instance(), &CloudSync::finished);
+	CloudSync::instance()->requestSync(remote, branch);
+	CloudSync::instance()->waitForSync();
+	QCOMPARE(CloudSync::instance()->state(), CLOUD_SYNC_IDLE);
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(spy[0][0].toBool(), true);
+	// nothing new came from the remote
+	QCOMPARE(spy[0][1].toString(), QString(saved_git_id));
+	QCOMPARE(spy[0][2].toString(), QString(saved_git_id));
+	QCOMPARE(branchId("./gitremote", branch), QString(saved_git_id));
+}
+
+void TestGitStorage::testGitStorageBackgroundSyncMerge()
+{
+	QString remote = bareRemoteUrl();
+	QString branch = "merge";
+	QString localCache;
+	pushNewBranch(remote, branch, localCache);
+	if (QTest::currentTestFailed())
+		return;
+
+	// make the pushed branch the upstream of the local branch, as a clone does
+	git_repository *cache;
+	git_remote *origin;
+	git_reference *local;
+	QCOMPARE(git_repository_open(&cache, qPrintable(localCache)), 0);
+	QCOMPARE(git_remote_lookup(&origin, cache, "origin"), 0);
+	QCOMPARE(git_remote_fetch(origin, NULL, NULL, NULL), 0);
+	QCOMPARE(git_branch_lookup(&local, cache, qPrintable(branch), GIT_BRANCH_LOCAL), 0);
+	QCOMPARE(git_branch_set_upstream(local, qPrintable("origin/" + branch)), 0);
+	git_reference_free(local);
+	git_remote_free(origin);
+	git_repository_free(cache);
+
+	// change one dive on the remote and another one in the local cache
+	changeDiveNotes("./gitremote[" + branch + "]", 0, "remote change");
+	changeDiveNotes(localCache + "[" + branch + "]", 1, "local change");
+	if (QTest::currentTestFailed())
+		return;
+	QString localId = branchId(localCache, branch);
+
+	QSignalSpy spy(CloudSync::instance(), &CloudSync::finished);
+	CloudSync::instance()->requestSync(remote, branch);
+	CloudSync::instance()->waitForSync();
+	QCOMPARE(CloudSync::instance()->state(), CLOUD_SYNC_IDLE);
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(spy[0][0].toBool(), true);
+	// the local branch was merged with the remote and the merge was pushed
+	QCOMPARE(spy[0][1].toString(), localId);
+	QString mergedId = spy[0][2].toString();
+	QVERIFY(mergedId != localId);
+	QCOMPARE(branchId(localCache, branch), mergedId);
+	QCOMPARE(branchId("./gitremote", branch), mergedId);
+
+	QCOMPARE(parse_file(qPrintable("./gitremote[" + branch + "]"), &dive_table, &trip_table), 0);
+	QCOMPARE(QString(get_dive(0)->notes), QString("remote change"));
+	QCOMPARE(QString(get_dive(1)->notes), QString("local change"));
+}
+
+void TestGitStorage::testGitStorageBackgroundSyncCoalesce()
+{
+	QString remote = bareRemoteUrl();
+	QString branch = "coalesce";
+	QString localCache;
+	pushNewBranch(remote, branch, localCache);
+	if (QTest::currentTestFailed())
+		return;
+	changeDiveNotes(localCache + "[" + branch + "]", 0, "local change");
+	if (QTest::currentTestFailed())
+		return;
+	QString localId = branchId(localCache, branch);
+
+	// Requests that come in while a sync is running are done in one more sync
+	// of the newest request. Thus, the failing syncs of the first requests are
+	// either skipped or followed by a sync of the right branch.
+	const int requests = 10;
+	QSignalSpy spy(CloudSync::instance(), &CloudSync::finished);
+	for (int i = 0; i < requests - 1; ++i)
+		CloudSync::instance()->requestSync(remote, "nonexistent");
+	CloudSync::instance()->requestSync(remote, branch);
+	CloudSync::instance()->waitForSync();
+	QVERIFY(spy.count() >= 1);
+	QVERIFY(spy.count() < requests);
+	QCOMPARE(spy.last()[0].toBool(), true);
+	QCOMPARE(CloudSync::instance()->state(), CLOUD_SYNC_IDLE);
+	QCOMPARE(branchId("./gitremote", branch), localId);
+}
+
+void TestGitStorage::testGitStorageBackgroundSyncOnSave()
+{
+	// The remote is never contacted: the local cache has the bare repository as origin.
+	// Any URL that isn't file:// is treated as a remote with a local cache.
+	QString remote = "git://example.invalid/ssrftest";
+	QString branch = "save";
+	QString localCache;
+	setupSyncRepositories(remote, branch, bareRemoteUrl(), localCache);
+	if (QTest::currentTestFailed())
+		return;
+
+	// saving only commits to the local cache and requests a sync
+	git_local_only = false;
+	cloud_sync_in_background = true;
+	QSignalSpy spy(CloudSync::instance(), &CloudSync::finished);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &dive_table, &trip_table), 0);
+	int ret = save_dives(qPrintable(remote + "[" + branch + "]"));
+	CloudSync::instance()->waitForSync();
+	cloud_sync_in_background = false;
+	QCOMPARE(ret, 0);
+	QCOMPARE(branchId(localCache, branch), QString(saved_git_id));
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(spy[0][0].toBool(), true);
+	QCOMPARE(CloudSync::instance()->state(), CLOUD_SYNC_IDLE);
+	QCOMPARE(branchId("./gitremote", branch), QString(saved_git_id));
+}
+
+// Errors reported from the sync thread
+static QAtomicInt syncErrors;
+static void countSyncError(char *error)
+{
+	free(error);
+	syncErrors.ref();
+}
+
+void TestGitStorage::testGitStorageBackgroundSyncFailed()
+{
+	QString remote = bareRemoteUrl();
+	QString branch = "failed";
+	QString localCache;
+	setupSyncRepositories(remote, branch, "file://" + QDir::currentPath() + "/nonexistent", localCache);
+	if (QTest::currentTestFailed())
+		return;
+
+	// the fetch fails, the commit stays in the local cache
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &dive_table, &trip_table), 0);
+	QCOMPARE(save_dives(qPrintable(localCache + "[" + branch + "]")), 0);
+	git_local_only = false;
+	syncErrors = 0;
+	set_error_cb(&countSyncError);
+	QSignalSpy spy(CloudSync::instance(), &CloudSync::finished);
+	CloudSync::instance()->requestSync(remote, branch);
+	CloudSync::instance()->waitForSync();
+	QCOMPARE(CloudSync::instance()->state(), CLOUD_SYNC_FAILED);
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(spy[0][0].toBool(), false);
+	QCOMPARE(spy[0][1].toString(), QString(saved_git_id));
+	QCOMPARE(spy[0][2].toString(), QString(saved_git_id));
+	QCOMPARE(branchId(localCache, branch), QString(saved_git_id));
+	QCOMPARE(branchId("./gitremote", branch), QString());
+
+	// the cloud server can't be reached: the sync fails, but it must neither switch
+	// the UI thread to offline mode nor report an error other than the failed state
+	const char *cloudBaseUrl = prefs.cloud_base_url;
+	int cloudTimeout = prefs.cloud_timeout;
+	prefs.cloud_base_url = "http://127.0.0.1:9/";	// discard port - nobody is listening
+	prefs.cloud_timeout = 1;
+	is_subsurface_cloud = true;
+	spy.clear();
+	CloudSync::instance()->requestSync(remote, branch);
+	CloudSync::instance()->waitForSync();
+	is_subsurface_cloud = false;
+	prefs.cloud_base_url = cloudBaseUrl;
+	prefs.cloud_timeout = cloudTimeout;
+	set_error_cb(NULL);
+	QCOMPARE(CloudSync::instance()->state(), CLOUD_SYNC_FAILED);
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(spy[0][0].toBool(), false);
+	QCOMPARE(git_local_only, false);
+	QCOMPARE(syncErrors.load(), 0);
+}
+
+static struct dive *findDive(timestamp_t when)
+{
+	int i;
+	struct dive *dive;
+	for_each_dive (i, dive) {
+		if (dive->when == when)
+			return dive;
+	}
+	return NULL;
+}
+
+void TestGitStorage::testGitStorageJournal()
+{
+	// change the dives after loading them from git, then replay the journal on
+	// the dives of the same commit, as happens when the app was killed before
+	// the changes were committed
+	const char *repoName = "./gitjournal[journal]";
+	git_repository *repo;
+	QDir testDir("./gitjournal");
+	QCOMPARE(testDir.removeRecursively(), true);
+	QCOMPARE(QDir().mkdir("./gitjournal"), true);
+	QCOMPARE(git_repository_init(&repo, "./gitjournal", false), 0);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &dive_table, &trip_table), 0);
+	QCOMPARE(save_dives(repoName), 0);
+	clear_dive_file_data();
+	QCOMPARE(parse_file(repoName, &dive_table, &trip_table), 0);
+	process_loaded_dives();
+	git_journal_clear(repoName);
+	git_journal_set_base();
+
+	// change the notes of a dive, delete a dive, change the notes of a trip,
+	// delete a dive site and add a dive, writing the journal after every change
+	struct dive *changed = get_dive(0);
+	timestamp_t changedWhen = changed->when;
+	free(changed->notes);
+	changed->notes = strdup("Changed after loading");
+	invalidate_dive_cache(changed);
+	QCOMPARE(git_journal_write(repoName), 0);
+	timestamp_t deletedWhen = get_dive(1)->when;
+	delete_single_dive(1);
+	QCOMPARE(git_journal_write(repoName), 0);
+	QVERIFY(trip_table.nr > 0);
+	dive_trip_t *trip = trip_table.trips[0];
+	free(trip->notes);
+	trip->notes = strdup("Trip changed after loading");
+	QCOMPARE(git_journal_write(repoName), 0);
+	QVERIFY(dive_site_table.nr > 0);
+	struct dive_site *ds = get_dive_site(0);
+	uint32_t deletedSite = ds->uuid;
+	int i;
+	struct dive *dive;
+	for_each_dive (i, dive) {
+		if (dive->dive_site == ds) {
+			dive->dive_site = NULL;
+			invalidate_dive_cache(dive);
+		}
+	}
+	delete_dive_site(ds);
+	QCOMPARE(git_journal_write(repoName), 0);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/test10.xml", &dive_table, &trip_table), 0);
+	process_loaded_dives();
+	QCOMPARE(git_journal_write(repoName), 0);
+	int nr = dive_table.nr;
+	clear_dive_file_data();
+
+	// the journal holds only the last entry
+	char *journalName = get_journal_name(repoName);
+	QFile journal(journalName);
+	QVERIFY(journal.open(QFile::ReadOnly));
+	QByteArray data = journal.readAll();
+	journal.close();
+	int headerEnd = data.indexOf('\n');
+	QList<QByteArray> header = data.left(headerEnd).split(' ');
+	QCOMPARE(header.size(), 3);
+	QCOMPARE(header[0], QByteArray("journal"));
+	QCOMPARE(data.size() - headerEnd - 1, header[1].toInt());
+
+	// a new entry that was cut short is ignored
+	QFile newJournal(QString(journalName) + ".new");
+	QVERIFY(newJournal.open(QFile::WriteOnly));
+	newJournal.write("journal 1000 0123456789012345678901234567890123456789\nremoved ");
+	newJournal.close();
+	free(journalName);
+
+	QCOMPARE(parse_file(repoName, &dive_table, &trip_table), 0);
+	process_loaded_dives();
+	git_journal_set_base();
+	QCOMPARE(git_journal_replay(repoName), 1);
+	QCOMPARE(dive_table.nr, nr);
+	QVERIFY(findDive(deletedWhen) == NULL);
+	QVERIFY(findDive(changedWhen) != NULL);
+	QCOMPARE(QString(findDive(changedWhen)->notes), QString("Changed after loading"));
+	QVERIFY(get_dive_site_by_uuid(deletedSite) == NULL);
+	bool tripChanged = false;
+	for (i = 0; i < trip_table.nr; i++)
+		tripChanged |= same_string(trip_table.trips[i]->notes, "Trip changed after loading");
+	QVERIFY(tripChanged);
+
+	// once the changes are committed, there is nothing to replay
+	QCOMPARE(save_dives(repoName), 0);
+	git_journal_clear(repoName);
+	clear_dive_file_data();
+	QCOMPARE(parse_file(repoName, &dive_table, &trip_table), 0);
+	QCOMPARE(git_journal_replay(repoName), 0);
+	QCOMPARE(dive_table.nr, nr);
+}
+
 void TestGitStorage::testGitStorageCloud()
 {
 	// test writing and reading back from cloud storage
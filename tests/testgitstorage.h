@@ -12,6 +12,13 @@ private slots:
 
 	void testGitStorageLocal_data();
 	void testGitStorageLocal();
+	void testGitStorageReload();
+	void testGitStorageBackgroundSync();
+	void testGitStorageBackgroundSyncMerge();
+	void testGitStorageBackgroundSyncCoalesce();
+	void testGitStorageBackgroundSyncOnSave();
+	void testGitStorageBackgroundSyncFailed();
+	void testGitStorageJournal();
 	void testGitStorageCloud();
 	void testGitStorageCloudOfflineSync();
 	void testGitStorageCloudMerge();
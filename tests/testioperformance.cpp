@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testioperformance.h"
+#include "git2.h"
+
+#include "core/dive.h"
+#include "core/divelist.h"
+#include "core/divesite.h"
+#include "core/membuffer.h"
+#include "core/qthelper.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSet>
+#include <QTextCodec>
+
+// this is a local helper function in save-xml.c
+extern "C" void save_dives_buffer(struct membuffer *b, const bool select_only, bool anonymize);
+
+// Benchmarks of loading and saving dive logs on a synthetic corpus, which is
+// written to the current directory as XML file and local git repository.
+// No network access is needed. Besides the predefined corpus sizes, a custom
+// size can be given as "dives,samples per dive,pictures per dive,sites":
+//	SUBSURFACE_IO_CORPUS=5000,1000,2,500 ./TestIOPerformance loadGit:custom
+
+struct CorpusSize {
+	int dives;
+	int samples;
+	int pictures;
+	int sites;
+};
+
+#define SAMPLE_INTERVAL 10
+#define CORPUS_BRANCH "[bench]"
+
+// A simple linear congruential generator, so that the corpus is the same on all platforms
+static int nextRandom(unsigned int &state)
+{
+	state = state * 1103515245 + 12345;
+	return (state >> 16) & 0x7fff;
+}
+
+static QString xmlName(const QString &corpus)
+{
+	return "./iocorpus-" + corpus + ".ssrf";
+}
+
+static QString gitName(const QString &corpus)
+{
+	return "./iocorpus-" + corpus + "-git";
+}
+
+// Fill the dive and dive site tables with synthetic dives: two dives a day,
+// each at one of the dive sites and with pictures spread over the dive.
+static void generateCorpus(const CorpusSize &size)
+{
+	const timestamp_t start = 1546300800;	// 2019-01-01
+	unsigned int random = 1;
+	QVector<struct dive_site *> sites;
+
+	for (int i = 0; i < size.sites; ++i) {
+		QByteArray name = "Synthetic site " + QByteArray::number(i + 1);
+		struct dive_site *ds = create_dive_site(name.constData(), start);
+		ds->location.lat.udeg = (nextRandom(random) % 18000 - 9000) * 10000;
+		ds->location.lon.udeg = (nextRandom(random) % 36000 - 18000) * 10000;
+		sites.append(ds);
+	}
+
+	for (int i = 0; i < size.dives; ++i) {
+		struct dive *dive = alloc_dive();
+		struct divecomputer *dc = &dive->dc;
+		int maxdepth = 10000 + nextRandom(random) % 30000;
+		int duration = size.samples * SAMPLE_INTERVAL;
+		int descent = qMax(duration / 10, 1);
+		int ascent = qMax(duration * 2 / 10, 1);
+
+		dive->number = i + 1;
+		dive->when = dc->when = start + i * 12 * 3600;
+		dive->dive_site = sites.isEmpty() ? NULL : sites[i % sites.size()];
+		dc->model = strdup("Synthetic");
+		dc->deviceid = 0x12345678;
+		dive->cylinder[0].type.size.mliter = 12000;
+		dive->cylinder[0].type.workingpressure.mbar = 232000;
+		dive->cylinder[0].start.mbar = 200000;
+		dive->cylinder[0].end.mbar = 50000;
+
+		alloc_samples(dc, size.samples);
+		for (int j = 0; j < size.samples; ++j) {
+			int time = j * SAMPLE_INTERVAL;
+			int depth = maxdepth;
+			if (time < descent)
+				depth = maxdepth * time / descent;
+			else if (time > duration - ascent)
+				depth = maxdepth * (duration - time) / ascent;
+			if (j > 0 && j < size.samples - 1)
+				depth = qMax(depth + nextRandom(random) % 1001 - 500, 0);
+
+			struct sample *sample = prepare_sample(dc);
+			sample->time.seconds = time;
+			sample->depth.mm = depth;
+			sample->pressure[0].mbar = 200000 - 150000LL * j / size.samples;
+			if (j % 6 == 0)
+				sample->temperature.mkelvin = C_to_mkelvin(20.0 - depth / 5000.0);
+			finish_sample(dc);
+		}
+
+		for (int j = 0; j < size.pictures; ++j) {
+			struct picture *picture = alloc_picture();
+			QByteArray filename = "/synthetic/dive" + QByteArray::number(i + 1) + "-" + QByteArray::number(j + 1) + ".jpg";
+			picture->filename = strdup(filename.constData());
+			picture->offset.seconds = duration * j / size.pictures;
+			if (dive->dive_site)
+				picture->location = dive->dive_site->location;
+			dive_add_picture(dive, picture);
+		}
+		record_dive(dive);
+	}
+}
+
+// Write the corpus of the given size as XML file and local git repository.
+// This is only done once per corpus and run of the test.
+static void writeCorpus(const QString &corpus, const CorpusSize &size)
+{
+	static QSet<QString> written;
+	if (written.contains(corpus))
+		return;
+
+	git_repository *repo;
+	QDir gitDir(gitName(corpus));
+	QVERIFY(gitDir.removeRecursively());
+	QVERIFY(QDir().mkdir(gitName(corpus)));
+	QCOMPARE(git_repository_init(&repo, qPrintable(gitName(corpus)), false), 0);
+	git_repository_free(repo);
+
+	generateCorpus(size);
+	QCOMPARE(save_dives(qPrintable(xmlName(corpus))), 0);
+	QCOMPARE(save_dives(qPrintable(gitName(corpus) + CORPUS_BRANCH)), 0);
+	clear_dive_file_data();
+	written.insert(corpus);
+}
+
+static QByteArray readCorpus(const QString &corpus)
+{
+	QFile f(xmlName(corpus));
+	if (!f.open(QFile::ReadOnly))
+		return QByteArray();
+	return f.readAll();
+}
+
+static void addCorpusRows()
+{
+	QTest::addColumn<QString>("corpus");
+	QTest::addColumn<int>("dives");
+	QTest::addColumn<int>("samples");
+	QTest::addColumn<int>("pictures");
+	QTest::addColumn<int>("sites");
+	QTest::newRow("small") << "small" << 100 << 360 << 2 << 20;
+	QTest::newRow("large") << "large" << 1000 << 720 << 4 << 200;
+
+	QStringList custom = QString(qgetenv("SUBSURFACE_IO_CORPUS")).split(',');
+	if (custom.size() == 4)
+		QTest::newRow("custom") << "custom" << custom[0].toInt() << custom[1].toInt() << custom[2].toInt() << custom[3].toInt();
+}
+
+#define FETCH_CORPUS()									\
+	QFETCH(QString, corpus);							\
+	QFETCH(int, dives);								\
+	QFETCH(int, samples);								\
+	QFETCH(int, pictures);								\
+	QFETCH(int, sites);								\
+	writeCorpus(corpus, { dives, samples, pictures, sites });			\
+	if (QTest::currentTestFailed())							\
+		return
+
+void TestIOPerformance::initTestCase()
+{
+	// Set UTF8 text codec as in real applications
+	QTextCodec::setCodecForLocale(QTextCodec::codecForMib(106));
+	copy_prefs(&default_prefs, &prefs);
+	git_libgit2_init();
+}
+
+void TestIOPerformance::cleanup()
+{
+	clear_dive_file_data();
+}
+
+void TestIOPerformance::loadXml_data()
+{
+	addCorpusRows();
+}
+
+void TestIOPerformance::loadXml()
+{
+	FETCH_CORPUS();
+	QByteArray data = readCorpus(corpus);
+	QVERIFY(!data.isEmpty());
+
+	QBENCHMARK {
+		clear_dive_file_data();
+		parse_xml_buffer(qPrintable(xmlName(corpus)), data.constData(), data.size(), &dive_table, &trip_table, NULL);
+	}
+	QCOMPARE(dive_table.nr, dives);
+}
+
+void TestIOPerformance::loadGit_data()
+{
+	addCorpusRows();
+}
+
+void TestIOPerformance::loadGit()
+{
+	FETCH_CORPUS();
+
+	QBENCHMARK {
+		clear_dive_file_data();
+		parse_file(qPrintable(gitName(corpus) + CORPUS_BRANCH), &dive_table, &trip_table);
+	}
+	QCOMPARE(dive_table.nr, dives);
+}
+
+void TestIOPerformance::saveXml_data()
+{
+	addCorpusRows();
+}
+
+void TestIOPerformance::saveXml()
+{
+	FETCH_CORPUS();
+	QCOMPARE(parse_file(qPrintable(xmlName(corpus)), &dive_table, &trip_table), 0);
+
+	struct membuffer b = { 0 };
+	QBENCHMARK {
+		free_buffer(&b);
+		save_dives_buffer(&b, false, false);
+	}
+	QVERIFY(b.len > 0);
+	free_buffer(&b);
+}
+
+void TestIOPerformance::saveGit_data()
+{
+	addCorpusRows();
+}
+
+// Save all dives, as if they had been changed. The dives of the corpus are saved to a new branch.
+void TestIOPerformance::saveGit()
+{
+	FETCH_CORPUS();
+	QCOMPARE(parse_file(qPrintable(xmlName(corpus)), &dive_table, &trip_table), 0);
+
+	int i;
+	struct dive *dive;
+	QBENCHMARK {
+		for_each_dive (i, dive)
+			invalidate_dive_cache(dive);
+		QCOMPARE(save_dives(qPrintable(gitName(corpus) + "[save]")), 0);
+	}
+}
+
+void TestIOPerformance::resaveGitUnchanged_data()
+{
+	addCorpusRows();
+}
+
+// Save the dives loaded from git. Since nothing changed, the git objects of the dives can be reused.
+void TestIOPerformance::resaveGitUnchanged()
+{
+	FETCH_CORPUS();
+	QCOMPARE(parse_file(qPrintable(gitName(corpus) + CORPUS_BRANCH), &dive_table, &trip_table), 0);
+
+	QBENCHMARK {
+		QCOMPARE(save_dives(qPrintable(gitName(corpus) + CORPUS_BRANCH)), 0);
+	}
+}
+
+void TestIOPerformance::importMerge_data()
+{
+	addCorpusRows();
+}
+
+// Import the corpus into the loaded corpus, i.e. every imported dive is merged into an existing dive.
+// This is measured only once, since a second import would merge into the already merged dives.
+void TestIOPerformance::importMerge()
+{
+	FETCH_CORPUS();
+	QCOMPARE(parse_file(qPrintable(gitName(corpus) + CORPUS_BRANCH), &dive_table, &trip_table), 0);
+	process_loaded_dives();
+	QByteArray data = readCorpus(corpus);
+
+	QBENCHMARK_ONCE {
+		struct dive_table import_table = { 0 };
+		struct trip_table import_trip_table = { 0 };
+		parse_xml_buffer(qPrintable(xmlName(corpus)), data.constData(), data.size(), &import_table, &import_trip_table, NULL);
+		add_imported_dives(&import_table, &import_trip_table, false, false, false);
+		free(import_table.dives);
+		free(import_trip_table.trips);
+	}
+	QCOMPARE(dive_table.nr, dives);
+}
+
+QTEST_GUILESS_MAIN(TestIOPerformance)
@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTIOPERFORMANCE_H
+#define TESTIOPERFORMANCE_H
+
+#include <QtTest>
+
+class TestIOPerformance : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void cleanup();
+
+	void loadXml_data();
+	void loadXml();
+	void loadGit_data();
+	void loadGit();
+	void saveXml_data();
+	void saveXml();
+	void saveGit_data();
+	void saveGit();
+	void resaveGitUnchanged_data();
+	void resaveGitUnchanged();
+	void importMerge_data();
+	void importMerge();
+};
+
+#endif
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testpicturemodel.h"
+#include "core/dive.h"
+#include "core/divelist.h"
+#include "core/qthelper.h"
+#include "qt-models/divepicturemodel.h"
+
+#include <algorithm>
+
+typedef QVector<QPair<int, QString>> Rows;
+
+void TestPictureModel::initTestCase()
+{
+	/* we need to manually tell that the resource exists, because we are using it as library. */
+	Q_INIT_RESOURCE(subsurface);
+}
+
+void TestPictureModel::cleanup()
+{
+	current_dive = NULL;
+	clear_dive_file_data();
+	DivePictureModel::instance()->updateDivePictures();
+}
+
+// Add a dive whose pictures are one minute apart
+static struct dive *addDive(timestamp_t when, const QVector<QString> &filenames)
+{
+	struct dive *d = alloc_dive();
+	d->when = when;
+	int offset = 0;
+	for (const QString &filename: filenames) {
+		struct picture *picture = alloc_picture();
+		picture->filename = copy_qstring(filename);
+		picture->offset.seconds = offset += 60;
+		dive_add_picture(d, picture);
+	}
+	record_dive(d);
+	return d;
+}
+
+// The dive id and file name of every row of the model
+static Rows rows()
+{
+	Rows res;
+	DivePictureModel *model = DivePictureModel::instance();
+	for (int i = 0; i < model->rowCount(); ++i) {
+		QModelIndex index = model->index(i, 0);
+		res.push_back({ model->data(index, Qt::UserRole).toInt(), model->data(index, Qt::ToolTipRole).toString() });
+	}
+	return res;
+}
+
+// The rows for which dataChanged() was emitted
+static QVector<int> changedRows(const QSignalSpy &spy)
+{
+	QVector<int> res;
+	for (const QList<QVariant> &args: spy)
+		res.push_back(args[0].value<QModelIndex>().row());
+	std::sort(res.begin(), res.end());
+	return res;
+}
+
+void TestPictureModel::testSelectionDiff()
+{
+	DivePictureModel *model = DivePictureModel::instance();
+	struct dive *d1 = addDive(1000, { "/pictures/a.jpg", "/pictures/b.jpg" });
+	struct dive *d2 = addDive(2000, { "/pictures/c.jpg" });
+	addDive(3000, {});
+	struct dive *d4 = addDive(4000, { "/pictures/d.jpg", "/pictures/e.jpg" });
+	d1->selected = d4->selected = true;
+	model->updateDivePictures();
+	QCOMPARE(rows(), Rows({ { d1->id, "/pictures/a.jpg" }, { d1->id, "/pictures/b.jpg" },
+				{ d4->id, "/pictures/d.jpg" }, { d4->id, "/pictures/e.jpg" } }));
+
+	QSignalSpy inserted(model, SIGNAL(rowsInserted(QModelIndex, int, int)));
+	QSignalSpy removed(model, SIGNAL(rowsRemoved(QModelIndex, int, int)));
+	QSignalSpy reset(model, SIGNAL(modelReset()));
+
+	// selecting a dive only inserts the rows of its pictures
+	d2->selected = true;
+	model->updateDivePictures();
+	QCOMPARE(inserted.count(), 1);
+	QCOMPARE(inserted[0][1].toInt(), 2);
+	QCOMPARE(inserted[0][2].toInt(), 2);
+	QCOMPARE(removed.count(), 0);
+	QCOMPARE(rows(), Rows({ { d1->id, "/pictures/a.jpg" }, { d1->id, "/pictures/b.jpg" }, { d2->id, "/pictures/c.jpg" },
+				{ d4->id, "/pictures/d.jpg" }, { d4->id, "/pictures/e.jpg" } }));
+
+	// deselecting a dive only removes the rows of its pictures
+	inserted.clear();
+	d1->selected = false;
+	model->updateDivePictures();
+	QCOMPARE(removed.count(), 1);
+	QCOMPARE(removed[0][1].toInt(), 0);
+	QCOMPARE(removed[0][2].toInt(), 1);
+	QCOMPARE(inserted.count(), 0);
+	QCOMPARE(rows(), Rows({ { d2->id, "/pictures/c.jpg" }, { d4->id, "/pictures/d.jpg" }, { d4->id, "/pictures/e.jpg" } }));
+
+	// an unchanged selection doesn't touch the rows
+	removed.clear();
+	model->updateDivePictures();
+	QCOMPARE(inserted.count(), 0);
+	QCOMPARE(removed.count(), 0);
+	QCOMPARE(reset.count(), 0);
+}
+
+void TestPictureModel::testSharedPicture()
+{
+	DivePictureModel *model = DivePictureModel::instance();
+	struct dive *d1 = addDive(1000, { "/pictures/a.jpg", "/pictures/shared.jpg" });
+	struct dive *d2 = addDive(2000, { "/pictures/b.jpg" });
+	struct dive *d3 = addDive(3000, { "/pictures/shared.jpg", "/pictures/c.jpg" });
+	d2->selected = d3->selected = true;
+	model->updateDivePictures();
+
+	// selecting the first dive shifts the rows of the other dives
+	d1->selected = true;
+	model->updateDivePictures();
+	QCOMPARE(rows(), Rows({ { d1->id, "/pictures/a.jpg" }, { d1->id, "/pictures/shared.jpg" }, { d2->id, "/pictures/b.jpg" },
+				{ d3->id, "/pictures/shared.jpg" }, { d3->id, "/pictures/c.jpg" } }));
+
+	// the thumbnail of a picture is shown in the rows of all its dives
+	QSignalSpy changed(model, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+	QImage thumbnail(16, 16, QImage::Format_RGB32);
+	thumbnail.fill(Qt::red);
+	model->updateThumbnail("/pictures/shared.jpg", thumbnail, { 0 });
+	QCOMPARE(changedRows(changed), QVector<int>({ 1, 3 }));
+
+	// and still in the row of the remaining dive after deselecting the other one
+	changed.clear();
+	d1->selected = false;
+	model->updateDivePictures();
+	model->updateThumbnail("/pictures/shared.jpg", thumbnail, { 0 });
+	QCOMPARE(changedRows(changed), QVector<int>({ 1 }));
+	changed.clear();
+	model->updateThumbnail("/pictures/a.jpg", thumbnail, { 0 });
+	QCOMPARE(changed.count(), 0);
+}
+
+void TestPictureModel::testChangeOffset()
+{
+	DivePictureModel *model = DivePictureModel::instance();
+	struct dive *d1 = addDive(1000, { "/pictures/a.jpg", "/pictures/b.jpg", "/pictures/c.jpg" });
+	struct dive *d2 = addDive(2000, { "/pictures/d.jpg" });
+	d1->selected = d2->selected = true;
+	current_dive = d1;
+	model->updateDivePictures();
+
+	// moving a picture behind the next one moves its row
+	model->updateDivePictureOffset(d1->id, "/pictures/a.jpg", 150);
+	QCOMPARE(rows(), Rows({ { d1->id, "/pictures/b.jpg" }, { d1->id, "/pictures/a.jpg" }, { d1->id, "/pictures/c.jpg" },
+				{ d2->id, "/pictures/d.jpg" } }));
+
+	QSignalSpy changed(model, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+	QImage thumbnail(16, 16, QImage::Format_RGB32);
+	thumbnail.fill(Qt::red);
+	model->updateThumbnail("/pictures/a.jpg", thumbnail, { 0 });
+	model->updateThumbnail("/pictures/b.jpg", thumbnail, { 0 });
+	model->updateThumbnail("/pictures/d.jpg", thumbnail, { 0 });
+	QCOMPARE(changedRows(changed), QVector<int>({ 0, 1, 3 }));
+}
+
+QTEST_MAIN(TestPictureModel)
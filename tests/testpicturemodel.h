@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTPICTUREMODEL_H
+#define TESTPICTUREMODEL_H
+
+#include <QtTest>
+
+class TestPictureModel : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void cleanup();
+
+	void testSelectionDiff();
+	void testSharedPicture();
+	void testChangeOffset();
+};
+
+#endif
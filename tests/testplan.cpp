@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "testplan.h"
+#include "core/decotable.h"
 #include "core/dive.h"
+#include "core/divelist.h"
 #include "core/planner.h"
 #include "core/qthelper.h"
 #include "core/subsurfacestartup.h"
@@ -389,11 +391,10 @@ void TestPlan::testMetric()
 	struct diveplan testPlan = {};
 	setupPlan(&testPlan);
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -430,11 +431,10 @@ void TestPlan::testImperial()
 	struct diveplan testPlan = {};
 	setupPlan(&testPlan);
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -471,11 +471,10 @@ void TestPlan::testVpmbMetric45m30minTx()
 	setupPlanVpmb45m30mTx(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -502,11 +501,10 @@ void TestPlan::testVpmbMetric60m10minTx()
 	setupPlanVpmb60m10mTx(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -533,11 +531,10 @@ void TestPlan::testVpmbMetric60m30minAir()
 	setupPlanVpmb60m30minAir(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -564,11 +561,10 @@ void TestPlan::testVpmbMetric60m30minEan50()
 	setupPlanVpmb60m30minEan50(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -601,11 +597,10 @@ void TestPlan::testVpmbMetric60m30minTx()
 	setupPlanVpmb60m30minTx(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -638,11 +633,10 @@ void TestPlan::testVpmbMetric100m60min()
 	setupPlanVpmb100m60min(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -682,11 +676,10 @@ void TestPlan::testMultipleGases()
 	setupPlanSeveralGases(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -708,11 +701,10 @@ void TestPlan::testVpmbMetricMultiLevelAir()
 	setupPlanVpmbMultiLevelAir(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -739,11 +731,10 @@ void TestPlan::testVpmbMetric100m10min()
 	setupPlanVpmb100m10min(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -786,11 +777,10 @@ void TestPlan::testVpmbMetricRepeat()
 	setupPlanVpmb30m20min(&testPlan);
 	setCurrentAppState("PlanDive");
 
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -807,11 +797,10 @@ void TestPlan::testVpmbMetricRepeat()
 	int firstDiveRunTimeSeconds = displayed_dive.dc.duration.seconds;
 
 	setupPlanVpmb100mTo70m30min(&testPlan);
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -844,11 +833,10 @@ void TestPlan::testVpmbMetricRepeat()
 	QVERIFY(compareDecoTime(displayed_dive.dc.duration.seconds, 127u * 60u + 20u, 127u * 60u + 20u));
 
 	setupPlanVpmb30m20min(&testPlan);
-	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1, 0);
+	plan(&test_deco_state, &testPlan, &displayed_dive, 60, stoptable, &cache, 1);
 
 #if DEBUG
-	free(displayed_dive.notes);
-	displayed_dive.notes = NULL;
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
 	save_dive(stdout, &displayed_dive, false);
 #endif
 
@@ -865,4 +853,272 @@ void TestPlan::testVpmbMetricRepeat()
 	QCOMPARE(finalDiveRunTimeSeconds, firstDiveRunTimeSeconds);
 }
 
+// Shorten the last manually entered segment of a plan
+static void shortenLastSegment(struct diveplan *dp, int seconds)
+{
+	struct divedatapoint *last = dp->dp;
+	while (last->next)
+		last = last->next;
+	last->time -= seconds;
+}
+
+static int planDuration(struct diveplan *dp, struct decostop *table)
+{
+	struct deco_state *cache = NULL;
+	plan(&test_deco_state, dp, &displayed_dive, 60, table, &cache, 1);
+	free(cache);
+	return displayed_dive.dc.duration.seconds;
+}
+
+void TestPlan::testIncrementalReplan()
+{
+	struct decostop fullTable[60], incrementalTable[60];
+	struct deco_checkpoints *checkpoints = alloc_deco_checkpoints();
+
+	setupPrefsVpmb();
+	prefs.unit_system = METRIC;
+	prefs.units.length = units::METERS;
+	setCurrentAppState("PlanDive");
+
+	// Calculate the plan once to fill the checkpoints, then change the last waypoint.
+	// Resuming from the checkpoints must give the same result as planning from scratch.
+	struct diveplan testPlan = {};
+	setupPlanVpmbMultiLevelAir(&testPlan);
+	testPlan.checkpoints = checkpoints;
+	planDuration(&testPlan, incrementalTable);
+
+	setupPlanVpmbMultiLevelAir(&testPlan);
+	shortenLastSegment(&testPlan, 5 * 60);
+	int incrementalDuration = planDuration(&testPlan, incrementalTable);
+
+	testPlan.checkpoints = NULL;
+	setupPlanVpmbMultiLevelAir(&testPlan);
+	shortenLastSegment(&testPlan, 5 * 60);
+	int fullDuration = planDuration(&testPlan, fullTable);
+
+	QCOMPARE(incrementalDuration, fullDuration);
+	for (int i = 0; fullTable[i].depth; i++) {
+		QCOMPARE(incrementalTable[i].depth, fullTable[i].depth);
+		QCOMPARE(incrementalTable[i].time, fullTable[i].time);
+	}
+	free_dps(&testPlan);
+	free_deco_checkpoints(checkpoints);
+}
+
+static int minimumGas(const struct diveplan *dp)
+{
+	for (const struct divedatapoint *p = dp->dp; p; p = p->next) {
+		if (p->minimum_gas.mbar)
+			return p->minimum_gas.mbar;
+	}
+	return 0;
+}
+
+static int planWithResults(struct diveplan *dp, struct deco_state **cache)
+{
+	free(*cache);
+	*cache = NULL;
+	plan(&test_deco_state, dp, &displayed_dive, 60, stoptable, cache, 1);
+	return displayed_dive.dc.duration.seconds;
+}
+
+void TestPlan::testPlanResultCache()
+{
+	struct plan_results *results = alloc_plan_results();
+	struct deco_state *cache = NULL;
+
+	setupPrefsVpmb();
+	prefs.unit_system = METRIC;
+	prefs.units.length = units::METERS;
+	prefs.verbatim_plan = false;
+	setCurrentAppState("PlanDive");
+
+	// The first plan is calculated and stored
+	struct diveplan testPlan = {};
+	testPlan.when = displayed_dive.when = 1500000000;
+	setupPlanVpmbMultiLevelAir(&testPlan);
+	testPlan.results = results;
+	QCOMPARE(planWithResults(&testPlan, &cache), 169 * 60 + 20);
+	QCOMPARE(plan_results_hits(results), 0);
+	QVERIFY(!plan_result_unchanged(results));
+	struct deco_state initial = *cache;
+
+	// Verbatim notes only change the presentation: the stored result is used
+	// and gives the same dive, minimum gas and initial tissues.
+	prefs.verbatim_plan = true;
+	setupPlanVpmbMultiLevelAir(&testPlan);
+	QCOMPARE(planWithResults(&testPlan, &cache), 169 * 60 + 20);
+	QCOMPARE(plan_results_hits(results), 1);
+	QVERIFY(plan_result_unchanged(results));
+	QCOMPARE(lrint(minimumGas(&testPlan) / 1000.0), 101l);
+	QVERIFY(cache != NULL);
+	QVERIFY(!memcmp(cache->tissue_n2_sat, initial.tissue_n2_sat, sizeof(initial.tissue_n2_sat)));
+	add_plan_to_notes(&testPlan, &displayed_dive, false);
+	QVERIFY(displayed_dive.notes != NULL);
+	QVERIFY(!QString(displayed_dive.notes).contains("<table>"));
+
+	// A changed waypoint is planned. Going back to the first input finds its result,
+	// but it differs from the plan before.
+	shortenLastSegment(&testPlan, 60);
+	planWithResults(&testPlan, &cache);
+	QCOMPARE(plan_results_hits(results), 1);
+	setupPlanVpmbMultiLevelAir(&testPlan);
+	QCOMPARE(planWithResults(&testPlan, &cache), 169 * 60 + 20);
+	QCOMPARE(plan_results_hits(results), 2);
+	QVERIFY(!plan_result_unchanged(results));
+
+	// A dive three hours before the plan loads the tissues. It is part of the key,
+	// thus the same input has to be planned again and needs more deco.
+	struct dive *previous = alloc_dive();
+	previous->when = testPlan.when - 3 * 3600;
+	previous->dc.salinity = previous->salinity = 10300;
+	previous->dc.surface_pressure.mbar = previous->surface_pressure.mbar = 1013;
+	const int times[] = { 0, 120, 1800, 2100 }, depths[] = { 0, 30000, 30000, 0 };
+	for (int i = 0; i < 4; i++) {
+		struct sample *sample = prepare_sample(&previous->dc);
+		sample->time.seconds = times[i];
+		sample->depth.mm = depths[i];
+		finish_sample(&previous->dc);
+	}
+	previous->dc.duration.seconds = previous->duration.seconds = 2100;
+	add_single_dive(dive_table.nr, previous);
+	setupPlanVpmbMultiLevelAir(&testPlan);
+	QVERIFY(planWithResults(&testPlan, &cache) > 169 * 60 + 20);
+	QCOMPARE(plan_results_hits(results), 2);
+
+	delete_single_dive(get_divenr(previous));
+	free(cache);
+	free_dps(&testPlan);
+	free_plan_results(results);
+	prefs.verbatim_plan = false;
+	displayed_dive.when = 0;
+}
+
+void TestPlan::testGasBudget()
+{
+	struct decostop table[60];
+	struct plan_results *results = alloc_plan_results();
+
+	setupPrefsVpmb();
+	prefs.unit_system = METRIC;
+	prefs.units.length = units::METERS;
+	setCurrentAppState("PlanDive");
+
+	struct diveplan testPlan = {};
+	setupPlanVpmb45m30mTx(&testPlan);
+	testPlan.results = results;
+	QCOMPARE(planDuration(&testPlan, table), 3200);
+	QCOMPARE(displayed_dive.cylinder[0].gas_used.mliter, 3400175);
+	QCOMPARE(displayed_dive.cylinder[0].end.mbar, 81786);
+	QCOMPARE(testPlan.gas.cyl[0].turn.mbar, 89950);
+	QCOMPARE(minimumGas(&testPlan), 107775);
+
+	// Higher SAC rates don't change the stops. The stored result is used and
+	// only the gas consumption is recalculated.
+	setupPlanVpmb45m30mTx(&testPlan);
+	testPlan.bottomsac = testPlan.bottomsac * 11 / 10;
+	testPlan.decosac = testPlan.decosac * 11 / 10;
+	QCOMPARE(planDuration(&testPlan, table), 3200);
+	QCOMPARE(plan_results_hits(results), 1);
+	QCOMPARE(displayed_dive.cylinder[0].gas_used.mliter, 3740193);
+	QCOMPARE(displayed_dive.cylinder[0].end.mbar, 66836);
+	QCOMPARE(testPlan.gas.cyl[0].turn.mbar, 75790);
+	QCOMPARE(minimumGas(&testPlan), 111154);
+	QCOMPARE(testPlan.gas.cyl[0].minimum.mbar, minimumGas(&testPlan));
+	free_plan_results(results);
+
+	// In recreational mode, the gas for the ascent is accounted for before the
+	// bottom time is extended. The turn pressure still only covers the bottom time.
+	prefs.planner_deco_mode = RECREATIONAL;
+	setupPlanVpmb30m20min(&testPlan);
+	testPlan.results = NULL;
+	QCOMPARE(planDuration(&testPlan, table), 1562);
+	QCOMPARE(displayed_dive.cylinder[0].end.mbar, 180802);
+	QCOMPARE(testPlan.gas.cyl[0].turn.mbar, 186658);
+	free_dps(&testPlan);
+}
+
+static QString decoTableStops(const DecoTableCell &cell)
+{
+	QStringList stops;
+	for (const struct decostop &stop: cell.stops)
+		stops.append(QString("%1:%2").arg(stop.depth).arg(stop.time));
+	return stops.join(' ');
+}
+
+static void checkDecoTable(const DecoTableGrid &grid, const QVector<QPair<int, QString>> &reference)
+{
+	// The cells are planned in parallel. Each of them must give the same result
+	// as when it is planned on its own and as the reference values, which were
+	// calculated by planning the cells one after another.
+	QVector<DecoTableCell> table = generateDecoTable(grid);
+	QCOMPARE(table.size(), reference.size());
+	for (int i = 0; i < table.size(); ++i) {
+		const DecoTableCell &cell = table[i];
+		DecoTableGrid single = grid;
+		single.depths = { cell.depth };
+		single.bottomTimes = { cell.bottomTime };
+		single.gradientFactors = { { cell.gflow, cell.gfhigh } };
+		DecoTableCell expected = generateDecoTable(single)[0];
+		QVERIFY(cell.valid);
+		QVERIFY(cell.runtime > cell.bottomTime);
+		QCOMPARE(cell.runtime, expected.runtime);
+		QCOMPARE(decoTableStops(cell), decoTableStops(expected));
+		QCOMPARE(cell.runtime, reference[i].first);
+		QCOMPARE(decoTableStops(cell), reference[i].second);
+	}
+}
+
+void TestPlan::testDecoTable()
+{
+	setupPrefsVpmb();
+	prefs.unit_system = METRIC;
+	prefs.units.length = units::METERS;
+	setCurrentAppState("PlanDive");
+
+	DecoTableGrid grid;
+	grid.surfacePressure = 1013;
+	grid.salinity = 10300;
+	grid.vpmbConservatism = 0;
+	grid.depths = { 30000, 45000, 60000 };
+	grid.bottomTimes = { 20 * 60, 30 * 60 };
+	grid.gradientFactors = { { 30, 70 }, { 50, 80 } };
+	grid.gases = { { { { 210 }, { 350 } }, 0 }, { { { 500 }, { 0 } }, 0 }, { { { 1000 }, { 0 } }, 0 } };
+
+	// Runtime and stops (depth:time) of the cells, in the order depth, bottom time, gradient factors.
+	// VPM-B ignores the gradient factors, thus pairs of cells are identical.
+	checkDecoTable(grid, {
+		{ 1460, "" },
+		{ 1460, "" },
+		{ 2240, "3000:180" },
+		{ 2240, "3000:180" },
+		{ 2120, "12000:20 9000:100 6000:160 3000:280" },
+		{ 2120, "12000:20 9000:100 6000:160 3000:280" },
+		{ 3260, "15000:100 12000:100 9000:220 6000:220 3000:460" },
+		{ 3260, "15000:100 12000:100 9000:220 6000:220 3000:460" },
+		{ 2900, "24000:60 18000:80 15000:100 12000:100 9000:220 6000:280 3000:400" },
+		{ 2900, "24000:60 18000:80 15000:100 12000:100 9000:220 6000:280 3000:400" },
+		{ 4460, "30000:40 27000:100 24000:100 21000:40 18000:100 15000:160 12000:220 9000:340 6000:460 3000:640" },
+		{ 4460, "30000:40 27000:100 24000:100 21000:40 18000:100 15000:160 12000:220 9000:340 6000:460 3000:640" }
+	});
+
+	// With Bühlmann, every cell uses its own gradient factors. These are set per
+	// thread, so cells planned at the same time must not see each other's.
+	prefs.planner_deco_mode = BUEHLMANN;
+	checkDecoTable(grid, {
+		{ 1700, "6000:80 3000:160" },
+		{ 1640, "3000:180" },
+		{ 2720, "9000:160 6000:160 3000:340" },
+		{ 2540, "6000:200 3000:280" },
+		{ 2540, "15000:40 12000:100 9000:220 6000:220 3000:400" },
+		{ 2360, "12000:80 9000:160 6000:220 3000:340" },
+		{ 3920, "18000:120 15000:100 12000:160 9000:340 6000:400 3000:640" },
+		{ 3680, "15000:100 12000:160 9000:280 6000:400 3000:580" },
+		{ 3680, "27000:80 24000:100 18000:80 15000:160 12000:220 9000:340 6000:400 3000:640" },
+		{ 3200, "18000:80 15000:100 12000:160 9000:280 6000:340 3000:580" },
+		{ 5900, "30000:100 27000:160 24000:160 21000:100 18000:100 15000:280 12000:340 9000:580 6000:700 3000:1120" },
+		{ 5120, "27000:20 24000:160 21000:40 18000:160 15000:160 12000:340 9000:460 6000:580 3000:940" }
+	});
+}
+
 QTEST_GUILESS_MAIN(TestPlan)
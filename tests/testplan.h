@@ -19,6 +19,10 @@ private slots:
 	void testVpmbMetric100m10min();
 	void testVpmbMetricRepeat();
 	void testMultipleGases();
+	void testIncrementalReplan();
+	void testPlanResultCache();
+	void testGasBudget();
+	void testDecoTable();
 };
 
 #endif // TESTPLAN_H
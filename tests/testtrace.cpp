@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testtrace.h"
+#include "core/trace.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <atomic>
+
+// Records spans until it is told to stop
+class TraceThread : public QThread {
+public:
+	TraceThread(int spans) : spans(spans), stop(false)
+	{
+		setObjectName("worker");
+	}
+	void run() override
+	{
+		for (int i = 0; (spans < 0 || i < spans) && !stop; ++i) {
+			TraceSpan span("worker_span");
+		}
+	}
+	int spans;		// -1: until stop is set
+	std::atomic<bool> stop;
+};
+
+static QJsonArray readTrace(const QString &filename)
+{
+	QFile f(filename);
+	if (!f.open(QIODevice::ReadOnly))
+		return QJsonArray();
+	QJsonParseError error;
+	QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &error);
+	if (error.error != QJsonParseError::NoError)
+		return QJsonArray();
+	return doc.object()["traceEvents"].toArray();
+}
+
+// Returns the number of complete events with the given name and checks their fields
+static int countSpans(const QJsonArray &events, const QString &name, const QString &threadName)
+{
+	int tid = -1;
+	for (const QJsonValue &v: events) {
+		QJsonObject e = v.toObject();
+		if (e["ph"].toString() == "M" && e["args"].toObject()["name"].toString() == threadName)
+			tid = e["tid"].toInt();
+	}
+	int count = 0;
+	for (const QJsonValue &v: events) {
+		QJsonObject e = v.toObject();
+		if (e["ph"].toString() != "X" || e["name"].toString() != name)
+			continue;
+		if (e["tid"].toInt() != tid || e["ts"].toDouble() < 0 || e["dur"].toDouble() < 0)
+			return -1;
+		++count;
+	}
+	return count;
+}
+
+void TestTrace::testDisabled()
+{
+	QVERIFY(!trace_is_enabled());
+	struct trace_span span = trace_begin("disabled");
+	QCOMPARE(span.start, (int64_t)-1);
+	trace_end(&span);
+	QCOMPARE(trace_stop(), 0);
+}
+
+void TestTrace::testTraceFile()
+{
+	QTemporaryDir dir;
+	QString filename = dir.filePath("trace.json");
+	trace_start(qPrintable(filename));
+	QVERIFY(trace_is_enabled());
+
+	struct trace_span span = trace_begin("c_span");
+	QVERIFY(span.start >= 0);
+	trace_end(&span);
+	{
+		TraceSpan cppSpan("cpp_span");
+	}
+	TraceThread thread(10);
+	thread.start();
+	QVERIFY(thread.wait());
+
+	QCOMPARE(trace_stop(), 0);
+	QVERIFY(!trace_is_enabled());
+	// spans after the stop are not recorded
+	span = trace_begin("late_span");
+	trace_end(&span);
+
+	QJsonArray events = readTrace(filename);
+	QVERIFY(!events.isEmpty());
+	QCOMPARE(countSpans(events, "c_span", "main"), 1);
+	QCOMPARE(countSpans(events, "cpp_span", "main"), 1);
+	QCOMPARE(countSpans(events, "worker_span", "worker"), 10);
+	QCOMPARE(countSpans(events, "late_span", "main"), 0);
+}
+
+// trace_stop() must wait for the spans that are being recorded and write a valid file
+void TestTrace::testStopWhileRecording()
+{
+	QTemporaryDir dir;
+	QString filename = dir.filePath("trace.json");
+	trace_start(qPrintable(filename));
+
+	TraceThread thread(-1);
+	thread.start();
+	QThread::msleep(50);
+	QCOMPARE(trace_stop(), 0);
+	thread.stop = true;
+	QVERIFY(thread.wait());
+
+	QJsonArray events = readTrace(filename);
+	QVERIFY(!events.isEmpty());
+	QVERIFY(countSpans(events, "worker_span", "worker") > 0);
+}
+
+QTEST_GUILESS_MAIN(TestTrace)
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTTRACE_H
+#define TESTTRACE_H
+
+#include <QtTest>
+
+class TestTrace : public QObject {
+	Q_OBJECT
+private slots:
+	void testDisabled();
+	void testTraceFile();
+	void testStopWhileRecording();
+};
+
+#endif
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testvideoframeextractor.h"
+#include "core/videoframeextractor.h"
+#include "core/pref.h"
+#include "core/qthelper.h"
+
+Q_DECLARE_METATYPE(duration_t)
+
+void TestVideoFrameExtractor::initTestCase()
+{
+	qRegisterMetaType<duration_t>();
+}
+
+void TestVideoFrameExtractor::extractFrames()
+{
+	prefs.extract_video_thumbnails = true;
+	prefs.extract_video_thumbnails_position = 20;
+	prefs.ffmpeg_executable = copy_qstring(SUBSURFACE_TEST_DATA "/tests/ffmpeg-stub.sh");
+
+	VideoFrameExtractor *extractor = VideoFrameExtractor::instance();
+	QSignalSpy extracted(extractor, &VideoFrameExtractor::extracted);
+	QSignalSpy failed(extractor, &VideoFrameExtractor::failed);
+
+	// Requests for videos that are already being processed are ignored
+	const QStringList videos { "a.mp4", "b.mp4", "c.mp4", "d.mp4" };
+	for (int i = 0; i < 3; ++i) {
+		for (const QString &video: videos)
+			extractor->extract(video, video, duration_t{ 100 });
+	}
+
+	for (int i = 0; i < 50 && extracted.count() < videos.size(); ++i)
+		extracted.wait(100);
+	QCOMPARE(extracted.count(), videos.size());
+	QCOMPARE(failed.count(), 0);
+
+	QStringList names;
+	for (const QList<QVariant> &args: extracted) {
+		names.append(args[0].toString());
+		QVERIFY(!args[1].value<QImage>().isNull());
+		// Position is 20% of the duration minus one second
+		QCOMPARE(args[3].value<duration_t>().seconds, 19);
+	}
+	names.sort();
+	QCOMPARE(names, videos);
+}
+
+void TestVideoFrameExtractor::failToStart()
+{
+	prefs.extract_video_thumbnails = true;
+	prefs.ffmpeg_executable = copy_qstring(SUBSURFACE_TEST_DATA "/tests/does-not-exist");
+
+	VideoFrameExtractor *extractor = VideoFrameExtractor::instance();
+	QSignalSpy extracted(extractor, &VideoFrameExtractor::extracted);
+	QSignalSpy failed(extractor, &VideoFrameExtractor::failed);
+	extractor->extract("e.mp4", "e.mp4", duration_t{ 5 });
+	QVERIFY(failed.wait(5000));
+	QCOMPARE(extracted.count(), 0);
+
+	// Failing to start the extractor turns off thumbnail extraction
+	QVERIFY(!prefs.extract_video_thumbnails);
+}
+
+QTEST_GUILESS_MAIN(TestVideoFrameExtractor)
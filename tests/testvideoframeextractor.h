@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTVIDEOFRAMEEXTRACTOR_H
+#define TESTVIDEOFRAMEEXTRACTOR_H
+
+#include <QtTest>
+
+class TestVideoFrameExtractor : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void extractFrames();
+	void failToStart();
+};
+
+#endif
@@ -817,6 +817,40 @@ function getItems()
 	}
 }
 
+/**
+*The details of the dives (samples, cylinders, etc.) are exported
+*in shards, which are loaded when a dive of the shard is shown.
+*/
+var shardCallbacks = {};
+
+function loadShard(shard, callback)
+{
+	if (shardCallbacks[shard]) {
+		shardCallbacks[shard].push(callback);
+		return;
+	}
+	shardCallbacks[shard] = [callback];
+	var fileref = document.createElement('script');
+	fileref.setAttribute("type", "text/javascript");
+	fileref.setAttribute("src", location.pathname + "_files/dives_" + shard + ".js");
+	fileref.onload = function() {
+		var callbacks = shardCallbacks[shard];
+		shardCallbacks[shard] = undefined;
+		for (var i = 0; i < callbacks.length; i++)
+			callbacks[i]();
+	};
+	document.getElementsByTagName("head")[0].appendChild(fileref);
+}
+
+function shardLoaded(dives)
+{
+	for (var i = 0; i < dives.length; i++) {
+		var dive = items[dives[i].number];
+		for (var key in dives[i])
+			dive[key] = dives[i][key];
+	}
+}
+
 ////////////////////////canvas///////////////////
 
 /*
@@ -1355,6 +1389,12 @@ function canvas_draw()
 */
 function showDiveDetails(dive)
 {
+	//the details of the dive are loaded on demand
+	if (items[dive].shard !== undefined && !items[dive].details_loaded) {
+		loadShard(items[dive].shard, function() { showDiveDetails(dive); });
+		return;
+	}
+
 	//set global variables
 	dive_id = dive;
 	points = items[dive_id].samples;